@@ -0,0 +1,779 @@
+/*--------------------------------------------------------------------*/
+/* archive.c                                                          */
+/* Many files and directories moved as one stream                     */
+/*--------------------------------------------------------------------*/
+
+#include "archive.h"
+#include <dirent.h>
+#include <endian.h>
+#include <limits.h>
+
+/*--------------------------------------------------------------------*/
+
+struct ArchiveOut
+
+/* An archive being sent, gathered into frames of PROTO_LZ_CHUNK
+   bytes. */
+
+{
+   int iSockFD;
+   /* Where it goes. */
+
+   uint32_t uId;
+   /* Request it belongs to. */
+
+   char acBuf[PROTO_LZ_CHUNK];
+   /* Bytes not sent yet. */
+
+   size_t iUsed;
+   /* Number of them. */
+
+   int iErr;
+   /* errno value of the first file left out, or 0. */
+};
+
+struct ArchiveDir
+
+/* A directory unpacked, whose mode and time are set last. */
+
+{
+   uint32_t uMode;
+   /* Permission bits. */
+
+   uint64_t uMtime;
+   /* Modification time, in nanoseconds. */
+
+   char acName[1];
+   /* Its name; allocated as long as it needs. */
+};
+
+struct ArchiveIn
+
+/* An archive being unpacked. */
+
+{
+   unsigned char aucHeader[ARCHIVE_HEADER + PATH_MAX];
+   /* Header and name of the next entry, as far as they arrived. */
+
+   size_t iHave;
+   /* Bytes in aucHeader. */
+
+   uint32_t uMode;
+   /* Mode of the current entry. */
+
+   uint64_t uMtime;
+   /* Modification time of the current entry. */
+
+   uint64_t uLeft;
+   /* Bytes of data of the current entry still to come. */
+
+   char acName[PATH_MAX];
+   /* Name of the current entry. */
+
+   char acTemp[PATH_MAX];
+   /* Where the current file is written until it is complete. */
+
+   int iOutFD;
+   /* Descriptor of acTemp, or -1 if its data is thrown away. */
+
+   int iInData;
+   /* 1 (TRUE) while the data of a file is coming. */
+
+   int iEnded;
+   /* 1 (TRUE) once the end of the archive arrived. */
+
+   int iErr;
+   /* errno value of the first entry that could not be unpacked. */
+
+   DynArray_T oDirs;
+   /* Directories unpacked, as struct ArchiveDir. */
+};
+
+/*--------------------------------------------------------------------*/
+
+static void Archive_putBe16(unsigned char *puc, uint16_t u)
+
+/* Store u at puc in network byte order. */
+
+{
+   u = htobe16(u);
+   memcpy(puc, &u, sizeof(u));
+}
+
+/*--------------------------------------------------------------------*/
+
+static void Archive_putBe32(unsigned char *puc, uint32_t u)
+
+/* Store u at puc in network byte order. */
+
+{
+   u = htobe32(u);
+   memcpy(puc, &u, sizeof(u));
+}
+
+/*--------------------------------------------------------------------*/
+
+static void Archive_putBe64(unsigned char *puc, uint64_t u)
+
+/* Store u at puc in network byte order. */
+
+{
+   u = htobe64(u);
+   memcpy(puc, &u, sizeof(u));
+}
+
+/*--------------------------------------------------------------------*/
+
+static uint16_t Archive_getBe16(const unsigned char *puc)
+
+/* Return the number stored at puc in network byte order. */
+
+{
+   uint16_t u;
+
+   memcpy(&u, puc, sizeof(u));
+   return be16toh(u);
+}
+
+/*--------------------------------------------------------------------*/
+
+static uint32_t Archive_getBe32(const unsigned char *puc)
+
+/* Return the number stored at puc in network byte order. */
+
+{
+   uint32_t u;
+
+   memcpy(&u, puc, sizeof(u));
+   return be32toh(u);
+}
+
+/*--------------------------------------------------------------------*/
+
+static uint64_t Archive_getBe64(const unsigned char *puc)
+
+/* Return the number stored at puc in network byte order. */
+
+{
+   uint64_t u;
+
+   memcpy(&u, puc, sizeof(u));
+   return be64toh(u);
+}
+
+/*--------------------------------------------------------------------*/
+
+static int Archive_flush(struct ArchiveOut *psOut)
+
+/* Send what *psOut gathered. Return SUCCESS or FAILURE. */
+
+{
+   if (Proto_sendBytes(psOut->iSockFD, psOut->uId, psOut->acBuf,
+                       psOut->iUsed) == FAILURE)
+      return FAILURE;
+   psOut->iUsed = 0;
+   return SUCCESS;
+}
+
+/*--------------------------------------------------------------------*/
+
+static int Archive_put(struct ArchiveOut *psOut, const void *pvData,
+                       size_t iLength)
+
+/* Add the iLength bytes at pvData to the archive *psOut. Return
+   SUCCESS or FAILURE. */
+
+{
+   const char *pcData = (const char*)pvData;
+   size_t iTake;
+
+   while (iLength > 0)
+   {
+      if ((psOut->iUsed == sizeof(psOut->acBuf)) &&
+          (Archive_flush(psOut) == FAILURE))
+         return FAILURE;
+      iTake = sizeof(psOut->acBuf) - psOut->iUsed;
+      if (iTake > iLength)
+         iTake = iLength;
+      memcpy(psOut->acBuf + psOut->iUsed, pcData, iTake);
+      psOut->iUsed += iTake;
+      pcData += iTake;
+      iLength -= iTake;
+   }
+   return SUCCESS;
+}
+
+/*--------------------------------------------------------------------*/
+
+static int Archive_putHeader(struct ArchiveOut *psOut, const char *pcName,
+                             const struct stat *psStat, uint64_t uSize)
+
+/* Add the header of an entry named pcName, with the mode and time in
+   *psStat and uSize bytes of data, to the archive *psOut. Return
+   SUCCESS or FAILURE. */
+
+{
+   unsigned char aucHeader[ARCHIVE_HEADER];
+   size_t iName = strlen(pcName);
+
+   Archive_putBe16(aucHeader, (uint16_t)iName);
+   Archive_putBe32(aucHeader + 2, (uint32_t)psStat->st_mode);
+   Archive_putBe64(aucHeader + 6,
+                   (uint64_t)psStat->st_mtim.tv_sec * 1000000000 +
+                   (uint64_t)psStat->st_mtim.tv_nsec);
+   Archive_putBe64(aucHeader + 14, uSize);
+   if (Archive_put(psOut, aucHeader, ARCHIVE_HEADER) == FAILURE)
+      return FAILURE;
+   return Archive_put(psOut, pcName, iName);
+}
+
+/*--------------------------------------------------------------------*/
+
+static void Archive_leaveOut(struct ArchiveOut *psOut, const char *pcPath,
+                             int iErr)
+
+/* Report that file pcPath is left out of the archive *psOut for the
+   reason iErr, an errno value. */
+
+{
+   fprintf(stderr, "%s: %s\n", pcPath, strerror(iErr));
+   if (psOut->iErr == 0)
+      psOut->iErr = iErr;
+}
+
+/*--------------------------------------------------------------------*/
+
+static int Archive_putFile(struct ArchiveOut *psOut, const char *pcPath,
+                           const char *pcName)
+
+/* Add regular file pcPath to the archive *psOut as pcName. Return
+   SUCCESS or FAILURE. */
+
+{
+   struct stat sStat;
+   uint64_t uLeft;
+   ssize_t iGot;
+   size_t iWant;
+   int iFD;
+
+   if ((iFD = open(pcPath, O_RDONLY | O_CLOEXEC | O_NOFOLLOW)) == -1)
+   {
+      Archive_leaveOut(psOut, pcPath, errno);
+      return SUCCESS;
+   }
+   if (fstat(iFD, &sStat) == -1)
+   {
+      Archive_leaveOut(psOut, pcPath, errno);
+      close(iFD);
+      return SUCCESS;
+   }
+   if (Archive_putHeader(psOut, pcName, &sStat, (uint64_t)sStat.st_size)
+       == FAILURE)
+   {
+      close(iFD);
+      return FAILURE;
+   }
+
+   /* Read straight into the frame being gathered. */
+   for (uLeft = (uint64_t)sStat.st_size; uLeft > 0;)
+   {
+      if ((psOut->iUsed == sizeof(psOut->acBuf)) &&
+          (Archive_flush(psOut) == FAILURE))
+      {
+         close(iFD);
+         return FAILURE;
+      }
+      iWant = sizeof(psOut->acBuf) - psOut->iUsed;
+      if (iWant > uLeft)
+         iWant = (size_t)uLeft;
+      iGot = read(iFD, psOut->acBuf + psOut->iUsed, iWant);
+      if ((iGot == -1) && (errno == EINTR))
+         continue;
+      if (iGot <= 0)
+      {
+         /* The file shrank: the entry still needs all of its bytes. */
+         Archive_leaveOut(psOut, pcPath, (iGot == 0) ? EIO : errno);
+         memset(psOut->acBuf + psOut->iUsed, 0, iWant);
+         iGot = (ssize_t)iWant;
+      }
+      psOut->iUsed += (size_t)iGot;
+      uLeft -= (uint64_t)iGot;
+   }
+   close(iFD);
+   return SUCCESS;
+}
+
+/*--------------------------------------------------------------------*/
+
+static int Archive_putPath(struct ArchiveOut *psOut, const char *pcPath,
+                           const char *pcName)
+
+/* Add file or directory pcPath, a directory with everything in it, to
+   the archive *psOut as pcName, or a directory's contents only if
+   pcName is empty. Return SUCCESS or FAILURE. */
+
+{
+   char acPath[PATH_MAX];
+   char acName[PATH_MAX];
+   struct dirent *psDirent;
+   struct stat sStat;
+   DIR *psDir;
+   int iRet = SUCCESS;
+
+   if (lstat(pcPath, &sStat) == -1)
+   {
+      Archive_leaveOut(psOut, pcPath, errno);
+      return SUCCESS;
+   }
+   if (S_ISREG(sStat.st_mode) && (pcName[0] != '\0'))
+      return Archive_putFile(psOut, pcPath, pcName);
+   if (! S_ISDIR(sStat.st_mode))
+   {
+      Archive_leaveOut(psOut, pcPath, EINVAL);
+      return SUCCESS;
+   }
+
+   if ((psDir = opendir(pcPath)) == NULL)
+   {
+      Archive_leaveOut(psOut, pcPath, errno);
+      return SUCCESS;
+   }
+   if ((pcName[0] != '\0') &&
+       (Archive_putHeader(psOut, pcName, &sStat, 0) == FAILURE))
+      iRet = FAILURE;
+   while ((iRet == SUCCESS) && ((psDirent = readdir(psDir)) != NULL))
+   {
+      if ((strcmp(psDirent->d_name, ".") == 0) ||
+          (strcmp(psDirent->d_name, "..") == 0))
+         continue;
+      if ((snprintf(acPath, sizeof(acPath), "%s/%s", pcPath,
+                    psDirent->d_name) >= (int)sizeof(acPath)) ||
+          (snprintf(acName, sizeof(acName), "%s%s%s", pcName,
+                    (pcName[0] != '\0') ? "/" : "", psDirent->d_name)
+           >= (int)sizeof(acName)))
+      {
+         Archive_leaveOut(psOut, psDirent->d_name, ENAMETOOLONG);
+         continue;
+      }
+      iRet = Archive_putPath(psOut, acPath, acName);
+   }
+   closedir(psDir);
+   return iRet;
+}
+
+/*--------------------------------------------------------------------*/
+
+static const char *Archive_name(const char *pcPath)
+
+/* Return the name in the archive of path pcPath: pcPath less any
+   leading "/", "./" and "../". */
+
+{
+   for (;;)
+   {
+      if (pcPath[0] == '/')
+         pcPath++;
+      else if (strncmp(pcPath, "./", 2) == 0)
+         pcPath += 2;
+      else if (strncmp(pcPath, "../", 3) == 0)
+         pcPath += 3;
+      else if ((strcmp(pcPath, ".") == 0) || (strcmp(pcPath, "..") == 0))
+         return "";
+      else
+         return pcPath;
+   }
+}
+
+/*--------------------------------------------------------------------*/
+
+int Archive_send(int iSockFD, uint32_t uId, char **ppcPaths,
+                 size_t iPaths)
+
+/* Send the iPaths files and directories in ppcPaths as an archive body
+   of request uId, all but its PROTO_END. Return SUCCESS, FAILURE, or
+   the positive errno value of the first file left out. */
+
+{
+   struct ArchiveOut *psOut;
+   unsigned char aucEnd[ARCHIVE_HEADER];
+   char acName[PATH_MAX];
+   size_t iName;
+   size_t i;
+   int iRet;
+
+   assert(ppcPaths != NULL);
+
+   if ((psOut = (struct ArchiveOut*)calloc(1, sizeof(*psOut))) == NULL)
+      return ENOMEM;
+   psOut->iSockFD = iSockFD;
+   psOut->uId = uId;
+
+   iRet = Proto_writeFrame(iSockFD, PROTO_ARCHIVE, 0, uId, NULL, 0);
+   for (i = 0; (iRet == SUCCESS) && (i < iPaths); i++)
+   {
+      /* "dir/" is "dir". */
+      snprintf(acName, sizeof(acName), "%s", Archive_name(ppcPaths[i]));
+      for (iName = strlen(acName); (iName > 0) && (acName[iName - 1] == '/');)
+         acName[--iName] = '\0';
+      iRet = Archive_putPath(psOut, ppcPaths[i], acName);
+   }
+
+   memset(aucEnd, 0, sizeof(aucEnd));
+   if ((iRet == SUCCESS) &&
+       ((Archive_put(psOut, aucEnd, sizeof(aucEnd)) == FAILURE) ||
+        (Archive_flush(psOut) == FAILURE)))
+      iRet = FAILURE;
+   if (iRet == SUCCESS)
+      iRet = psOut->iErr;
+   free(psOut);
+   return iRet;
+}
+
+/*--------------------------------------------------------------------*/
+
+static int Archive_isSafe(const char *pcName)
+
+/* Return 1 (TRUE) if pcName names something under the current
+   directory, 0 (FALSE) otherwise. */
+
+{
+   const char *pcPart;
+   size_t iPart;
+
+   if ((pcName[0] == '\0') || (pcName[0] == '/'))
+      return FALSE;
+   for (pcPart = pcName; *pcPart != '\0'; pcPart += iPart)
+   {
+      iPart = strcspn(pcPart, "/");
+      if ((iPart == 0) || ((iPart == 1) && (pcPart[0] == '.')) ||
+          ((iPart == 2) && (strncmp(pcPart, "..", 2) == 0)))
+         return FALSE;
+      if (pcPart[iPart] == '/')
+         iPart++;
+   }
+   return TRUE;
+}
+
+/*--------------------------------------------------------------------*/
+
+static int Archive_makeParents(char *pcName)
+
+/* Create the directories that pcName is in, as far as they are
+   missing. Return 0, or an errno value. */
+
+{
+   char *pcSlash;
+
+   for (pcSlash = strchr(pcName, '/'); pcSlash != NULL;
+        pcSlash = strchr(pcSlash + 1, '/'))
+   {
+      *pcSlash = '\0';
+      if ((mkdir(pcName, 0777) == -1) && (errno != EEXIST))
+      {
+         *pcSlash = '/';
+         return errno;
+      }
+      *pcSlash = '/';
+   }
+   return 0;
+}
+
+/*--------------------------------------------------------------------*/
+
+static void Archive_setTimes(struct timespec *psTimes, uint64_t uMtime)
+
+/* Store access and modification times for utimensat(2) that keep the
+   access time and set the modification time to uMtime nanoseconds in
+   psTimes. */
+
+{
+   psTimes[0].tv_sec = 0;
+   psTimes[0].tv_nsec = UTIME_OMIT;
+   psTimes[1].tv_sec = (time_t)(uMtime / 1000000000);
+   psTimes[1].tv_nsec = (long)(uMtime % 1000000000);
+}
+
+/*--------------------------------------------------------------------*/
+
+static void Archive_fail(struct ArchiveIn *psIn, int iErr)
+
+/* Note that the current entry of *psIn could not be unpacked for the
+   reason iErr, an errno value. */
+
+{
+   if (psIn->iErr == 0)
+      psIn->iErr = iErr;
+}
+
+/*--------------------------------------------------------------------*/
+
+static void Archive_endFile(struct ArchiveIn *psIn)
+
+/* Move the complete current file of *psIn into place. */
+
+{
+   struct timespec asTimes[2];
+
+   psIn->iInData = FALSE;
+   if (psIn->iOutFD == -1)
+      return;
+   Archive_setTimes(asTimes, psIn->uMtime);
+   if ((fchmod(psIn->iOutFD, psIn->uMode & 07777) == -1) ||
+       (futimens(psIn->iOutFD, asTimes) == -1) ||
+       (close(psIn->iOutFD) == -1) ||
+       (rename(psIn->acTemp, psIn->acName) == -1))
+   {
+      Archive_fail(psIn, errno);
+      unlink(psIn->acTemp);
+   }
+   psIn->iOutFD = -1;
+}
+
+/*--------------------------------------------------------------------*/
+
+static void Archive_beginEntry(struct ArchiveIn *psIn, size_t iName)
+
+/* Start unpacking the entry whose header and name of iName bytes are in
+   psIn->aucHeader. */
+
+{
+   struct ArchiveDir *psDir;
+   uint64_t uSize;
+   int iErr;
+
+   psIn->uMode = Archive_getBe32(psIn->aucHeader + 2);
+   psIn->uMtime = Archive_getBe64(psIn->aucHeader + 6);
+   uSize = Archive_getBe64(psIn->aucHeader + 14);
+   memcpy(psIn->acName, psIn->aucHeader + ARCHIVE_HEADER, iName);
+   psIn->acName[iName] = '\0';
+   psIn->iHave = 0;
+
+   if (S_ISREG(psIn->uMode))
+   {
+      psIn->uLeft = uSize;
+      psIn->iInData = TRUE;
+   }
+   else if ((! S_ISDIR(psIn->uMode)) || (uSize != 0))
+   {
+      /* Nothing else is archived, so nothing can be skipped safely. */
+      Archive_fail(psIn, EPROTO);
+      psIn->iEnded = TRUE;
+      return;
+   }
+
+   if ((strlen(psIn->acName) != iName) || (! Archive_isSafe(psIn->acName)))
+   {
+      Archive_fail(psIn, EACCES);
+      return;
+   }
+   if ((iErr = Archive_makeParents(psIn->acName)) != 0)
+   {
+      Archive_fail(psIn, iErr);
+      return;
+   }
+
+   if (S_ISDIR(psIn->uMode))
+   {
+      /* Writable until its contents are in. */
+      if ((mkdir(psIn->acName, 0700) == -1) && (errno != EEXIST))
+      {
+         Archive_fail(psIn, errno);
+         return;
+      }
+      psDir = (struct ArchiveDir*)malloc(sizeof(*psDir) + iName);
+      if ((psDir == NULL) || (! DynArray_add(psIn->oDirs, psDir)))
+      {
+         free(psDir);
+         Archive_fail(psIn, ENOMEM);
+         return;
+      }
+      psDir->uMode = psIn->uMode & 07777;
+      psDir->uMtime = psIn->uMtime;
+      strcpy(psDir->acName, psIn->acName);
+      return;
+   }
+
+   if (snprintf(psIn->acTemp, sizeof(psIn->acTemp), "%s.%ld.part",
+                psIn->acName, (long)getpid()) >= (int)sizeof(psIn->acTemp))
+   {
+      Archive_fail(psIn, ENAMETOOLONG);
+      return;
+   }
+   psIn->iOutFD = open(psIn->acTemp, O_WRONLY | O_CREAT | O_TRUNC |
+                       O_CLOEXEC | O_NOFOLLOW, PERMISSIONS);
+   if (psIn->iOutFD == -1)
+      Archive_fail(psIn, errno);
+   if (psIn->uLeft == 0)
+      Archive_endFile(psIn);
+}
+
+/*--------------------------------------------------------------------*/
+
+static void Archive_feed(struct ArchiveIn *psIn, const char *pcData,
+                         size_t iLength)
+
+/* Unpack the iLength bytes of archive at pcData, which continue what
+   *psIn took so far. */
+
+{
+   size_t iTake;
+   size_t iName;
+
+   while ((iLength > 0) && (! psIn->iEnded))
+   {
+      /* Data of a file. */
+      if (psIn->iInData)
+      {
+         iTake = (psIn->uLeft < iLength) ? (size_t)psIn->uLeft : iLength;
+         if ((psIn->iOutFD != -1) &&
+             (Common_writen(psIn->iOutFD, pcData, iTake) == FAILURE))
+         {
+            Archive_fail(psIn, errno ? errno : EIO);
+            close(psIn->iOutFD);
+            unlink(psIn->acTemp);
+            psIn->iOutFD = -1;
+         }
+         psIn->uLeft -= iTake;
+         pcData += iTake;
+         iLength -= iTake;
+         if (psIn->uLeft == 0)
+            Archive_endFile(psIn);
+         continue;
+      }
+
+      /* A header, then a name of the length it gives. */
+      iTake = ARCHIVE_HEADER - ((psIn->iHave < ARCHIVE_HEADER) ?
+                                psIn->iHave : ARCHIVE_HEADER);
+      iName = 0;
+      if (iTake == 0)
+      {
+         iName = Archive_getBe16(psIn->aucHeader);
+         iTake = ARCHIVE_HEADER + iName - psIn->iHave;
+      }
+      if (iTake > iLength)
+         iTake = iLength;
+      memcpy(psIn->aucHeader + psIn->iHave, pcData, iTake);
+      psIn->iHave += iTake;
+      pcData += iTake;
+      iLength -= iTake;
+      if (psIn->iHave < ARCHIVE_HEADER)
+         continue;
+
+      iName = Archive_getBe16(psIn->aucHeader);
+      if (iName == 0)
+         psIn->iEnded = TRUE;
+      else if (iName >= PATH_MAX)
+      {
+         Archive_fail(psIn, EPROTO);
+         psIn->iEnded = TRUE;
+      }
+      else if (psIn->iHave == ARCHIVE_HEADER + iName)
+         Archive_beginEntry(psIn, iName);
+   }
+   if (iLength > 0)
+      Archive_fail(psIn, EPROTO); /* bytes after the end */
+}
+
+/*--------------------------------------------------------------------*/
+
+static void Archive_finishDirs(struct ArchiveIn *psIn)
+
+/* Give the directories unpacked into *psIn their modes and times,
+   innermost first, and forget them. */
+
+{
+   struct ArchiveDir *psDir;
+   struct timespec asTimes[2];
+   int i;
+
+   for (i = DynArray_getLength(psIn->oDirs); i-- > 0;)
+   {
+      psDir = (struct ArchiveDir*)DynArray_get(psIn->oDirs, i);
+      Archive_setTimes(asTimes, psDir->uMtime);
+      if ((chmod(psDir->acName, psDir->uMode) == -1) ||
+          (utimensat(AT_FDCWD, psDir->acName, asTimes, 0) == -1))
+         Archive_fail(psIn, errno);
+      free(psDir);
+   }
+   DynArray_free(psIn->oDirs);
+}
+
+/*--------------------------------------------------------------------*/
+
+int Archive_recv(RecvBuf_T oBuf, uint32_t uId, int *piStatus)
+
+/* Receive the archive body of request uId from oBuf and unpack it under
+   the current directory. Return SUCCESS, or FAILURE if the connection
+   failed or broke the protocol. */
+
+{
+   char acBuf[PROTO_LZ_CHUNK];
+   struct ArchiveIn *psIn;
+   ProtoHeader sHeader;
+   uint32_t uStatus;
+   uint64_t uLeft;
+   ssize_t iGot;
+   int iRet = FAILURE;
+
+   assert(oBuf != NULL);
+   assert(piStatus != NULL);
+
+   if ((Proto_readHeader(oBuf, &sHeader) != RECVBUF_OK) ||
+       (sHeader.eType != PROTO_ARCHIVE) || (sHeader.uId != uId) ||
+       (sHeader.uLength != 0))
+      return FAILURE;
+   if ((psIn = (struct ArchiveIn*)calloc(1, sizeof(*psIn))) == NULL)
+      return FAILURE;
+   if ((psIn->oDirs = DynArray_new(0)) == NULL)
+   {
+      free(psIn);
+      return FAILURE;
+   }
+   psIn->iOutFD = -1;
+
+   for (;;)
+   {
+      if ((Proto_readHeader(oBuf, &sHeader) != RECVBUF_OK) ||
+          (sHeader.uId != uId))
+         break;
+
+      if (sHeader.eType == PROTO_END)
+      {
+         if ((sHeader.uLength != sizeof(uStatus)) ||
+             (RecvBuf_readn(oBuf, &uStatus, sizeof(uStatus))
+              != sizeof(uStatus)))
+            break;
+         *piStatus = (int)be32toh(uStatus);
+         if ((! psIn->iEnded) && (*piStatus == 0))
+            Archive_fail(psIn, EIO); /* the archive was cut short */
+         if (psIn->iErr != 0)
+            *piStatus = psIn->iErr;
+         iRet = SUCCESS;
+         break;
+      }
+
+      if (sHeader.eType != PROTO_DATA)
+         break;
+      for (uLeft = sHeader.uLength; uLeft > 0;)
+      {
+         iGot = Proto_readData(oBuf, &sHeader, &uLeft, acBuf, sizeof(acBuf));
+         if (iGot <= 0)
+            break;
+         Archive_feed(psIn, acBuf, (size_t)iGot);
+      }
+      if (uLeft > 0)
+         break;
+   }
+
+   /* A file cut off midway is not kept. */
+   if (psIn->iOutFD != -1)
+   {
+      close(psIn->iOutFD);
+      unlink(psIn->acTemp);
+   }
+   Archive_finishDirs(psIn);
+   free(psIn);
+   return iRet;
+}
+
+/*--------------------------------------------------------------------*/
@@ -0,0 +1,52 @@
+/*--------------------------------------------------------------------*/
+/* archive.h                                                          */
+/* Many files and directories moved as one stream                     */
+/*--------------------------------------------------------------------*/
+
+#ifndef ARCHIVE_INCLUDED
+#define ARCHIVE_INCLUDED
+
+#include "common.h"
+
+/*--------------------------------------------------------------------*/
+
+/* A sendfile of several files, or of a directory, and a recvfile of a
+   directory, move all of them in one archive body: an empty
+   PROTO_ARCHIVE frame, PROTO_DATA frames holding the archive, and the
+   usual PROTO_END. The archive is a series of entries, each of them
+
+      bytes 0-1     length of the name, 0 for the end of the archive
+      bytes 2-5     mode (file type and permission bits)
+      bytes 6-13    modification time, in nanoseconds
+      bytes 14-21   size of the data, 0 for a directory
+      then          name, a relative path
+      then          data of a regular file
+
+   A directory comes before what is in it. Names are the paths the
+   sender was given, less any leading "/", "./" and "../"; a receiver
+   refuses names that still climb out of the directory it unpacks into.
+   Files are unpacked under a temporary name and renamed into place
+   once complete; directories get their modes and times once all of
+   their contents are in. Only regular files and directories are
+   archived. */
+
+#define ARCHIVE_HEADER 22 /* bytes of an entry before its name */
+
+/*--------------------------------------------------------------------*/
+
+int Archive_send(int iSockFD, uint32_t uId, char **ppcPaths,
+                 size_t iPaths);
+/* Send the iPaths files and directories in ppcPaths, directories with
+   everything in them, as an archive body of request uId, all but its
+   PROTO_END. Files that cannot be read are left out, and reported on
+   stderr. Return SUCCESS, FAILURE if the connection failed, or the
+   positive errno value of the first file left out. */
+
+int Archive_recv(RecvBuf_T oBuf, uint32_t uId, int *piStatus);
+/* Receive the archive body of request uId from oBuf and unpack it
+   under the current directory. Store the status of its PROTO_END in
+   *piStatus, or an errno value if some of it could not be unpacked.
+   Return SUCCESS, or FAILURE if the connection failed or broke the
+   protocol. */
+
+#endif
@@ -0,0 +1,182 @@
+/*--------------------------------------------------------------------*/
+/* arena.c                                                            */
+/* Bump allocator for the objects of one command line                 */
+/*--------------------------------------------------------------------*/
+
+#include "arena.h"
+#include <assert.h>
+#include <stdalign.h>
+#include <stdlib.h>
+#include <string.h>
+
+enum {ARENA_ALIGN = alignof(max_align_t)};
+
+/*--------------------------------------------------------------------*/
+
+struct ArenaBlock
+
+/* An ArenaBlock is one piece of memory that allocations are cut
+   from. */
+
+{
+   struct ArenaBlock *psNext;
+   /* The block to move on to when this one is full, or NULL. */
+
+   size_t iSize;
+   /* Number of bytes in acData. */
+
+   alignas(ARENA_ALIGN) char acData[];
+   /* The memory handed out. */
+};
+
+/*--------------------------------------------------------------------*/
+
+struct Arena
+
+/* An Arena is a chain of blocks, of which the first ones are in use
+   and the rest wait to be used again. */
+
+{
+   struct ArenaBlock *psFirst;
+   /* The first block. */
+
+   struct ArenaBlock *psCur;
+   /* The block allocations are cut from now. */
+
+   size_t iUsed;
+   /* Number of bytes of psCur handed out. */
+};
+
+/*--------------------------------------------------------------------*/
+
+static struct ArenaBlock *Arena_newBlock(size_t iSize)
+
+/* Return a new block of iSize bytes, or NULL if insufficient memory is
+   available. */
+
+{
+   struct ArenaBlock *psBlock;
+
+   psBlock = (struct ArenaBlock*)malloc(sizeof(struct ArenaBlock) + iSize);
+   if (psBlock == NULL)
+      return NULL;
+   psBlock->psNext = NULL;
+   psBlock->iSize = iSize;
+   return psBlock;
+}
+
+/*--------------------------------------------------------------------*/
+
+Arena_T Arena_new(void)
+
+/* Return a new, empty Arena, or NULL if insufficient memory is
+   available. */
+
+{
+   Arena_T oArena;
+
+   oArena = (Arena_T)calloc(1, sizeof(struct Arena));
+   if (oArena == NULL)
+      return NULL;
+   oArena->psFirst = Arena_newBlock(ARENA_BLOCK_SIZE);
+   if (oArena->psFirst == NULL)
+   {
+      free(oArena);
+      return NULL;
+   }
+   oArena->psCur = oArena->psFirst;
+   return oArena;
+}
+
+/*--------------------------------------------------------------------*/
+
+void Arena_free(Arena_T oArena)
+
+/* Free oArena and everything allocated from it. */
+
+{
+   struct ArenaBlock *psBlock;
+   struct ArenaBlock *psNext;
+
+   assert(oArena != NULL);
+
+   for (psBlock = oArena->psFirst; psBlock != NULL; psBlock = psNext)
+   {
+      psNext = psBlock->psNext;
+      free(psBlock);
+   }
+   free(oArena);
+}
+
+/*--------------------------------------------------------------------*/
+
+void *Arena_alloc(Arena_T oArena, size_t iSize)
+
+/* Return iSize bytes from oArena, aligned for any type, or NULL if
+   insufficient memory is available. */
+
+{
+   struct ArenaBlock *psBlock;
+   size_t iAt;
+
+   assert(oArena != NULL);
+
+   iAt = (oArena->iUsed + ARENA_ALIGN - 1) & ~((size_t)ARENA_ALIGN - 1);
+   if ((iAt <= oArena->psCur->iSize) &&
+       (iSize <= oArena->psCur->iSize - iAt))
+   {
+      oArena->iUsed = iAt + iSize;
+      return oArena->psCur->acData + iAt;
+   }
+
+   /* On to the next block, or a new one twice the size of this one
+      that goes in front of a next one too small for iSize. */
+   psBlock = oArena->psCur->psNext;
+   if ((psBlock == NULL) || (psBlock->iSize < iSize))
+   {
+      psBlock = Arena_newBlock((2 * oArena->psCur->iSize > iSize)
+                               ? 2 * oArena->psCur->iSize : iSize);
+      if (psBlock == NULL)
+         return NULL;
+      psBlock->psNext = oArena->psCur->psNext;
+      oArena->psCur->psNext = psBlock;
+   }
+   oArena->psCur = psBlock;
+   oArena->iUsed = iSize;
+   return psBlock->acData;
+}
+
+/*--------------------------------------------------------------------*/
+
+char *Arena_strdup(Arena_T oArena, const char *pcStr)
+
+/* Return a copy of string pcStr allocated from oArena, or NULL if
+   insufficient memory is available. */
+
+{
+   size_t iLength;
+   char *pcCopy;
+
+   assert(oArena != NULL);
+   assert(pcStr != NULL);
+
+   iLength = strlen(pcStr) + 1;
+   pcCopy = (char*)Arena_alloc(oArena, iLength);
+   if (pcCopy == NULL)
+      return NULL;
+   memcpy(pcCopy, pcStr, iLength);
+   return pcCopy;
+}
+
+/*--------------------------------------------------------------------*/
+
+void Arena_reset(Arena_T oArena)
+
+/* Take back everything allocated from oArena, in constant time. */
+
+{
+   assert(oArena != NULL);
+
+   oArena->psCur = oArena->psFirst;
+   oArena->iUsed = 0;
+}
@@ -0,0 +1,44 @@
+/*--------------------------------------------------------------------*/
+/* arena.h                                                            */
+/* Bump allocator for the objects of one command line                 */
+/*--------------------------------------------------------------------*/
+
+#ifndef ARENA_INCLUDED
+#define ARENA_INCLUDED
+
+#include <stddef.h>
+
+/*--------------------------------------------------------------------*/
+
+typedef struct Arena *Arena_T;
+/* An Arena hands out memory from large blocks by moving a pointer
+   forward, and takes all of it back at once. The tokens and command
+   words of a line are allocated from one, which is reset once the
+   command is done and reused for the next line. Blocks added while a
+   long line was being analyzed stay with the arena for later lines. */
+
+#define ARENA_BLOCK_SIZE 8192 /* bytes in the first block */
+
+/*--------------------------------------------------------------------*/
+
+Arena_T Arena_new(void);
+/* Return a new, empty Arena, or NULL if insufficient memory is
+   available. */
+
+void Arena_free(Arena_T oArena);
+/* Free oArena and everything allocated from it. */
+
+void *Arena_alloc(Arena_T oArena, size_t iSize);
+/* Return iSize bytes from oArena, aligned for any type, or NULL if
+   insufficient memory is available. They stay valid until oArena is
+   reset or freed. */
+
+char *Arena_strdup(Arena_T oArena, const char *pcStr);
+/* Return a copy of string pcStr allocated from oArena, or NULL if
+   insufficient memory is available. */
+
+void Arena_reset(Arena_T oArena);
+/* Take back everything allocated from oArena, in constant time. Its
+   blocks are kept for reuse. */
+
+#endif
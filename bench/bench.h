@@ -0,0 +1,146 @@
+/*--------------------------------------------------------------------*/
+/* bench.h                                                            */
+/* Timing and setup shared by the benchmark programs                  */
+/*--------------------------------------------------------------------*/
+
+#ifndef BENCH_INCLUDED
+#define BENCH_INCLUDED
+
+/* Each benchmark runs a case BENCH_ROUNDS times and reports the
+   fastest run, which is the one least disturbed by the rest of the
+   machine. The programs take no part in "make test"; "make bench"
+   builds and runs them with the flags of the rest of the tree. */
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BENCH_ROUNDS 3 /* runs of each case */
+#define BENCH_MB (1024 * 1024)
+
+/*--------------------------------------------------------------------*/
+
+/* return the time on a monotonic clock, in seconds */
+static double Bench_now(void)
+{
+  struct timespec sNow;
+
+  clock_gettime(CLOCK_MONOTONIC, &sNow);
+  return (double) sNow.tv_sec + (double) sNow.tv_nsec / 1e9;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* report that case pcWhat of benchmark pcBench moved lBytes in
+   dSeconds */
+static void Bench_reportBytes(const char *pcBench, const char *pcWhat,
+			      long lBytes, double dSeconds)
+{
+  printf("%s: %-28s %6ld MB %9.3f s %9.1f MB/s\n", pcBench, pcWhat,
+	 lBytes / BENCH_MB, dSeconds,
+	 (dSeconds > 0) ? (double) lBytes / BENCH_MB / dSeconds : 0.0);
+  fflush(stdout); /* before the next fork copies it */
+}
+
+/*--------------------------------------------------------------------*/
+
+/* report that case pcWhat of benchmark pcBench did lCount operations
+   in dSeconds */
+static void Bench_reportOps(const char *pcBench, const char *pcWhat,
+			    long lCount, double dSeconds)
+{
+  printf("%s: %-28s %8ld ops %9.3f s %11.1f ns/op\n", pcBench, pcWhat,
+	 lCount, dSeconds, (lCount > 0) ? dSeconds * 1e9 / lCount : 0.0);
+  fflush(stdout);
+}
+
+/*--------------------------------------------------------------------*/
+
+/* create file pcPath with lSize bytes of pseudo-random data. Return 0
+   or -1 */
+static int Bench_makeFile(const char *pcPath, long lSize)
+{
+  static unsigned int auBlock[BENCH_MB / sizeof(unsigned int)];
+  unsigned int uSeed = 1;
+  long lLeft = lSize;
+  size_t iWant = 0;
+  size_t i = 0;
+  FILE *psFile = NULL;
+
+  if ((psFile = fopen(pcPath, "w")) == NULL) {
+    perror(pcPath);
+    return -1;
+  }
+  while (lLeft > 0) {
+    for (i = 0; i < sizeof(auBlock) / sizeof(auBlock[0]); i++)
+      auBlock[i] = (uSeed = uSeed * 1103515245 + 12345);
+    iWant = (lLeft < (long) sizeof(auBlock)) ? (size_t) lLeft : sizeof(auBlock);
+    if (fwrite(auBlock, 1, iWant, psFile) != iWant) {
+      perror(pcPath);
+      fclose(psFile);
+      return -1;
+    }
+    lLeft -= (long) iWant;
+  }
+  return (fclose(psFile) == 0) ? 0 : -1;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* connect two TCP sockets to each other over 127.0.0.1, through a
+   listening socket on a port the kernel picks, and store them in
+   aiSock. Return 0 or -1 */
+static int Bench_tcpPair(int aiSock[2])
+{
+  struct sockaddr_in sAddr;
+  socklen_t iAddrLen = sizeof(sAddr);
+  int iListenFD = -1;
+
+  memset(&sAddr, 0, sizeof(sAddr));
+  sAddr.sin_family = AF_INET;
+  sAddr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  aiSock[0] = aiSock[1] = -1;
+  if (((iListenFD = socket(AF_INET, SOCK_STREAM, 0)) == -1) ||
+      (bind(iListenFD, (struct sockaddr *) &sAddr, sizeof(sAddr)) == -1) ||
+      (listen(iListenFD, 1) == -1) ||
+      (getsockname(iListenFD, (struct sockaddr *) &sAddr, &iAddrLen) == -1) ||
+      ((aiSock[0] = socket(AF_INET, SOCK_STREAM, 0)) == -1) ||
+      (connect(aiSock[0], (struct sockaddr *) &sAddr, sizeof(sAddr)) == -1) ||
+      ((aiSock[1] = accept(iListenFD, NULL, NULL)) == -1)) {
+    if (aiSock[0] != -1)
+      close(aiSock[0]);
+    if (iListenFD != -1)
+      close(iListenFD);
+    return -1;
+  }
+  close(iListenFD);
+  return 0;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* fork a process that reads iFD to its end and throws the bytes away.
+   It closes iPeerFD, the other end of iFD, so that it sees that end.
+   Return its pid, or -1 */
+static pid_t Bench_drain(int iFD, int iPeerFD)
+{
+  static char acBuf[BENCH_MB];
+  pid_t iPid = 0;
+
+  if ((iPid = fork()) != 0)
+    return iPid;
+  close(iPeerFD);
+  while (read(iFD, acBuf, sizeof(acBuf)) > 0)
+    ;
+  _exit(0);
+}
+
+#endif
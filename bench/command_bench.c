@@ -0,0 +1,215 @@
+/*--------------------------------------------------------------------*/
+/* command_bench.c                                                    */
+/* Time short remote commands against the server, one after another  */
+/*--------------------------------------------------------------------*/
+
+/* The server is started in event and in fork mode. A legacy client,
+   written out here as in tests/legacy_test.c, sends 'remote echo hi'
+   and waits for each answer before it sends the next command. Then the
+   client program runs the same commands from its standard input over
+   the framed protocol. What these time is mostly the answer path:
+   the scratch file that collects a command's output, and how quickly
+   its last piece leaves the socket. For the baseline, the server is
+   started again with -O, which collects a legacy client's output in a
+   srvN.out file in the current directory and removes it with
+   /bin/rm -f after each answer, as it did before anonymous scratch
+   files, and the legacy client is timed against it. The number of
+   commands is the third argument. */
+
+#include "bench.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/socket.h>
+
+#define LEGACY_HEADER_SIZE 11 /* bytes of the length before a body */
+#define BENCH_PORT 21002 /* SERV_PORT of the server */
+#define BENCH_COMMAND "remote echo hi\n"
+#define BENCH_INPUT "command_bench.in"
+#define BENCH_DEFAULT_COMMANDS 1000
+
+/*--------------------------------------------------------------------*/
+
+/* connect to the server, trying for a few seconds while it starts.
+   Return the socket, or -1 */
+static int Bench_connect(void)
+{
+  struct sockaddr_in sAddr;
+  int iSockFD = -1;
+  int i = 0;
+
+  memset(&sAddr, 0, sizeof(sAddr));
+  sAddr.sin_family = AF_INET;
+  sAddr.sin_port = htons(BENCH_PORT);
+  sAddr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  for (i = 0; i < 50; i++) {
+    if ((iSockFD = socket(AF_INET, SOCK_STREAM, 0)) == -1)
+      return -1;
+    if (connect(iSockFD, (struct sockaddr *) &sAddr, sizeof(sAddr)) == 0)
+      return iSockFD;
+    close(iSockFD);
+    usleep(100000);
+  }
+  return -1;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* read exactly iSize bytes from iFD into pvBuf. Return 0 or -1 */
+static int Bench_read(int iFD, void *pvBuf, size_t iSize)
+{
+  char *pcBuf = pvBuf;
+  ssize_t iDone = 0;
+
+  while (iSize > 0) {
+    if ((iDone = read(iFD, pcBuf, iSize)) <= 0) {
+      if ((iDone == -1) && (errno == EINTR))
+	continue;
+      return -1;
+    }
+    pcBuf += iDone;
+    iSize -= (size_t) iDone;
+  }
+  return 0;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* send iCount commands as a legacy client, each after the answer to
+   the one before, and report the best time as case pcWhat */
+static void Bench_legacy(const char *pcWhat, int iCount)
+{
+  char acAnswer[4096];
+  double dBest = 0, dStart = 0, dTime = 0;
+  long lLength = 0;
+  int iSockFD = -1;
+  int i = 0, j = 0;
+
+  for (i = 0; i < BENCH_ROUNDS; i++) {
+    if ((iSockFD = Bench_connect()) == -1) {
+      fprintf(stderr, "command_bench: cannot connect to server\n");
+      exit(EXIT_FAILURE);
+    }
+    dStart = Bench_now();
+    for (j = 0; j < iCount; j++) {
+      if ((write(iSockFD, BENCH_COMMAND, strlen(BENCH_COMMAND)) == -1) ||
+	  (Bench_read(iSockFD, acAnswer, LEGACY_HEADER_SIZE) == -1) ||
+	  ((lLength = strtol(acAnswer, NULL, 10)) < 0) ||
+	  (lLength >= (long) sizeof(acAnswer)) ||
+	  (Bench_read(iSockFD, acAnswer, (size_t) lLength) == -1)) {
+	fprintf(stderr, "command_bench: %s: no answer\n", pcWhat);
+	exit(EXIT_FAILURE);
+      }
+    }
+    dTime = Bench_now() - dStart;
+    close(iSockFD);
+    if ((i == 0) || (dTime < dBest))
+      dBest = dTime;
+  }
+  Bench_reportOps("command_bench", pcWhat, iCount, dBest);
+}
+
+/*--------------------------------------------------------------------*/
+
+/* run client pcClient on the iCount commands of BENCH_INPUT and report
+   the best time as case pcWhat */
+static void Bench_framed(const char *pcClient, const char *pcWhat,
+			 int iCount)
+{
+  double dBest = 0, dStart = 0, dTime = 0;
+  int iStatus = 0;
+  pid_t iPid = 0;
+  int i = 0;
+
+  for (i = 0; i < BENCH_ROUNDS; i++) {
+    dStart = Bench_now();
+    if ((iPid = fork()) == 0) {
+      if ((freopen(BENCH_INPUT, "r", stdin) == NULL) ||
+	  (freopen("/dev/null", "w", stdout) == NULL))
+	_exit(127);
+      execl(pcClient, pcClient, "127.0.0.1", (char *) NULL);
+      perror(pcClient);
+      _exit(127);
+    }
+    waitpid(iPid, &iStatus, 0);
+    dTime = Bench_now() - dStart;
+    if (!WIFEXITED(iStatus) || (WEXITSTATUS(iStatus) == 127)) {
+      fprintf(stderr, "command_bench: %s: client failed\n", pcWhat);
+      exit(EXIT_FAILURE);
+    }
+    if ((i == 0) || (dTime < dBest))
+      dBest = dTime;
+  }
+  Bench_reportOps("command_bench", pcWhat, iCount, dBest);
+}
+
+/*--------------------------------------------------------------------*/
+
+/* run server pcServer in mode pcMode and time both clients against
+   it, or with the scratch files of before if iNamed, and time the
+   legacy client against it */
+static void Bench_mode(const char *pcServer, const char *pcClient,
+		       const char *pcMode, int iNamed, int iCount)
+{
+  char acWhat[64];
+  int iStatus = 0;
+  pid_t iPid = 0;
+
+  if ((iPid = fork()) == 0) {
+    if (freopen("/dev/null", "w", stderr) == NULL)
+      _exit(127);
+    execl(pcServer, pcServer, "-m", pcMode, "-C", "", "-S", "", "-P", "",
+	  iNamed ? "-O" : (char *) NULL, (char *) NULL);
+    _exit(127);
+  }
+
+  if (iNamed) {
+    snprintf(acWhat, sizeof(acWhat), "legacy, %s server, rm", pcMode);
+    Bench_legacy(acWhat, iCount);
+  }
+  else {
+    snprintf(acWhat, sizeof(acWhat), "legacy, %s server", pcMode);
+    Bench_legacy(acWhat, iCount);
+    snprintf(acWhat, sizeof(acWhat), "framed, %s server", pcMode);
+    Bench_framed(pcClient, acWhat, iCount);
+  }
+
+  kill(iPid, SIGTERM);
+  waitpid(iPid, &iStatus, 0);
+}
+
+/*--------------------------------------------------------------------*/
+
+int main(int argc, char **argv)
+{
+  int iCount = BENCH_DEFAULT_COMMANDS;
+  FILE *psInput = NULL;
+  int i = 0;
+
+  if ((argc != 3) && (argc != 4)) {
+    fprintf(stderr, "usage: command_bench <server> <client> [commands]\n");
+    exit(EXIT_FAILURE);
+  }
+  if (argc == 4)
+    iCount = atoi(argv[3]);
+  signal(SIGPIPE, SIG_IGN);
+
+  if ((psInput = fopen(BENCH_INPUT, "w")) == NULL) {
+    perror(BENCH_INPUT);
+    exit(EXIT_FAILURE);
+  }
+  for (i = 0; i < iCount; i++)
+    fputs(BENCH_COMMAND, psInput);
+  fclose(psInput);
+
+  Bench_mode(argv[1], argv[2], "event", 1, iCount);
+  Bench_mode(argv[1], argv[2], "event", 0, iCount);
+  Bench_mode(argv[1], argv[2], "fork", 1, iCount);
+  Bench_mode(argv[1], argv[2], "fork", 0, iCount);
+
+  unlink(BENCH_INPUT);
+  exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,158 @@
+/*--------------------------------------------------------------------*/
+/* delta_bench.c                                                      */
+/* Time sending a changed file whole and as a delta against the      */
+/* receiver's old copy                                                */
+/*--------------------------------------------------------------------*/
+
+/* The old copy is a file of the given size, 32 MB by default or the
+   first argument in MB. The new one has 1 KB inserted a third of the
+   way in and 4 KB overwritten two thirds of the way in. A process
+   sends it through a socket with Delta_sendBody, as the framed
+   protocol does, to a receiver that rebuilds it with Delta_recvBody:
+   once with no base, so that every byte goes as data, and once
+   against the old copy's signatures. */
+
+#include "delta.h"
+#include "bench.h"
+
+#include <sys/socket.h>
+
+#define BENCH_OLD "delta_bench.old"
+#define BENCH_NEW "delta_bench.new"
+#define BENCH_OUT "delta_bench.out"
+#define BENCH_DEFAULT_MB 32
+#define BENCH_INSERT 1024 /* bytes inserted into the new copy */
+#define BENCH_OVERWRITE 4096 /* bytes overwritten in the new copy */
+
+/*--------------------------------------------------------------------*/
+
+/* write BENCH_NEW as BENCH_OLD with an insertion and an overwrite.
+   Return 0 or -1 */
+static int Bench_change(long lSize)
+{
+  char acPatch[BENCH_OVERWRITE];
+  char *pcData = NULL;
+  FILE *psFile = NULL;
+  int iOk = 0;
+
+  if ((pcData = malloc((size_t) lSize)) == NULL)
+    return -1;
+  memset(acPatch, 'x', sizeof(acPatch));
+  if (((psFile = fopen(BENCH_OLD, "r")) == NULL) ||
+      (fread(pcData, 1, (size_t) lSize, psFile) != (size_t) lSize)) {
+    perror(BENCH_OLD);
+    free(pcData);
+    return -1;
+  }
+  fclose(psFile);
+
+  memcpy(pcData + 2 * lSize / 3, acPatch, BENCH_OVERWRITE);
+  if ((psFile = fopen(BENCH_NEW, "w")) == NULL) {
+    perror(BENCH_NEW);
+    free(pcData);
+    return -1;
+  }
+  iOk = (fwrite(pcData, 1, (size_t) lSize / 3, psFile) == (size_t) lSize / 3) &&
+    (fwrite(acPatch, 1, BENCH_INSERT, psFile) == BENCH_INSERT) &&
+    (fwrite(pcData + lSize / 3, 1, (size_t) (lSize - lSize / 3), psFile) ==
+     (size_t) (lSize - lSize / 3));
+  free(pcData);
+  return ((fclose(psFile) == 0) && iOk) ? 0 : -1;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* send BENCH_NEW on iSockFD for request 1 against the signatures the
+   receiver sends first, and write the number of bytes sent as data to
+   iReportFD. Does not return */
+static void Bench_sender(int iSockFD, int iReportFD)
+{
+  DeltaSigs_T oSigs = NULL;
+  RecvBuf_T oBuf = RecvBuf_new(iSockFD);
+  uint64_t uLiteral = 0;
+
+  if ((oBuf == NULL) ||
+      (Delta_recvSigs(oBuf, 1, &oSigs) != RECVBUF_OK) ||
+      (Delta_sendBody(iSockFD, 1, BENCH_NEW, oSigs, &uLiteral) != SUCCESS) ||
+      (Proto_sendEnd(iSockFD, 1, 0) == FAILURE))
+    _exit(EXIT_FAILURE);
+  if (write(iReportFD, &uLiteral, sizeof(uLiteral)) != sizeof(uLiteral))
+    _exit(EXIT_FAILURE);
+  _exit(EXIT_SUCCESS);
+}
+
+/*--------------------------------------------------------------------*/
+
+/* receive BENCH_NEW into BENCH_OUT, against BENCH_OLD if iDelta, and
+   report the best time as case pcWhat */
+static void Bench_send(const char *pcWhat, int iDelta, long lSize)
+{
+  double dBest = 0, dStart = 0, dTime = 0;
+  uint64_t uLiteral = 0;
+  RecvBuf_T oBuf = NULL;
+  int aiSock[2], aiReport[2];
+  int iBaseFD = -1;
+  int iStatus = 0, iSent = 0;
+  pid_t iPid = 0;
+  int i = 0;
+
+  for (i = 0; i < BENCH_ROUNDS; i++) {
+    if ((socketpair(AF_UNIX, SOCK_STREAM, 0, aiSock) == -1) ||
+	(pipe(aiReport) == -1) ||
+	(iDelta && ((iBaseFD = open(BENCH_OLD, O_RDONLY)) == -1))) {
+      perror("delta_bench");
+      exit(EXIT_FAILURE);
+    }
+
+    dStart = Bench_now();
+    if ((iPid = fork()) == 0) {
+      close(aiSock[1]);
+      close(aiReport[0]);
+      Bench_sender(aiSock[0], aiReport[1]);
+    }
+    close(aiSock[0]);
+    close(aiReport[1]);
+    oBuf = RecvBuf_new(aiSock[1]);
+    iStatus = -1;
+    if ((oBuf == NULL) ||
+	(Delta_sendSigs(aiSock[1], 1, iBaseFD) == FAILURE) ||
+	(Delta_recvBody(oBuf, 1, iBaseFD, BENCH_OUT, NULL, &iStatus)
+	 == FAILURE) || (iStatus != 0) ||
+	(read(aiReport[0], &uLiteral, sizeof(uLiteral)) != sizeof(uLiteral))) {
+      fprintf(stderr, "delta_bench: %s: transfer failed\n", pcWhat);
+      exit(EXIT_FAILURE);
+    }
+    waitpid(iPid, &iSent, 0);
+    dTime = Bench_now() - dStart;
+
+    RecvBuf_free(oBuf);
+    close(aiSock[1]);
+    close(aiReport[0]);
+    if (iBaseFD != -1)
+      close(iBaseFD);
+    if ((i == 0) || (dTime < dBest))
+      dBest = dTime;
+  }
+  Bench_reportBytes("delta_bench", pcWhat, lSize, dBest);
+  printf("delta_bench: %-28s %ld bytes sent as data\n", pcWhat,
+	 (long) uLiteral);
+}
+
+/*--------------------------------------------------------------------*/
+
+int main(int argc, char **argv)
+{
+  long lSize = (long) ((argc > 1) ? atoi(argv[1]) : BENCH_DEFAULT_MB) * BENCH_MB;
+
+  signal(SIGPIPE, SIG_IGN);
+  if ((Bench_makeFile(BENCH_OLD, lSize) == -1) || (Bench_change(lSize) == -1))
+    exit(EXIT_FAILURE);
+
+  Bench_send("whole file", FALSE, lSize);
+  Bench_send("delta against the old copy", TRUE, lSize);
+
+  unlink(BENCH_OLD);
+  unlink(BENCH_NEW);
+  unlink(BENCH_OUT);
+  exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,74 @@
+/*--------------------------------------------------------------------*/
+/* dynarray_bench.c                                                   */
+/* Time making, filling and freeing small DynArrays                   */
+/*--------------------------------------------------------------------*/
+
+/* Each round makes a DynArray, adds k elements to it and frees it, as
+   a command's words once were: with DynArray_new, with
+   DynArray_newInline and room for 16 elements, and with DynArray_init
+   on 16 elements' worth of stack. k is 4, 8, 16 and 32, so the last
+   case outgrows the inline room. The number of rounds is the first
+   argument, 500000 by default. */
+
+#include "dynarray.h"
+#include "bench.h"
+
+#define BENCH_INLINE 16
+#define BENCH_DEFAULT_ROUNDS 500000
+
+enum BenchKind {KIND_NEW, KIND_INLINE, KIND_STACK};
+/* how the arrays are made */
+
+static const char *apcKinds[] =
+  {"new", "newInline(16)", "init(16) on stack"};
+
+/*--------------------------------------------------------------------*/
+
+/* make iRounds arrays of kind eKind, add iAdds elements to each, and
+   free it. Report the best time */
+static void Bench_rounds(enum BenchKind eKind, int iAdds, int iRounds)
+{
+  void *apvMem[DYNARRAY_WORDS(BENCH_INLINE)];
+  DynArray_T oDynArray = NULL;
+  double dBest = 0, dStart = 0, dTime = 0;
+  char acWhat[64];
+  int i = 0, j = 0, k = 0;
+
+  for (i = 0; i < BENCH_ROUNDS; i++) {
+    dStart = Bench_now();
+    for (j = 0; j < iRounds; j++) {
+      if (eKind == KIND_NEW)
+	oDynArray = DynArray_new(0);
+      else if (eKind == KIND_INLINE)
+	oDynArray = DynArray_newInline(0, BENCH_INLINE);
+      else
+	oDynArray = DynArray_init(apvMem, DYNARRAY_WORDS(BENCH_INLINE), 0);
+      if (oDynArray == NULL) {
+	fprintf(stderr, "dynarray_bench: cannot allocate memory\n");
+	exit(EXIT_FAILURE);
+      }
+      for (k = 0; k < iAdds; k++)
+	DynArray_add(oDynArray, &apvMem[k % BENCH_INLINE]);
+      DynArray_free(oDynArray);
+    }
+    dTime = Bench_now() - dStart;
+    if ((i == 0) || (dTime < dBest))
+      dBest = dTime;
+  }
+  snprintf(acWhat, sizeof(acWhat), "%s, %d adds", apcKinds[eKind], iAdds);
+  Bench_reportOps("dynarray_bench", acWhat, iRounds, dBest);
+}
+
+/*--------------------------------------------------------------------*/
+
+int main(int argc, char **argv)
+{
+  int iRounds = (argc > 1) ? atoi(argv[1]) : BENCH_DEFAULT_ROUNDS;
+  int iAdds = 0;
+  int eKind = 0;
+
+  for (iAdds = 4; iAdds <= 2 * BENCH_INLINE; iAdds *= 2)
+    for (eKind = KIND_NEW; eKind <= KIND_STACK; eKind++)
+      Bench_rounds((enum BenchKind) eKind, iAdds, iRounds);
+  exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,122 @@
+/*--------------------------------------------------------------------*/
+/* parse_bench.c                                                      */
+/* Time turning command lines into commands, with malloc and with a  */
+/* per-line arena                                                     */
+/*--------------------------------------------------------------------*/
+
+/* Eight typical lines are analyzed over and over, the first argument
+   times in all, 400000 by default. Each line is analyzed three ways:
+   - Lex_lexLine and Syn_synLine with malloc, then freeing every token
+     and command word, as before the arena;
+   - the same two passes from an arena that is reset after the line;
+   - Syn_parseLine from an arena, in one pass, as the server and the
+     client do now. */
+
+#include "lex.h"
+#include "syn.h"
+#include "arena.h"
+#include "dynarray.h"
+#include "bench.h"
+
+#define BENCH_DEFAULT_LINES 400000
+
+static char *apcLines[] = {
+  "remote gcc -O2 -Wall -c main.c -o main.o",
+  "remote build cc -g main.c lex.c syn.c dynarray.c arena.c recvbuf.c "
+  "sha256.c lz.c proto.c common.c stage.c stripe.c archive.c delta.c "
+  "uring.c pipeline.c server.c session.c jobtab.c cache.c",
+  "sendfile src/main.c",
+  "recvfile \"build output/app.tar\"",
+  "remote ls -l > listing.txt",
+  "remote sort < names.txt > sorted.txt",
+  "cd src/lib",
+  "setenv CFLAGS \"-O2 -g\""
+};
+/* what a session sends */
+
+#define BENCH_LINES ((int) (sizeof(apcLines) / sizeof(apcLines[0])))
+
+/*--------------------------------------------------------------------*/
+
+/* analyze iCount lines with Lex_lexLine and Syn_synLine, from oArena,
+   or with malloc if it is NULL, and report the time as case pcWhat */
+static void Bench_twoPass(const char *pcWhat, Arena_T oArena, int iCount)
+{
+  DynArray_T oTokens = NULL, oCmds = NULL;
+  double dBest = 0, dStart = 0, dTime = 0;
+  int i = 0, j = 0;
+
+  for (i = 0; i < BENCH_ROUNDS; i++) {
+    dStart = Bench_now();
+    for (j = 0; j < iCount; j++) {
+      oTokens = DynArray_new(0);
+      oCmds = DynArray_new(0);
+      if ((oTokens == NULL) || (oCmds == NULL) ||
+	  !Lex_lexLine(apcLines[j % BENCH_LINES], oTokens, oArena,
+		       "parse_bench") ||
+	  !Syn_synLine(oTokens, oCmds, oArena, "parse_bench")) {
+	fprintf(stderr, "parse_bench: %s: line rejected\n", pcWhat);
+	exit(EXIT_FAILURE);
+      }
+      if (oArena == NULL) {
+	DynArray_map(oTokens, Lex_freeToken, NULL);
+	DynArray_map(oCmds, Syn_freeCmd, NULL);
+      }
+      else
+	Arena_reset(oArena);
+      DynArray_free(oTokens);
+      DynArray_free(oCmds);
+    }
+    dTime = Bench_now() - dStart;
+    if ((i == 0) || (dTime < dBest))
+      dBest = dTime;
+  }
+  Bench_reportOps("parse_bench", pcWhat, iCount, dBest);
+}
+
+/*--------------------------------------------------------------------*/
+
+/* analyze iCount lines with Syn_parseLine from oArena, and report the
+   time as case pcWhat */
+static void Bench_onePass(const char *pcWhat, Arena_T oArena, int iCount)
+{
+  double dBest = 0, dStart = 0, dTime = 0;
+  SynCmd sCmd;
+  int i = 0, j = 0;
+
+  for (i = 0; i < BENCH_ROUNDS; i++) {
+    dStart = Bench_now();
+    for (j = 0; j < iCount; j++) {
+      if (!Syn_parseLine(apcLines[j % BENCH_LINES], &sCmd, oArena,
+			 "parse_bench")) {
+	fprintf(stderr, "parse_bench: %s: line rejected\n", pcWhat);
+	exit(EXIT_FAILURE);
+      }
+      Arena_reset(oArena);
+    }
+    dTime = Bench_now() - dStart;
+    if ((i == 0) || (dTime < dBest))
+      dBest = dTime;
+  }
+  Bench_reportOps("parse_bench", pcWhat, iCount, dBest);
+}
+
+/*--------------------------------------------------------------------*/
+
+int main(int argc, char **argv)
+{
+  int iCount = (argc > 1) ? atoi(argv[1]) : BENCH_DEFAULT_LINES;
+  Arena_T oArena = Arena_new();
+
+  if (oArena == NULL) {
+    fprintf(stderr, "parse_bench: cannot allocate memory\n");
+    exit(EXIT_FAILURE);
+  }
+
+  Bench_twoPass("lex + syn, malloc and free", NULL, iCount);
+  Bench_twoPass("lex + syn, arena", oArena, iCount);
+  Bench_onePass("Syn_parseLine, arena", oArena, iCount);
+
+  Arena_free(oArena);
+  exit(EXIT_SUCCESS);
+}
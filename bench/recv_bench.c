@@ -0,0 +1,124 @@
+/*--------------------------------------------------------------------*/
+/* recv_bench.c                                                       */
+/* Time receiving a legacy upload into a file                         */
+/*--------------------------------------------------------------------*/
+
+/* A process sends a file through a socket with Common_sendFile, length
+   header first, as a legacy client uploads one. The receiver takes it
+   with Common_recvFile, which allocates the file at its full size,
+   reads it through a 1 MB aligned buffer and renames it into place.
+   For comparison, it also takes it with a loop of MAX_BUFF reads and
+   writes, as Common_recvFile did before. The sizes run from 1 MB to
+   the first argument in MB, 4096 by default, which needs twice that
+   much free disk space. */
+
+#include "common.h"
+#include "bench.h"
+
+#include <sys/socket.h>
+
+#define BENCH_FILE "recv_bench.dat"
+#define BENCH_OUT "recv_bench.out"
+#define BENCH_DEFAULT_MB 4096
+
+/*--------------------------------------------------------------------*/
+
+/* receive a file from oBuf into BENCH_OUT with a loop of MAX_BUFF
+   reads and writes. Return SUCCESS or FAILURE */
+static int Bench_recvLoop(RecvBuf_T oBuf)
+{
+  char acBuf[MAX_BUFF];
+  long lLeft = 0;
+  ssize_t iGot = 0;
+  int iFD = -1;
+
+  if (RecvBuf_readn(oBuf, acBuf, LEGACY_LENGTH_WIDTH + 1) !=
+      LEGACY_LENGTH_WIDTH + 1)
+    return FAILURE;
+  acBuf[LEGACY_LENGTH_WIDTH + 1] = '\0';
+  lLeft = atol(acBuf);
+  if ((iFD = open(BENCH_OUT, O_WRONLY | O_CREAT | O_TRUNC, 0666)) == -1)
+    return FAILURE;
+  while (lLeft > 0) {
+    iGot = RecvBuf_readn(oBuf, acBuf,
+			 (lLeft < MAX_BUFF) ? (size_t) lLeft : MAX_BUFF);
+    if ((iGot <= 0) || (Common_writen(iFD, acBuf, iGot) == FAILURE))
+      break;
+    lLeft -= iGot;
+  }
+  close(iFD);
+  return (lLeft == 0) ? SUCCESS : FAILURE;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* send BENCH_FILE, of lSize bytes, to a receiver that uses
+   Common_recvFile if iRecvFile, or else Bench_recvLoop, and report the
+   best time as case pcWhat */
+static void Bench_recv(const char *pcWhat, int iRecvFile, long lSize)
+{
+  double dBest = 0, dStart = 0, dTime = 0;
+  RecvBuf_T oBuf = NULL;
+  int aiSock[2];
+  int iStatus = 0, iRet = 0;
+  pid_t iPid = 0;
+  int i = 0;
+
+  if (Bench_makeFile(BENCH_FILE, lSize) == -1)
+    exit(EXIT_FAILURE);
+  for (i = 0; i < BENCH_ROUNDS; i++) {
+    unlink(BENCH_OUT);
+    if ((socketpair(AF_UNIX, SOCK_STREAM, 0, aiSock) == -1) ||
+	((oBuf = RecvBuf_new(aiSock[1])) == NULL)) {
+      perror("recv_bench");
+      exit(EXIT_FAILURE);
+    }
+
+    dStart = Bench_now();
+    if ((iPid = fork()) == 0) {
+      close(aiSock[1]);
+      _exit((Common_sendFile(aiSock[0], BENCH_FILE) == SUCCESS) ?
+	    EXIT_SUCCESS : EXIT_FAILURE);
+    }
+    close(aiSock[0]);
+    if (iRecvFile)
+      iRet = Common_recvFile(oBuf, BENCH_OUT);
+    else
+      iRet = Bench_recvLoop(oBuf);
+    dTime = Bench_now() - dStart;
+    waitpid(iPid, &iStatus, 0);
+
+    RecvBuf_free(oBuf);
+    close(aiSock[1]);
+    if ((iRet != SUCCESS) || !WIFEXITED(iStatus) ||
+	(WEXITSTATUS(iStatus) != EXIT_SUCCESS)) {
+      fprintf(stderr, "recv_bench: %s: transfer failed\n", pcWhat);
+      exit(EXIT_FAILURE);
+    }
+    if ((i == 0) || (dTime < dBest))
+      dBest = dTime;
+  }
+  Bench_reportBytes("recv_bench", pcWhat, lSize, dBest);
+}
+
+/*--------------------------------------------------------------------*/
+
+int main(int argc, char **argv)
+{
+  long alSizes[] = {1, 16, 64, 256, 1024, 4096};
+  long lMost = (argc > 1) ? atol(argv[1]) : BENCH_DEFAULT_MB;
+  int i = 0;
+
+  signal(SIGPIPE, SIG_IGN);
+
+  for (i = 0; i < (int) (sizeof(alSizes) / sizeof(alSizes[0])); i++) {
+    if (alSizes[i] > lMost)
+      break;
+    Bench_recv("read/write loop", FALSE, alSizes[i] * BENCH_MB);
+    Bench_recv("Common_recvFile", TRUE, alSizes[i] * BENCH_MB);
+  }
+
+  unlink(BENCH_FILE);
+  unlink(BENCH_OUT);
+  exit(EXIT_SUCCESS);
+}
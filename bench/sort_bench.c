@@ -0,0 +1,144 @@
+/*--------------------------------------------------------------------*/
+/* sort_bench.c                                                       */
+/* Time DynArray_sort on the orders file listings and job tables     */
+/* come in                                                            */
+/*--------------------------------------------------------------------*/
+
+/* An array of pointers to ints, the first argument long, 100000 by
+   default, is sorted from several orders: sorted, reversed, random,
+   16 distinct keys, and sorted with random elements at its end. Each
+   order is sorted with DynArray_sort and, for reference, with the C
+   library's qsort(3) on a plain array of the same pointers. Both the
+   time and the number of comparisons are reported. */
+
+#include "dynarray.h"
+#include "bench.h"
+
+#define BENCH_DEFAULT_LENGTH 100000
+#define BENCH_TAIL 100 /* random elements after a sorted run */
+
+enum BenchOrder {ORDER_SORTED, ORDER_REVERSED, ORDER_RANDOM, ORDER_KEYS,
+		 ORDER_TAIL, ORDER_COUNT};
+/* orders to sort from */
+
+static const char *apcOrders[ORDER_COUNT] =
+  {"sorted", "reversed", "random", "16 keys", "sorted + tail"};
+
+static long lCompares = 0; /* calls of Bench_compare */
+
+/*--------------------------------------------------------------------*/
+
+/* compare the ints that pvElement1 and pvElement2 point to */
+static int Bench_compare(const void *pvElement1, const void *pvElement2)
+{
+  int iValue1 = *(const int *) pvElement1;
+  int iValue2 = *(const int *) pvElement2;
+
+  lCompares++;
+  return (iValue1 > iValue2) - (iValue1 < iValue2);
+}
+
+/*--------------------------------------------------------------------*/
+
+/* compare the elements of a plain array of pointers to ints that
+   pvElement1 and pvElement2 point to, for qsort(3) */
+static int Bench_compareQsort(const void *pvElement1, const void *pvElement2)
+{
+  return Bench_compare(*(void *const *) pvElement1,
+		       *(void *const *) pvElement2);
+}
+
+/*--------------------------------------------------------------------*/
+
+/* set the iLength ints at piValues in order eOrder */
+static void Bench_fill(int *piValues, int iLength, enum BenchOrder eOrder)
+{
+  int i = 0;
+
+  srand(1);
+  for (i = 0; i < iLength; i++)
+    switch (eOrder) {
+    case ORDER_SORTED:
+      piValues[i] = i;
+      break;
+    case ORDER_REVERSED:
+      piValues[i] = iLength - i;
+      break;
+    case ORDER_RANDOM:
+      piValues[i] = rand();
+      break;
+    case ORDER_KEYS:
+      piValues[i] = rand() % 16;
+      break;
+    default:
+      piValues[i] = (i < iLength - BENCH_TAIL) ? i : rand() % iLength;
+      break;
+    }
+}
+
+/*--------------------------------------------------------------------*/
+
+/* sort iLength ints from order eOrder with DynArray_sort if iDynArray,
+   or else with qsort(3), and report the best time */
+static void Bench_sort(enum BenchOrder eOrder, int iDynArray, int iLength)
+{
+  DynArray_T oDynArray = NULL;
+  double dBest = 0, dStart = 0, dTime = 0;
+  const void **ppvArray = NULL;
+  int *piValues = NULL;
+  char acWhat[64];
+  int i = 0, j = 0;
+
+  if (((piValues = malloc(sizeof(int) * (size_t) iLength)) == NULL) ||
+      ((ppvArray = malloc(sizeof(void *) * (size_t) iLength)) == NULL) ||
+      ((oDynArray = DynArray_new(0)) == NULL) ||
+      !DynArray_reserve(oDynArray, iLength)) {
+    fprintf(stderr, "sort_bench: cannot allocate memory\n");
+    exit(EXIT_FAILURE);
+  }
+  Bench_fill(piValues, iLength, eOrder);
+
+  for (i = 0; i < BENCH_ROUNDS; i++) {
+    for (j = 0; j < iLength; j++)
+      ppvArray[j] = &piValues[j];
+    DynArray_clear(oDynArray);
+    DynArray_addAll(oDynArray, ppvArray, iLength);
+
+    lCompares = 0;
+    dStart = Bench_now();
+    if (iDynArray)
+      DynArray_sort(oDynArray, Bench_compare);
+    else
+      qsort(ppvArray, (size_t) iLength, sizeof(void *), Bench_compareQsort);
+    dTime = Bench_now() - dStart;
+    if ((i == 0) || (dTime < dBest))
+      dBest = dTime;
+  }
+
+  snprintf(acWhat, sizeof(acWhat), "%s, %s", apcOrders[eOrder],
+	   iDynArray ? "DynArray_sort" : "qsort");
+  Bench_reportOps("sort_bench", acWhat, iLength, dBest);
+  printf("sort_bench: %-28s %ld comparisons\n", acWhat, lCompares);
+
+  DynArray_free(oDynArray);
+  free(ppvArray);
+  free(piValues);
+}
+
+/*--------------------------------------------------------------------*/
+
+int main(int argc, char **argv)
+{
+  int iLength = (argc > 1) ? atoi(argv[1]) : BENCH_DEFAULT_LENGTH;
+  int eOrder = 0;
+
+  if (iLength <= BENCH_TAIL) {
+    fprintf(stderr, "sort_bench: sort more than %d elements\n", BENCH_TAIL);
+    exit(EXIT_FAILURE);
+  }
+  for (eOrder = 0; eOrder < ORDER_COUNT; eOrder++) {
+    Bench_sort((enum BenchOrder) eOrder, 1, iLength);
+    Bench_sort((enum BenchOrder) eOrder, 0, iLength);
+  }
+  exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,134 @@
+/*--------------------------------------------------------------------*/
+/* stripe_bench.c                                                     */
+/* Time a large recvfile over one connection and striped over       */
+/* several                                                            */
+/*--------------------------------------------------------------------*/
+
+/* The server runs in a directory of its own, holding a file of the
+   given size: STRIPE_MIN_SIZE, 64 MB, by default, or the third
+   argument in MB. The client program fetches it with recvfile into
+   the current directory, once with one stream and once with -s 4,
+   against the server in event and in fork mode. The local copy is
+   removed before each run, so that no delta is sent against it. On a
+   machine with a single CPU, loopback is bound by the CPU and striping
+   cannot be faster. */
+
+#include "bench.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#define BENCH_DIR "stripe_bench.d"
+#define BENCH_FILE "stripe_bench.dat"
+#define BENCH_INPUT "stripe_bench.in"
+#define BENCH_DEFAULT_MB 64
+
+/*--------------------------------------------------------------------*/
+
+/* fetch BENCH_FILE with client pcClient using pcStreams streams, and
+   report the best time as case pcWhat */
+static void Bench_fetch(const char *pcClient, const char *pcStreams,
+			const char *pcWhat, long lSize)
+{
+  double dBest = 0, dStart = 0, dTime = 0;
+  struct stat sStat;
+  int iStatus = 0;
+  pid_t iPid = 0;
+  int i = 0;
+
+  for (i = 0; i < BENCH_ROUNDS; i++) {
+    unlink(BENCH_FILE);
+    dStart = Bench_now();
+    if ((iPid = fork()) == 0) {
+      if ((freopen(BENCH_INPUT, "r", stdin) == NULL) ||
+	  (freopen("/dev/null", "w", stdout) == NULL))
+	_exit(127);
+      execl(pcClient, pcClient, "-s", pcStreams, "127.0.0.1", (char *) NULL);
+      perror(pcClient);
+      _exit(127);
+    }
+    waitpid(iPid, &iStatus, 0);
+    dTime = Bench_now() - dStart;
+    if ((stat(BENCH_FILE, &sStat) == -1) || (sStat.st_size != lSize)) {
+      fprintf(stderr, "stripe_bench: %s: recvfile failed\n", pcWhat);
+      exit(EXIT_FAILURE);
+    }
+    if ((i == 0) || (dTime < dBest))
+      dBest = dTime;
+  }
+  Bench_reportBytes("stripe_bench", pcWhat, lSize, dBest);
+}
+
+/*--------------------------------------------------------------------*/
+
+/* run server pcServer in mode pcMode in BENCH_DIR and fetch its file
+   over one stream and over four */
+static void Bench_mode(const char *pcServer, const char *pcClient,
+		       const char *pcMode, long lSize)
+{
+  char acWhat[64];
+  int iStatus = 0;
+  pid_t iPid = 0;
+
+  if ((iPid = fork()) == 0) {
+    if ((chdir(BENCH_DIR) == -1) ||
+	(freopen("/dev/null", "w", stderr) == NULL))
+      _exit(127);
+    execl(pcServer, pcServer, "-m", pcMode, "-C", "", "-S", "", "-P", "",
+	  (char *) NULL);
+    _exit(127);
+  }
+  usleep(300000); /* the client does not retry its connection */
+
+  snprintf(acWhat, sizeof(acWhat), "1 stream, %s server", pcMode);
+  Bench_fetch(pcClient, "1", acWhat, lSize);
+  snprintf(acWhat, sizeof(acWhat), "-s 4, %s server", pcMode);
+  Bench_fetch(pcClient, "4", acWhat, lSize);
+
+  kill(iPid, SIGTERM);
+  waitpid(iPid, &iStatus, 0);
+}
+
+/*--------------------------------------------------------------------*/
+
+int main(int argc, char **argv)
+{
+  char acServer[PATH_MAX];
+  long lSize = BENCH_DEFAULT_MB;
+  FILE *psInput = NULL;
+
+  if ((argc != 3) && (argc != 4)) {
+    fprintf(stderr, "usage: stripe_bench <server> <client> [MB]\n");
+    exit(EXIT_FAILURE);
+  }
+  if (argc == 4)
+    lSize = atoi(argv[3]);
+  lSize *= BENCH_MB;
+  signal(SIGPIPE, SIG_IGN);
+
+  /* the server runs in BENCH_DIR */
+  if (realpath(argv[1], acServer) == NULL) {
+    perror(argv[1]);
+    exit(EXIT_FAILURE);
+  }
+  if (((mkdir(BENCH_DIR, 0777) == -1) && (errno != EEXIST)) ||
+      (Bench_makeFile(BENCH_DIR "/" BENCH_FILE, lSize) == -1) ||
+      ((psInput = fopen(BENCH_INPUT, "w")) == NULL)) {
+    perror("stripe_bench");
+    exit(EXIT_FAILURE);
+  }
+  fputs("recvfile " BENCH_FILE "\n", psInput);
+  fclose(psInput);
+
+  Bench_mode(acServer, argv[2], "event", lSize);
+  Bench_mode(acServer, argv[2], "fork", lSize);
+
+  unlink(BENCH_FILE);
+  unlink(BENCH_INPUT);
+  unlink(BENCH_DIR "/" BENCH_FILE);
+  rmdir(BENCH_DIR);
+  exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,79 @@
+/*--------------------------------------------------------------------*/
+/* transfer_bench.c                                                   */
+/* Time sending a file through a socket with sendfile/splice and     */
+/* with the copy loop                                                 */
+/*--------------------------------------------------------------------*/
+
+/* A file is sent through a TCP connection over loopback to a process
+   that throws it away, as Common_sendFile sends a download: once with
+   Common_transfer, which uses sendfile(2), and once through
+   Common_copyFD's user buffer, the path that 'server -c' takes. The
+   size is the first argument, in MB. */
+
+#include "common.h"
+#include "bench.h"
+
+#define BENCH_FILE "transfer_bench.dat"
+#define BENCH_DEFAULT_MB 256
+
+/*--------------------------------------------------------------------*/
+
+/* send the lSize bytes of BENCH_FILE over loopback TCP, with
+   Common_transfer if iZeroCopy, or else with Common_copyFD, and report
+   the best time as case pcWhat */
+static void Bench_send(const char *pcWhat, int iZeroCopy, long lSize)
+{
+  double dBest = 0, dStart = 0, dTime = 0;
+  int aiSock[2];
+  int iStatus = 0;
+  int iFD = -1;
+  ssize_t iSent = 0;
+  pid_t iPid = 0;
+  int i = 0;
+
+  for (i = 0; i < BENCH_ROUNDS; i++) {
+    if ((Bench_tcpPair(aiSock) == -1) ||
+	((iFD = open(BENCH_FILE, O_RDONLY)) == -1) ||
+	((iPid = Bench_drain(aiSock[1], aiSock[0])) == -1)) {
+      perror("transfer_bench");
+      exit(EXIT_FAILURE);
+    }
+    close(aiSock[1]);
+
+    dStart = Bench_now();
+    if (iZeroCopy)
+      iSent = Common_transfer(aiSock[0], iFD, (size_t) lSize);
+    else
+      iSent = Common_copyFD(aiSock[0], iFD, (size_t) lSize);
+    close(aiSock[0]);
+    waitpid(iPid, &iStatus, 0);
+    dTime = Bench_now() - dStart;
+    close(iFD);
+
+    if (iSent != lSize) {
+      fprintf(stderr, "transfer_bench: %s: sent %ld of %ld bytes\n", pcWhat,
+	      (long) iSent, lSize);
+      exit(EXIT_FAILURE);
+    }
+    if ((i == 0) || (dTime < dBest))
+      dBest = dTime;
+  }
+  Bench_reportBytes("transfer_bench", pcWhat, lSize, dBest);
+}
+
+/*--------------------------------------------------------------------*/
+
+int main(int argc, char **argv)
+{
+  long lSize = (long) ((argc > 1) ? atoi(argv[1]) : BENCH_DEFAULT_MB) * BENCH_MB;
+
+  signal(SIGPIPE, SIG_IGN);
+  if (Bench_makeFile(BENCH_FILE, lSize) == -1)
+    exit(EXIT_FAILURE);
+
+  Bench_send("copy loop (server -c)", FALSE, lSize);
+  Bench_send("sendfile/splice", TRUE, lSize);
+
+  unlink(BENCH_FILE);
+  exit(EXIT_SUCCESS);
+}
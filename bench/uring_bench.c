@@ -0,0 +1,118 @@
+/*--------------------------------------------------------------------*/
+/* uring_bench.c                                                      */
+/* Time Common_copyFD with and without io_uring                       */
+/*--------------------------------------------------------------------*/
+
+/* Common_copyFD copies a file to a socket, read by a process that
+   throws the bytes away, and from a socket, fed by a process that
+   sends the file, into a file. Each copy runs once through its
+   read(2)/write(2) loop and once through io_uring, as 'server -u'
+   does. The system calls each way made are reported with it. The size
+   is the first argument in MB, 256 by default. */
+
+#include "common.h"
+#include "uring.h"
+#include "bench.h"
+
+#include <sys/socket.h>
+
+#define BENCH_FILE "uring_bench.dat"
+#define BENCH_OUT "uring_bench.out"
+#define BENCH_DEFAULT_MB 256
+
+/*--------------------------------------------------------------------*/
+
+/* copy lSize bytes with Common_copyFD, from BENCH_FILE to a socket if
+   iToSocket or else from a socket into BENCH_OUT, through io_uring if
+   iUring, and report the best time as case pcWhat */
+static void Bench_copy(const char *pcWhat, int iToSocket, int iUring,
+		       long lSize)
+{
+  double dBest = 0, dStart = 0, dTime = 0;
+  UringStats sBefore, sAfter;
+  int aiSock[2];
+  int iFD = -1;
+  int iStatus = 0;
+  ssize_t iCopied = 0;
+  pid_t iPid = 0;
+  int i = 0;
+
+  Uring_setOn(iUring);
+  Uring_getStats(&sBefore);
+  for (i = 0; i < BENCH_ROUNDS; i++) {
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, aiSock) == -1) {
+      perror("uring_bench");
+      exit(EXIT_FAILURE);
+    }
+    if (iToSocket) {
+      iFD = open(BENCH_FILE, O_RDONLY);
+      iPid = Bench_drain(aiSock[1], aiSock[0]);
+    }
+    else {
+      iFD = open(BENCH_OUT, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+      if ((iPid = fork()) == 0) {
+	close(aiSock[1]);
+	_exit((Common_sendFile(aiSock[0], BENCH_FILE) == SUCCESS) ?
+	      EXIT_SUCCESS : EXIT_FAILURE);
+      }
+    }
+    if ((iFD == -1) || (iPid == -1)) {
+      perror("uring_bench");
+      exit(EXIT_FAILURE);
+    }
+
+    dStart = Bench_now();
+    if (iToSocket) {
+      close(aiSock[1]);
+      iCopied = Common_copyFD(aiSock[0], iFD, (size_t) lSize);
+      close(aiSock[0]);
+    }
+    else {
+      close(aiSock[0]);
+      /* the length header Common_sendFile sends first */
+      iCopied = LEGACY_LENGTH_WIDTH + 1;
+      if (Common_copyFD(iFD, aiSock[1], iCopied) == iCopied)
+	iCopied = Common_copyFD(iFD, aiSock[1], (size_t) lSize);
+      close(aiSock[1]);
+    }
+    waitpid(iPid, &iStatus, 0);
+    dTime = Bench_now() - dStart;
+    close(iFD);
+
+    if (iCopied != lSize) {
+      fprintf(stderr, "uring_bench: %s: copied %ld of %ld bytes\n", pcWhat,
+	      (long) iCopied, lSize);
+      exit(EXIT_FAILURE);
+    }
+    if ((i == 0) || (dTime < dBest))
+      dBest = dTime;
+  }
+  Uring_getStats(&sAfter);
+
+  Bench_reportBytes("uring_bench", pcWhat, lSize, dBest);
+  if (iUring && Uring_isOn())
+    printf("uring_bench: %-28s %lld io_uring_enter calls per copy\n", pcWhat,
+	   (sAfter.llEnters - sBefore.llEnters) / BENCH_ROUNDS);
+  else if (iUring)
+    printf("uring_bench: %-28s io_uring is not available\n", pcWhat);
+}
+
+/*--------------------------------------------------------------------*/
+
+int main(int argc, char **argv)
+{
+  long lSize = (long) ((argc > 1) ? atoi(argv[1]) : BENCH_DEFAULT_MB) * BENCH_MB;
+
+  signal(SIGPIPE, SIG_IGN);
+  if (Bench_makeFile(BENCH_FILE, lSize) == -1)
+    exit(EXIT_FAILURE);
+
+  Bench_copy("file to socket, loop", TRUE, FALSE, lSize);
+  Bench_copy("file to socket, io_uring", TRUE, TRUE, lSize);
+  Bench_copy("socket to file, loop", FALSE, FALSE, lSize);
+  Bench_copy("socket to file, io_uring", FALSE, TRUE, lSize);
+
+  unlink(BENCH_FILE);
+  unlink(BENCH_OUT);
+  exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,532 @@
+/*--------------------------------------------------------------------*/
+/* build.c                                                            */
+/* Parallel compilation of several source files into one program      */
+/*--------------------------------------------------------------------*/
+
+#include "build.h"
+#include <sched.h>
+#include <sys/resource.h>
+#include <time.h>
+
+/*--------------------------------------------------------------------*/
+
+enum BuildState {BUILD_WAITING, BUILD_RUNNING, BUILD_DONE, BUILD_SKIPPED};
+/* Where a unit is in the build. */
+
+enum {BUILD_ARGV_INLINE = 32};
+/* Words of the compiler or linker command kept on the stack. */
+
+struct BuildUnit
+
+/* A source file compiled to an object file. */
+
+{
+   char *pcSource;
+   /* Name of the source file. */
+
+   char *pcObject;
+   /* Name of the object file. */
+
+   enum BuildState eState;
+   /* Where the unit is in the build. */
+
+   pid_t iPid;
+   /* Compiler of the unit while it runs. */
+
+   int iOutFD;
+   /* Anonymous file collecting what the compiler prints. */
+
+   int iStatus;
+   /* Exit status of the compiler. */
+
+   struct timespec sStart;
+   /* When the compiler was started. */
+
+   double dWall;
+   /* Seconds the compiler ran. */
+
+   double dCpu;
+   /* Seconds of CPU time the compiler and its children used. */
+};
+
+static const char *apcSourceExts[] =
+   {".c", ".cc", ".cp", ".cpp", ".cxx", ".c++", ".C", ".S", NULL};
+/* Extensions of the files that are compiled; the others are linked as
+   they are. */
+
+/*--------------------------------------------------------------------*/
+
+static int Build_isSource(const char *pcFile)
+
+/* Return 1 (TRUE) if pcFile is compiled, 0 (FALSE) if it is linked as
+   it is. */
+
+{
+   const char *pcExt = strrchr(pcFile, '.');
+   int i;
+
+   if ((pcExt == NULL) || (strchr(pcExt, '/') != NULL))
+      return FALSE;
+   for (i = 0; apcSourceExts[i] != NULL; i++)
+      if (strcmp(pcExt, apcSourceExts[i]) == 0)
+         return TRUE;
+   return FALSE;
+}
+
+/*--------------------------------------------------------------------*/
+
+static double Build_since(const struct timespec *psStart)
+
+/* Return the seconds elapsed since *psStart. */
+
+{
+   struct timespec sNow;
+
+   clock_gettime(CLOCK_MONOTONIC, &sNow);
+   return (double)(sNow.tv_sec - psStart->tv_sec) +
+          (double)(sNow.tv_nsec - psStart->tv_nsec) / 1e9;
+}
+
+/*--------------------------------------------------------------------*/
+
+static int Build_addWords(DynArray_T oArgv, const char *pcWords)
+
+/* Add the words of pcWords, separated by white space, to oArgv. pcWords
+   may be NULL. Return 1 (TRUE) if successful, 0 (FALSE) if
+   insufficient memory is available. The words are never freed: the
+   build process exits when it is done. */
+
+{
+   char *pcCopy;
+   char *pcSave = NULL;
+   char *pcWord;
+
+   if (pcWords == NULL)
+      return TRUE;
+   if ((pcCopy = strdup(pcWords)) == NULL)
+      return FALSE;
+   for (pcWord = strtok_r(pcCopy, " \t\n", &pcSave); pcWord != NULL;
+        pcWord = strtok_r(NULL, " \t\n", &pcSave))
+      if (! DynArray_add(oArgv, pcWord))
+         return FALSE;
+   return TRUE;
+}
+
+/*--------------------------------------------------------------------*/
+
+static pid_t Build_exec(DynArray_T oArgv, int iOutFD)
+
+/* Run the command whose words are in oArgv with its stdout and stderr
+   going to iOutFD, or to ours if iOutFD is -1. Return its pid, or
+   FAILURE if it could not be started. */
+
+{
+   char **ppcArgv;
+   pid_t iPid;
+
+   ppcArgv = (char**)calloc((size_t)DynArray_getLength(oArgv) + 1,
+                            sizeof(char*));
+   if (ppcArgv == NULL)
+      return FAILURE;
+   DynArray_toArray(oArgv, (void**)ppcArgv);
+
+   fflush(NULL);
+   if ((iPid = fork()) == -1)
+   {
+      free(ppcArgv);
+      return FAILURE;
+   }
+   if (iPid == 0)
+   {
+      if (iOutFD != -1)
+      {
+         dup2(iOutFD, 1);
+         dup2(iOutFD, 2);
+      }
+      execvp(ppcArgv[0], ppcArgv);
+      fprintf(stderr, "%s: %s\n", ppcArgv[0], strerror(errno));
+      _exit(EXIT_FAILURE);
+   }
+   free(ppcArgv);
+   return iPid;
+}
+
+/*--------------------------------------------------------------------*/
+
+static int Build_countJobs(int iUnits)
+
+/* Return how many of iUnits compilers to run at once: one per core
+   this process may use that the load average says is idle, and at
+   least one. */
+
+{
+   cpu_set_t sCpus;
+   double dLoad = 0.0;
+   int iCores;
+   int iJobs;
+
+   if (sched_getaffinity(0, sizeof(sCpus), &sCpus) == 0)
+      iCores = CPU_COUNT(&sCpus);
+   else
+      iCores = (int)sysconf(_SC_NPROCESSORS_ONLN);
+   if (getloadavg(&dLoad, 1) != 1)
+      dLoad = 0.0;
+
+   iJobs = iCores - (int)dLoad;
+   if (iJobs < 1)
+      iJobs = 1;
+   return (iJobs < iUnits) ? iJobs : iUnits;
+}
+
+/*--------------------------------------------------------------------*/
+
+static int Build_start(struct BuildUnit *psUnit, DynArray_T oCompiler)
+
+/* Start compiling *psUnit with compiler command oCompiler. Return
+   SUCCESS or FAILURE. */
+
+{
+   const void *apvUnit[] = {"-c", psUnit->pcSource, "-o", psUnit->pcObject};
+   int iLength = DynArray_getLength(oCompiler);
+   int iRet;
+
+   if ((psUnit->iOutFD = Common_createScratch(BUILD_NAME)) == -1)
+      return FAILURE;
+   iRet = DynArray_addAll(oCompiler, apvUnit,
+                          (int)(sizeof(apvUnit) / sizeof(apvUnit[0])));
+   clock_gettime(CLOCK_MONOTONIC, &psUnit->sStart);
+   if (iRet)
+      psUnit->iPid = Build_exec(oCompiler, psUnit->iOutFD);
+   DynArray_shrink(oCompiler, iLength);
+   if ((! iRet) || (psUnit->iPid == FAILURE))
+      return FAILURE;
+   psUnit->eState = BUILD_RUNNING;
+   return SUCCESS;
+}
+
+/*--------------------------------------------------------------------*/
+
+static void Build_print(struct BuildUnit *psUnit)
+
+/* Pass on what the compiler of *psUnit printed and close its file. */
+
+{
+   struct stat sStat;
+
+   if (psUnit->iOutFD == -1)
+      return;
+   fflush(stdout);
+   lseek(psUnit->iOutFD, 0, SEEK_SET); /* the compiler moved the offset */
+   if (fstat(psUnit->iOutFD, &sStat) == 0)
+      Common_transfer(1, psUnit->iOutFD, (size_t)sStat.st_size);
+   close(psUnit->iOutFD);
+   psUnit->iOutFD = -1;
+}
+
+/*--------------------------------------------------------------------*/
+
+static int Build_compile(struct BuildUnit *psUnits, int iUnits, int iJobs,
+                         DynArray_T oCompiler)
+
+/* Compile the iUnits units of psUnits with command oCompiler, iJobs at
+   a time, printing what each compiler printed in the order of the
+   units. Return 1 (TRUE) if all of them compiled, 0 (FALSE)
+   otherwise. */
+
+{
+   struct rusage sUsage;
+   int iNext = 0;
+   int iPrinted = 0;
+   int iRunning = 0;
+   int iFailed = FALSE;
+   int iWaitStatus;
+   pid_t iPid;
+   int i;
+
+   while (iPrinted < iUnits)
+   {
+      /* Keep iJobs compilers busy until something fails. */
+      for (; (! iFailed) && (iRunning < iJobs) && (iNext < iUnits); iNext++)
+      {
+         if (Build_start(&psUnits[iNext], oCompiler) == FAILURE)
+         {
+            fprintf(stderr, "%s: %s: cannot start compiler: %s\n",
+                    BUILD_NAME, psUnits[iNext].pcSource, strerror(errno));
+            psUnits[iNext].eState = BUILD_DONE;
+            psUnits[iNext].iStatus = EXIT_FAILURE;
+            iFailed = TRUE;
+            break;
+         }
+         iRunning++;
+      }
+      for (i = iNext; iFailed && (i < iUnits); i++)
+         if (psUnits[i].eState == BUILD_WAITING)
+            psUnits[i].eState = BUILD_SKIPPED;
+
+      /* Wait for any compiler, then print whatever is next in line. */
+      if (iRunning > 0)
+      {
+         iPid = wait4(-1, &iWaitStatus, 0, &sUsage);
+         if ((iPid == -1) && (errno == EINTR))
+            continue;
+         for (i = 0; (iPid > 0) && (i < iUnits); i++)
+            if ((psUnits[i].eState == BUILD_RUNNING) &&
+                (psUnits[i].iPid == iPid))
+               break;
+         if ((iPid <= 0) || (i == iUnits))
+            continue;
+
+         psUnits[i].eState = BUILD_DONE;
+         psUnits[i].dWall = Build_since(&psUnits[i].sStart);
+         psUnits[i].dCpu =
+            (double)(sUsage.ru_utime.tv_sec + sUsage.ru_stime.tv_sec) +
+            (double)(sUsage.ru_utime.tv_usec + sUsage.ru_stime.tv_usec) / 1e6;
+         psUnits[i].iStatus = WIFEXITED(iWaitStatus) ?
+            WEXITSTATUS(iWaitStatus) : 128 + WTERMSIG(iWaitStatus);
+         if (psUnits[i].iStatus != 0)
+            iFailed = TRUE;
+         iRunning--;
+      }
+      while ((iPrinted < iUnits) &&
+             (psUnits[iPrinted].eState >= BUILD_DONE))
+         Build_print(&psUnits[iPrinted++]);
+   }
+   fflush(NULL);
+   return ! iFailed;
+}
+
+/*--------------------------------------------------------------------*/
+
+static void Build_report(struct BuildUnit *psUnits, int iUnits, int iJobs,
+                         double dWall, double dLink)
+
+/* Print the time each of the iUnits units of psUnits took to compile
+   with iJobs at a time, the wall clock time dWall of the compile
+   phase, and the time dLink linking took, or -1 if there was no
+   linking. */
+
+{
+   double dCpu = 0.0;
+   int iLongest = -1;
+   int i;
+
+   for (i = 0; i < iUnits; i++)
+   {
+      if (psUnits[i].eState == BUILD_SKIPPED)
+      {
+         printf("%s: %-24s skipped\n", BUILD_NAME, psUnits[i].pcSource);
+         continue;
+      }
+      printf("%s: %-24s %7.2fs wall %7.2fs cpu", BUILD_NAME,
+             psUnits[i].pcSource, psUnits[i].dWall, psUnits[i].dCpu);
+      if (psUnits[i].iStatus != 0)
+         printf("  (exit %d)", psUnits[i].iStatus);
+      printf("\n");
+      dCpu += psUnits[i].dCpu;
+      if ((iLongest == -1) || (psUnits[i].dWall > psUnits[iLongest].dWall))
+         iLongest = i;
+   }
+
+   /* The slowest unit bounds the build however many cores there are. */
+   printf("%s: %d sources, %d jobs, %.2fs wall, %.2fs cpu", BUILD_NAME,
+          iUnits, iJobs, dWall, dCpu);
+   if (dLink >= 0.0)
+      printf(", link %.2fs", dLink);
+   printf("\n");
+   if (iLongest != -1)
+      printf("%s: critical path %s %.2fs%s\n", BUILD_NAME,
+             psUnits[iLongest].pcSource, psUnits[iLongest].dWall,
+             (dLink >= 0.0) ? " + link" : "");
+}
+
+/*--------------------------------------------------------------------*/
+
+static char *Build_objectName(const char *pcSource)
+
+/* Return the name of the object file of source file pcSource, or NULL
+   if insufficient memory is available. */
+
+{
+   const char *pcExt = strrchr(pcSource, '.');
+   char *pcObject;
+
+   pcObject = (char*)malloc((size_t)(pcExt - pcSource) + 3);
+   if (pcObject == NULL)
+      return NULL;
+   sprintf(pcObject, "%.*s.o", (int)(pcExt - pcSource), pcSource);
+   return pcObject;
+}
+
+/*--------------------------------------------------------------------*/
+
+static int Build_run(SynCmd *psCmd)
+
+/* Carry out build command psCmd. Return the exit status of the
+   build. */
+
+{
+   void *apvCompiler[DYNARRAY_WORDS(BUILD_ARGV_INLINE)];
+   void *apvLinker[DYNARRAY_WORDS(BUILD_ARGV_INLINE)];
+   struct BuildUnit *psUnits;
+   struct timespec sStart;
+   DynArray_T oCompiler, oLinker;
+   char *pcOutput = "a.out";
+   char *pcWord;
+   int iCompileOnly = FALSE;
+   int iJobs = 0;
+   int iUnits = 0;
+   int iFiles = 0;
+   int iRet = TRUE;
+   double dWall, dLink = -1.0;
+   int iWaitStatus = 0;
+   pid_t iPid;
+   int i;
+
+   psUnits = (struct BuildUnit*)calloc((size_t)psCmd->iArgc,
+                                       sizeof(struct BuildUnit));
+   oCompiler = DynArray_init(apvCompiler,
+                             DYNARRAY_WORDS(BUILD_ARGV_INLINE), 0);
+   oLinker = DynArray_init(apvLinker, DYNARRAY_WORDS(BUILD_ARGV_INLINE), 0);
+   if ((psUnits == NULL) || (oCompiler == NULL) || (oLinker == NULL) ||
+       (! Build_addWords(oCompiler, getenv("CC") ? getenv("CC") : "cc")) ||
+       (! Build_addWords(oCompiler, getenv("CFLAGS"))) ||
+       (! Build_addWords(oLinker, getenv("CC") ? getenv("CC") : "cc")))
+   {
+      fprintf(stderr, "%s: cannot allocate memory\n", BUILD_NAME);
+      return EXIT_FAILURE;
+   }
+
+   /* Options, then sources to compile and files to link. */
+   for (i = 1; i < psCmd->iArgc; i++)
+   {
+      pcWord = psCmd->ppcArgv[i];
+      if ((strcmp(pcWord, "-j") == 0) || (strcmp(pcWord, "-o") == 0))
+      {
+         if (i + 1 == psCmd->iArgc)
+         {
+            iRet = FALSE;
+            break;
+         }
+         i++;
+         if (pcWord[1] == 'o')
+            pcOutput = psCmd->ppcArgv[i];
+         else if ((iJobs = atoi(psCmd->ppcArgv[i])) <= 0)
+            iRet = FALSE;
+      }
+      else if (strcmp(pcWord, "-c") == 0)
+         iCompileOnly = TRUE;
+      else if (pcWord[0] == '-')
+         iRet = FALSE;
+      else if (Build_isSource(pcWord))
+      {
+         psUnits[iUnits].pcSource = pcWord;
+         psUnits[iUnits].iOutFD = -1;
+         if (((psUnits[iUnits].pcObject = Build_objectName(pcWord)) == NULL) ||
+             (! DynArray_add(oLinker, psUnits[iUnits].pcObject)))
+         {
+            fprintf(stderr, "%s: cannot allocate memory\n", BUILD_NAME);
+            return EXIT_FAILURE;
+         }
+         iUnits++;
+         iFiles++;
+      }
+      else if (DynArray_add(oLinker, pcWord))
+         iFiles++;
+      else
+      {
+         fprintf(stderr, "%s: cannot allocate memory\n", BUILD_NAME);
+         return EXIT_FAILURE;
+      }
+   }
+   if ((! iRet) || (iFiles == 0))
+   {
+      fprintf(stderr, "usage: %s [-j jobs] [-c] [-o program] file...\n",
+              BUILD_NAME);
+      return EXIT_FAILURE;
+   }
+   if ((iJobs == 0) || (iJobs > BUILD_MAX_JOBS))
+      iJobs = Build_countJobs(iUnits);
+   if (iJobs > iUnits)
+      iJobs = (iUnits > 0) ? iUnits : 1;
+
+   /* Compile. */
+   clock_gettime(CLOCK_MONOTONIC, &sStart);
+   iRet = Build_compile(psUnits, iUnits, iJobs, oCompiler);
+   dWall = Build_since(&sStart);
+
+   /* Link, printing straight to our output: nothing else is. */
+   if (iRet && (! iCompileOnly))
+   {
+      clock_gettime(CLOCK_MONOTONIC, &sStart);
+      iRet = Build_addWords(oLinker, getenv("LDFLAGS")) &&
+             DynArray_add(oLinker, "-o") && DynArray_add(oLinker, pcOutput);
+      if (iRet && ((iPid = Build_exec(oLinker, -1)) != FAILURE))
+      {
+         while ((waitpid(iPid, &iWaitStatus, 0) == -1) && (errno == EINTR))
+            ;
+         iRet = WIFEXITED(iWaitStatus) && (WEXITSTATUS(iWaitStatus) == 0);
+      }
+      else
+      {
+         fprintf(stderr, "%s: cannot start linker\n", BUILD_NAME);
+         iRet = FALSE;
+      }
+      dLink = Build_since(&sStart);
+   }
+
+   Build_report(psUnits, iUnits, iJobs, dWall, dLink);
+   DynArray_free(oCompiler);
+   DynArray_free(oLinker);
+   return iRet ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/*--------------------------------------------------------------------*/
+
+int Build_isBuild(const SynCmd *psCmd)
+
+/* Return 1 (TRUE) if psCmd is a build command, 0 (FALSE) otherwise. */
+
+{
+   assert(psCmd != NULL);
+
+   return (psCmd->eVerb == VERB_BUILD) && (psCmd->psNext == NULL);
+}
+
+/*--------------------------------------------------------------------*/
+
+pid_t Build_spawn(SynCmd *psCmd, char **ppcEnv, char *pcProgName)
+
+/* Run build command psCmd in a child process, with environment ppcEnv
+   if it is not NULL, and return its pid without waiting for it, or
+   FAILURE if it could not be started. */
+
+{
+   extern char **environ;
+   pid_t iPid;
+
+   assert(psCmd != NULL);
+   assert(pcProgName != NULL);
+
+   fflush(NULL);
+   if ((iPid = fork()) == -1)
+   {
+      perror(pcProgName);
+      return FAILURE;
+   }
+   if (iPid == 0)
+   {
+      /* Undo what an event-driven parent may have set up. */
+      signal(SIGPIPE, SIG_DFL);
+      Common_checkSigUnblock(SIGCHLD);
+      if (ppcEnv != NULL)
+         environ = ppcEnv;
+      if ((! Common_redirectStdin(psCmd, pcProgName)) ||
+          (! Common_redirectStdout(psCmd, pcProgName)) ||
+          (! Common_redirectStderr(psCmd, pcProgName)))
+         exit(EXIT_FAILURE);
+      exit(Build_run(psCmd));
+   }
+   return iPid;
+}
+
+/*--------------------------------------------------------------------*/
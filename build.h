@@ -0,0 +1,40 @@
+/*--------------------------------------------------------------------*/
+/* build.h                                                            */
+/* Parallel compilation of several source files into one program      */
+/*--------------------------------------------------------------------*/
+
+#ifndef BUILD_INCLUDED
+#define BUILD_INCLUDED
+
+#include "common.h"
+
+/*--------------------------------------------------------------------*/
+
+/* The build command
+
+      build [-j jobs] [-c] [-o program] file...
+
+   compiles every C or C++ source among the files to an object file next
+   to it with "$CC $CFLAGS -c", running as many compilers at a time as
+   the machine has idle cores (or jobs), and then links the objects and
+   any other files into program (a.out by default) with
+   "$CC objects $LDFLAGS -o program", unless -c is given. What each
+   compiler prints is passed on in the order of the files, as soon as
+   the compilers of the files before it are done, followed by the time
+   each file took. No file is started once one has failed. */
+
+#define BUILD_NAME CMDNAME_BUILD
+#define BUILD_MAX_JOBS 256 /* most compilers run at once */
+
+/*--------------------------------------------------------------------*/
+
+int Build_isBuild(const SynCmd *psCmd);
+/* Return 1 (TRUE) if psCmd is a build command, 0 (FALSE) otherwise. */
+
+pid_t Build_spawn(SynCmd *psCmd, char **ppcEnv, char *pcProgName);
+/* Run build command psCmd in a child process, with environment ppcEnv
+   if it is not NULL, and return its pid without waiting for it, or
+   FAILURE if it could not be started. The child exits with status 0
+   if every step succeeded. */
+
+#endif
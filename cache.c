@@ -0,0 +1,1006 @@
+/*--------------------------------------------------------------------*/
+/* cache.c                                                            */
+/* Content-addressed cache of compiler outputs for the server         */
+/*--------------------------------------------------------------------*/
+
+#include "cache.h"
+#include "sha256.h"
+#include <dirent.h>
+#include <limits.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+
+extern char **environ;
+
+/*--------------------------------------------------------------------*/
+
+enum CacheArg {CACHE_ARG_FLAG, CACHE_ARG_VALUE, CACHE_ARG_OUTPUT,
+               CACHE_ARG_SOURCE, CACHE_ARG_INPUT};
+/* What a word of a compiler command line is. */
+
+enum {CACHE_HITS, CACHE_MISSES, CACHE_STORES, CACHE_EVICTIONS,
+      CACHE_STATS};
+/* Counters kept in the stats file. */
+
+enum {CACHE_REPORT_HIT = 'h', CACHE_REPORT_MISS = 'm'};
+/* What the child of a job found in the cache, after the key. */
+
+struct CacheJob
+
+/* A compilation the cache can handle, which is looked up by the
+   child that runs it. */
+
+{
+   char acKey[SHA256_HEX_SIZE];
+   /* Key the output is stored under, once the child has reported
+      it. */
+
+   int *piKinds;
+   /* What each word of the command line is. */
+
+   char *pcOutput;
+   /* Absolute path of the output file. */
+
+   int iReportFD;
+   /* Read end of the pipe the child reports its key and whether it
+      hit through, or -1 before the job is started. */
+
+   char *pcDiag;
+   /* What the compiler printed so far. */
+
+   size_t iDiagLength;
+   /* Number of bytes in pcDiag. */
+
+   int iOverflow;
+   /* The compiler printed more than CACHE_MAX_DIAGNOSTICS bytes. */
+};
+
+struct CacheEntry
+
+/* An entry found when scanning the cache. */
+
+{
+   char acName[SHA256_HEX_SIZE];
+   /* Key of the entry. */
+
+   struct timespec sUsed;
+   /* When the entry was last stored or hit. */
+
+   long long llSize;
+   /* Bytes the entry takes, diagnostics included. */
+};
+
+static char *pcCacheDir = NULL;
+/* Absolute path of the cache directory, or NULL if the cache is
+   off. */
+
+static long long llCacheBudget = 0;
+/* Bytes the entries may take. */
+
+static long lTmpCount = 0;
+/* Number of temporary files made, to keep their names unique. */
+
+static const char *apcCompilers[] =
+   {"cc", "c++", "gcc", "g++", "clang", "clang++", NULL};
+/* Programs whose invocations are cached, also with a "-version"
+   suffix. */
+
+static const char *apcValueOptions[] =
+   {"-o", "-I", "-D", "-U", "-include", "-imacros", "-isystem",
+    "-iquote", "-idirafter", "-l", "-Xlinker", "-Xpreprocessor",
+    "-Xassembler", "-T", "-u", NULL};
+/* Options whose value is the next word. */
+
+static const char *apcUncacheable[] =
+   {"-M", "-E", "-x", "-L", "-B", "-save-temps", "-fprofile",
+    "--coverage", "-specs", "-wrapper", "-fplugin", NULL};
+/* Prefixes of options that write extra files, read inputs the key
+   does not cover, or change how inputs are recognized. */
+
+static const char *apcSourceExts[] =
+   {".c", ".cc", ".cp", ".cpp", ".cxx", ".c++", ".C", ".S", NULL};
+/* Extensions of inputs that go through the preprocessor. */
+
+/*--------------------------------------------------------------------*/
+
+static int Cache_inList(const char *pcWord, const char **ppcList,
+                        int iPrefix)
+
+/* Return 1 (TRUE) if pcWord is one of the words in NULL-terminated
+   ppcList, or starts with one if iPrefix is TRUE, 0 (FALSE)
+   otherwise. */
+
+{
+   int i;
+
+   for (i = 0; ppcList[i] != NULL; i++)
+   {
+      if (iPrefix && (strncmp(pcWord, ppcList[i], strlen(ppcList[i])) == 0))
+         return TRUE;
+      if (strcmp(pcWord, ppcList[i]) == 0)
+         return TRUE;
+   }
+   return FALSE;
+}
+
+/*--------------------------------------------------------------------*/
+
+static int Cache_isCompiler(const char *pcPath)
+
+/* Return 1 (TRUE) if program pcPath is a compiler the cache knows,
+   0 (FALSE) otherwise. */
+
+{
+   const char *pcName = strrchr(pcPath, '/');
+   size_t iLength;
+   int i;
+
+   pcName = (pcName == NULL) ? pcPath : pcName + 1;
+   for (i = 0; apcCompilers[i] != NULL; i++)
+   {
+      iLength = strlen(apcCompilers[i]);
+      if ((strncmp(pcName, apcCompilers[i], iLength) == 0) &&
+          ((pcName[iLength] == '\0') || (pcName[iLength] == '-')))
+         return TRUE;
+   }
+   return FALSE;
+}
+
+/*--------------------------------------------------------------------*/
+
+static int Cache_isSource(const char *pcPath)
+
+/* Return 1 (TRUE) if input pcPath is preprocessed, 0 (FALSE)
+   otherwise. */
+
+{
+   const char *pcExt = strrchr(pcPath, '.');
+
+   return (pcExt != NULL) && Cache_inList(pcExt, apcSourceExts, FALSE);
+}
+
+/*--------------------------------------------------------------------*/
+
+static int Cache_classify(char **ppcArgv, int iArgc, int *piKinds,
+                          char **ppcOutput)
+
+/* Set piKinds[i] to the kind of word ppcArgv[i] for i from 1 to
+   iArgc - 1, and *ppcOutput to the output file. Return 1 (TRUE) if
+   the command line is one the cache can handle, 0 (FALSE) otherwise. */
+
+{
+   int iInputs = 0;
+   int iCompileOnly = FALSE;
+   int i;
+
+   *ppcOutput = NULL;
+   for (i = 1; i < iArgc; i++)
+   {
+      piKinds[i] = CACHE_ARG_FLAG;
+
+      /* The value of the previous option. */
+      if ((i > 1) && (piKinds[i - 1] == CACHE_ARG_FLAG) &&
+          Cache_inList(ppcArgv[i - 1], apcValueOptions, FALSE))
+      {
+         piKinds[i] = CACHE_ARG_VALUE;
+         if (strcmp(ppcArgv[i - 1], "-o") == 0)
+         {
+            piKinds[i - 1] = piKinds[i] = CACHE_ARG_OUTPUT;
+            *ppcOutput = ppcArgv[i];
+         }
+         continue;
+      }
+
+      if ((ppcArgv[i][0] == '@') || (strcmp(ppcArgv[i], "-") == 0) ||
+          Cache_inList(ppcArgv[i], apcUncacheable, TRUE))
+         return FALSE;
+      if (strncmp(ppcArgv[i], "-o", 2) == 0)
+      {
+         if (ppcArgv[i][2] != '\0')
+         {
+            piKinds[i] = CACHE_ARG_OUTPUT;
+            *ppcOutput = ppcArgv[i] + 2;
+         }
+      }
+      else if (strcmp(ppcArgv[i], "-c") == 0)
+         iCompileOnly = TRUE;
+      else if (ppcArgv[i][0] != '-')
+      {
+         piKinds[i] = Cache_isSource(ppcArgv[i]) ? CACHE_ARG_SOURCE
+                                                 : CACHE_ARG_INPUT;
+         iInputs++;
+      }
+   }
+
+   /* A dangling option, no output named, or several outputs. */
+   if ((iArgc > 1) && (piKinds[iArgc - 1] == CACHE_ARG_FLAG) &&
+       Cache_inList(ppcArgv[iArgc - 1], apcValueOptions, FALSE))
+      return FALSE;
+   if ((*ppcOutput == NULL) || (iInputs == 0) ||
+       (iCompileOnly && (iInputs > 1)))
+      return FALSE;
+   return TRUE;
+}
+
+/*--------------------------------------------------------------------*/
+
+static int Cache_hashCompiler(Sha256 *psHash, const char *pcName,
+                              char **ppcEnv)
+
+/* Add the identity of compiler pcName, looked up in the PATH of
+   ppcEnv, to *psHash. Return 1 (TRUE) if successful, or 0 (FALSE) if
+   it cannot be found. */
+
+{
+   char acPath[PATH_MAX];
+   const char *pcDirs = "/usr/bin:/bin";
+   const char *pcEnd = NULL;
+   struct stat sStat;
+   long long allId[4];
+   int i;
+
+   /* Find the program like execvp does. */
+   if (strchr(pcName, '/') != NULL)
+      snprintf(acPath, sizeof(acPath), "%s", pcName);
+   else
+   {
+      for (i = 0; (ppcEnv != NULL) && (ppcEnv[i] != NULL); i++)
+         if (strncmp(ppcEnv[i], "PATH=", 5) == 0)
+            pcDirs = ppcEnv[i] + 5;
+      acPath[0] = '\0';
+      for (; *pcDirs != '\0'; pcDirs = (*pcEnd == ':') ? pcEnd + 1 : pcEnd)
+      {
+         pcEnd = strchr(pcDirs, ':');
+         if (pcEnd == NULL)
+            pcEnd = pcDirs + strlen(pcDirs);
+         snprintf(acPath, sizeof(acPath), "%.*s/%s",
+                  (int)(pcEnd - pcDirs), pcDirs, pcName);
+         if (access(acPath, X_OK) == 0)
+            break;
+         acPath[0] = '\0';
+      }
+   }
+   if ((acPath[0] == '\0') || (stat(acPath, &sStat) == -1))
+      return FALSE;
+
+   /* An upgraded compiler is a different file. */
+   allId[0] = (long long)sStat.st_dev;
+   allId[1] = (long long)sStat.st_ino;
+   allId[2] = (long long)sStat.st_size;
+   allId[3] = (long long)sStat.st_mtime;
+   Sha256_update(psHash, acPath, strlen(acPath) + 1);
+   Sha256_update(psHash, allId, sizeof(allId));
+   return TRUE;
+}
+
+/*--------------------------------------------------------------------*/
+
+static int Cache_hashRun(Sha256 *psHash, char **ppcArgv, char **ppcEnv)
+
+/* Run command ppcArgv with environment ppcEnv and add the digest of
+   what it writes to stdout to *psHash. Return 1 (TRUE) if it exited
+   with status 0, 0 (FALSE) otherwise. */
+
+{
+   unsigned char aucDigest[SHA256_SIZE];
+   char acBuf[MAX_BUFF];
+   Sha256 sOutput;
+   ssize_t iGot;
+   int aiPipe[2];
+   int iNull;
+   int iStatus = 0;
+   pid_t iPid;
+
+   if (pipe2(aiPipe, O_CLOEXEC) == -1)
+      return FALSE;
+   fflush(NULL);
+   if ((iPid = fork()) == -1)
+   {
+      close(aiPipe[0]);
+      close(aiPipe[1]);
+      return FALSE;
+   }
+
+   if (iPid == 0)
+   {
+      signal(SIGPIPE, SIG_DFL);
+      Common_checkSigUnblock(SIGCHLD);
+      iNull = open("/dev/null", O_RDWR);
+      dup2(iNull, 0);
+      dup2(aiPipe[1], 1);
+      dup2(iNull, 2); /* the real compile reports errors */
+      if (ppcEnv != NULL)
+         environ = ppcEnv;
+      execvp(ppcArgv[0], ppcArgv);
+      _exit(EXIT_FAILURE);
+   }
+
+   close(aiPipe[1]);
+   Sha256_init(&sOutput);
+   while (((iGot = read(aiPipe[0], acBuf, sizeof(acBuf))) > 0) ||
+          ((iGot == -1) && (errno == EINTR)))
+      if (iGot > 0)
+         Sha256_update(&sOutput, acBuf, (size_t)iGot);
+   close(aiPipe[0]);
+   while ((waitpid(iPid, &iStatus, 0) == -1) && (errno == EINTR))
+      ;
+
+   Sha256_final(&sOutput, aucDigest);
+   Sha256_update(psHash, aucDigest, sizeof(aucDigest));
+   return WIFEXITED(iStatus) && (WEXITSTATUS(iStatus) == 0);
+}
+
+/*--------------------------------------------------------------------*/
+
+static int Cache_hashFile(Sha256 *psHash, const char *pcPath)
+
+/* Add the digest of the contents of file pcPath to *psHash. Return
+   1 (TRUE) if successful, 0 (FALSE) otherwise. */
+
+{
+   unsigned char aucDigest[SHA256_SIZE];
+
+   if (Common_hashFile(pcPath, aucDigest, NULL) == FAILURE)
+      return FALSE;
+   Sha256_update(psHash, aucDigest, sizeof(aucDigest));
+   return TRUE;
+}
+
+/*--------------------------------------------------------------------*/
+
+static int Cache_makeKey(char **ppcArgv, int iArgc, int *piKinds,
+                         char **ppcEnv, char *pcKey)
+
+/* Compute the key of compiler command line ppcArgv, classified in
+   piKinds, as hex digits in pcKey. Return 1 (TRUE) if successful, 0
+   (FALSE) if some input cannot be read or preprocessed. */
+
+{
+   unsigned char aucDigest[SHA256_SIZE];
+   char **ppcCpp;
+   char *pcCwd;
+   Sha256 sHash;
+   int iCpp = 0;
+   int iRet = TRUE;
+   int i, j;
+
+   Sha256_init(&sHash);
+   Sha256_update(&sHash, "cloudide-cache 1", 17);
+   if (! Cache_hashCompiler(&sHash, ppcArgv[0], ppcEnv))
+      return FALSE;
+
+   /* The flags, with inputs as placeholders and without the output,
+      plus the directory if debug information records it. */
+   for (i = 1; i < iArgc; i++)
+   {
+      if ((piKinds[i] == CACHE_ARG_FLAG) || (piKinds[i] == CACHE_ARG_VALUE))
+         Sha256_update(&sHash, ppcArgv[i], strlen(ppcArgv[i]) + 1);
+      else if (piKinds[i] != CACHE_ARG_OUTPUT)
+         Sha256_update(&sHash, "", 1);
+      if ((piKinds[i] == CACHE_ARG_FLAG) &&
+          (strncmp(ppcArgv[i], "-g", 2) == 0) &&
+          ((pcCwd = getcwd(NULL, 0)) != NULL))
+      {
+         Sha256_update(&sHash, pcCwd, strlen(pcCwd) + 1);
+         free(pcCwd);
+      }
+   }
+
+   /* Sources as the preprocessor sees them: the same command line
+      with -E and one source, without output and other inputs. */
+   ppcCpp = (char**)calloc((size_t)iArgc + 2, sizeof(char*));
+   if (ppcCpp == NULL)
+      return FALSE;
+   ppcCpp[iCpp++] = ppcArgv[0];
+   for (i = 1; i < iArgc; i++)
+      if ((piKinds[i] == CACHE_ARG_FLAG) || (piKinds[i] == CACHE_ARG_VALUE))
+         ppcCpp[iCpp++] = ppcArgv[i];
+   ppcCpp[iCpp++] = "-E";
+
+   for (j = 1; iRet && (j < iArgc); j++)
+   {
+      if (piKinds[j] == CACHE_ARG_SOURCE)
+      {
+         ppcCpp[iCpp] = ppcArgv[j];
+         iRet = Cache_hashRun(&sHash, ppcCpp, ppcEnv);
+      }
+      else if (piKinds[j] == CACHE_ARG_INPUT)
+         iRet = Cache_hashFile(&sHash, ppcArgv[j]);
+   }
+   free(ppcCpp);
+   if (! iRet)
+      return FALSE;
+
+   Sha256_final(&sHash, aucDigest);
+   Sha256_toHex(aucDigest, pcKey);
+   return TRUE;
+}
+
+/*--------------------------------------------------------------------*/
+
+static int Cache_lockStats(long long *pllStats)
+
+/* Lock the cache against other sessions and servers and read its
+   counters into pllStats. Return the descriptor holding the lock, or
+   -1 on failure. */
+
+{
+   char acPath[PATH_MAX];
+
+   snprintf(acPath, sizeof(acPath), "%s/stats", pcCacheDir);
+   return Common_lockCounters(acPath, pllStats, CACHE_STATS);
+}
+
+/*--------------------------------------------------------------------*/
+
+static void Cache_count(int iCounter)
+
+/* Add one to counter iCounter. */
+
+{
+   long long allStats[CACHE_STATS];
+   int iFD;
+
+   if ((iFD = Cache_lockStats(allStats)) == -1)
+      return;
+   allStats[iCounter]++;
+   Common_unlockCounters(iFD, allStats, CACHE_STATS);
+}
+
+/*--------------------------------------------------------------------*/
+
+static int Cache_compareUsed(const void *pvEntry1, const void *pvEntry2)
+
+/* Order cache entries from least to most recently used. */
+
+{
+   const struct CacheEntry *psEntry1 = pvEntry1;
+   const struct CacheEntry *psEntry2 = pvEntry2;
+
+   if (psEntry1->sUsed.tv_sec != psEntry2->sUsed.tv_sec)
+      return (psEntry1->sUsed.tv_sec < psEntry2->sUsed.tv_sec) ? -1 : 1;
+   if (psEntry1->sUsed.tv_nsec != psEntry2->sUsed.tv_nsec)
+      return (psEntry1->sUsed.tv_nsec < psEntry2->sUsed.tv_nsec) ? -1 : 1;
+   return 0;
+}
+
+/*--------------------------------------------------------------------*/
+
+static void Cache_freeEntry(void *pvItem, void *pvExtra)
+
+/* Free cache entry pvItem. pvExtra is unused. */
+
+{
+   free(pvItem);
+}
+
+/*--------------------------------------------------------------------*/
+
+static DynArray_T Cache_scan(long long *pllTotal)
+
+/* Return the entries of the cache, and store the bytes they take in
+   *pllTotal, or return NULL if insufficient memory is available. The
+   caller must hold the lock. */
+
+{
+   char acPath[PATH_MAX];
+   struct CacheEntry *psEntry;
+   struct dirent *psDirent;
+   struct stat sStat;
+   DynArray_T oEntries;
+   DIR *psDir;
+
+   *pllTotal = 0;
+   if ((oEntries = DynArray_new(0)) == NULL)
+      return NULL;
+   snprintf(acPath, sizeof(acPath), "%s/o", pcCacheDir);
+   if ((psDir = opendir(acPath)) == NULL)
+      return oEntries;
+
+   while ((psDirent = readdir(psDir)) != NULL)
+   {
+      if (strlen(psDirent->d_name) != SHA256_HEX_SIZE - 1)
+         continue; /* diagnostics are counted with their entry */
+      snprintf(acPath, sizeof(acPath), "%s/o/%s", pcCacheDir,
+               psDirent->d_name);
+      if ((stat(acPath, &sStat) == -1) ||
+          ((psEntry = calloc(1, sizeof(struct CacheEntry))) == NULL))
+         continue;
+      strcpy(psEntry->acName, psDirent->d_name);
+      psEntry->sUsed = sStat.st_mtim;
+      psEntry->llSize = (long long)sStat.st_size;
+      strcat(acPath, ".err");
+      if (stat(acPath, &sStat) == 0)
+         psEntry->llSize += (long long)sStat.st_size;
+      if (! DynArray_add(oEntries, psEntry))
+      {
+         free(psEntry);
+         continue;
+      }
+      *pllTotal += psEntry->llSize;
+   }
+   closedir(psDir);
+   return oEntries;
+}
+
+/*--------------------------------------------------------------------*/
+
+static void Cache_evict(void)
+
+/* Remove least recently used entries until the cache fits its
+   budget. */
+
+{
+   char acPath[PATH_MAX];
+   long long allStats[CACHE_STATS];
+   struct CacheEntry *psEntry;
+   DynArray_T oEntries;
+   long long llTotal;
+   int iFD;
+   int i;
+
+   if ((iFD = Cache_lockStats(allStats)) == -1)
+      return;
+   if ((oEntries = Cache_scan(&llTotal)) == NULL)
+   {
+      Common_unlockCounters(iFD, allStats, CACHE_STATS);
+      return;
+   }
+
+   if (llTotal > llCacheBudget)
+   {
+      DynArray_sort(oEntries, Cache_compareUsed);
+      for (i = 0; (i < DynArray_getLength(oEntries)) &&
+                  (llTotal > llCacheBudget); i++)
+      {
+         psEntry = DynArray_get(oEntries, i);
+         snprintf(acPath, sizeof(acPath), "%s/o/%s", pcCacheDir,
+                  psEntry->acName);
+         unlink(acPath); /* hardlinked outputs stay where they are */
+         strcat(acPath, ".err");
+         unlink(acPath);
+         llTotal -= psEntry->llSize;
+         allStats[CACHE_EVICTIONS]++;
+      }
+   }
+
+   DynArray_map(oEntries, Cache_freeEntry, NULL);
+   DynArray_free(oEntries);
+   Common_unlockCounters(iFD, allStats, CACHE_STATS);
+}
+
+/*--------------------------------------------------------------------*/
+
+static int Cache_clone(int iDestFD, int iSrcFD)
+
+/* Make the file open at iDestFD a copy of the one open at iSrcFD, as a
+   reflink if possible. Return SUCCESS or FAILURE. */
+
+{
+   struct stat sStat;
+
+   if (ioctl(iDestFD, FICLONE, iSrcFD) == 0)
+      return SUCCESS;
+   if (fstat(iSrcFD, &sStat) == -1)
+      return FAILURE;
+   if (Common_transfer(iDestFD, iSrcFD, (size_t)sStat.st_size)
+       != (ssize_t)sStat.st_size)
+      return FAILURE;
+   return SUCCESS;
+}
+
+/*--------------------------------------------------------------------*/
+
+static int Cache_place(const char *pcEntry, const char *pcOutput)
+
+/* Put cache entry pcEntry in place as file pcOutput. Return SUCCESS
+   or FAILURE. */
+
+{
+   int iSrcFD, iDestFD;
+   int iRet = FAILURE;
+
+   if ((iSrcFD = open(pcEntry, O_RDONLY | O_CLOEXEC)) == -1)
+      return FAILURE;
+   unlink(pcOutput);
+
+   /* A reflink shares the blocks but not the inode; a hardlink shares
+      both, so the entry is read-only. */
+   iDestFD = open(pcOutput, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0777);
+   if ((iDestFD != -1) && (ioctl(iDestFD, FICLONE, iSrcFD) == 0))
+      iRet = SUCCESS;
+   else
+   {
+      if (iDestFD != -1)
+      {
+         close(iDestFD);
+         unlink(pcOutput);
+      }
+      if (link(pcEntry, pcOutput) == 0)
+      {
+         close(iSrcFD);
+         return SUCCESS;
+      }
+      iDestFD = open(pcOutput, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC,
+                     0777);
+      if (iDestFD != -1)
+         iRet = Cache_clone(iDestFD, iSrcFD);
+   }
+
+   close(iSrcFD);
+   if (iDestFD != -1)
+      close(iDestFD);
+   if ((iRet == FAILURE) && (iDestFD != -1))
+      unlink(pcOutput);
+   return iRet;
+}
+
+/*--------------------------------------------------------------------*/
+
+static void Cache_store(CacheJob_T oJob)
+
+/* Store the output and diagnostics of successful job oJob. */
+
+{
+   char acTmp[PATH_MAX], acTmpErr[PATH_MAX], acEntry[PATH_MAX];
+   int iSrcFD, iDestFD, iErrFD;
+   int iRet = FAILURE;
+
+   snprintf(acTmp, sizeof(acTmp), "%s/tmp/%s.%ld.%ld", pcCacheDir,
+            oJob->acKey, (long)getpid(), lTmpCount);
+   snprintf(acTmpErr, sizeof(acTmpErr), "%s/tmp/%s.%ld.%ld.err",
+            pcCacheDir, oJob->acKey, (long)getpid(), lTmpCount++);
+   snprintf(acEntry, sizeof(acEntry), "%s/o/%s", pcCacheDir, oJob->acKey);
+
+   if ((iSrcFD = open(oJob->pcOutput, O_RDONLY | O_CLOEXEC)) == -1)
+      return;
+   iDestFD = open(acTmp, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0555);
+   if (iDestFD != -1)
+   {
+      iRet = Cache_clone(iDestFD, iSrcFD);
+      close(iDestFD);
+   }
+   close(iSrcFD);
+
+   /* Diagnostics first: an entry that is visible is complete. */
+   if (iRet == SUCCESS)
+   {
+      iRet = FAILURE;
+      iErrFD = open(acTmpErr, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC,
+                    0444);
+      if ((iErrFD != -1) &&
+          (Common_writen(iErrFD, oJob->pcDiag, oJob->iDiagLength)
+           != FAILURE))
+      {
+         strcat(acEntry, ".err");
+         if (rename(acTmpErr, acEntry) == 0)
+         {
+            acEntry[strlen(acEntry) - 4] = '\0';
+            if (rename(acTmp, acEntry) == 0)
+               iRet = SUCCESS;
+         }
+      }
+      if (iErrFD != -1)
+         close(iErrFD);
+   }
+
+   if (iRet == FAILURE)
+   {
+      unlink(acTmp);
+      unlink(acTmpErr);
+      return;
+   }
+   Cache_count(CACHE_STORES);
+   Cache_evict();
+}
+
+/*--------------------------------------------------------------------*/
+
+int Cache_open(const char *pcDir, long long llBudget)
+
+/* Keep the cache in directory pcDir, created if needed, and let it
+   grow to llBudget bytes. Return SUCCESS or FAILURE. */
+
+{
+   char acPath[PATH_MAX];
+   struct stat sStat;
+
+   assert(pcDir != NULL);
+
+   /* Only a private directory: anyone able to plant entries could
+      make our users run their binaries. */
+   if (((mkdir(pcDir, 0700) == -1) && (errno != EEXIST)) ||
+       (stat(pcDir, &sStat) == -1))
+      return FAILURE;
+   if ((! S_ISDIR(sStat.st_mode)) || (sStat.st_uid != geteuid()) ||
+       ((sStat.st_mode & 077) != 0))
+   {
+      errno = EPERM;
+      return FAILURE;
+   }
+
+   snprintf(acPath, sizeof(acPath), "%s/o", pcDir);
+   if ((mkdir(acPath, 0700) == -1) && (errno != EEXIST))
+      return FAILURE;
+   snprintf(acPath, sizeof(acPath), "%s/tmp", pcDir);
+   if ((mkdir(acPath, 0700) == -1) && (errno != EEXIST))
+      return FAILURE;
+
+   /* Sessions change directory, so the path must be absolute. */
+   free(pcCacheDir);
+   if ((pcCacheDir = realpath(pcDir, NULL)) == NULL)
+      return FAILURE;
+   llCacheBudget = llBudget;
+   return SUCCESS;
+}
+
+/*--------------------------------------------------------------------*/
+
+CacheJob_T Cache_begin(SynCmd *psCmd)
+
+/* Return a job for compiler invocation psCmd if the cache can handle
+   it, or NULL otherwise. */
+
+{
+   char *pcOutput = NULL;
+   char *pcCwd = NULL;
+   CacheJob_T oJob = NULL;
+
+   assert(psCmd != NULL);
+
+   if (pcCacheDir == NULL)
+      return NULL;
+
+   /* The words of the command; redirected or piped output is not
+      cached. */
+   if ((psCmd->pcStdin != NULL) || (psCmd->pcStdout != NULL) ||
+       (psCmd->pcStderr != NULL) || (psCmd->psNext != NULL) ||
+       psCmd->iBackground || (psCmd->iArgc == 0) ||
+       (! Cache_isCompiler(psCmd->ppcArgv[0])))
+      return NULL;
+   if ((oJob = (CacheJob_T)calloc(1, sizeof(struct CacheJob))) == NULL)
+      return NULL;
+   oJob->iReportFD = -1;
+   oJob->piKinds = (int*)calloc((size_t)psCmd->iArgc + 1, sizeof(int));
+   if ((oJob->piKinds == NULL) ||
+       (! Cache_classify(psCmd->ppcArgv, psCmd->iArgc, oJob->piKinds,
+                         &pcOutput)))
+   {
+      Cache_end(oJob, -1);
+      return NULL;
+   }
+
+   /* Remember where the output will be. */
+   if (pcOutput[0] == '/')
+      oJob->pcOutput = strdup(pcOutput);
+   else if ((pcCwd = getcwd(NULL, 0)) != NULL)
+   {
+      oJob->pcOutput = (char*)malloc(strlen(pcCwd) + strlen(pcOutput) + 2);
+      if (oJob->pcOutput != NULL)
+         sprintf(oJob->pcOutput, "%s/%s", pcCwd, pcOutput);
+      free(pcCwd);
+   }
+   if (oJob->pcOutput == NULL)
+   {
+      Cache_end(oJob, -1);
+      return NULL;
+   }
+   return oJob;
+}
+
+/*--------------------------------------------------------------------*/
+
+static void Cache_lookup(CacheJob_T oJob, SynCmd *psCmd, char **ppcEnv,
+                         int iReportFD)
+
+/* Look up psCmd, the command of oJob, in the child that runs it,
+   running the preprocessor with environment ppcEnv. On a hit, put the
+   cached output in place, print what the compiler printed when it was
+   built and exit with status 0. Otherwise return, and let the command
+   run. Either way write the key and whether it hit to iReportFD,
+   unless some input cannot be read or preprocessed. */
+
+{
+   char acEntry[PATH_MAX];
+   char acReport[SHA256_HEX_SIZE + 1];
+   struct stat sStat;
+   int iErrFD;
+
+   if (! Cache_makeKey(psCmd->ppcArgv, psCmd->iArgc, oJob->piKinds,
+                       ppcEnv, acReport))
+      return;
+
+   /* A hit: the output, and what the compiler said about it. */
+   snprintf(acEntry, sizeof(acEntry), "%s/o/%s", pcCacheDir, acReport);
+   if (Cache_place(acEntry, oJob->pcOutput) == SUCCESS)
+   {
+      utimensat(AT_FDCWD, acEntry, NULL, 0);
+      strcat(acEntry, ".err");
+      if ((iErrFD = open(acEntry, O_RDONLY | O_CLOEXEC)) != -1)
+      {
+         fflush(stdout);
+         if (fstat(iErrFD, &sStat) == 0)
+            Common_transfer(1, iErrFD, (size_t)sStat.st_size);
+         close(iErrFD);
+      }
+      Cache_count(CACHE_HITS);
+      acReport[SHA256_HEX_SIZE] = CACHE_REPORT_HIT;
+      Common_writen(iReportFD, acReport, sizeof(acReport));
+      exit(EXIT_SUCCESS);
+   }
+
+   /* A miss: stored by Cache_end once it has succeeded. */
+   Cache_count(CACHE_MISSES);
+   acReport[SHA256_HEX_SIZE] = CACHE_REPORT_MISS;
+   Common_writen(iReportFD, acReport, sizeof(acReport));
+}
+
+/*--------------------------------------------------------------------*/
+
+pid_t Cache_spawn(CacheJob_T oJob, SynCmd *psCmd, char **ppcEnv,
+                  char *pcProgName)
+
+/* Start psCmd, the command of oJob, like Common_spawn, in a child that
+   first looks it up in the cache and only runs it on a miss. Return
+   the pid of the child, or FAILURE. */
+
+{
+   extern char **environ;
+   int aiPipe[2];
+   pid_t iPid;
+
+   assert(oJob != NULL);
+   assert(psCmd != NULL);
+   assert(oJob->iReportFD == -1);
+
+   if (pipe2(aiPipe, O_CLOEXEC) == -1)
+   {
+      perror(pcProgName);
+      return FAILURE;
+   }
+   fflush(NULL);
+   if ((iPid = fork()) == -1)
+   {
+      perror(pcProgName);
+      close(aiPipe[0]);
+      close(aiPipe[1]);
+      return FAILURE;
+   }
+
+   /* The report is read once the command has exited, but the job may
+      be ended before (see Cache_end). */
+   if (iPid != 0)
+   {
+      close(aiPipe[1]);
+      fcntl(aiPipe[0], F_SETFL, O_NONBLOCK);
+      oJob->iReportFD = aiPipe[0];
+      return iPid;
+   }
+
+   /* Undo what an event-driven parent may have set up. */
+   close(aiPipe[0]);
+   signal(SIGPIPE, SIG_DFL);
+   Common_checkSigUnblock(SIGCHLD);
+   Cache_lookup(oJob, psCmd, ppcEnv, aiPipe[1]);
+   if (ppcEnv != NULL)
+      environ = ppcEnv;
+   Common_execCmd(psCmd, pcProgName);
+   exit(EXIT_FAILURE);
+}
+
+/*--------------------------------------------------------------------*/
+
+void Cache_addOutput(CacheJob_T oJob, const void *pvData, size_t iSize)
+
+/* Record that the compilation of oJob printed the iSize bytes at
+   pvData. */
+
+{
+   char *pcDiag;
+
+   if ((oJob == NULL) || oJob->iOverflow || (iSize == 0))
+      return;
+   if (oJob->iDiagLength + iSize > CACHE_MAX_DIAGNOSTICS)
+   {
+      oJob->iOverflow = TRUE;
+      return;
+   }
+   if ((pcDiag = (char*)realloc(oJob->pcDiag, oJob->iDiagLength + iSize))
+       == NULL)
+   {
+      oJob->iOverflow = TRUE;
+      return;
+   }
+   memcpy(pcDiag + oJob->iDiagLength, pvData, iSize);
+   oJob->pcDiag = pcDiag;
+   oJob->iDiagLength += iSize;
+}
+
+/*--------------------------------------------------------------------*/
+
+void Cache_end(CacheJob_T oJob, int iStatus)
+
+/* End job oJob, whose compilation exited with status iStatus, storing
+   its output in the cache if iStatus is 0 and it missed, and free
+   it. */
+
+{
+   char acReport[SHA256_HEX_SIZE + 1];
+
+   if (oJob == NULL)
+      return;
+
+   /* The child reported before it ran the compiler, if it got that
+      far. */
+   if ((oJob->iReportFD != -1) && (iStatus == 0) && (! oJob->iOverflow) &&
+       (read(oJob->iReportFD, acReport, sizeof(acReport))
+        == (ssize_t)sizeof(acReport)) &&
+       (acReport[SHA256_HEX_SIZE] == CACHE_REPORT_MISS))
+   {
+      memcpy(oJob->acKey, acReport, SHA256_HEX_SIZE);
+      oJob->acKey[SHA256_HEX_SIZE - 1] = '\0';
+      Cache_store(oJob);
+   }
+   if (oJob->iReportFD != -1)
+      close(oJob->iReportFD);
+   free(oJob->piKinds);
+   free(oJob->pcOutput);
+   free(oJob->pcDiag);
+   free(oJob);
+}
+
+/*--------------------------------------------------------------------*/
+
+int Cache_handleStats(SynCmd *psCmd, char *pcProgName)
+
+/* Checks if psCmd is a cachestats command. If so, it prints the hit
+   and miss counts and the size of the cache. */
+
+{
+   long long allStats[CACHE_STATS];
+   DynArray_T oEntries;
+   long long llTotal = 0;
+   long long llLookups;
+   int iFD;
+
+   assert(psCmd != NULL);
+   assert(pcProgName != NULL);
+
+   if (psCmd->eVerb != VERB_CACHESTATS)
+      return FALSE;
+   if (psCmd->iArgc > 1)
+   {
+      fprintf(stderr, "%s: cachestats: too many arguments\n", pcProgName);
+      return TRUE;
+   }
+   if (pcCacheDir == NULL)
+   {
+      printf("cache: off\n");
+      return TRUE;
+   }
+   if ((iFD = Cache_lockStats(allStats)) == -1)
+   {
+      fprintf(stderr, "%s: cachestats: %s\n", pcProgName, strerror(errno));
+      return TRUE;
+   }
+   oEntries = Cache_scan(&llTotal);
+
+   llLookups = allStats[CACHE_HITS] + allStats[CACHE_MISSES];
+   printf("cache: %s\n", pcCacheDir);
+   printf("cache: %lld hits, %lld misses (%.1f%% hits)\n",
+          allStats[CACHE_HITS], allStats[CACHE_MISSES],
+          llLookups ? 100.0 * allStats[CACHE_HITS] / llLookups : 0.0);
+   printf("cache: %d entries, %lld of %lld bytes, %lld stored, %lld evicted\n",
+          oEntries ? DynArray_getLength(oEntries) : 0, llTotal,
+          llCacheBudget, allStats[CACHE_STORES], allStats[CACHE_EVICTIONS]);
+
+   if (oEntries != NULL)
+   {
+      DynArray_map(oEntries, Cache_freeEntry, NULL);
+      DynArray_free(oEntries);
+   }
+   Common_unlockCounters(iFD, NULL, CACHE_STATS); /* nothing changed */
+   return TRUE;
+}
+
+/*--------------------------------------------------------------------*/
@@ -0,0 +1,78 @@
+/*--------------------------------------------------------------------*/
+/* cache.h                                                            */
+/* Content-addressed cache of compiler outputs for the server         */
+/*--------------------------------------------------------------------*/
+
+#ifndef CACHE_INCLUDED
+#define CACHE_INCLUDED
+
+#include "common.h"
+
+/*--------------------------------------------------------------------*/
+
+/* A compilation such as "gcc -O2 A.c -o A" is identified by a SHA-256
+   key over the compiler binary's identity, the flags without the
+   output name, and the contents of every input: C and C++ sources as
+   the compiler's own preprocessor sees them (so edited headers count),
+   any other input file as it is. The cache directory holds
+
+      o/<key>       the output file, read-only
+      o/<key>.err   what the compiler printed while building it
+      tmp/          files being written before they are renamed in
+      stats         hit and miss counts, also used as lock file
+
+   Entries appear by rename(2) only, so concurrent sessions (and
+   concurrent server processes) never see a partial entry. A hit puts
+   the output in place as a reflink (copy-on-write clone) where the
+   file system supports it, or else a hardlink, or else a copy, and
+   marks the entry used by touching its modification time. When the
+   entries grow past the size budget the least recently used ones are
+   evicted. */
+
+#define CACHE_DEFAULT_DIR ".cloudide-cache"
+#define CACHE_DEFAULT_BUDGET 256 /* megabytes */
+#define CACHE_MAX_DIAGNOSTICS (1 << 15) /* bytes a cached build may print;
+                                          less than a pipe holds */
+
+typedef struct CacheJob *CacheJob_T;
+/* A compilation the cache can handle. If it misses, its output is
+   stored once it has succeeded. */
+
+/*--------------------------------------------------------------------*/
+
+int Cache_open(const char *pcDir, long long llBudget);
+/* Keep the cache in directory pcDir, created if needed, and let it
+   grow to llBudget bytes. Return SUCCESS, or FAILURE if pcDir cannot
+   be used; the cache stays off then. */
+
+CacheJob_T Cache_begin(SynCmd *psCmd);
+/* If psCmd is a compiler invocation the cache can handle, return a
+   job for it, which the caller must start with Cache_spawn and end
+   with Cache_end. Otherwise return NULL. Looking the command up takes
+   running the preprocessor, which is left to the child. */
+
+pid_t Cache_spawn(CacheJob_T oJob, SynCmd *psCmd, char **ppcEnv,
+                  char *pcProgName);
+/* Start psCmd, the command of oJob, like Common_spawn, in a child that
+   first looks it up, running the preprocessor in the current
+   directory with environment ppcEnv. On a hit, the child puts the
+   cached output in place, prints what the compiler printed when it
+   was built to stdout and exits with status 0 instead of running the
+   command. It reports the key and whether it hit through a pipe that
+   Cache_end reads. Return the pid of the child, or FAILURE. */
+
+void Cache_addOutput(CacheJob_T oJob, const void *pvData, size_t iSize);
+/* Record that the compilation of oJob printed the iSize bytes at
+   pvData. oJob may be NULL. */
+
+void Cache_end(CacheJob_T oJob, int iStatus);
+/* End job oJob, whose compilation exited with status iStatus, storing
+   its output in the cache if iStatus is 0 and it missed, and free it.
+   oJob may be NULL. */
+
+int Cache_handleStats(SynCmd *psCmd, char *pcProgName);
+/* Checks if psCmd is a cachestats command. If so, it prints the hit
+   and miss counts and the size of the cache. Returns 1 if command is
+   cachestats, 0 otherwise. */
+
+#endif
@@ -2,11 +2,27 @@
 
 /*--------------------------------------------------------------------*/
 
-static void Client_executeCommand(char *acLine, DynArray_T oTokens, DynArray_T oCmds, int iSockFD); /* execute a command contained in acLine */
-static int Client_handleSend(DynArray_T oCmds, int iSockFD, char *acLine); /* send a file to remote server */
-static int Client_handleRecv(DynArray_T oCmds, int iSockFD, char *acLine); /* receive a file from remote server */
-static int Client_handleRemote(DynArray_T oCmds, int iSockFD, char *acLine); /* any other remote command */
-static void Client_recvResponse(int iSockFD); /* receive response from socket and print to stdout */
+static void Client_executeCommand(char *acLine, int iSockFD); /* execute a command contained in acLine */
+static void Client_handleSend(SynCmd *psCmd, int iSockFD, char *acLine); /* send a file to remote server */
+static void Client_handleRecv(SynCmd *psCmd, int iSockFD, char *acLine); /* receive a file from remote server */
+static void Client_handleRemote(SynCmd *psCmd, int iSockFD, char *acLine); /* any other remote command */
+static void Client_sendArchive(SynCmd *psCmd, int iSockFD, char *acLine); /* send several files or a directory to remote server */
+static uint32_t Client_sendCommand(int iSockFD, char *acLine); /* send acLine to the server as a new request */
+static void Client_expect(uint32_t uId, ClientReply eKind, char *pcPath, int iLocalErr, int iBaseFD); /* remember a request whose answer is due */
+static void Client_recvReply(void); /* receive and report the next answer from the server */
+static void Client_recvReady(void); /* receive the answers that have arrived already */
+static void Client_recvAll(void); /* receive all answers still due */
+static void Client_lostConnection(void); /* give up after the server went away */
+static void Client_reapJobs(void); /* report local background jobs that have finished */
+
+static RecvBuf_T oSockBuf = NULL; /* buffered reader in front of the server socket */
+static uint32_t uNextId = 1; /* id of the next request */
+static DynArray_T oPending = NULL; /* requests sent but not answered yet, oldest first */
+static int iPipeline = FALSE; /* send requests without waiting for answers */
+static int iVersion = PROTO_VERSION_MIN; /* protocol version agreed on with the server */
+static int iStreams = 1; /* most connections a download may use */
+static struct sockaddr_in sServAddr; /* where the server listens */
+static Arena_T oArena = NULL; /* memory of the command words of a line */
 
 /*--------------------------------------------------------------------*/
 
@@ -15,15 +31,19 @@ int main(int argc, char **argv)
   /* variable declarations and initializations */
   char acPrompt[2] = "%";
   char acLine[MAX_LINE_SIZE];
-  DynArray_T oTokens = NULL;
-  DynArray_T oCmds = NULL;
   int iSockFD = 0;
-  struct sockaddr_in sServAddr;
-  bzero(&sServAddr, sizeof(sServAddr));
+  int iOpt = 0;
   
   /* check usage */
-  if (argc != 2) {
-    fprintf(stderr, "usage: client <server>\n");
+  while ((iOpt = getopt(argc, argv, "s:")) != -1) {
+    if ((iOpt == 's') && ((iStreams = atoi(optarg)) >= 1) &&
+	(iStreams <= STRIPE_MAX_STREAMS))
+      ; /* connections for a large download */
+    else
+      break;
+  }
+  if ((iOpt != -1) || (optind != argc - 1)) {
+    fprintf(stderr, "usage: client [-s streams] <server>\n");
     exit(-1);	      
   }
   
@@ -37,7 +57,7 @@ int main(int argc, char **argv)
   bzero(&sServAddr, sizeof(sServAddr));
   sServAddr.sin_family = AF_INET;
   sServAddr.sin_port = htons(SERV_PORT);
-  inet_pton(AF_INET, argv[1], &sServAddr.sin_addr);
+  inet_pton(AF_INET, argv[optind], &sServAddr.sin_addr);
   
   /* connect */
   if (connect(iSockFD, (struct sockaddr *) &sServAddr, sizeof(sServAddr)) < 0) {
@@ -49,16 +69,44 @@ int main(int argc, char **argv)
    ********** At this point, client is connected to server ************
    ********************************************************************/
 
+  if ((oSockBuf = RecvBuf_new(iSockFD)) == NULL) {
+    fprintf(stderr, "client: cannot allocate memory\n");
+    exit(EXIT_FAILURE);
+  }
+  if ((iVersion = Proto_clientHello(iSockFD, oSockBuf)) == FAILURE) {
+    fprintf(stderr, "client: protocol handshake with server failed\n");
+    exit(EXIT_FAILURE);
+  }
+
+  /* large downloads cut off by a lost connection resume next time */
+  if (iVersion >= PROTO_VERSION_RESUME)
+    Stage_open(STAGE_DEFAULT_DIR);
+
+  /* scripts send their requests back to back; a user at a terminal
+     sees every answer before the next prompt */
+  if ((oPending = DynArray_new(0)) == NULL) {
+    fprintf(stderr, "client: cannot allocate memory\n");
+    exit(EXIT_FAILURE);
+  }
+  iPipeline = !isatty(0);
+
+  /* one arena for every line, reset after each */
+  if ((oArena = Arena_new()) == NULL) {
+    fprintf(stderr, "client: cannot allocate memory\n");
+    exit(EXIT_FAILURE);
+  }
+
   printf("%s ", acPrompt);
 
   while (fgets(acLine, MAX_LINE_SIZE, stdin)) {
     if (strlen(acLine)) {
-      Client_executeCommand(acLine, oTokens, oCmds, iSockFD);
+      Client_executeCommand(acLine, iSockFD);
     }
     bzero(acLine, MAX_LINE_SIZE);
     printf("%s ", acPrompt);
   }
 
+  Client_recvAll();
   printf("\n");
 
   exit(EXIT_SUCCESS);
@@ -67,229 +115,427 @@ int main(int argc, char **argv)
 /*--------------------------------------------------------------------*/
 
 /* execute a command contained in acLine */
-static void Client_executeCommand(char *acLine, DynArray_T oTokens,
-				  DynArray_T oCmds, int iSockFD)
+static void Client_executeCommand(char *acLine, int iSockFD)
 {
-  int iSuccessful = 0;
+  SynCmd sCmd;
+  pid_t iPid = 0;
   
   assert(acLine != NULL);
 
-  /* create empty DynArrays */
-  if ((oTokens = DynArray_new(0)) == NULL) {
-    fprintf(stderr, "client: Server_executeCommand: cannot allocate memory\n");
-    return;
-  }
-  if ((oCmds = DynArray_new(0)) == NULL) {
-    fprintf(stderr, "client: Server_executeCommand: cannot allocate memory\n");
-    return;
-  }
-  
-  /* lexical analysis stage. */
-  iSuccessful = Lex_lexLine(acLine, oTokens, "client");
-  /* check if successful lexical analysis, and if token
-     array size is greater than zero. */
-  if ((!iSuccessful) || (!DynArray_getLength(oTokens))) {  
-    Common_cleanup(oTokens, oCmds);
+  /* print whatever answers are in, and which jobs have finished */
+  Client_recvReady();
+  Client_reapJobs();
+
+  /* lexical and syntactical analysis, in one pass */
+  if (!Syn_parseLine(acLine, &sCmd, oArena, "client") || (sCmd.iArgc == 0)) {
+    Arena_reset(oArena);
     return;
   }
-  
-  /* syntactical parsing stage. */
-  iSuccessful = Syn_synLine(oTokens, oCmds, "client");
-  /* check if successful syntactical parsing. */
-  if (!iSuccessful) {  
-    Common_cleanup(oTokens, oCmds);
-    return;
-  }  
-  
+
   /* check for custom commands */
-  if (Client_handleSend(oCmds, iSockFD, acLine)) { /* send a file to remote server */
-    Common_cleanup(oTokens, oCmds);
-    return;
+  switch (sCmd.eVerb) {
+  case VERB_SEND: /* send a file to remote server */
+  case VERB_RECV: /* receive a file from remote server */
+    if (sCmd.psNext != NULL)
+      fprintf(stderr, "client: %s: cannot be part of a pipeline\n",
+	      sCmd.ppcArgv[0]);
+    else if (sCmd.iBackground)
+      fprintf(stderr, "client: %s: cannot run in the background\n",
+	      sCmd.ppcArgv[0]);
+    else if (sCmd.eVerb == VERB_SEND)
+      Client_handleSend(&sCmd, iSockFD, acLine);
+    else
+      Client_handleRecv(&sCmd, iSockFD, acLine);
+    break;
+
+  case VERB_REMOTE: /* any other remote command */
+    Client_handleRemote(&sCmd, iSockFD, acLine);
+    break;
+
+  default:
+    /* local commands may depend on earlier remote ones, e.g. read a
+       file being received */
+    Client_recvAll();
+
+    if (sCmd.iBackground) { /* not waited for; see Client_reapJobs */
+      if ((iPid = Common_spawn(&sCmd, NULL, "client")) != FAILURE)
+	printf("[%d]\n", (int) iPid);
+    }
+    else if (sCmd.psNext != NULL) /* every stage of a pipeline is a program */
+      Common_exec(&sCmd, "client");
+    else if (Common_handleCd(&sCmd, "client")) /* change current directory */
+      ;
+    else if (Common_handleSetenv(&sCmd, "client")) /* set environment variable value */
+      ;
+    else if (Common_handleUnsetenv(&sCmd, "client")) /* unset environment variable value */
+      ;
+    else if (Common_handleExit(&sCmd, "client")) /* exit program */
+      ;
+    else /* execute other commands */
+      Common_exec(&sCmd, "client");
+    break;
   }
-  else if (Client_handleRecv(oCmds, iSockFD, acLine)) { /* receive a file from remote server */
-    Common_cleanup(oTokens, oCmds);
+
+  Arena_reset(oArena);
+}
+
+/*--------------------------------------------------------------------*/
+
+/* send a file to remote server */
+static void Client_handleSend(SynCmd *psCmd, int iSockFD, char *acLine)
+{
+  char *pcFile = NULL;
+  uint32_t uId = 0;
+  int iSent = 0;
+  unsigned char aucDigest[PROTO_DIGEST_SIZE];
+  uint64_t uSize = 0;
+  ProtoHeader sHeader;
+  unsigned char aucStaged[PROTO_DIGEST_SIZE];
+  uint64_t uStaged = 0;
+  uint64_t uOffset = 0;
+  DeltaSigs_T oSigs = NULL;
+  struct stat sStat;
+  int iDelta = FALSE;
+
+  assert(psCmd != NULL);
+  assert(psCmd->eVerb == VERB_SEND);
+
+  /* sendfile needs a file name */
+  if (psCmd->iArgc < 2) {
+    fprintf(stderr, "client: %s: missing file name\n", CMDNAME_SEND);
     return;
   }
-  else if (Client_handleRemote(oCmds, iSockFD, acLine)) { /* any other remote command */
-    Common_cleanup(oTokens, oCmds);
+  pcFile = psCmd->ppcArgv[1];
+
+  /* several files, a pattern, or a directory go as one archive */
+  if ((psCmd->iArgc > 2) || (strpbrk(pcFile, "*?[") != NULL) ||
+      ((stat(pcFile, &sStat) == 0) && S_ISDIR(sStat.st_mode))) {
+    Client_sendArchive(psCmd, iSockFD, acLine);
     return;
   }
-  else if (Common_handleCd(oCmds, "client")) { /* change current directory */
-    Common_cleanup(oTokens, oCmds);
-    return;
-  } 
-  else if (Common_handleSetenv(oCmds, "client")) { /* set environment variable value */
-    Common_cleanup(oTokens, oCmds);
-    return;
-  } 
-  else if (Common_handleUnsetenv(oCmds, "client")) { /* unset environment variable value */
-    Common_cleanup(oTokens, oCmds);
-    return;
-  } 
-  else if (Common_handleExit(oCmds, "client")) { /* exit program */
-    Common_cleanup(oTokens, oCmds);
-    return;
-  } 
 
-  /* execute other commands */
-  Common_exec(oCmds, "client");
-  Common_cleanup(oTokens, oCmds);
+  /* no answers may be due while uploading: the server could be
+     blocked sending one to us while we are blocked sending to it */
+  Client_recvAll();
+
+  /* send file to server: the body ends with our own status, so a file
+     that cannot be read makes the server drop the upload */
+  uId = Client_sendCommand(iSockFD, acLine);
+
+  /* offer the digest first: the server may have the contents already,
+     and then answers right away instead of asking for them */
+  if ((iVersion >= PROTO_VERSION_HAVE) &&
+      (Common_hashFile(pcFile, aucDigest, &uSize) == SUCCESS)) {
+    if ((Proto_sendHave(iSockFD, uId, 0, aucDigest, uSize) == FAILURE) ||
+	(Proto_peekHeader(oSockBuf, &sHeader) != RECVBUF_OK))
+      Client_lostConnection();
+    if (sHeader.eType == PROTO_SIGS) {
+      /* the server has an old copy: only send what it lacks */
+      if (Delta_recvSigs(oSockBuf, uId, &oSigs) != RECVBUF_OK)
+	Client_lostConnection();
+      iSent = Delta_sendBody(iSockFD, uId, pcFile, oSigs, NULL);
+      Delta_freeSigs(oSigs);
+      iDelta = TRUE;
+    }
+    else if (sHeader.eType == PROTO_RESUME) {
+      /* the server kept part of it from an interrupted upload */
+      if (Proto_readResume(oSockBuf, uId, aucStaged, &uStaged,
+			   &uOffset) != RECVBUF_OK)
+	Client_lostConnection();
+      iSent = Delta_sendRange(iSockFD, uId, pcFile, aucDigest,
+			      uSize, uOffset);
+      iDelta = TRUE;
+    }
+    else if (sHeader.eType != PROTO_WANT) {
+      Client_expect(uId, CLIENT_REPLY_SEND, pcFile, SUCCESS, -1);
+      return;
+    }
+    else if (Proto_readHeader(oSockBuf, &sHeader) != RECVBUF_OK)
+      Client_lostConnection();
+  }
+
+  if (!iDelta)
+    iSent = Proto_sendData(iSockFD, uId, pcFile);
+  if (iSent == FAILURE)
+    Client_lostConnection();
+  if (iSent != SUCCESS)
+    fprintf(stderr, "client: %s: %s: %s\n", CMDNAME_SEND,
+	    pcFile, strerror(iSent));
+  if (Proto_sendEnd(iSockFD, uId, iSent) == FAILURE)
+    Client_lostConnection();
+
+  Client_expect(uId, CLIENT_REPLY_SEND, pcFile, iSent, -1);
 }
 
 /*--------------------------------------------------------------------*/
 
-/* send a file to remote server */
-static int Client_handleSend(DynArray_T oCmds, int iSockFD, char *acLine)
+/* send the files and directories named in psCmd, with shell patterns
+   expanded, to remote server as one archive */
+static void Client_sendArchive(SynCmd *psCmd, int iSockFD, char *acLine)
 {
-  int iLength = 0;
+  glob_t sGlob;
+  uint32_t uId = 0;
+  int iSent = 0;
   int i = 0;
-  int iFlag = FALSE;
-  Cmd_T psCmd = NULL;
-  CmdType eType;
-  int iArgs = 0;
-
-  assert(oCmds != NULL);
-
-  iLength = DynArray_getLength(oCmds);
-
-  /* Go through entire command */
-  for (i = 0; i < iLength; i++) {
-    psCmd = (Cmd_T) DynArray_get(oCmds, i);
-    eType = Syn_returnType(psCmd);
-    if (eType == CMD_CMD) {
-      if (strcmp(Syn_returnValue(psCmd), CMDNAME_SEND) == 0) {
-	assert(i == 0); 
-	iFlag = TRUE;
-      }
-      else break;
+
+  assert(psCmd != NULL);
+
+  if (iVersion < PROTO_VERSION_ARCHIVE) {
+    fprintf(stderr, "client: %s: %s: server takes one file at a time\n",
+	    CMDNAME_SEND, psCmd->ppcArgv[1]);
+    return;
+  }
+
+  /* a pattern that matches nothing is sent as a name, and reported */
+  bzero(&sGlob, sizeof(sGlob));
+  for (i = 1; i < psCmd->iArgc; i++) {
+    if (glob(psCmd->ppcArgv[i], GLOB_NOCHECK | ((i > 1) ? GLOB_APPEND : 0),
+	     NULL, &sGlob) != 0) {
+      fprintf(stderr, "client: %s: cannot allocate memory\n", CMDNAME_SEND);
+      globfree(&sGlob);
+      return;
     }
-    else if (eType == CMD_ARG) iArgs++;
   }
 
-  /* if not send */
-  if (!iFlag) return FALSE;
+  /* as for a single file, no answers may be due while uploading */
+  Client_recvAll();
+  uId = Client_sendCommand(iSockFD, acLine);
+  iSent = Archive_send(iSockFD, uId, sGlob.gl_pathv, sGlob.gl_pathc);
+  globfree(&sGlob);
+  if ((iSent == FAILURE) || (Proto_sendEnd(iSockFD, uId, iSent) == FAILURE))
+    Client_lostConnection();
 
-  /* send file to server */
-  assert(Common_writen(iSockFD, acLine, strlen(acLine)) != FAILURE);
-  psCmd = (Cmd_T) DynArray_get(oCmds, 1);
-  if (Common_sendFile(iSockFD, Syn_returnValue(psCmd)) == FAILURE) {
-    assert(Common_sendFile(iSockFD, EMPTYFILE) == SUCCESS);
-  }
-  
-  return TRUE;
+  Client_expect(uId, CLIENT_REPLY_SEND, psCmd->ppcArgv[1], iSent, -1);
 }
 
 /*--------------------------------------------------------------------*/
 
 /* receive a file from remote server */
-static int Client_handleRecv(DynArray_T oCmds, int iSockFD, char *acLine)
+static void Client_handleRecv(SynCmd *psCmd, int iSockFD, char *acLine)
 {
-  int iLength = 0;
-  int i = 0;
-  int iFlag = FALSE;
-  Cmd_T psCmd = NULL;
-  CmdType eType;
-  int iArgs = 0;
-
-  assert(oCmds != NULL);
-
-  iLength = DynArray_getLength(oCmds);
-
-  /* Go through entire command */
-  for (i = 0; i < iLength; i++) {
-    psCmd = (Cmd_T) DynArray_get(oCmds, i);
-    eType = Syn_returnType(psCmd);
-    if (eType == CMD_CMD) {
-      if (strcmp(Syn_returnValue(psCmd), CMDNAME_RECV) == 0) {
-	assert(i == 0); 
-	iFlag = TRUE;
-      }
-      else break;
-    }
-    else if (eType == CMD_ARG) iArgs++;
+  char *pcFile = NULL;
+  uint32_t uId = 0;
+  int iBaseFD = -1;
+  unsigned char aucDigest[PROTO_DIGEST_SIZE];
+  char acKey[STAGE_KEY_SIZE];
+  uint64_t uSize = 0;
+  uint64_t uHave = 0;
+
+  assert(psCmd != NULL);
+  assert(psCmd->eVerb == VERB_RECV);
+
+  /* recvfile needs a file name */
+  if (psCmd->iArgc < 2) {
+    fprintf(stderr, "client: %s: missing file name\n", CMDNAME_RECV);
+    return;
+  }
+  pcFile = psCmd->ppcArgv[1];
+
+  /* receive file from server, as a delta against the copy we have, or
+     only the rest if an interrupted transfer left us part of it, or
+     over several connections if it is large and we may */
+  if (iVersion >= PROTO_VERSION_DELTA)
+    /* as for an upload, no answers may be due while we send the
+       signatures of our copy, which can be large: the server could be
+       blocked sending one to us while we are blocked sending to it */
+    Client_recvAll();
+  uId = Client_sendCommand(iSockFD, acLine);
+  if (iVersion >= PROTO_VERSION_RESUME) {
+    Stage_keyForPath(pcFile, acKey);
+    if ((Stage_lookup(acKey, aucDigest, &uSize, &uHave) == SUCCESS) &&
+	(Proto_sendResume(iSockFD, uId, aucDigest, uSize, uHave) == FAILURE))
+      Client_lostConnection();
+  }
+  if ((iVersion >= PROTO_VERSION_STRIPE) && (iStreams > 1) &&
+      (Proto_writeFrame(iSockFD, PROTO_STRIPE, 0, uId, NULL, 0) == FAILURE))
+    Client_lostConnection();
+  if (iVersion >= PROTO_VERSION_DELTA) {
+    iBaseFD = open(pcFile, O_RDONLY | O_CLOEXEC);
+    if (Delta_sendSigs(iSockFD, uId, iBaseFD) == FAILURE)
+      Client_lostConnection();
   }
+  Client_expect(uId, CLIENT_REPLY_RECV, pcFile, 0, iBaseFD);
+}
 
-  /* if not send */
-  if (!iFlag) return FALSE;
+/*--------------------------------------------------------------------*/
 
-  /* receive file from server */
-  assert(Common_writen(iSockFD, acLine, strlen(acLine)) != FAILURE);
-  psCmd = (Cmd_T) DynArray_get(oCmds, 1);
-  assert(Common_recvFile(iSockFD, Syn_returnValue(psCmd)) == SUCCESS);
-  
-  return TRUE;
+/* any other remote command */
+static void Client_handleRemote(SynCmd *psCmd, int iSockFD, char *acLine)
+{
+  uint32_t uId = 0;
+
+  assert(psCmd != NULL);
+  assert(psCmd->eVerb == VERB_REMOTE);
+
+  /* send command; its output is printed when it arrives */
+  uId = Client_sendCommand(iSockFD, acLine);
+  Client_expect(uId, CLIENT_REPLY_REMOTE, NULL, 0, -1);
 }
 
 /*--------------------------------------------------------------------*/
 
-/* any other remote command */
-static int Client_handleRemote(DynArray_T oCmds, int iSockFD, char *acLine)
+/* send acLine to the server as a new request and return its id */
+static uint32_t Client_sendCommand(int iSockFD, char *acLine)
+{
+  size_t iLength = strlen(acLine);
+  uint32_t uId = uNextId++;
+
+  /* the frame delimits the command, not a newline */
+  if ((iLength > 0) && (acLine[iLength - 1] == '\n'))
+    iLength--;
+  if (Proto_writeFrame(iSockFD, PROTO_COMMAND, 0, uId, acLine, iLength) == FAILURE)
+    Client_lostConnection();
+  return uId;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* remember that request uId of kind eKind has been sent. pcPath is
+   the file it is about, iLocalErr what went wrong on this side and
+   iBaseFD the old copy of a file being received, which is closed once
+   the answer is in */
+static void Client_expect(uint32_t uId, ClientReply eKind, char *pcPath,
+			  int iLocalErr, int iBaseFD)
+{
+  ClientRequest_T psRequest = NULL;
+
+  if (((psRequest = calloc(1, sizeof(struct ClientRequest))) == NULL) ||
+      ((pcPath != NULL) && ((psRequest->pcPath = strdup(pcPath)) == NULL)) ||
+      !DynArray_add(oPending, psRequest)) {
+    fprintf(stderr, "client: cannot allocate memory\n");
+    exit(EXIT_FAILURE);
+  }
+  psRequest->uId = uId;
+  psRequest->eKind = eKind;
+  psRequest->iLocalErr = iLocalErr;
+  psRequest->iBaseFD = iBaseFD;
+
+  /* keep the number of requests in flight bounded, and answer them
+     right away for a user at a terminal */
+  while ((DynArray_getLength(oPending) >= MAX_PENDING_REQUESTS) ||
+	 (!iPipeline && DynArray_getLength(oPending)))
+    Client_recvReply();
+}
+
+/*--------------------------------------------------------------------*/
+
+/* receive the next answer from the server, match it with the request
+   it carries the id of and report it */
+static void Client_recvReply(void)
 {
-  int iLength = 0;
+  ClientRequest_T psRequest = NULL;
+  ProtoHeader sHeader;
+  StripeFile sFile;
+  char acKey[STAGE_KEY_SIZE];
+  int iStatus = 0;
   int i = 0;
-  int iFlag = FALSE;
-  Cmd_T psCmd = NULL;
-  CmdType eType;
-  int iArgs = 0;
-
-  assert(oCmds != NULL);
-
-  iLength = DynArray_getLength(oCmds);
-
-  /* Go through entire command */
-  for (i = 0; i < iLength; i++) {
-    psCmd = (Cmd_T) DynArray_get(oCmds, i);
-    eType = Syn_returnType(psCmd);
-    if (eType == CMD_CMD) {
-      if (strcmp(Syn_returnValue(psCmd), CMDNAME_REMOTE) == 0) {
-	assert(i == 0); 
-	iFlag = TRUE;
-      }
-      else break;
-    }
-    else if (eType == CMD_ARG) iArgs++;
+
+  if (Proto_peekHeader(oSockBuf, &sHeader) != RECVBUF_OK)
+    Client_lostConnection();
+  for (i = 0; i < DynArray_getLength(oPending); i++) {
+    psRequest = DynArray_get(oPending, i);
+    if (psRequest->uId == sHeader.uId)
+      break;
+  }
+  if (i == DynArray_getLength(oPending)) {
+    fprintf(stderr, "client: answer to unknown request %u\n", sHeader.uId);
+    Client_lostConnection();
   }
 
-  /* if not remote */
-  if (!iFlag) return FALSE;
+  if ((psRequest->eKind == CLIENT_REPLY_RECV) &&
+      (sHeader.eType == PROTO_STRIPE)) {
+    if ((Stripe_readOffer(oSockBuf, psRequest->uId, &sFile) != RECVBUF_OK) ||
+	(Proto_recvBody(oSockBuf, psRequest->uId, NULL, &iStatus) == FAILURE))
+      Client_lostConnection();
+    if (iStatus == 0)
+      iStatus = Stripe_fetch(&sServAddr, &sFile, psRequest->pcPath, iStreams);
+  }
+  else if ((psRequest->eKind == CLIENT_REPLY_RECV) &&
+	   (sHeader.eType == PROTO_ARCHIVE)) {
+    /* a directory, unpacked here */
+    if (Archive_recv(oSockBuf, psRequest->uId, &iStatus) == FAILURE)
+      Client_lostConnection();
+  }
+  else if ((psRequest->eKind == CLIENT_REPLY_RECV) &&
+	   (iVersion >= PROTO_VERSION_DELTA)) {
+    Stage_keyForPath(psRequest->pcPath, acKey);
+    if (Delta_recvBody(oSockBuf, psRequest->uId, psRequest->iBaseFD,
+		       psRequest->pcPath,
+		       (iVersion >= PROTO_VERSION_RESUME) ? acKey : NULL,
+		       &iStatus) == FAILURE)
+      Client_lostConnection();
+  }
+  else if (Proto_recvBody(oSockBuf, psRequest->uId,
+			  (psRequest->eKind == CLIENT_REPLY_RECV) ? psRequest->pcPath : NULL,
+			  &iStatus) == FAILURE)
+    Client_lostConnection();
+
+  /* output of remote commands speaks for itself */
+  if ((psRequest->eKind == CLIENT_REPLY_RECV) && (iStatus != 0))
+    fprintf(stderr, "client: %s: %s: %s\n", CMDNAME_RECV,
+	    psRequest->pcPath, strerror(iStatus));
+  if ((psRequest->eKind == CLIENT_REPLY_SEND) &&
+      (psRequest->iLocalErr == SUCCESS) && (iStatus != 0))
+    fprintf(stderr, "client: %s: %s: %s\n", CMDNAME_SEND,
+	    psRequest->pcPath, strerror(iStatus));
+
+  DynArray_removeAt(oPending, i);
+  if (psRequest->iBaseFD != -1)
+    close(psRequest->iBaseFD);
+  free(psRequest->pcPath);
+  free(psRequest);
+}
+
+/*--------------------------------------------------------------------*/
+
+/* receive the answers that have arrived already, without waiting for
+   more */
+static void Client_recvReady(void)
+{
+  struct pollfd sPoll;
+  bzero(&sPoll, sizeof(sPoll));
+
+  sPoll.fd = RecvBuf_getFD(oSockBuf);
+  sPoll.events = POLLIN;
+  while (DynArray_getLength(oPending) &&
+	 ((RecvBuf_getBuffered(oSockBuf) > 0) || (poll(&sPoll, 1, 0) > 0)))
+    Client_recvReply();
+}
+
+/*--------------------------------------------------------------------*/
 
-  /* send command and receive response from server */
-  assert(Common_writen(iSockFD, acLine, strlen(acLine)) != FAILURE);
-  Client_recvResponse(iSockFD);
- 
-  return TRUE; 
+/* receive all answers still due */
+static void Client_recvAll(void)
+{
+  while (DynArray_getLength(oPending))
+    Client_recvReply();
 }
 
 /*--------------------------------------------------------------------*/
 
-/* receive response from socket and print to stdout */
-static void Client_recvResponse(int iSockFD)
+/* give up after the server went away */
+static void Client_lostConnection(void)
 {
-  /*
-  char acBuf[MAX_BUFF];
-  int iGot = 0;
-
-  * read data from client and write to file *
-  while (TRUE) {
-    iGot = Common_readn(iSockFD, acBuf, MAX_BUFF);
-    if (iGot < 0) { * error *
-      fprintf(stderr, "error reading from socket\n");
-      return;
-    }
-    
-    if (iGot == 0) * EOF *
-      break;
+  fprintf(stderr, "client: lost connection to server\n");
+  exit(EXIT_FAILURE);
+}
 
-    * otherwise write data to stdout *
-    printf("%s", acBuf);
-    
-    if (iGot < MAX_BUFF) * EOF *
-      break;  
-  };
-  */
-  assert(Common_recvFile(iSockFD, NULL) == SUCCESS);
-  
+/*--------------------------------------------------------------------*/
 
+/* report the local background jobs that have finished. Between two
+   lines they are the only children the client has that nobody waits
+   for */
+static void Client_reapJobs(void)
+{
+  pid_t iPid = 0;
+  int iWaitStatus = 0;
+
+  while ((iPid = waitpid(-1, &iWaitStatus, WNOHANG)) > 0) {
+    if (WIFSIGNALED(iWaitStatus))
+      printf("[%d] killed by signal %d\n", (int) iPid, WTERMSIG(iWaitStatus));
+    else
+      printf("[%d] exit %d\n", (int) iPid, WEXITSTATUS(iWaitStatus));
+  }
 }
 
 /*--------------------------------------------------------------------*/
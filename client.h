@@ -2,6 +2,26 @@
 #define CLIENT_INCLUDED 1
 
 #include "common.h"
+#include "delta.h"
+#include "stage.h"
+#include "stripe.h"
+#include "archive.h"
+#include <glob.h>
+#include <poll.h>
+
+#define MAX_PENDING_REQUESTS 32 /* requests sent before waiting for an answer */
+
+/* what to do with the answer to a request */
+typedef enum {CLIENT_REPLY_REMOTE, CLIENT_REPLY_SEND, CLIENT_REPLY_RECV} ClientReply;
+
+/* a request whose answer has not arrived yet */
+typedef struct ClientRequest {
+  uint32_t uId; /* id the answer carries */
+  ClientReply eKind; /* what the request was */
+  char *pcPath; /* file it is about, or NULL */
+  int iLocalErr; /* what went wrong on this side, for a sendfile */
+  int iBaseFD; /* old copy of the file, for a recvfile, or -1 */
+} *ClientRequest_T;
 
 /* function declarations */
 
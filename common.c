@@ -1,4 +1,8 @@
 #include "common.h"
+#include "uring.h"
+#include "pipeline.h"
+
+static int iZeroCopy = TRUE; /* move file data with sendfile/splice */
        
 /*--------------------------------------------------------------------*/     
 
@@ -86,8 +90,6 @@ ssize_t Common_writen(int iFD, const void *pvBuf, size_t iSize)
 	return FAILURE;    /* error */
       }
     }
-    //printf("writen: "); // DEBUG
-    //fwrite(pcSave, iNWritten, 1, stdout); fflush(NULL); //DEBUG
     iNLeft -= iNWritten;
     pcSave += iNWritten;
   }
@@ -96,6 +98,32 @@ ssize_t Common_writen(int iFD, const void *pvBuf, size_t iSize)
 
 /*--------------------------------------------------------------------*/     
 
+/* Write "iSize" bytes to a file at offset lOffset, without moving its
+   file offset. */
+
+ssize_t Common_pwriten(int iFD, const void *pvBuf, size_t iSize, off_t lOffset)
+{
+  size_t iNLeft = iSize;
+  ssize_t iNWritten = 0;
+  const char *pcSave = (const char *) pvBuf;
+
+  while (iNLeft > 0) {
+    if ((iNWritten = pwrite(iFD, pcSave, iNLeft, lOffset)) <= 0) {
+      if ((iNWritten < 0) && (errno == EINTR))
+	continue;
+      if (iNWritten == 0)
+	errno = EIO;
+      return FAILURE;
+    }
+    iNLeft -= iNWritten;
+    pcSave += iNWritten;
+    lOffset += iNWritten;
+  }
+  return iSize;
+}
+
+/*--------------------------------------------------------------------*/     
+
 /* Read "iSize" bytes from a descriptor. 
    NOTE: waits till iSize bytes are available. Be sure to check 
    the size you want to receive.
@@ -137,113 +165,354 @@ ssize_t Common_readn(int iFD, void *pvBuf, size_t iSize)
    be very useful, or make much sense */
 
 int Common_sendFile(int iSockFD, char *pcSource)
+{
+  int iFD = -1;
+  int iRet = 0;
+
+  /* open source file to send */
+  if ((iFD = open(pcSource, O_RDONLY)) == -1) {
+    perror("cannot open file");
+    return FAILURE;
+  }
+  iRet = Common_sendFD(iSockFD, iFD);
+  close(iFD);
+  return iRet;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* send the whole of the file open at iFD through a file descriptor,
+   from its start */
+
+int Common_sendFD(int iSockFD, int iFD)
 {
   /* variable declarations and initializations */
   char acBuf[MAX_BUFF];
-  FILE *FD = NULL;
-  int iN = 0;
-  int iWritten = 0;
+  struct stat sStat;
+  ssize_t iSent = 0;
   bzero(acBuf, MAX_BUFF);
 
-  /* open source file to send */
-  if (!(FD  = fopen(pcSource, "r"))) {
-    perror("cannot open file");
+  if ((fstat(iFD, &sStat) == -1) || (lseek(iFD, 0, SEEK_SET) == -1)) {
+    perror("cannot stat file");
     return FAILURE;
   }
 
   /* send size of file to server */
-  fseek(FD, 0, SEEK_END);
-  Common_ltoa(ftell(FD), acBuf);
-  while (strlen(acBuf) != LONG_WIDTH + 1) acBuf[strlen(acBuf)] = '\n';
-  Common_writen(iSockFD, acBuf, strlen(acBuf));
-  fseek(FD, 0, SEEK_SET);
-  bzero(acBuf, MAX_BUFF);
+  Common_ltoa((long) sStat.st_size, acBuf);
+  while (strlen(acBuf) != LEGACY_LENGTH_WIDTH + 1) acBuf[strlen(acBuf)] = '\n';
+  if (Common_writen(iSockFD, acBuf, strlen(acBuf)) == FAILURE) {
+    fprintf(stderr, "error writing: %s\n", strerror(errno));
+    return FAILURE;
+  }
  
   /* send file to server */
-  while ((iN = fread(acBuf, 1, MAX_BUFF, FD)) > 0) {
-    //printf("\n*****\nWriting from %s:\n"/*%s*/, pcSource/*, acBuf*/); fflush(NULL); // DEBUG
-    if ((iWritten = Common_writen(iSockFD, acBuf, iN)) == FAILURE) {
-      fprintf(stderr, "error writing: %s\n", strerror(errno));
-      return FAILURE;
-    }
-    assert(iWritten == iN);
-    bzero(acBuf, MAX_BUFF);
+  if (iZeroCopy)
+    iSent = Common_transfer(iSockFD, iFD, (size_t) sStat.st_size);
+  else
+    iSent = Common_copyFD(iSockFD, iFD, (size_t) sStat.st_size);
+
+  if (iSent == FAILURE) {
+    fprintf(stderr, "error writing: %s\n", strerror(errno));
+    return FAILURE;
   }
 
   /* if not reached end of file */
-  if (feof(FD) == 0) {
-    perror("could not send file entirely\n");
+  if (iSent != (ssize_t) sStat.st_size) {
+    fprintf(stderr, "could not send file entirely\n");
     return FAILURE;
   }
 
-  fclose(FD);
   return SUCCESS;
 }
 
+/*--------------------------------------------------------------------*/     
+
+/* use the kernel's zero-copy paths in Common_transfer, or always copy
+   through a user buffer */
+
+void Common_setZeroCopy(int iOn)
+{
+  iZeroCopy = iOn;
+}
+
+/*--------------------------------------------------------------------*/     
+
+/* copy iCount bytes from the current offset of iInFD to iOutFD through
+   a user buffer. Return the number of bytes copied, which is less than
+   iCount only if iInFD ended early, or FAILURE. */
+
+ssize_t Common_copyFD(int iOutFD, int iInFD, size_t iCount)
+{
+  char acBuf[MAX_BUFF];
+  size_t iLeft = iCount;
+  ssize_t iN = 0;
+
+  /* in batches through io_uring, where it is on */
+  if (((iN = Uring_copy(iOutFD, iInFD, iCount)) != FAILURE) ||
+      (errno != ENOSYS))
+    return iN;
+
+  while (iLeft > 0) {
+    iN = Common_readn(iInFD, acBuf, (iLeft >= MAX_BUFF ? MAX_BUFF : iLeft));
+    if (iN == FAILURE)
+      return FAILURE;
+    if (iN == 0) /* EOF */
+      break;
+    if (Common_writen(iOutFD, acBuf, iN) == FAILURE)
+      return FAILURE;
+    iLeft -= iN;
+  }
+  return iCount - iLeft;
+}
+
+/*--------------------------------------------------------------------*/     
+
+/* move iCount bytes from iInFD to iOutFD with splice(2). One of them
+   must be a pipe, or aiPipe must be a pipe to go through. Return the
+   number of bytes moved, or FAILURE with errno set. */
+
+static ssize_t Common_spliceVia(int iOutFD, int iInFD, int aiPipe[2],
+				size_t iCount)
+{
+  size_t iLeft = iCount;
+  ssize_t iIn = 0, iOut = 0;
+
+  while (iLeft > 0) {
+    if (aiPipe == NULL) { /* one end is a pipe already */
+      iIn = splice(iInFD, NULL, iOutFD, NULL, iLeft,
+		   SPLICE_F_MOVE | SPLICE_F_MORE);
+      if ((iIn < 0) && (errno == EINTR)) continue;
+      if (iIn <= 0) break;
+      iLeft -= iIn;
+      continue;
+    }
+
+    iIn = splice(iInFD, NULL, aiPipe[1], NULL, iLeft,
+		 SPLICE_F_MOVE | SPLICE_F_MORE);
+    if ((iIn < 0) && (errno == EINTR)) continue;
+    if (iIn <= 0) break;
+    iLeft -= iIn;
+
+    /* drain the pipe completely before filling it again */
+    while (iIn > 0) {
+      iOut = splice(aiPipe[0], NULL, iOutFD, NULL, iIn,
+		    SPLICE_F_MOVE | SPLICE_F_MORE);
+      if ((iOut < 0) && (errno == EINTR)) continue;
+      if (iOut <= 0) {
+	if ((iOut == 0) || (errno == EINVAL)) errno = EIO;
+	return FAILURE;
+      }
+      iIn -= iOut;
+    }
+  }
+
+  if (iIn < 0) {
+    if ((iLeft != iCount) && ((errno == EINVAL) || (errno == ENOSYS)))
+      errno = EIO; /* too late to fall back to copying */
+    return FAILURE;
+  }
+  return iCount - iLeft;
+}
+
+/*--------------------------------------------------------------------*/     
+
+/* move iCount bytes from the current offset of iInFD to iOutFD without
+   copying them through user space where the kernel allows it:
+   sendfile(2) from a regular file, splice(2) from or to a pipe, and
+   splice(2) through an intermediate pipe otherwise. Falls back to
+   Common_copyFD if neither works for these descriptors. Return the
+   number of bytes moved, which is less than iCount only if iInFD
+   ended early, or FAILURE. */
+
+ssize_t Common_transfer(int iOutFD, int iInFD, size_t iCount)
+{
+  struct stat sIn, sOut;
+  size_t iLeft = iCount;
+  ssize_t iN = 0;
+  int aiPipe[2];
+
+  if ((fstat(iInFD, &sIn) == -1) || (fstat(iOutFD, &sOut) == -1))
+    return FAILURE;
+
+  /* regular file: sendfile */
+  if (S_ISREG(sIn.st_mode)) {
+    while (iLeft > 0) {
+      iN = sendfile(iOutFD, iInFD, NULL, iLeft);
+      if ((iN < 0) && (errno == EINTR)) continue;
+      if (iN <= 0) break;
+      iLeft -= iN;
+    }
+    if (iN >= 0)
+      return iCount - iLeft;
+    if (((errno != EINVAL) && (errno != ENOSYS)) || (iLeft != iCount))
+      return FAILURE;
+    /* sendfile cannot do this pair; try splice */
+  }
+
+  /* a pipe at either end: splice directly */
+  if (S_ISFIFO(sIn.st_mode) || S_ISFIFO(sOut.st_mode)) {
+    if ((iN = Common_spliceVia(iOutFD, iInFD, NULL, iCount)) != FAILURE)
+      return iN;
+  }
+  /* otherwise splice through a pipe of our own */
+  else if (pipe2(aiPipe, O_CLOEXEC) == 0) {
+    iN = Common_spliceVia(iOutFD, iInFD, aiPipe, iCount);
+    close(aiPipe[0]);
+    close(aiPipe[1]);
+    if (iN != FAILURE)
+      return iN;
+  }
+
+  if ((errno != EINVAL) && (errno != ENOSYS))
+    return FAILURE;
+
+  /* kernel cannot do it: copy */
+  return Common_copyFD(iOutFD, iInFD, iCount);
+}
+
+/*--------------------------------------------------------------------*/     
+
+/* read lLength bytes of a file from oBuf into iFD, through one large
+   aligned buffer. With io_uring on, the bytes come through its ring
+   instead. Return the number of bytes read, which is less than
+   lLength only if the connection ended early, or FAILURE */
+
+static long Common_recvBody(RecvBuf_T oBuf, int iFD, long lLength)
+{
+  char acBuf[MAX_BUFF];
+  void *pvBuf = NULL;
+  long lDone = 0;
+  size_t iWant = 0;
+  ssize_t iGot = 0;
+
+  /* what oBuf holds already first, then the rest straight from the
+     socket through io_uring */
+  while (Uring_isOn() && (lDone < lLength) &&
+	 ((iWant = RecvBuf_getBuffered(oBuf)) > 0)) {
+    if (iWant > sizeof(acBuf)) iWant = sizeof(acBuf);
+    if ((size_t) (lLength - lDone) < iWant) iWant = lLength - lDone;
+    if ((RecvBuf_readn(oBuf, acBuf, iWant) != (ssize_t) iWant) ||
+	(Common_writen(iFD, acBuf, iWant) == FAILURE)) {
+      perror("error writing to file");
+      return FAILURE;
+    }
+    lDone += iWant;
+  }
+  if (Uring_isOn()) {
+    if ((iGot = Uring_copy(iFD, RecvBuf_getFD(oBuf), lLength - lDone)) >= 0)
+      return lDone + iGot;
+    if (errno != ENOSYS) {
+      perror("error receiving file");
+      return FAILURE;
+    }
+  }
+
+  /* a mapping of the file, a window at a time, and an fdatasync
+     before the rename were slower than this at every size from 1 MB
+     to 4 GB (see bench/recv_bench.c) */
+  if (posix_memalign(&pvBuf, RECV_ALIGN, RECV_BUFF) != 0) {
+    fprintf(stderr, "cannot allocate memory\n");
+    return FAILURE;
+  }
+  while (lDone < lLength) {
+    iWant = (lLength - lDone < RECV_BUFF) ? (size_t) (lLength - lDone) : RECV_BUFF;
+    iGot = RecvBuf_readn(oBuf, pvBuf, iWant);
+    if (iGot < 0) {
+      fprintf(stderr, "error reading from socket\n");
+      lDone = FAILURE;
+      break;
+    }
+    if ((iGot > 0) && (Common_writen(iFD, pvBuf, iGot) == FAILURE)) {
+      perror("error writing to file");
+      lDone = FAILURE;
+      break;
+    }
+    lDone += iGot;
+    if ((size_t) iGot < iWant) /* EOF */
+      break;
+  }
+  free(pvBuf);
+  return lDone;
+}
+
 /*--------------------------------------------------------------------*/            
-/* receive a file through a file descriptor 
-   if pcDest is NULL, write to stdout.
+/* receive a file through a buffered descriptor 
+   if pcDest is NULL, write to stdout. A regular file is received under
+   a temporary name next to pcDest, allocated at its full size first,
+   and renamed into place once it is complete; anything else that
+   already exists at pcDest (a device, a fifo) is written to directly.
  */
 
-int Common_recvFile(int iSockFD, char *pcDest)
+int Common_recvFile(RecvBuf_T oBuf, char *pcDest)
 {
   /* variable declarations */
-  char acBuf[MAX_BUFF];
-  char acCopy[MAX_BUFF];
-  FILE *FD = NULL;
+  char acBuf[LEGACY_LENGTH_WIDTH + 2];
+  char acTemp[PATH_MAX];
+  struct stat sStat;
+  int iFD = STDOUT_FILENO;
+  int iDirect = (pcDest == NULL);
   ssize_t iGot = 0;
   long lFileLength = 0;
+  long lDone = 0;
   int iIndex = 0;
-  bzero(acBuf, MAX_BUFF);
-  bzero(acCopy, MAX_BUFF);
-  
-  /* open destination file to receive */
-  if (pcDest != NULL) {
-    if (!(FD  = fopen(pcDest, "w"))) {
-      perror("cannot open file");
-      return FAILURE;
-    }
-  }
+  bzero(acBuf, sizeof(acBuf));
 
   /* recv size of file */
-  iGot = Common_readn(iSockFD, acBuf, LONG_WIDTH + 1);
-  if (iGot < 0) { /* error */
+  iGot = RecvBuf_readn(oBuf, acBuf, LEGACY_LENGTH_WIDTH + 1);
+  if (iGot != LEGACY_LENGTH_WIDTH + 1) { /* error */
     fprintf(stderr, "error reading from socket\n");
     return FAILURE;
   }
-  while (acBuf[iIndex] != '\n') iIndex++;
-  memcpy(acCopy, acBuf, iIndex);
-  lFileLength = atol(acCopy);
-
-  /* read data from client and write to file */
-  while (lFileLength > 0) {
-    iGot = Common_readn(iSockFD, acBuf, 
-			(lFileLength >= MAX_BUFF ? MAX_BUFF : lFileLength));
-    //printf("*****\nReading to %s:\n%s", pcDest, acBuf); fflush(NULL); // DEBUG
-    if (iGot < 0) { /* error */
-      fprintf(stderr, "error reading from socket\n");
+  while ((iIndex < LEGACY_LENGTH_WIDTH) && (acBuf[iIndex] != '\n')) iIndex++;
+  acBuf[iIndex] = '\0';
+  lFileLength = atol(acBuf);
+
+  /* open destination file to receive, at its full size: it cannot
+     run out of space halfway */
+  if ((pcDest != NULL) && (stat(pcDest, &sStat) == 0) &&
+      !S_ISREG(sStat.st_mode)) {
+    iDirect = TRUE;
+    if ((iFD = open(pcDest, O_WRONLY | O_CLOEXEC)) == -1) {
+      perror("cannot open file");
       return FAILURE;
     }
-    
-    if (iGot == 0) /* EOF */
-      break;
-    
-    if (fwrite(acBuf, 1, iGot, (pcDest != NULL ? FD : stdout)) < (size_t) iGot) { /* otherwise write data to file */
-      perror("error writing to file");
+  }
+  else if (pcDest != NULL) {
+    if (snprintf(acTemp, sizeof(acTemp), "%s.%ld.part", pcDest,
+		 (long) getpid()) >= (int) sizeof(acTemp)) {
+      fprintf(stderr, "cannot open file: %s\n", strerror(ENAMETOOLONG));
+      return FAILURE;
+    }
+    if ((iFD = open(acTemp, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0666)) == -1) {
+      perror("cannot open file");
       return FAILURE;
     }
+    if (lFileLength > 0)
+      fallocate(iFD, 0, 0, lFileLength); /* not every file system can */
+  }
 
-    bzero(acBuf, MAX_BUFF);
-    lFileLength -= iGot;
+  /* read data from client and write to file */
+  lDone = Common_recvBody(oBuf, iFD, lFileLength);
+  if (iDirect) {
+    if (pcDest != NULL) close(iFD);
+    return (lDone == lFileLength) ? SUCCESS : FAILURE;
+  }
 
-    if (iGot < MAX_BUFF) /* EOF */
-      break;  
+  if (lDone == lFileLength) {
+    if ((close(iFD) == -1) || (rename(acTemp, pcDest) == -1)) {
+      perror("error writing to file");
+      unlink(acTemp);
+      return FAILURE;
+    }
+    return SUCCESS;
   }
-  
-  assert(lFileLength == 0);
+  close(iFD);
+  unlink(acTemp);
 
-  if (pcDest != NULL) fclose(FD);
-  return SUCCESS;
+  /* the connection went away before the whole file arrived */
+  if (lDone != FAILURE)
+    fprintf(stderr, "connection lost during file transfer\n");
+  return FAILURE;
 }
 
 /*--------------------------------------------------------------------*/     
@@ -262,119 +531,55 @@ void Common_checkSigUnblock(int signum)
 
 /*--------------------------------------------------------------------*/     
 
-/* free oTokens and oCmds arrays. */
-
-void Common_cleanup(DynArray_T oTokens, DynArray_T oCmds)
-{
-  if (oTokens != NULL) {
-    DynArray_map(oTokens, Lex_freeToken, NULL);
-    DynArray_free(oTokens);
-  }
-  if (oCmds != NULL) {
-    DynArray_map(oCmds, Syn_freeCmd, NULL);
-    DynArray_free(oCmds);
-  }
-}
-
-/*--------------------------------------------------------------------*/ 
-
-/* create argv array corresponding to oCmds and return pointer to it */
-
-char **Common_createArgv(DynArray_T oCmds)
-{
-   char **apcArgv = NULL;
-   Cmd_T psCmd = NULL;
-   int iArgs = 0;
-   int i;
-
-   assert(oCmds != NULL);
-
-   /* Number of arguments in command. */
-   for (i = 0; i < DynArray_getLength(oCmds); i++)
-   {
-      psCmd = (Cmd_T)DynArray_get(oCmds, i);
-      iArgs++;
-   }
-   
-   /* Create apcArgv array, of size iArgs + 1 (to hold command 
-      name, arguments and NULL terminator). */
-   apcArgv = (char**)calloc((size_t)(iArgs + 1), sizeof(char*));
-   if (apcArgv == NULL)
-      return NULL;
-   
-   /* Assign values to apcArgv elements. */
-   for (i = 0, iArgs = 0; i < DynArray_getLength(oCmds); i++)
-   {
-      psCmd = (Cmd_T)DynArray_get(oCmds, i);
-      apcArgv[iArgs++] = Syn_returnValue(psCmd);
-   }
-   apcArgv[iArgs] = NULL;
- 
-   return apcArgv;
-}
-
-/*--------------------------------------------------------------------*/ 
-
-/* redirect stdin based on oCmds. Function requires calling program's
+/* redirect stdin based on psCmd. Function requires calling program's
    name for error-checking. Returns 1 (TRUE) if successful, or 0 (FALSE)
    if an error occured. */
 
-int Common_redirectStdin(DynArray_T oCmds, char *pcProgName) 
+int Common_redirectStdin(const SynCmd *psCmd, char *pcProgName) 
 {
-   int i;
    int iFd;
    int iRet;
    int iErrSv;
-   Cmd_T psCmd = NULL;
    char *pcFileName = NULL;
 
-   assert(oCmds != NULL);
+   assert(psCmd != NULL);
    assert(pcProgName != NULL);
 
-   /* Check for stdin redirection. */
-   for (i = 0; i < DynArray_getLength(oCmds); i++)
+   /* Redirect stdin, if required. */
+   pcFileName = psCmd->pcStdin;
+   if (pcFileName != NULL)
    {
-      psCmd = (Cmd_T)DynArray_get(oCmds, i);
-      /* Redirect stdin, if required. */
-      if (Syn_returnType(psCmd) == CMD_STDIN)
+      /* Create new file descriptor. */
+      iFd = open(pcFileName, O_RDONLY);
+      if (iFd == -1) 
       {
-         pcFileName = Syn_returnValue(psCmd);
-         if (pcFileName != NULL)
-         {
-            /* Create new file descriptor. */
-            iFd = open(pcFileName, O_RDONLY);
-            if (iFd == -1) 
-            {
-               iErrSv = errno; 
-               fprintf(stderr, "%s: %s: %s\n", pcProgName,  pcFileName, 
-                       strerror(iErrSv));
-               return FALSE; 
-            }
-            
-            /* Close stdin file descriptor. */
-            iRet = close(0);
-            if (iRet == -1) 
-            {
-               perror(pcProgName);
-               return FALSE; 
-            }
-
-            /* Duplicate new file descriptor to stdin. */
-            iRet = dup2(iFd, 0);
-            if (iRet == -1) 
-           { 
-              perror(pcProgName);
-               return FALSE; 
-            }            
-            /* Close the file descriptor created in first step. */
-            iRet = close(iFd);
-            if (iRet == -1) 
-            {
-               perror(pcProgName);
-               return FALSE; 
-            }
-         }
-         return TRUE;
+         iErrSv = errno; 
+         fprintf(stderr, "%s: %s: %s\n", pcProgName,  pcFileName, 
+                 strerror(iErrSv));
+         return FALSE; 
+      }
+      
+      /* Close stdin file descriptor. */
+      iRet = close(0);
+      if (iRet == -1) 
+      {
+         perror(pcProgName);
+         return FALSE; 
+      }
+
+      /* Duplicate new file descriptor to stdin. */
+      iRet = dup2(iFd, 0);
+      if (iRet == -1) 
+      { 
+         perror(pcProgName);
+         return FALSE; 
+      }            
+      /* Close the file descriptor created in first step. */
+      iRet = close(iFd);
+      if (iRet == -1) 
+      {
+         perror(pcProgName);
+         return FALSE; 
       }
    }
    return TRUE;
@@ -382,67 +587,56 @@ int Common_redirectStdin(DynArray_T oCmds, char *pcProgName)
 
 /*--------------------------------------------------------------------*/ 
 
-/* redirect stdout based on oCmds. Function requires calling program's
+/* redirect stdout based on psCmd. Function requires calling program's
    name for error-checking. Returns 1 (TRUE) if successful, or 0 (FALSE)
    if an error occured. */
 
-int Common_redirectStdout(DynArray_T oCmds, char *pcProgName)   
+int Common_redirectStdout(const SynCmd *psCmd, char *pcProgName)   
 {
-   int i;
    int iFd;
    int iRet;
    int iErrSv;
-   Cmd_T psCmd = NULL;
    char *pcFileName = NULL;
-   
-   assert(oCmds != NULL);
+
+   assert(psCmd != NULL);
    assert(pcProgName != NULL);
 
-  /* Check for stdout redirection. */
-   for (i = 0; i < DynArray_getLength(oCmds); i++)
+   /* Redirect stdout, if required. */
+   pcFileName = psCmd->pcStdout;
+   if (pcFileName != NULL)
    {
-      psCmd = (Cmd_T)DynArray_get(oCmds, i);
-      /* Redirect stdout, if required. */
-      if (Syn_returnType(psCmd) == CMD_STDOUT)
+      /* Create new file descriptor. */
+      iFd = creat(pcFileName, PERMISSIONS);
+      if (iFd == -1) 
       {
-         pcFileName = Syn_returnValue(psCmd);
-         if (pcFileName != NULL)
-         {
-            /* Create new file descriptor. */
-            iFd = creat(pcFileName, PERMISSIONS);
-            if (iFd == -1) 
-            {
-               iErrSv = errno; 
-               fprintf(stderr, "%s: %s: %s\n", pcProgName,  pcFileName, 
-                       strerror(iErrSv));
-               return FALSE; 
-            }
-
-            /* Close stdout file descriptor. */
-            iRet = close(1);
-            if (iRet == -1) 
-            {
-               perror(pcProgName);
-               return FALSE; 
-            }
-            
-            /* Duplicate new file descriptor to stdout. */
-            iRet = dup2(iFd, 1);
-            if (iRet == -1) 
-            {
-               perror(pcProgName);
-               return FALSE; 
-            }
-            
-            /* Close the file descriptor created in first step. */
-            iRet = close(iFd);
-            if (iRet == -1) 
-            {
-               perror(pcProgName);
-               return FALSE; 
-            }
-         }
-         return TRUE;
+         iErrSv = errno; 
+         fprintf(stderr, "%s: %s: %s\n", pcProgName,  pcFileName, 
+                 strerror(iErrSv));
+         return FALSE; 
+      }
+
+      /* Close stdout file descriptor. */
+      iRet = close(1);
+      if (iRet == -1) 
+      {
+         perror(pcProgName);
+         return FALSE; 
+      }
+      
+      /* Duplicate new file descriptor to stdout. */
+      iRet = dup2(iFd, 1);
+      if (iRet == -1) 
+      {
+         perror(pcProgName);
+         return FALSE; 
+      }
+      
+      /* Close the file descriptor created in first step. */
+      iRet = close(iFd);
+      if (iRet == -1) 
+      {
+         perror(pcProgName);
+         return FALSE; 
       }
    }
    return TRUE;
@@ -463,8 +657,6 @@ int Common_redirectStdoutForce(char *pcFileName, char *pcProgName)
   assert(pcFileName != NULL);
   assert(pcProgName != NULL);
   
-  //printf("\nRedirecting stdout to: %s\n", pcFileName); fflush(NULL); //DEBUG
-  
   /* Create new file descriptor. */
   iFd = creat(pcFileName, PERMISSIONS);
   if (iFd == -1) {
@@ -495,75 +687,62 @@ int Common_redirectStdoutForce(char *pcFileName, char *pcProgName)
     return FALSE; 
   }
 
-  //printf("TEST"); // DEBUG
-
   return TRUE;
 }
 
 
 /*--------------------------------------------------------------------*/ 
 
-/* redirect stderr based on oCmds. Function requires calling program's
+/* redirect stderr based on psCmd. Function requires calling program's
    name for error-checking. Returns 1 (TRUE) if successful, or 0 (FALSE)
    if an error occured. */
 
-int Common_redirectStderr(DynArray_T oCmds, char *pcProgName)   
+int Common_redirectStderr(const SynCmd *psCmd, char *pcProgName)   
 {
-   int i;
    int iFd;
    int iRet;
    int iErrSv;
-   Cmd_T psCmd = NULL;
    char *pcFileName = NULL;
-   
-   assert(oCmds != NULL);
+
+   assert(psCmd != NULL);
    assert(pcProgName != NULL);
 
-  /* Check for stderr redirection. */
-   for (i = 0; i < DynArray_getLength(oCmds); i++)
+   /* Redirect stderr, if required. */
+   pcFileName = psCmd->pcStderr;
+   if (pcFileName != NULL)
    {
-      psCmd = (Cmd_T)DynArray_get(oCmds, i);
-      /* Redirect stdout, if required. */
-      if (Syn_returnType(psCmd) == CMD_STDERR)
+      /* Create new file descriptor. */
+      iFd = creat(pcFileName, PERMISSIONS);
+      if (iFd == -1) 
       {
-         pcFileName = Syn_returnValue(psCmd);
-         if (pcFileName != NULL)
-         {
-            /* Create new file descriptor. */
-            iFd = creat(pcFileName, PERMISSIONS);
-            if (iFd == -1) 
-            {
-               iErrSv = errno; 
-               fprintf(stderr, "%s: %s: %s\n", pcProgName,  pcFileName, 
-                       strerror(iErrSv));
-               return FALSE; 
-            }
-
-            /* Close stderr file descriptor. */
-            iRet = close(2);
-            if (iRet == -1) 
-            {
-               perror(pcProgName);
-               return FALSE; 
-            }
-            
-            /* Duplicate new file descriptor to stderr. */
-            iRet = dup2(iFd, 2);
-            if (iRet == -1) 
-            {
-               perror(pcProgName);
-               return FALSE; 
-            }
-            
-            /* Close the file descriptor created in first step. */
-            iRet = close(iFd);
-            if (iRet == -1) 
-            {
-               perror(pcProgName);
-               return FALSE; 
-            }
-         }
-         return TRUE;
+         iErrSv = errno; 
+         fprintf(stderr, "%s: %s: %s\n", pcProgName,  pcFileName, 
+                 strerror(iErrSv));
+         return FALSE; 
+      }
+
+      /* Close stderr file descriptor. */
+      iRet = close(2);
+      if (iRet == -1) 
+      {
+         perror(pcProgName);
+         return FALSE; 
+      }
+      
+      /* Duplicate new file descriptor to stderr. */
+      iRet = dup2(iFd, 2);
+      if (iRet == -1) 
+      {
+         perror(pcProgName);
+         return FALSE; 
+      }
+      
+      /* Close the file descriptor created in first step. */
+      iRet = close(iFd);
+      if (iRet == -1) 
+      {
+         perror(pcProgName);
+         return FALSE; 
       }
    }
    return TRUE;
@@ -584,8 +763,6 @@ int Common_redirectStderrForce(char *pcFileName, char *pcProgName)
   assert(pcFileName != NULL);
   assert(pcProgName != NULL);
   
-  //printf("\nRedirecting stdout to: %s\n", pcFileName); fflush(NULL); //DEBUG
-  
   /* Create new file descriptor. */
   iFd = creat(pcFileName, PERMISSIONS);
   if (iFd == -1) {
@@ -616,387 +793,292 @@ int Common_redirectStderrForce(char *pcFileName, char *pcProgName)
     return FALSE; 
   }
 
-  //printf("TEST"); // DEBUG
-
   return TRUE;
 }
 
 /*--------------------------------------------------------------------*/ 
 
-/* execute a command stored in oCmds. Redirect stdout depending on
-   pcFileName
+/* execute command psCmd, with its redirections, and wait for it
 */
 
-void Common_exec(DynArray_T oCmds, char *pcProgName)
+void Common_exec(SynCmd *psCmd, char *pcProgName)
 {
-  int iPid = 0;
-  int iErrSv = 0;
-  char **apcArgv = NULL;
-   
-  /* create arguments array */
-  if ((apcArgv = Common_createArgv(oCmds)) == NULL) {
-    fprintf(stderr, "%s: cannot create argv array\n", pcProgName);
+  pid_t iPid = 0;
+
+  /* start child */
+  if ((iPid = Common_spawn(psCmd, NULL, pcProgName)) == FAILURE)
+    return;
+
+  /* parent process */
+  if (waitpid(iPid, NULL, 0) == -1) {
+    perror(pcProgName);
     return;
   }
+}
+
+/*--------------------------------------------------------------------*/ 
+
+/* start command psCmd in a child process and return its
+   pid without waiting for it, or FAILURE if it could not be started.
+   If ppcEnv is not NULL, the child runs with ppcEnv as its
+   environment instead of the caller's. The child of a pipeline runs
+   its stages, waits for them and exits with the status of the last.
+   A background command gets a process group of its own and reads
+   /dev/null unless its stdin is redirected
+*/
+
+pid_t Common_spawn(SynCmd *psCmd, char **ppcEnv, char *pcProgName)
+{
+  extern char **environ;
+  pid_t iPid = 0;
+  int iNull = -1;
+
+  assert(psCmd != NULL);
+  assert(psCmd->iArgc > 0);
  
   /* fork */
   fflush(NULL);
   if ((iPid = fork()) == -1) {
     perror(pcProgName);
-    return;
+    return FAILURE;
   }
 
   /* child process */
   if (iPid == 0) {
-    /* Redirect stdin */
-    if(!Common_redirectStdin(oCmds, pcProgName))
-      exit(EXIT_FAILURE);
+    /* undo what an event-driven parent may have set up */
+    signal(SIGPIPE, SIG_DFL);
+    Common_checkSigUnblock(SIGCHLD);
+    if (ppcEnv != NULL)
+      environ = ppcEnv;
+
+    /* a job is signalled as a whole, and not from the terminal */
+    if (psCmd->iBackground) {
+      setpgid(0, 0);
+      if ((iNull = open("/dev/null", O_RDONLY)) != -1) {
+	dup2(iNull, 0);
+	close(iNull);
+      }
+    }
 
-    /* Redirect stdout */
-    if(!Common_redirectStdout(oCmds, pcProgName))
-      exit(EXIT_FAILURE);
-    
-    /* Redirect stderr */
-    if(!Common_redirectStderr(oCmds, pcProgName))
-      exit(EXIT_FAILURE);
-    
-    /* Execute command. */
-    execvp(apcArgv[0], apcArgv);
-    iErrSv = errno;
-    fprintf(stderr, "%s: %s\n", pcProgName, strerror(iErrSv));
-    exit(EXIT_FAILURE);
+    if (psCmd->psNext != NULL)
+      exit(Pipeline_run(psCmd, pcProgName));
+    Common_execCmd(psCmd, pcProgName);
   }
 
-  /* parent process */
-  if ((iPid = wait(NULL)) == -1) {
-    perror(pcProgName);
-    return;
-  }
+  return iPid;
+}
+
+/*--------------------------------------------------------------------*/ 
+
+/* redirect and execute command psCmd in this process. Does not
+   return: exits if the command cannot be executed
+*/
+
+void Common_execCmd(SynCmd *psCmd, char *pcProgName)
+{
+  int iErrSv = 0;
+
+  assert(psCmd != NULL);
+
+  /* Redirect stdin */
+  if(!Common_redirectStdin(psCmd, pcProgName))
+    exit(EXIT_FAILURE);
 
-  /* cleanup */
-  free(apcArgv);
+  /* Redirect stdout */
+  if(!Common_redirectStdout(psCmd, pcProgName))
+    exit(EXIT_FAILURE);
+    
+  /* Redirect stderr */
+  if(!Common_redirectStderr(psCmd, pcProgName))
+    exit(EXIT_FAILURE);
+    
+  /* Execute command. */
+  execvp(psCmd->ppcArgv[0], psCmd->ppcArgv);
+  iErrSv = errno;
+  fprintf(stderr, "%s: %s\n", pcProgName, strerror(iErrSv));
+  exit(EXIT_FAILURE);
 }
 
 /*--------------------------------------------------------------------*/ 
 
-/* Checks if oCmds is a cd command. If so, it executes this command
+/* Checks if psCmd is a cd command. If so, it executes this command
    using chdir(). Returns 1 if command is cd (regardless of 
    successful or unsuccessful execution), 0 otherwise. */
 
-int Common_handleCd(DynArray_T oCmds, char *pcProgName)
+int Common_handleCd(SynCmd *psCmd, char *pcProgName)
 
 {
    int i;
-   int iLength;
-   int iFlag = FALSE;
-   int iArgs = 0;
    int iLastDir = 0;
    int iErrSv;
-   Cmd_T psCmd = NULL;
-   Cmd_T psArg = NULL;
-   CmdType eType;
+   char *pcArg = NULL;
    char *pcPath = NULL;
 
-   assert(oCmds != NULL);
+   assert(psCmd != NULL);
    assert(pcProgName != NULL);
 
-   iLength = DynArray_getLength(oCmds);
-
-   /* Go through entire command. */
-   for (i = 0; i < iLength; i++)  {
-      psCmd = (Cmd_T) DynArray_get(oCmds, i);
-      eType = Syn_returnType(psCmd);
-      /* Check if command name is cd. */
-      if (i == 0) {
-         if (strcmp(Syn_returnValue(psCmd), "cd") == 0)
-            iFlag = TRUE;
-         else
-            break;
-      }
-      /* Check for number of arguments. */
-      else if (eType == CMD_ARG) {
-         iArgs++;
-         psArg = psCmd;
-      }
-   }
-   
    /* If command is not cd. */
-   if (!iFlag)
+   if (psCmd->eVerb != VERB_CD)
       return FALSE;
-   /* Execute cd. */
-   else {
-     //printf("\nCommand is cd\n"); // DEBUG
-      /* Too many arguments. */ 
-      if (iArgs > 1) {
-         fprintf(stderr, "%s: cd: too many arguments\n", pcProgName);
+
+   /* Too many arguments. */ 
+   if (psCmd->iArgc > 2) {
+      fprintf(stderr, "%s: cd: too many arguments\n", pcProgName);
+      return TRUE;
+   }
+   /* Change directory to home. */
+   else if (psCmd->iArgc == 1) {
+      pcPath = getenv("HOME");
+      if (chdir(pcPath) == -1) {
+         iErrSv = errno; 
+         fprintf(stderr, "%s: cd: %s: %s\n", pcProgName, pcPath,
+                 strerror(iErrSv));
          return TRUE;
       }
-      /* Change directory to home. */
-      else if (iArgs == 0) {
-         pcPath = getenv("HOME");
+   }
+   /* Change directory. */
+   else  {
+      pcArg = psCmd->ppcArgv[1];
+      /* Argument "." has no effect. */
+      if (strcmp(pcArg, ".") == 0);
+      /* Argument ".." causes a one-level up change in directory. */
+      else if (strcmp(pcArg, "..") == 0) {
+         pcPath = getcwd(NULL, 0);
+         /* Find last '/' */
+         for (i = 0; i < (int)strlen(pcPath); i++)
+            if (pcPath[i] == '/')
+               iLastDir = i;
+         /* Truncate pcPath at last '/' */
+         if (iLastDir != 0)
+            pcPath[iLastDir] = '\0';
+         else /* Case where path is only '/' */
+            pcPath[iLastDir + 1] = '\0';
+         /* Change directory. */
          if (chdir(pcPath) == -1) {
             iErrSv = errno; 
             fprintf(stderr, "%s: cd: %s: %s\n", pcProgName, pcPath,
                     strerror(iErrSv));
+            free(pcPath);
             return TRUE;
          }
+         free(pcPath);
       }
-      /* Change directory. */
-      else  {
-         /* Argument "." has no effect. */
-         if (strcmp(Syn_returnValue(psArg), ".") == 0);
-         /* Argument ".." causes a one-level up change in directory. */
-         else if (strcmp(Syn_returnValue(psArg), "..") == 0) {
-	    pcPath = getcwd(NULL, 0);
-	    //printf("\nChanging directory from %s to", pcPath); // DEBUG
-            /* Find last '/' */
-            for (i = 0; i < (int)strlen(pcPath); i++)
-               if (pcPath[i] == '/')
-                  iLastDir = i;
-            /* Truncate pcPath at last '/' */
-            if (iLastDir != 0)
-               pcPath[iLastDir] = '\0';
-            else /* Case where path is only '/' */
-               pcPath[iLastDir + 1] = '\0';
-            /* Change directory. */
-	    //printf("%s\n", pcPath); // DEBUG
-            if (chdir(pcPath) == -1) {
-               iErrSv = errno; 
-               fprintf(stderr, "%s: cd: %s: %s\n", pcProgName, pcPath,
-                       strerror(iErrSv));
-	       free(pcPath);
-               return TRUE;
-            }
-	    free(pcPath);
-         }
-         /* Change directory to given path. */
-         else {
-            pcPath = Syn_returnValue(psArg);
-	    //printf("\nChanging directory to %s\n", pcPath); // DEBUG
-            if (chdir(pcPath) == -1) {
-               iErrSv = errno;
-               fprintf(stderr, "%s: cd: %s: %s\n", pcProgName, pcPath, 
-                       strerror(iErrSv));
-               return TRUE;
-            }
+      /* Change directory to given path. */
+      else {
+         pcPath = pcArg;
+         if (chdir(pcPath) == -1) {
+            iErrSv = errno;
+            fprintf(stderr, "%s: cd: %s: %s\n", pcProgName, pcPath, 
+                    strerror(iErrSv));
+            return TRUE;
          }
       }
-   return TRUE;
    }
+   return TRUE;
 }
 
 /*--------------------------------------------------------------------*/            
-/* Checks if oCmds is a setenv command. If so, it executes this command
+/* Checks if psCmd is a setenv command. If so, it executes this command
    using setenv(). Returns 1 if command is setenv (regardless of
    whether execution is successful or not), 0 otherwise. */
 
-int Common_handleSetenv(DynArray_T oCmds, char *pcProgName)
+int Common_handleSetenv(SynCmd *psCmd, char *pcProgName)
 
 {
-   int i;
-   int iLength;
-   int iFlag = FALSE;
-   int iArgs = 0;
    int iErrSv;
-   Cmd_T psCmd = NULL;
-   Cmd_T psArg = NULL;
-   char *pcArgs[2];
    char *pcArg = NULL;
-   CmdType eType;
    
-   assert(oCmds != NULL);
+   assert(psCmd != NULL);
    assert(pcProgName != NULL);
 
-   iLength = DynArray_getLength(oCmds);
-
-   /* Go through entire command. */
-   for (i = 0; i < iLength; i++) {
-      psCmd = (Cmd_T)DynArray_get(oCmds, i);
-      eType = Syn_returnType(psCmd);
-      /* Check if command name is setenv. */
-      if (i == 0) {
-         if (strcmp(Syn_returnValue(psCmd), "setenv") == 0)
-            iFlag = TRUE;
-         else
-            break;
-      }
-      /* Checks for number of arguments. */
-      else if (eType == CMD_ARG) {
-         iArgs++;
-         psArg = psCmd;
-      }
-   }
-   
    /* If command is not setenv. */
-   if (!iFlag)
+   if (psCmd->eVerb != VERB_SETENV)
       return FALSE;
-   /* Execute setenv. */
-   else  {
-      /* Too many arguments. */
-      if (iArgs > 2) {
-         fprintf(stderr, "%s: setenv: too many arguments\n", 
-                 pcProgName);
-         return TRUE;
-      }
-      /* No arguments. */
-      else if (iArgs == 0) {
-         fprintf(stderr, "%s: setenv: missing variable\n", pcProgName);
-         return TRUE;
-      }
-      /* Set variable to empty. */
-      else if (iArgs == 1) {
-         pcArg = Syn_returnValue(psArg);
-         if(setenv(pcArg, "", 1) == -1) {
-            iErrSv = errno; 
-            fprintf(stderr, "%s: setenv: %s: %s\n", pcProgName, pcArg,
-                    strerror(iErrSv));
-            return TRUE;
-         }
-      }
-      /* Set value of variable. */
-      else {
-         int j = 0;
-         /* Find the 2 arguments. */
-         for (i = 0; i < iLength; i++) {
-            psCmd = (Cmd_T)DynArray_get(oCmds, i);
-            if (Syn_returnType(psCmd) == CMD_ARG)
-               pcArgs[j++] = Syn_returnValue(psCmd);
-         }
-         if(setenv(pcArgs[0], pcArgs[1], 1) == -1) {
-            iErrSv = errno; 
-            fprintf(stderr, "%s: setenv: %s: %s\n", pcProgName, pcArgs[0],
-                    strerror(iErrSv));
-            return TRUE;
-         }
-      }
+
+   /* Too many arguments. */
+   if (psCmd->iArgc > 3) {
+      fprintf(stderr, "%s: setenv: too many arguments\n", 
+              pcProgName);
+      return TRUE;
+   }
+   /* No arguments. */
+   else if (psCmd->iArgc == 1) {
+      fprintf(stderr, "%s: setenv: missing variable\n", pcProgName);
+      return TRUE;
+   }
+   /* Set value of variable, or set it to empty. */
+   pcArg = psCmd->ppcArgv[1];
+   if (setenv(pcArg, (psCmd->iArgc == 3) ? psCmd->ppcArgv[2] : "", 1)
+       == -1) {
+      iErrSv = errno; 
+      fprintf(stderr, "%s: setenv: %s: %s\n", pcProgName, pcArg,
+              strerror(iErrSv));
+      return TRUE;
    }
    return TRUE;
 }
 
 /*--------------------------------------------------------------------*/            
-/* Checks if oCmds is an unsetenv command. If so, it executes this 
+/* Checks if psCmd is an unsetenv command. If so, it executes this 
    command using unsetenv(). Returns 1 if successful, 0 otherwise. */
 
-int Common_handleUnsetenv(DynArray_T oCmds, char *pcProgName)
+int Common_handleUnsetenv(SynCmd *psCmd, char *pcProgName)
 
 {
-   int i;
-   int iLength;
-   int iFlag = FALSE;
-   int iArgs = 0;
    int iErrSv;
    char *pcArg = NULL;
-   Cmd_T psCmd = NULL;
-   Cmd_T psArg = NULL;
-   CmdType eType;
 
-   assert(oCmds != NULL);
+   assert(psCmd != NULL);
    assert(pcProgName != NULL);
-   
-   iLength = DynArray_getLength(oCmds);
-
-   /* Go through entire command. */
-   for (i = 0; i < iLength; i++) {
-      psCmd = (Cmd_T)DynArray_get(oCmds, i);
-      eType = Syn_returnType(psCmd);
-      /* Check if command name is unsetenv. */
-      if (i == 0) {
-         if (strcmp(Syn_returnValue(psCmd), "unsetenv") == 0)
-            iFlag = TRUE;
-         else
-            break;
-      }
-      /* Checks for number of arguments. */
-      else if (eType == CMD_ARG) {
-         iArgs++;
-         psArg = psCmd;
-      }
-   }
-   
+
    /* If command is not unsetenv. */
-   if (!iFlag)
+   if (psCmd->eVerb != VERB_UNSETENV)
       return FALSE;
-   /* Execute unsetenv. */
-   else {
-      /* Too many arguments. */
-      if (iArgs > 1) {
-         fprintf(stderr, "%s: unsetenv: too many arguments\n", 
-                 pcProgName);
-         return TRUE;
-      }
-      /* No arguments. */
-      else if (iArgs == 0) {
-         fprintf(stderr, "%s: unsetenv: missing variable\n", 
-                 pcProgName);
-         return TRUE;
-      }
-      /* Remove value of variable. */
-      else if (iArgs == 1) {
-         pcArg = Syn_returnValue(psArg);
-         if(unsetenv(pcArg) == -1) {
-            iErrSv = errno; 
-            fprintf(stderr, "%s: unsetenv: %s: %s\n", pcProgName, pcArg,
-                    strerror(iErrSv));
-            return TRUE;
-         }
-      }  
+
+   /* Too many arguments. */
+   if (psCmd->iArgc > 2) {
+      fprintf(stderr, "%s: unsetenv: too many arguments\n", 
+              pcProgName);
+      return TRUE;
+   }
+   /* No arguments. */
+   else if (psCmd->iArgc == 1) {
+      fprintf(stderr, "%s: unsetenv: missing variable\n", 
+              pcProgName);
+      return TRUE;
+   }
+   /* Remove value of variable. */
+   pcArg = psCmd->ppcArgv[1];
+   if(unsetenv(pcArg) == -1) {
+      iErrSv = errno; 
+      fprintf(stderr, "%s: unsetenv: %s: %s\n", pcProgName, pcArg,
+              strerror(iErrSv));
+      return TRUE;
    }
    return TRUE;
 }
 
 /*--------------------------------------------------------------------*/            
-/* Checks if oCmds is an exit command. If so, it executes this command
-   using exit(). Returns 1 if successful, 0 otherwise. If pcFileName
-   is not NULL, it deletes that file.
+/* Checks if psCmd is an exit command. If so, it executes this command
+   using exit(). Returns 1 if successful, 0 otherwise.
 */
 
-int Common_handleExit(DynArray_T oCmds, char *pcProgName)
+int Common_handleExit(SynCmd *psCmd, char *pcProgName)
 {
-   int i;
-   int iLength;
-   int iFlag = FALSE;
-   int iArgs = 0;
-   Cmd_T psCmd = NULL;
-   CmdType eType;
-
-   assert(oCmds != NULL);
+   assert(psCmd != NULL);
    assert(pcProgName != NULL);
 
-   iLength = DynArray_getLength(oCmds);
-
-   /* Go through entire command. */
-   for (i = 0; i < iLength; i++)
-   {
-      psCmd = (Cmd_T)DynArray_get(oCmds, i);
-      eType = Syn_returnType(psCmd);
-      /* Check if command name is exit. */
-      if (i == 0) {
-         if (strcmp(Syn_returnValue(psCmd), "exit") == 0)
-            iFlag = TRUE;
-         else
-            break;
-      }
-      /* Check for number of arguments. */
-      else if (eType == CMD_ARG)
-         iArgs++;
-   }
-   
    /* If command is not exit. */
-   if (!iFlag)
+   if (psCmd->eVerb != VERB_EXIT)
       return FALSE;
-   /* Execute command. */
-   else {
-      /* Too many arguments. */
-      if (iArgs > 0) { 
-         fprintf(stderr, "%s: exit: too many arguments\n", pcProgName);
-         return TRUE;
-      }
-      /* Execute exit command. */
-      else
-	{
-	  exit(EXIT_SUCCESS);
-	}
+
+   /* Too many arguments. */
+   if (psCmd->iArgc > 1) { 
+      fprintf(stderr, "%s: exit: too many arguments\n", pcProgName);
+      return TRUE;
    }
+   /* Execute exit command. */
+   exit(EXIT_SUCCESS);
 }
 
 /*--------------------------------------------------------------------*/
@@ -1005,34 +1087,130 @@ int Common_handleExit(DynArray_T oCmds, char *pcProgName)
 
 void Common_deleteFile(char *pcFileName, char *pcProgName)
 {
-  int iPid = 0;
-  int iErrSv = 0;
-  char *apcArgv[4] = {"rm", "-f", pcFileName, NULL};
-
   assert(pcFileName != NULL);
   assert(pcProgName != NULL);
- 
-  /* fork */
-  fflush(NULL);
-  if ((iPid = fork()) == -1) {
-    perror(pcProgName);
-    return;
+
+  /* like rm -f: a file that is not there is not an error */
+  if ((unlink(pcFileName) == -1) && (errno != ENOENT))
+    fprintf(stderr, "%s: %s: %s\n", pcProgName, pcFileName, strerror(errno));
+}
+
+/*--------------------------------------------------------------------*/
+
+/* create an anonymous scratch file that has no name in any directory
+   and disappears with its last descriptor */
+
+int Common_createScratch(char *pcProgName)
+{
+  int iFD = -1;
+
+  assert(pcProgName != NULL);
+
+  /* memfd_create(2) keeps it in memory; O_TMPFILE is for kernels
+     before 3.17 */
+  if ((iFD = memfd_create(pcProgName, MFD_CLOEXEC)) != -1)
+    return iFD;
+  if ((iFD = open(P_tmpdir, O_TMPFILE | O_RDWR | O_CLOEXEC, PERMISSIONS)) != -1)
+    return iFD;
+  fprintf(stderr, "%s: scratch file: %s\n", pcProgName, strerror(errno));
+  return FAILURE;
+}
+
+/*--------------------------------------------------------------------*/            
+
+/* compute the SHA-256 digest of file pcPath into pucDigest and its
+   size into *puSize. Return SUCCESS, or FAILURE with errno set if it
+   cannot be read */
+
+int Common_hashFile(const char *pcPath, unsigned char *pucDigest,
+		    uint64_t *puSize)
+{
+  char acBuf[MAX_BUFF];
+  Sha256 sHash;
+  ssize_t iGot = 0;
+  int iErrSv = 0;
+  int iFD = -1;
+
+  assert(pcPath != NULL);
+  assert(pucDigest != NULL);
+
+  if ((iFD = open(pcPath, O_RDONLY | O_CLOEXEC)) == -1)
+    return FAILURE;
+  Sha256_init(&sHash);
+  while (((iGot = read(iFD, acBuf, sizeof(acBuf))) > 0) ||
+	 ((iGot == -1) && (errno == EINTR)))
+    if (iGot > 0)
+      Sha256_update(&sHash, acBuf, (size_t) iGot);
+  iErrSv = errno;
+  close(iFD);
+  if (iGot == -1) {
+    errno = iErrSv;
+    return FAILURE;
   }
 
-  /* child process */
-  if (iPid == 0) {
-    /* Execute command. */
-    execvp(apcArgv[0], apcArgv);
-    iErrSv = errno;
-    fprintf(stderr, "%s: %s\n", pcProgName, strerror(iErrSv));
-    exit(EXIT_FAILURE);
+  if (puSize != NULL)
+    *puSize = sHash.uLength;
+  Sha256_final(&sHash, pucDigest);
+  return SUCCESS;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* lock the counter file pcPath, created if needed, against every
+   other process using it and read its iCount counters into
+   pllCounters. Return the descriptor holding the lock, or FAILURE */
+
+int Common_lockCounters(const char *pcPath, long long *pllCounters,
+			int iCount)
+{
+  char acText[MAX_LINE_SIZE];
+  char *pcNext = acText;
+  char *pcEnd = NULL;
+  ssize_t iGot = 0;
+  int iFD = -1;
+  int i = 0;
+
+  assert(pcPath != NULL);
+  assert(pllCounters != NULL);
+
+  memset(pllCounters, 0, iCount * sizeof(long long));
+  if ((iFD = open(pcPath, O_RDWR | O_CREAT | O_CLOEXEC, PERMISSIONS)) == -1)
+    return FAILURE;
+  if (flock(iFD, LOCK_EX) == -1) {
+    close(iFD);
+    return FAILURE;
   }
 
-  /* parent process */
-  if ((iPid = wait(NULL)) == -1) {
-    perror(pcProgName);
-    return;
+  /* one line of numbers separated by blanks */
+  if ((iGot = pread(iFD, acText, sizeof(acText) - 1, 0)) > 0) {
+    acText[iGot] = '\0';
+    for (i = 0; i < iCount; i++, pcNext = pcEnd) {
+      pllCounters[i] = strtoll(pcNext, &pcEnd, 10);
+      if (pcEnd == pcNext)
+	break;
+    }
   }
+  return iFD;
 }
 
-/*--------------------------------------------------------------------*/            
+/*--------------------------------------------------------------------*/
+
+/* write the iCount counters pllCounters back to the counter file
+   locked by iFD, unless pllCounters is NULL, and release the lock */
+
+void Common_unlockCounters(int iFD, const long long *pllCounters,
+			   int iCount)
+{
+  char acText[MAX_LINE_SIZE];
+  int iLength = 0;
+  int i = 0;
+
+  for (i = 0; (pllCounters != NULL) && (i < iCount); i++)
+    iLength += snprintf(acText + iLength, sizeof(acText) - iLength,
+			"%lld%c", pllCounters[i], (i + 1 < iCount) ? ' ' : '\n');
+  if ((iLength > 0) && (pwrite(iFD, acText, iLength, 0) == iLength))
+    ftruncate(iFD, iLength);
+  close(iFD);
+}
+
+/*--------------------------------------------------------------------*/
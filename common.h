@@ -1,9 +1,14 @@
 #ifndef COMMON_INCLUDED
 #define COMMON_INCLUDED 1
 
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
 #include <assert.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
 #include <netinet/in.h>
 #include <signal.h>
 #include <stdio.h>
@@ -12,14 +17,19 @@
 #include <strings.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/file.h>
+#include <sys/sendfile.h>
 #include <sys/wait.h>
 #include <unistd.h>
 #include <arpa/inet.h>
 #include "dynarray.h"
+#include "arena.h"
+#include "recvbuf.h"
 #include "lex.h"
 #include "syn.h"
-
-#define _GNU_SOURCE
+#include "proto.h"
+#include "sha256.h"
 
 #ifndef TRUE
 #define TRUE 1
@@ -41,6 +51,14 @@
 #define MAX_BUFF 4096
 #endif
 
+#ifndef RECV_BUFF
+#define RECV_BUFF (1024 * 1024) /* bytes of a received file read at once */
+#endif
+
+#ifndef RECV_ALIGN
+#define RECV_ALIGN 4096 /* alignment of the buffer they are read into */
+#endif
+
 #ifndef MAX_LINE_SIZE
 #define MAX_LINE_SIZE 1024
 #endif
@@ -57,9 +75,11 @@
 #define LONG_WIDTH 10
 #endif
 
-#define CMDNAME_REMOTE "remote"
-#define CMDNAME_SEND "sendfile"
-#define CMDNAME_RECV "recvfile"
+/* digits in the length that starts a file or an answer in the legacy
+   protocol, padded with newlines to one more byte than this. Part of
+   the wire format: not the width of a long, which <limits.h> may
+   define as LONG_WIDTH */
+#define LEGACY_LENGTH_WIDTH 10
 
 #define EMPTYFILE "empty.txt"
 
@@ -70,22 +90,31 @@ void Common_makeOutName(int iSockFD, char *pcName); /* make an output filename *
 void Common_itoa(int iConv, char *pcStr); /* convert int to string */
 void Common_ltoa(long lConv, char *pcStr); /* convert long to string */
 ssize_t Common_writen(int iFD, const void *pvBuf, size_t iSize); /* Write "n" bytes to a descriptor. */
+ssize_t Common_pwriten(int iFD, const void *pvBuf, size_t iSize, off_t lOffset); /* Write "n" bytes to a file at an offset. */
 ssize_t Common_readn(int iFD, void *pvBuf, size_t iSize); /* Read "n" bytes from a descriptor. */
 int Common_sendFile(int iSockFD, char *pcSource); /* send a file through a file descriptor */
-int Common_recvFile(int iSockFD, char *pcDest); /* receive a file through a file descriptor. if pcDest is NULL, write to stdout. */
+int Common_sendFD(int iSockFD, int iFD); /* send an open file, from its start, through a file descriptor */
+void Common_setZeroCopy(int iOn); /* turn the sendfile/splice transfer path on or off */
+ssize_t Common_copyFD(int iOutFD, int iInFD, size_t iCount); /* copy bytes between descriptors through a user buffer */
+ssize_t Common_transfer(int iOutFD, int iInFD, size_t iCount); /* move bytes between descriptors with sendfile/splice */
+int Common_recvFile(RecvBuf_T oBuf, char *pcDest); /* receive a file through a buffered descriptor. if pcDest is NULL, write to stdout. */
 void Common_checkSigUnblock(int signum); /* check that a signal is unblocked */
-void Common_cleanup(DynArray_T oTokens, DynArray_T oCmds); /* free oTokens and oCmds arrays. */
-char **Common_createArgv(DynArray_T oCmds); /* create argv array corresponding to oCmds and return pointer to it */
-int Common_redirectStdin(DynArray_T oCmds, char *pcProgName); /* redirect stdin based on oCmds. */
-int Common_redirectStdout(DynArray_T oCmds, char *pcProgName); /* redirect stdout based on oCmds. */
+int Common_redirectStdin(const SynCmd *psCmd, char *pcProgName); /* redirect stdin based on psCmd. */
+int Common_redirectStdout(const SynCmd *psCmd, char *pcProgName); /* redirect stdout based on psCmd. */
 int Common_redirectStdoutForce(char *pcFileName, char *pcProgName); /* redirect stdout based to a filename. */
-int Common_redirectStderr(DynArray_T oCmds, char *pcProgName); /* redirect stderr based on oCmds. */
+int Common_redirectStderr(const SynCmd *psCmd, char *pcProgName); /* redirect stderr based on psCmd. */
 int Common_redirectStderrForce(char *pcFileName, char *pcProgName); /* redirect stderr to a filename. */
-void Common_exec(DynArray_T oCmds, char *pcProgName); /* execute a command stored in oCmds. */
-int Common_handleCd(DynArray_T oCmds, char *pcProgName); /* checks if oCmds is a cd command and executes it */
-int Common_handleSetenv(DynArray_T oCmds, char *pcProgName); /* checks if oCmds is a setenv command and executes it */
-int Common_handleUnsetenv(DynArray_T oCmds, char *pcProgName); /* checks if oCmds is an unsetenv command and executes it */
-int Common_handleExit(DynArray_T oCmds, char *pcProgName); /* checks if oCmds is an exit command and executes it */
+void Common_exec(SynCmd *psCmd, char *pcProgName); /* execute command psCmd. */
+pid_t Common_spawn(SynCmd *psCmd, char **ppcEnv, char *pcProgName); /* start command psCmd without waiting for it. */
+void Common_execCmd(SynCmd *psCmd, char *pcProgName); /* redirect and execute command psCmd in this process. */
+int Common_handleCd(SynCmd *psCmd, char *pcProgName); /* checks if psCmd is a cd command and executes it */
+int Common_handleSetenv(SynCmd *psCmd, char *pcProgName); /* checks if psCmd is a setenv command and executes it */
+int Common_handleUnsetenv(SynCmd *psCmd, char *pcProgName); /* checks if psCmd is an unsetenv command and executes it */
+int Common_handleExit(SynCmd *psCmd, char *pcProgName); /* checks if psCmd is an exit command and executes it */
 void Common_deleteFile(char *pcFileName, char *pcProgName); /* delete a given file */
+int Common_createScratch(char *pcProgName); /* create an anonymous scratch file */
+int Common_hashFile(const char *pcPath, unsigned char *pucDigest, uint64_t *puSize); /* SHA-256 digest and size of a file */
+int Common_lockCounters(const char *pcPath, long long *pllCounters, int iCount); /* lock a counter file and read it */
+void Common_unlockCounters(int iFD, const long long *pllCounters, int iCount); /* write a counter file back and unlock it */
 
 #endif
@@ -0,0 +1,777 @@
+/*--------------------------------------------------------------------*/
+/* delta.c                                                            */
+/* rsync-style delta transfer of files the receiver has an old copy of */
+/*--------------------------------------------------------------------*/
+
+#include "delta.h"
+#include "stage.h"
+#include <endian.h>
+#include <limits.h>
+
+/*--------------------------------------------------------------------*/
+
+#define DELTA_SIGS_HEADER 12 /* block size and base size */
+#define DELTA_SIG_SIZE (4 + DELTA_STRONG_SIZE) /* one block */
+#define DELTA_MAX_SIGS (64 << 20) /* largest PROTO_SIGS payload taken */
+#define DELTA_COPY_SIZE 16 /* offset and length */
+
+struct DeltaSigs
+
+/* Block signatures of a base file, with a hash table on the weak
+   checksums. */
+
+{
+   uint32_t uBlockSize;
+   /* Bytes per block. */
+
+   uint32_t uBlocks;
+   /* Number of blocks. */
+
+   uint32_t *auWeak;
+   /* Weak checksum of each block. */
+
+   unsigned char *pucStrong;
+   /* Strong checksum of each block, DELTA_STRONG_SIZE bytes apiece. */
+
+   int *aiHead;
+   /* First block in each bucket of the hash table, or -1. */
+
+   int *aiNext;
+   /* Next block in the same bucket, or -1. */
+
+   uint32_t uMask;
+   /* Number of buckets less one; a power of two less one. */
+};
+
+struct DeltaOut
+
+/* A delta body being sent. */
+
+{
+   int iSockFD;
+   /* Where it goes. */
+
+   uint32_t uId;
+   /* Request it belongs to. */
+
+   uint64_t uCopyOffset;
+   /* Start of the base range waiting to be sent as PROTO_COPY. */
+
+   uint64_t uCopyLength;
+   /* Length of that range, or 0. */
+
+   uint64_t uLiteral;
+   /* Bytes sent as PROTO_DATA so far. */
+};
+
+/*--------------------------------------------------------------------*/
+
+static uint32_t Delta_blockSize(uint64_t uSize)
+
+/* Return the block size for a base of uSize bytes: about its square
+   root, so that signatures and matching effort grow slowly. */
+
+{
+   uint32_t uBlockSize = 512;
+
+   while (((uint64_t)uBlockSize * uBlockSize < uSize) &&
+          (uBlockSize < 65536))
+      uBlockSize *= 2;
+   return uBlockSize;
+}
+
+/*--------------------------------------------------------------------*/
+
+static uint32_t Delta_weak(const unsigned char *pucData, uint32_t uLength,
+                           uint32_t *puA, uint32_t *puB)
+
+/* Return the weak checksum of the uLength bytes at pucData, storing its
+   two halves in *puA and *puB for rolling it along. */
+
+{
+   uint32_t uA = 0, uB = 0;
+   uint32_t i;
+
+   for (i = 0; i < uLength; i++)
+   {
+      uA += pucData[i];
+      uB += (uLength - i) * pucData[i];
+   }
+   *puA = uA;
+   *puB = uB;
+   return (uA & 0xffff) | (uB << 16);
+}
+
+/*--------------------------------------------------------------------*/
+
+static void Delta_strong(const unsigned char *pucData, uint32_t uLength,
+                         unsigned char *pucStrong)
+
+/* Store the strong checksum of the uLength bytes at pucData in
+   pucStrong. */
+
+{
+   unsigned char aucDigest[SHA256_SIZE];
+   Sha256 sHash;
+
+   Sha256_init(&sHash);
+   Sha256_update(&sHash, pucData, uLength);
+   Sha256_final(&sHash, aucDigest);
+   memcpy(pucStrong, aucDigest, DELTA_STRONG_SIZE);
+}
+
+/*--------------------------------------------------------------------*/
+
+static void Delta_putBe32(unsigned char *puc, uint32_t u)
+
+/* Store u at puc in network byte order. */
+
+{
+   u = htobe32(u);
+   memcpy(puc, &u, sizeof(u));
+}
+
+/*--------------------------------------------------------------------*/
+
+static void Delta_putBe64(unsigned char *puc, uint64_t u)
+
+/* Store u at puc in network byte order. */
+
+{
+   u = htobe64(u);
+   memcpy(puc, &u, sizeof(u));
+}
+
+/*--------------------------------------------------------------------*/
+
+static uint32_t Delta_getBe32(const unsigned char *puc)
+
+/* Return the number stored at puc in network byte order. */
+
+{
+   uint32_t u;
+
+   memcpy(&u, puc, sizeof(u));
+   return be32toh(u);
+}
+
+/*--------------------------------------------------------------------*/
+
+static uint64_t Delta_getBe64(const unsigned char *puc)
+
+/* Return the number stored at puc in network byte order. */
+
+{
+   uint64_t u;
+
+   memcpy(&u, puc, sizeof(u));
+   return be64toh(u);
+}
+
+/*--------------------------------------------------------------------*/
+
+int Delta_sendSigs(int iSockFD, uint32_t uId, int iBaseFD)
+
+/* Send the block signatures of the file open at iBaseFD for request
+   uId, or an empty PROTO_SIGS frame. Return SUCCESS or FAILURE. */
+
+{
+   unsigned char *pucPayload;
+   unsigned char *pucBase;
+   unsigned char *pucSig;
+   struct stat sStat;
+   uint32_t uBlockSize, uBlocks;
+   uint32_t uA, uB;
+   uint32_t i;
+   size_t iLength;
+   int iRet;
+
+   if ((iBaseFD == -1) || (fstat(iBaseFD, &sStat) == -1) ||
+       (! S_ISREG(sStat.st_mode)) || (sStat.st_size < DELTA_MIN_SIZE))
+      return Proto_writeFrame(iSockFD, PROTO_SIGS, 0, uId, NULL, 0);
+
+   /* Only whole blocks: the tail of the base is never reused. */
+   uBlockSize = Delta_blockSize((uint64_t)sStat.st_size);
+   uBlocks = (uint32_t)((uint64_t)sStat.st_size / uBlockSize);
+   iLength = DELTA_SIGS_HEADER + (size_t)uBlocks * DELTA_SIG_SIZE;
+   if (iLength > DELTA_MAX_SIGS)
+      return Proto_writeFrame(iSockFD, PROTO_SIGS, 0, uId, NULL, 0);
+
+   pucBase = mmap(NULL, (size_t)sStat.st_size, PROT_READ, MAP_PRIVATE,
+                  iBaseFD, 0);
+   if (pucBase == MAP_FAILED)
+      return Proto_writeFrame(iSockFD, PROTO_SIGS, 0, uId, NULL, 0);
+   if ((pucPayload = (unsigned char*)malloc(iLength)) == NULL)
+   {
+      munmap(pucBase, (size_t)sStat.st_size);
+      return Proto_writeFrame(iSockFD, PROTO_SIGS, 0, uId, NULL, 0);
+   }
+
+   Delta_putBe32(pucPayload, uBlockSize);
+   Delta_putBe64(pucPayload + 4, (uint64_t)sStat.st_size);
+   for (i = 0, pucSig = pucPayload + DELTA_SIGS_HEADER; i < uBlocks;
+        i++, pucSig += DELTA_SIG_SIZE)
+   {
+      Delta_putBe32(pucSig, Delta_weak(pucBase + (size_t)i * uBlockSize,
+                                       uBlockSize, &uA, &uB));
+      Delta_strong(pucBase + (size_t)i * uBlockSize, uBlockSize, pucSig + 4);
+   }
+   munmap(pucBase, (size_t)sStat.st_size);
+
+   iRet = Proto_writeFrame(iSockFD, PROTO_SIGS, 0, uId, pucPayload, iLength);
+   free(pucPayload);
+   return iRet;
+}
+
+/*--------------------------------------------------------------------*/
+
+RecvBufRead Delta_recvSigs(RecvBuf_T oBuf, uint32_t uId,
+                           DeltaSigs_T *poSigs)
+
+/* Read the PROTO_SIGS frame of request uId from oBuf into *poSigs,
+   which is NULL if it was empty. */
+
+{
+   unsigned char *pucPayload;
+   unsigned char *pucSig;
+   DeltaSigs_T oSigs;
+   ProtoHeader sHeader;
+   RecvBufRead eRead;
+   uint64_t uBaseSize;
+   uint32_t uBuckets;
+   uint32_t i;
+   int iBucket;
+
+   assert(oBuf != NULL);
+   assert(poSigs != NULL);
+
+   *poSigs = NULL;
+   if ((eRead = Proto_readHeader(oBuf, &sHeader)) != RECVBUF_OK)
+      return eRead;
+   if ((sHeader.eType != PROTO_SIGS) || (sHeader.uId != uId) ||
+       (sHeader.uLength > DELTA_MAX_SIGS))
+      return RECVBUF_ERROR;
+   if (sHeader.uLength == 0)
+      return RECVBUF_OK;
+   if ((sHeader.uLength < DELTA_SIGS_HEADER) ||
+       ((sHeader.uLength - DELTA_SIGS_HEADER) % DELTA_SIG_SIZE != 0))
+      return RECVBUF_ERROR;
+
+   if ((pucPayload = (unsigned char*)malloc((size_t)sHeader.uLength))
+       == NULL)
+      return RECVBUF_ERROR;
+   if (RecvBuf_readn(oBuf, pucPayload, (size_t)sHeader.uLength)
+       != (ssize_t)sHeader.uLength)
+   {
+      free(pucPayload);
+      return RECVBUF_ERROR;
+   }
+
+   oSigs = (DeltaSigs_T)calloc(1, sizeof(struct DeltaSigs));
+   if (oSigs == NULL)
+   {
+      free(pucPayload);
+      return RECVBUF_ERROR;
+   }
+   oSigs->uBlockSize = Delta_getBe32(pucPayload);
+   uBaseSize = Delta_getBe64(pucPayload + 4);
+   oSigs->uBlocks = (uint32_t)((sHeader.uLength - DELTA_SIGS_HEADER) /
+                               DELTA_SIG_SIZE);
+   if ((oSigs->uBlockSize == 0) ||
+       ((uint64_t)oSigs->uBlocks * oSigs->uBlockSize > uBaseSize))
+   {
+      free(pucPayload);
+      Delta_freeSigs(oSigs);
+      return RECVBUF_ERROR;
+   }
+
+   /* A bucket per block or so, chained through aiNext. */
+   for (uBuckets = 16; uBuckets < oSigs->uBlocks; uBuckets *= 2)
+      ;
+   oSigs->uMask = uBuckets - 1;
+   oSigs->auWeak = (uint32_t*)calloc(oSigs->uBlocks + 1, sizeof(uint32_t));
+   oSigs->pucStrong = (unsigned char*)malloc(
+      (size_t)(oSigs->uBlocks + 1) * DELTA_STRONG_SIZE);
+   oSigs->aiHead = (int*)malloc(uBuckets * sizeof(int));
+   oSigs->aiNext = (int*)malloc((oSigs->uBlocks + 1) * sizeof(int));
+   if ((oSigs->auWeak == NULL) || (oSigs->pucStrong == NULL) ||
+       (oSigs->aiHead == NULL) || (oSigs->aiNext == NULL))
+   {
+      free(pucPayload);
+      Delta_freeSigs(oSigs);
+      return RECVBUF_ERROR;
+   }
+   memset(oSigs->aiHead, 0xff, uBuckets * sizeof(int));
+
+   /* Insert from the back so that chains list the first block first. */
+   for (i = oSigs->uBlocks; i-- > 0;)
+   {
+      pucSig = pucPayload + DELTA_SIGS_HEADER + (size_t)i * DELTA_SIG_SIZE;
+      oSigs->auWeak[i] = Delta_getBe32(pucSig);
+      memcpy(oSigs->pucStrong + (size_t)i * DELTA_STRONG_SIZE, pucSig + 4,
+             DELTA_STRONG_SIZE);
+      iBucket = (int)(oSigs->auWeak[i] & oSigs->uMask);
+      oSigs->aiNext[i] = oSigs->aiHead[iBucket];
+      oSigs->aiHead[iBucket] = (int)i;
+   }
+   free(pucPayload);
+
+   *poSigs = oSigs;
+   return RECVBUF_OK;
+}
+
+/*--------------------------------------------------------------------*/
+
+void Delta_freeSigs(DeltaSigs_T oSigs)
+
+/* Free oSigs, which may be NULL. */
+
+{
+   if (oSigs == NULL)
+      return;
+   free(oSigs->auWeak);
+   free(oSigs->pucStrong);
+   free(oSigs->aiHead);
+   free(oSigs->aiNext);
+   free(oSigs);
+}
+
+/*--------------------------------------------------------------------*/
+
+static int Delta_match(DeltaSigs_T oSigs, const unsigned char *pucWindow,
+                       uint32_t uWeak, int iExpected)
+
+/* Return the block of oSigs with the contents of the block-sized window
+   pucWindow, whose weak checksum is uWeak, or -1 if there is none.
+   Block iExpected, the one after the last match, is tried first, so
+   repeated blocks still come out as one run. */
+
+{
+   unsigned char aucStrong[DELTA_STRONG_SIZE];
+   int iHaveStrong = FALSE;
+   int i;
+
+   if ((iExpected >= 0) && ((uint32_t)iExpected < oSigs->uBlocks) &&
+       (oSigs->auWeak[iExpected] == uWeak))
+   {
+      Delta_strong(pucWindow, oSigs->uBlockSize, aucStrong);
+      iHaveStrong = TRUE;
+      if (memcmp(aucStrong, oSigs->pucStrong +
+                 (size_t)iExpected * DELTA_STRONG_SIZE,
+                 DELTA_STRONG_SIZE) == 0)
+         return iExpected;
+   }
+
+   for (i = oSigs->aiHead[uWeak & oSigs->uMask]; i != -1;
+        i = oSigs->aiNext[i])
+   {
+      if (oSigs->auWeak[i] != uWeak)
+         continue;
+      if (! iHaveStrong)
+      {
+         Delta_strong(pucWindow, oSigs->uBlockSize, aucStrong);
+         iHaveStrong = TRUE;
+      }
+      if (memcmp(aucStrong, oSigs->pucStrong + (size_t)i * DELTA_STRONG_SIZE,
+                 DELTA_STRONG_SIZE) == 0)
+         return i;
+   }
+   return -1;
+}
+
+/*--------------------------------------------------------------------*/
+
+static int Delta_flushCopy(struct DeltaOut *psOut)
+
+/* Send the base range waiting in *psOut, if any, as a PROTO_COPY
+   frame. Return SUCCESS or FAILURE. */
+
+{
+   unsigned char aucCopy[DELTA_COPY_SIZE];
+
+   if (psOut->uCopyLength == 0)
+      return SUCCESS;
+   Delta_putBe64(aucCopy, psOut->uCopyOffset);
+   Delta_putBe64(aucCopy + 8, psOut->uCopyLength);
+   psOut->uCopyLength = 0;
+   return Proto_writeFrame(psOut->iSockFD, PROTO_COPY, 0, psOut->uId,
+                           aucCopy, sizeof(aucCopy));
+}
+
+/*--------------------------------------------------------------------*/
+
+static int Delta_flushLiteral(struct DeltaOut *psOut,
+                              const unsigned char *pucData, size_t iLength)
+
+/* Send the waiting base range of *psOut, then the iLength bytes at
+   pucData as a PROTO_DATA frame. Return SUCCESS or FAILURE. */
+
+{
+   if (iLength == 0)
+      return SUCCESS;
+   if (Delta_flushCopy(psOut) == FAILURE)
+      return FAILURE;
+   psOut->uLiteral += iLength;
+   return Proto_sendBytes(psOut->iSockFD, psOut->uId, pucData, iLength);
+}
+
+/*--------------------------------------------------------------------*/
+
+static int Delta_sendDiff(struct DeltaOut *psOut, DeltaSigs_T oSigs,
+                          const unsigned char *pucData, size_t iSize)
+
+/* Send the iSize bytes at pucData to *psOut as the ranges of the base
+   oSigs describes and the bytes in between. Return SUCCESS or
+   FAILURE. */
+
+{
+   uint32_t uBlockSize = oSigs->uBlockSize;
+   uint32_t uWeak, uA, uB;
+   size_t iPos = 0;     /* start of the window */
+   size_t iLiteral = 0; /* start of the bytes not sent yet */
+   uint64_t uOffset;
+   int iExpected = -1;
+   int iBlock;
+
+   if (iSize < uBlockSize)
+      return Delta_flushLiteral(psOut, pucData, iSize);
+
+   uWeak = Delta_weak(pucData, uBlockSize, &uA, &uB);
+   while (iPos + uBlockSize <= iSize)
+   {
+      iBlock = Delta_match(oSigs, pucData + iPos, uWeak, iExpected);
+      if (iBlock == -1)
+      {
+         /* Roll the window on by one byte. */
+         if (iPos + uBlockSize < iSize)
+         {
+            uA += (uint32_t)pucData[iPos + uBlockSize] - pucData[iPos];
+            uB += uA - uBlockSize * (uint32_t)pucData[iPos];
+            uWeak = (uA & 0xffff) | (uB << 16);
+         }
+         iPos++;
+         continue;
+      }
+
+      /* A block of the base: grow the waiting range if it is the
+         next one. */
+      if (Delta_flushLiteral(psOut, pucData + iLiteral, iPos - iLiteral)
+          == FAILURE)
+         return FAILURE;
+      uOffset = (uint64_t)iBlock * uBlockSize;
+      if ((psOut->uCopyLength > 0) &&
+          (psOut->uCopyOffset + psOut->uCopyLength == uOffset))
+         psOut->uCopyLength += uBlockSize;
+      else
+      {
+         if (Delta_flushCopy(psOut) == FAILURE)
+            return FAILURE;
+         psOut->uCopyOffset = uOffset;
+         psOut->uCopyLength = uBlockSize;
+      }
+      iPos += uBlockSize;
+      iLiteral = iPos;
+      iExpected = iBlock + 1;
+      if (iPos + uBlockSize <= iSize)
+         uWeak = Delta_weak(pucData + iPos, uBlockSize, &uA, &uB);
+   }
+
+   if (Delta_flushLiteral(psOut, pucData + iLiteral, iSize - iLiteral)
+       == FAILURE)
+      return FAILURE;
+   return Delta_flushCopy(psOut);
+}
+
+/*--------------------------------------------------------------------*/
+
+int Delta_sendBody(int iSockFD, uint32_t uId, const char *pcSource,
+                   DeltaSigs_T oSigs, uint64_t *puLiteral)
+
+/* Send file pcSource for request uId as a delta body against the base
+   oSigs describes, all but its PROTO_END. Return SUCCESS, FAILURE, or
+   a positive errno value. */
+
+{
+   unsigned char aucDigest[SHA256_SIZE];
+   unsigned char *pucData = NULL;
+   struct DeltaOut sOut;
+   struct stat sStat;
+   Sha256 sHash;
+   int iErrSv;
+   int iFD;
+   int iRet;
+
+   assert(pcSource != NULL);
+
+   if ((iFD = open(pcSource, O_RDONLY | O_CLOEXEC)) == -1)
+      return errno;
+   if (fstat(iFD, &sStat) == -1)
+   {
+      iErrSv = errno;
+      close(iFD);
+      return iErrSv;
+   }
+   if (S_ISDIR(sStat.st_mode))
+   {
+      close(iFD);
+      return EISDIR;
+   }
+   if (sStat.st_size > 0)
+   {
+      pucData = mmap(NULL, (size_t)sStat.st_size, PROT_READ, MAP_PRIVATE,
+                     iFD, 0);
+      if (pucData == MAP_FAILED)
+      {
+         iErrSv = errno;
+         close(iFD);
+         return iErrSv;
+      }
+   }
+   close(iFD);
+
+   /* The digest lets the receiver check what it rebuilt. */
+   Sha256_init(&sHash);
+   Sha256_update(&sHash, pucData, (size_t)sStat.st_size);
+   Sha256_final(&sHash, aucDigest);
+
+   memset(&sOut, 0, sizeof(sOut));
+   sOut.iSockFD = iSockFD;
+   sOut.uId = uId;
+   iRet = Proto_sendHave(iSockFD, uId, 0, aucDigest,
+                         (uint64_t)sStat.st_size);
+   if (iRet == SUCCESS)
+   {
+      if (oSigs == NULL)
+         iRet = Delta_flushLiteral(&sOut, pucData, (size_t)sStat.st_size);
+      else
+         iRet = Delta_sendDiff(&sOut, oSigs, pucData, (size_t)sStat.st_size);
+   }
+
+   if (pucData != NULL)
+      munmap(pucData, (size_t)sStat.st_size);
+   if (puLiteral != NULL)
+      *puLiteral = sOut.uLiteral;
+   return iRet;
+}
+
+/*--------------------------------------------------------------------*/
+
+int Delta_sendRange(int iSockFD, uint32_t uId, const char *pcSource,
+                    const unsigned char *pucDigest, uint64_t uSize,
+                    uint64_t uOffset)
+
+/* Send the rest of file pcSource, of uSize bytes with digest
+   pucDigest, from byte uOffset on as the body of request uId that
+   resumes a transfer, all but its PROTO_END. Return SUCCESS, FAILURE,
+   or a positive errno value. */
+
+{
+   assert(pcSource != NULL);
+   assert(pucDigest != NULL);
+
+   if (uOffset > uSize)
+      return EINVAL;
+   if (Proto_sendHave(iSockFD, uId, PROTO_FLAG_RESUME, pucDigest, uSize)
+       == FAILURE)
+      return FAILURE;
+   return Proto_sendRange(iSockFD, uId, pcSource, uOffset);
+}
+
+/*--------------------------------------------------------------------*/
+
+static int Delta_openTemp(const char *pcTemp, int iBaseFD)
+
+/* Create file pcTemp to rebuild a file in, with the mode of the file
+   open at iBaseFD if it is not -1. Return its descriptor, or -1. */
+
+{
+   struct stat sStat;
+   int iFD;
+
+   iFD = open(pcTemp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, PERMISSIONS);
+   if ((iFD != -1) && (iBaseFD != -1) && (fstat(iBaseFD, &sStat) == 0))
+      fchmod(iFD, sStat.st_mode & 07777);
+   return iFD;
+}
+
+/*--------------------------------------------------------------------*/
+
+static int Delta_copyBase(int iBaseFD, int iOutFD, Sha256 *psHash,
+                          uint64_t uOffset, uint64_t uLength)
+
+/* Append the uLength bytes at uOffset in the file open at iBaseFD to
+   the file open at iOutFD, adding them to *psHash. Return 0, or an
+   errno value. */
+
+{
+   char acBuf[MAX_BUFF * 16];
+   ssize_t iGot;
+   size_t iWant;
+
+   if (iBaseFD == -1)
+      return EIO;
+   while (uLength > 0)
+   {
+      iWant = (uLength < sizeof(acBuf)) ? (size_t)uLength : sizeof(acBuf);
+      iGot = pread(iBaseFD, acBuf, iWant, (off_t)uOffset);
+      if ((iGot == -1) && (errno == EINTR))
+         continue;
+      if (iGot <= 0)
+         return (iGot == 0) ? EIO : errno; /* the base is shorter */
+      if (Common_writen(iOutFD, acBuf, (size_t)iGot) == FAILURE)
+         return errno ? errno : EIO;
+      Sha256_update(psHash, acBuf, (size_t)iGot);
+      uOffset += (uint64_t)iGot;
+      uLength -= (uint64_t)iGot;
+   }
+   return 0;
+}
+
+/*--------------------------------------------------------------------*/
+
+int Delta_recvBody(RecvBuf_T oBuf, uint32_t uId, int iBaseFD,
+                   const char *pcDest, const char *pcStageKey,
+                   int *piStatus)
+
+/* Receive the body of request uId from oBuf, plain or delta against
+   the file open at iBaseFD, into file pcDest, staged as transfer
+   pcStageKey if it is large. Return SUCCESS, or FAILURE if the
+   connection failed or broke the protocol. */
+
+{
+   unsigned char aucExpected[SHA256_SIZE];
+   unsigned char aucDigest[SHA256_SIZE];
+   unsigned char aucCopy[DELTA_COPY_SIZE];
+   char acTemp[PATH_MAX];
+   char acBuf[PROTO_LZ_CHUNK];
+   struct stat sStat;
+   ProtoHeader sHeader;
+   Sha256 sHash;
+   uint32_t uStatus;
+   uint64_t uExpectedSize = 0;
+   uint64_t uSize = 0;
+   uint64_t uLeft;
+   ssize_t iGot;
+   int iHaveDigest = FALSE;
+   int iStaged = FALSE;
+   int iOutFD = -1;
+   int iErr = 0;
+
+   assert(oBuf != NULL);
+   assert(pcDest != NULL);
+   assert(piStatus != NULL);
+
+   /* Rebuilt next to pcDest unless staged. */
+   snprintf(acTemp, sizeof(acTemp), "%s.%ld.delta", pcDest, (long)getpid());
+   Sha256_init(&sHash);
+
+   for (;;)
+   {
+      if ((Proto_peekHeader(oBuf, &sHeader) != RECVBUF_OK) ||
+          (sHeader.uId != uId))
+         break;
+
+      /* Only first: it decides where the file goes. */
+      if (sHeader.eType == PROTO_HAVE)
+      {
+         if (iHaveDigest || (iOutFD != -1) || (iErr != 0) ||
+             (Proto_readHave(oBuf, uId, aucExpected, &uExpectedSize)
+              != RECVBUF_OK))
+            break;
+         iHaveDigest = TRUE;
+         if ((pcStageKey != NULL) && (uExpectedSize >= STAGE_MIN_SIZE))
+            iOutFD = Stage_begin(pcStageKey, aucExpected, uExpectedSize,
+                                 (sHeader.uFlags & PROTO_FLAG_RESUME) != 0,
+                                 &sHash, &uSize);
+         iStaged = (iOutFD != -1);
+         if (iStaged && (iBaseFD != -1) && (fstat(iBaseFD, &sStat) == 0))
+            fchmod(iOutFD, sStat.st_mode & 07777);
+         continue;
+      }
+
+      if ((iOutFD == -1) && (iErr == 0) &&
+          ((iOutFD = Delta_openTemp(acTemp, iBaseFD)) == -1))
+         iErr = errno;
+
+      Proto_readHeader(oBuf, &sHeader);
+      if (sHeader.eType == PROTO_END)
+      {
+         if ((sHeader.uLength != sizeof(uStatus)) ||
+             (RecvBuf_readn(oBuf, &uStatus, sizeof(uStatus))
+              != sizeof(uStatus)))
+            break;
+         *piStatus = (int)be32toh(uStatus);
+
+         /* Only a file that is what the sender has replaces pcDest. */
+         if ((*piStatus == 0) && (iErr == 0) && iHaveDigest)
+         {
+            Sha256_final(&sHash, aucDigest);
+            if ((memcmp(aucDigest, aucExpected, SHA256_SIZE) != 0) ||
+                (uSize != uExpectedSize))
+               iErr = EIO;
+         }
+         if ((*piStatus == 0) && (iErr == 0) && (close(iOutFD) == -1))
+            iErr = errno;
+         else if (iOutFD != -1)
+            close(iOutFD);
+         if ((*piStatus == 0) && (iErr == 0))
+         {
+            if (iStaged)
+               iErr = Stage_finish(pcStageKey, pcDest);
+            else if (rename(acTemp, pcDest) == -1)
+               iErr = errno;
+         }
+         if ((*piStatus == 0) && (iErr != 0))
+            *piStatus = iErr;
+         if ((*piStatus != 0) && iStaged)
+            Stage_discard(pcStageKey);
+         else if (*piStatus != 0)
+            unlink(acTemp);
+         return SUCCESS;
+      }
+
+      if (sHeader.eType == PROTO_COPY)
+      {
+         if ((sHeader.uLength != DELTA_COPY_SIZE) ||
+             (RecvBuf_readn(oBuf, aucCopy, DELTA_COPY_SIZE)
+              != DELTA_COPY_SIZE))
+            break;
+         if (iErr == 0)
+            iErr = Delta_copyBase(iBaseFD, iOutFD, &sHash,
+                                  Delta_getBe64(aucCopy),
+                                  Delta_getBe64(aucCopy + 8));
+         uSize += Delta_getBe64(aucCopy + 8);
+         continue;
+      }
+
+      if (sHeader.eType != PROTO_DATA)
+         break;
+
+      /* Bytes the base does not have; drained on errors. */
+      for (uLeft = sHeader.uLength; uLeft > 0;)
+      {
+         iGot = Proto_readData(oBuf, &sHeader, &uLeft, acBuf, sizeof(acBuf));
+         if (iGot <= 0)
+            break;
+         if ((iErr == 0) &&
+             (Common_writen(iOutFD, acBuf, (size_t)iGot) == FAILURE))
+            iErr = errno ? errno : EIO;
+         Sha256_update(&sHash, acBuf, (size_t)iGot);
+         uSize += (uint64_t)iGot;
+      }
+      if (uLeft > 0)
+         break;
+   }
+
+   /* Connection lost or protocol broken: a staged file keeps what
+      arrived for the next try. */
+   if (iOutFD != -1)
+   {
+      close(iOutFD);
+      if (! iStaged)
+         unlink(acTemp);
+   }
+   return FAILURE;
+}
+
+/*--------------------------------------------------------------------*/
@@ -0,0 +1,87 @@
+/*--------------------------------------------------------------------*/
+/* delta.h                                                            */
+/* rsync-style delta transfer of files the receiver has an old copy of */
+/*--------------------------------------------------------------------*/
+
+#ifndef DELTA_INCLUDED
+#define DELTA_INCLUDED
+
+#include "common.h"
+
+/*--------------------------------------------------------------------*/
+
+/* The receiver of a file cuts its old copy (the base) into blocks and
+   sends their signatures in a PROTO_SIGS frame:
+
+      bytes 0-3     block size
+      bytes 4-11    size of the base
+      then per block, in order:
+      bytes 0-3     weak checksum (rsync's rolling checksum)
+      bytes 4-19    strong checksum (SHA-256, truncated)
+
+   An empty PROTO_SIGS frame means there is no base worth using. The
+   sender slides a block-sized window over its file, rolling the weak
+   checksum along one byte at a time and computing the strong one only
+   when the weak one matches a block. It answers with a delta body: a
+   PROTO_HAVE frame with the digest and size of the whole file, then in
+   file order PROTO_DATA frames with bytes the base does not have and
+   PROTO_COPY frames (64 bit offset and length) naming a range of the
+   base, then the usual PROTO_END. The receiver rebuilds the file under
+   a temporary name, checks its digest, and renames it over the old
+   copy, so readers see either version but never a mix. */
+
+#define DELTA_MIN_SIZE (64 * 1024) /* smaller bases are not worth it */
+#define DELTA_STRONG_SIZE 16 /* bytes of the strong checksum kept */
+
+typedef struct DeltaSigs *DeltaSigs_T;
+/* Block signatures of a base file. */
+
+/*--------------------------------------------------------------------*/
+
+int Delta_sendSigs(int iSockFD, uint32_t uId, int iBaseFD);
+/* Send the block signatures of the file open at iBaseFD for request
+   uId, or an empty PROTO_SIGS frame if iBaseFD is -1 or its file is
+   smaller than DELTA_MIN_SIZE. Return SUCCESS or FAILURE. */
+
+RecvBufRead Delta_recvSigs(RecvBuf_T oBuf, uint32_t uId,
+                           DeltaSigs_T *poSigs);
+/* Read the PROTO_SIGS frame of request uId from oBuf into *poSigs,
+   which is NULL if it was empty. Return values are as for
+   Proto_readHeader; a frame of another type or request, or signatures
+   that do not add up, are RECVBUF_ERROR. */
+
+void Delta_freeSigs(DeltaSigs_T oSigs);
+/* Free oSigs, which may be NULL. */
+
+int Delta_sendBody(int iSockFD, uint32_t uId, const char *pcSource,
+                   DeltaSigs_T oSigs, uint64_t *puLiteral);
+/* Send file pcSource for request uId as a delta body against the base
+   oSigs describes, all but its PROTO_END, and store the number of
+   bytes sent as data in *puLiteral unless it is NULL. Return SUCCESS,
+   FAILURE if the connection failed, or a positive errno value if the
+   file could not be read, in which case nothing was sent. */
+
+int Delta_sendRange(int iSockFD, uint32_t uId, const char *pcSource,
+                    const unsigned char *pucDigest, uint64_t uSize,
+                    uint64_t uOffset);
+/* Send the rest of file pcSource, of uSize bytes with SHA-256 digest
+   pucDigest, from byte uOffset on as the body of request uId that
+   resumes a transfer (see PROTO_RESUME in proto.h), all but its
+   PROTO_END. Return SUCCESS, FAILURE if the connection failed, or a
+   positive errno value if the file could not be read. */
+
+int Delta_recvBody(RecvBuf_T oBuf, uint32_t uId, int iBaseFD,
+                   const char *pcDest, const char *pcStageKey,
+                   int *piStatus);
+/* Receive the body of request uId from oBuf, plain, delta against the
+   file open at iBaseFD (-1 for none), or resuming a transfer, into
+   file pcDest. Store the status of its PROTO_END frame in *piStatus,
+   or an errno value if the file could not be rebuilt or does not have
+   the digest the sender announced; pcDest is only replaced if that is
+   0. Holding the base open keeps it valid even if pcDest is replaced
+   meanwhile. Unless pcStageKey is NULL, a file of STAGE_MIN_SIZE bytes
+   or more is received as transfer pcStageKey of the staging area,
+   which keeps what arrived if the connection fails. Return SUCCESS, or
+   FAILURE if the connection failed or broke the protocol. */
+
+#endif
@@ -5,15 +5,32 @@
 
 #include "dynarray.h"
 #include <assert.h>
+#include <limits.h>
+#include <stddef.h>
 #include <stdlib.h>
+#include <string.h>
 
 enum {MIN_PHYS_LENGTH = 2};
 enum {GROWTH_FACTOR = 2};
 
+enum {SORT_INSERTION_MAX = 24};
+/* Ranges this short are sorted by insertion. */
+
+enum {SORT_NINTHER_MIN = 128};
+/* Ranges this long take the median of three medians of three as
+   their pivot. */
+
+enum {SORT_PARTIAL_MAX = 8};
+/* Elements an insertion sort may move in a range that looks sorted
+   already before it gives up. */
+
 /*--------------------------------------------------------------------*/
 
 /* A DynArray consists of an array, along with its logical and
-   physical lengths. */
+   physical lengths. A small array may be kept in the DynArray itself,
+   until it outgrows it. Elements removed from near the front leave
+   room there, which the array slides back over once there is as much
+   of it as there are elements left. */
 
 struct DynArray
 {
@@ -26,9 +43,28 @@ struct DynArray
       DynArray. */
 
    const void **ppvArray;
-   /* The array that underlies the DynArray. */
+   /* The first element of the DynArray, iFirst elements into the
+      array that underlies it: apvInline, or an array on the heap. */
+
+   int iFirst;
+   /* The number of unused elements at the front of the underlying
+      array. */
+
+   short iInline;
+   /* The number of elements apvInline has room for. */
+
+   short iOwned;
+   /* 1 (TRUE) if the DynArray itself is on the heap, 0 (FALSE) if it
+      is in memory of the client's. */
+
+   const void *apvInline[];
+   /* Room for a small array. */
 };
 
+_Static_assert(offsetof(struct DynArray, apvInline) ==
+                  DYNARRAY_HEADER_WORDS * sizeof(void*),
+               "DYNARRAY_HEADER_WORDS does not match struct DynArray");
+
 /*--------------------------------------------------------------------*/
 
 #ifndef NDEBUG
@@ -42,12 +78,53 @@ static int DynArray_isValid(DynArray_T oDynArray)
    if (oDynArray->iPhysLength < MIN_PHYS_LENGTH) return 0;
    if (oDynArray->iLength > oDynArray->iPhysLength) return 0;
    if (oDynArray->ppvArray == NULL) return 0;
+   if (oDynArray->iFirst < 0) return 0;
+   if (oDynArray->iFirst + oDynArray->iLength > oDynArray->iPhysLength)
+      return 0;
+   if (oDynArray->iInline < 0) return 0;
+   if ((oDynArray->ppvArray - oDynArray->iFirst == oDynArray->apvInline)
+       && (oDynArray->iPhysLength != oDynArray->iInline)) return 0;
    return 1;
 }
 #endif
 
 /*--------------------------------------------------------------------*/
 
+static DynArray_T DynArray_setUp(DynArray_T oDynArray, int iLength,
+   int iInline)
+
+/* Set up oDynArray, which has room for iInline elements of its own,
+   as a DynArray whose length is iLength. Return it, or NULL if
+   insufficient memory is available. */
+
+{
+   oDynArray->iLength = iLength;
+   oDynArray->iFirst = 0;
+   oDynArray->iInline = (short)iInline;
+   if (iLength > MIN_PHYS_LENGTH)
+      oDynArray->iPhysLength = iLength;
+   else
+      oDynArray->iPhysLength = MIN_PHYS_LENGTH;
+
+   /* Small enough to keep inline. */
+   if (oDynArray->iPhysLength <= iInline)
+   {
+      oDynArray->iPhysLength = iInline;
+      oDynArray->ppvArray = oDynArray->apvInline;
+      memset(oDynArray->apvInline, 0, (size_t)iLength * sizeof(void*));
+      return oDynArray;
+   }
+
+   oDynArray->ppvArray =
+      (const void**)calloc((size_t)oDynArray->iPhysLength,
+                            sizeof(void*));
+   if (oDynArray->ppvArray == NULL)
+      return NULL;
+   return oDynArray;
+}
+
+/*--------------------------------------------------------------------*/
+
 DynArray_T DynArray_new(int iLength)
 
 /* Return a new DynArray_T object whose length is iLength, or
@@ -62,16 +139,37 @@ DynArray_T DynArray_new(int iLength)
    if (oDynArray == NULL)
       return NULL;
 
-   oDynArray->iLength = iLength;
-   if (iLength > MIN_PHYS_LENGTH)
-      oDynArray->iPhysLength = iLength;
-   else
-      oDynArray->iPhysLength = MIN_PHYS_LENGTH;
+   oDynArray->iOwned = 1;
+   if (DynArray_setUp(oDynArray, iLength, 0) == NULL)
+   {
+      free(oDynArray);
+      return NULL;
+   }
 
-   oDynArray->ppvArray =
-      (const void**)calloc((size_t)oDynArray->iPhysLength,
-                            sizeof(void*));
-   if (oDynArray->ppvArray == NULL)
+   return oDynArray;
+}
+
+/*--------------------------------------------------------------------*/
+
+DynArray_T DynArray_newInline(int iLength, int iInline)
+
+/* Return a new DynArray_T object whose length is iLength, allocated
+   in one piece along with room for iInline elements, or NULL if
+   insufficient memory is available. */
+
+{
+   DynArray_T oDynArray;
+
+   assert(iLength >= 0);
+   assert((iInline >= 0) && (iInline <= SHRT_MAX));
+
+   oDynArray = (struct DynArray*)malloc(sizeof(struct DynArray) +
+                                        (size_t)iInline * sizeof(void*));
+   if (oDynArray == NULL)
+      return NULL;
+
+   oDynArray->iOwned = 1;
+   if (DynArray_setUp(oDynArray, iLength, iInline) == NULL)
    {
       free(oDynArray);
       return NULL;
@@ -82,6 +180,33 @@ DynArray_T DynArray_new(int iLength)
 
 /*--------------------------------------------------------------------*/
 
+DynArray_T DynArray_init(void **ppvMem, int iWords, int iLength)
+
+/* Make the iWords pointer-sized words at ppvMem a new DynArray_T
+   object whose length is iLength, keeping as many elements as fit in
+   ppvMem itself, and return it, or NULL if insufficient memory is
+   available. */
+
+{
+   DynArray_T oDynArray;
+   int iInline;
+
+   assert(ppvMem != NULL);
+   assert(iLength >= 0);
+   assert(iWords >= DYNARRAY_HEADER_WORDS);
+
+   oDynArray = (struct DynArray*)ppvMem;
+   iInline = (int)(((size_t)iWords * sizeof(void*) -
+                    sizeof(struct DynArray)) / sizeof(void*));
+   if (iInline > SHRT_MAX)
+      iInline = SHRT_MAX;
+
+   oDynArray->iOwned = 0;
+   return DynArray_setUp(oDynArray, iLength, iInline);
+}
+
+/*--------------------------------------------------------------------*/
+
 void DynArray_free(DynArray_T oDynArray)
 
 /* Free oDynArray. */
@@ -90,8 +215,10 @@ void DynArray_free(DynArray_T oDynArray)
    assert(oDynArray != NULL);
    assert(DynArray_isValid(oDynArray));
 
-   free(oDynArray->ppvArray);
-   free(oDynArray);
+   if (oDynArray->ppvArray - oDynArray->iFirst != oDynArray->apvInline)
+      free(oDynArray->ppvArray - oDynArray->iFirst);
+   if (oDynArray->iOwned)
+      free(oDynArray);
 }
 
 /*--------------------------------------------------------------------*/
@@ -148,26 +275,82 @@ void *DynArray_set(DynArray_T oDynArray, int iIndex,
 
 /*--------------------------------------------------------------------*/
 
-static int DynArray_grow(DynArray_T oDynArray)
+static int DynArray_grow(DynArray_T oDynArray, int iMinLength)
 
-/* Increase the physical length of oDynArray.  Return 1 (TRUE) if
-   successful and 0 (FALSE) if insufficient memory is available. */
+/* Make room in oDynArray for iMinLength elements from its first one
+   on.  Return 1 (TRUE) if successful and 0 (FALSE) if insufficient
+   memory is available. Room left at the front is used if there is at
+   least as much of it as there are elements; otherwise the physical
+   length increases, and an inline array moves to the heap. */
 
 {
    int iNewLength;
+   const void **ppvOldArray;
    const void **ppvNewArray;
 
    assert(oDynArray != NULL);
 
+   ppvOldArray = oDynArray->ppvArray - oDynArray->iFirst;
+   if ((oDynArray->iFirst > 0) &&
+       (oDynArray->iFirst >= oDynArray->iLength) &&
+       (iMinLength <= oDynArray->iPhysLength))
+   {
+      memmove(ppvOldArray, oDynArray->ppvArray,
+              sizeof(void*) * (size_t)oDynArray->iLength);
+      oDynArray->ppvArray = ppvOldArray;
+      oDynArray->iFirst = 0;
+      return 1;
+   }
+
    iNewLength = oDynArray->iPhysLength * GROWTH_FACTOR;
+   while (iNewLength < iMinLength)
+      iNewLength *= GROWTH_FACTOR;
 
-   ppvNewArray = (const void**)
-      realloc(oDynArray->ppvArray, sizeof(void*) * iNewLength);
-   if (ppvNewArray == NULL)
-      return 0;
+   if (ppvOldArray == oDynArray->apvInline)
+   {
+      ppvNewArray = (const void**)malloc(sizeof(void*) * iNewLength);
+      if (ppvNewArray == NULL)
+         return 0;
+      memcpy(ppvNewArray, oDynArray->ppvArray,
+             sizeof(void*) * (size_t)oDynArray->iLength);
+   }
+   else
+   {
+      memmove(ppvOldArray, oDynArray->ppvArray,
+              sizeof(void*) * (size_t)oDynArray->iLength);
+      oDynArray->ppvArray = ppvOldArray;
+      oDynArray->iFirst = 0;
+      ppvNewArray = (const void**)
+         realloc(ppvOldArray, sizeof(void*) * iNewLength);
+      if (ppvNewArray == NULL)
+         return 0;
+   }
 
    oDynArray->iPhysLength = iNewLength;
    oDynArray->ppvArray = ppvNewArray;
+   oDynArray->iFirst = 0;
+   return 1;
+}
+
+/*--------------------------------------------------------------------*/
+
+int DynArray_reserve(DynArray_T oDynArray, int iLength)
+
+/* Make room in oDynArray for iLength elements, so that it can grow to
+   that length without allocating memory.  Return 1 (TRUE) if
+   successful, or 0 (FALSE) if insufficient memory is available. */
+
+{
+   assert(oDynArray != NULL);
+   assert(iLength >= 0);
+   assert(DynArray_isValid(oDynArray));
+
+   if (oDynArray->iPhysLength - oDynArray->iFirst < iLength)
+      if (! DynArray_grow(oDynArray, iLength))
+         return 0;
+
+   assert(DynArray_isValid(oDynArray));
+
    return 1;
 }
 
@@ -183,8 +366,8 @@ int DynArray_add(DynArray_T oDynArray, const void *pvElement)
    assert(oDynArray != NULL);
    assert(DynArray_isValid(oDynArray));
 
-   if (oDynArray->iLength == oDynArray->iPhysLength)
-      if (! DynArray_grow(oDynArray))
+   if (oDynArray->iFirst + oDynArray->iLength == oDynArray->iPhysLength)
+      if (! DynArray_grow(oDynArray, oDynArray->iLength + 1))
          return 0;
 
    oDynArray->ppvArray[oDynArray->iLength] = pvElement;
@@ -197,6 +380,47 @@ int DynArray_add(DynArray_T oDynArray, const void *pvElement)
 
 /*--------------------------------------------------------------------*/
 
+int DynArray_addAll(DynArray_T oDynArray, const void **ppvElements,
+   int iCount)
+
+/* Add the iCount elements of ppvElements to the end of oDynArray, in
+   order.  ppvElements may be elements of oDynArray itself.  Return 1
+   (TRUE) if successful, or 0 (FALSE) if insufficient memory is
+   available, in which case oDynArray is unchanged. */
+
+{
+   int iOwn = -1;
+
+   assert(oDynArray != NULL);
+   assert((ppvElements != NULL) || (iCount == 0));
+   assert(iCount >= 0);
+   assert(DynArray_isValid(oDynArray));
+
+   if (oDynArray->iPhysLength - oDynArray->iFirst - oDynArray->iLength
+       < iCount)
+   {
+      /* Growing moves the elements, so find them again after. */
+      if ((ppvElements >= oDynArray->ppvArray) &&
+          (ppvElements < oDynArray->ppvArray + oDynArray->iLength))
+         iOwn = (int)(ppvElements - oDynArray->ppvArray);
+      if (! DynArray_grow(oDynArray, oDynArray->iLength + iCount))
+         return 0;
+      if (iOwn != -1)
+         ppvElements = oDynArray->ppvArray + iOwn;
+   }
+
+   if (iCount > 0)
+      memcpy(oDynArray->ppvArray + oDynArray->iLength, ppvElements,
+             sizeof(void*) * (size_t)iCount);
+   oDynArray->iLength += iCount;
+
+   assert(DynArray_isValid(oDynArray));
+
+   return 1;
+}
+
+/*--------------------------------------------------------------------*/
+
 int DynArray_addAt(DynArray_T oDynArray, int iIndex,
    const void *pvElement)
 
@@ -212,8 +436,8 @@ int DynArray_addAt(DynArray_T oDynArray, int iIndex,
    assert(iIndex <= oDynArray->iLength);
    assert(DynArray_isValid(oDynArray));
 
-   if (oDynArray->iLength == oDynArray->iPhysLength)
-      if (! DynArray_grow(oDynArray))
+   if (oDynArray->iFirst + oDynArray->iLength == oDynArray->iPhysLength)
+      if (! DynArray_grow(oDynArray, oDynArray->iLength + 1))
          return 0;
 
    for (i = oDynArray->iLength; i > iIndex; i--)
@@ -231,7 +455,9 @@ int DynArray_addAt(DynArray_T oDynArray, int iIndex,
 
 void *DynArray_removeAt(DynArray_T oDynArray, int iIndex)
 
-/* Remove and return the iIndex'th element of oDynArray. */
+/* Remove and return the iIndex'th element of oDynArray. The elements
+   on the shorter side of it move, so removing the first element takes
+   constant time. */
 
 {
    const void *pvOldElement;
@@ -246,8 +472,21 @@ void *DynArray_removeAt(DynArray_T oDynArray, int iIndex)
 
    oDynArray->iLength--;
 
-   for (i = iIndex; i < oDynArray->iLength; i++)
-      oDynArray->ppvArray[i] = oDynArray->ppvArray[i+1];
+   if (oDynArray->iLength == 0)
+   {
+      oDynArray->ppvArray -= oDynArray->iFirst;
+      oDynArray->iFirst = 0;
+   }
+   else if (iIndex < oDynArray->iLength / 2)
+   {
+      for (i = iIndex; i > 0; i--)
+         oDynArray->ppvArray[i] = oDynArray->ppvArray[i-1];
+      oDynArray->ppvArray++;
+      oDynArray->iFirst++;
+   }
+   else
+      for (i = iIndex; i < oDynArray->iLength; i++)
+         oDynArray->ppvArray[i] = oDynArray->ppvArray[i+1];
 
    assert(DynArray_isValid(oDynArray));
 
@@ -256,6 +495,40 @@ void *DynArray_removeAt(DynArray_T oDynArray, int iIndex)
 
 /*--------------------------------------------------------------------*/
 
+void DynArray_shrink(DynArray_T oDynArray, int iLength)
+
+/* Remove the elements of oDynArray from the iLength'th on, keeping
+   the memory they took for elements added later. */
+
+{
+   assert(oDynArray != NULL);
+   assert(iLength >= 0);
+   assert(iLength <= oDynArray->iLength);
+   assert(DynArray_isValid(oDynArray));
+
+   oDynArray->iLength = iLength;
+   if (iLength == 0)
+   {
+      oDynArray->ppvArray -= oDynArray->iFirst;
+      oDynArray->iFirst = 0;
+   }
+
+   assert(DynArray_isValid(oDynArray));
+}
+
+/*--------------------------------------------------------------------*/
+
+void DynArray_clear(DynArray_T oDynArray)
+
+/* Remove all elements of oDynArray, keeping its memory for elements
+   added later. */
+
+{
+   DynArray_shrink(oDynArray, 0);
+}
+
+/*--------------------------------------------------------------------*/
+
 void DynArray_toArray(DynArray_T oDynArray, void **ppvArray)
 
 /* Fill ppvArray with the elements of oDynArray.  ppvArray should point
@@ -309,56 +582,295 @@ static void DynArray_swap(const void *ppvArray[], int iOne, int iTwo)
 
 /*--------------------------------------------------------------------*/
 
-static int DynArray_partition(const void *ppvArray[],
-   int iLeft, int iRight,
+static void DynArray_sort3(const void *ppvArray[], int iOne, int iTwo,
+   int iThree,
    int (*pfCompare)(const void *pvElement1, const void *pvElement2))
 
-/* Divide ppvArray[iLeft...iRight] into two partitions so elements
-   in the first partition are <= elements in the second partition.
-   Return the index of the element that marks the partition
-   boundary. The sort order is determined by *pfCompare. */
+/* Order ppvArray[iOne], ppvArray[iTwo] and ppvArray[iThree] among
+   themselves, as determined by *pfCompare, so that the median of the
+   three ends up in ppvArray[iTwo]. */
+
+{
+   if ((*pfCompare)(ppvArray[iTwo], ppvArray[iOne]) < 0)
+      DynArray_swap(ppvArray, iOne, iTwo);
+   if ((*pfCompare)(ppvArray[iThree], ppvArray[iTwo]) < 0)
+   {
+      DynArray_swap(ppvArray, iTwo, iThree);
+      if ((*pfCompare)(ppvArray[iTwo], ppvArray[iOne]) < 0)
+         DynArray_swap(ppvArray, iOne, iTwo);
+   }
+}
+
+/*--------------------------------------------------------------------*/
 
-/* This function is a variation of the partition() function from the
-   book "Algorithms in C" by Robert Sedgewick. */
+static int DynArray_insertionSort(const void *ppvArray[],
+   int iLeft, int iRight, int iMaxMoves,
+   int (*pfCompare)(const void *pvElement1, const void *pvElement2))
+
+/* Sort ppvArray[iLeft...iRight] in ascending order, as determined by
+   *pfCompare, by insertion. Give up once more than iMaxMoves elements
+   have been moved, unless iMaxMoves is -1. Return 1 (TRUE) if the
+   range is sorted, or 0 (FALSE) if the sort gave up. */
 
 {
-   int iFirst = iLeft-1;
-   int iLast = iRight;
+   const void *pvTemp;
+   int iMoves = 0;
+   int i;
+   int j;
 
-   while (1)
+   for (i = iLeft + 1; i <= iRight; i++)
    {
-      while ((*pfCompare)(ppvArray[++iFirst], ppvArray[iRight]) < 0)
+      pvTemp = ppvArray[i];
+      for (j = i; (j > iLeft) &&
+              ((*pfCompare)(pvTemp, ppvArray[j-1]) < 0); j--)
+         ppvArray[j] = ppvArray[j-1];
+      ppvArray[j] = pvTemp;
+
+      iMoves += i - j;
+      if ((iMaxMoves != -1) && (iMoves > iMaxMoves))
+         return 0;
+   }
+   return 1;
+}
+
+/*--------------------------------------------------------------------*/
+
+static void DynArray_siftDown(const void *ppvHeap[], int iParent,
+   int iSize,
+   int (*pfCompare)(const void *pvElement1, const void *pvElement2))
+
+/* Move ppvHeap[iParent] down the max-heap ppvHeap[0...iSize-1], as
+   ordered by *pfCompare, until it is not less than its children. */
+
+{
+   int iChild;
+
+   while ((iChild = 2 * iParent + 1) < iSize)
+   {
+      if ((iChild + 1 < iSize) &&
+          ((*pfCompare)(ppvHeap[iChild], ppvHeap[iChild+1]) < 0))
+         iChild++;
+      if (! ((*pfCompare)(ppvHeap[iParent], ppvHeap[iChild]) < 0))
+         return;
+      DynArray_swap(ppvHeap, iParent, iChild);
+      iParent = iChild;
+   }
+}
+
+/*--------------------------------------------------------------------*/
+
+static void DynArray_heapsort(const void *ppvArray[],
+   int iLeft, int iRight,
+   int (*pfCompare)(const void *pvElement1, const void *pvElement2))
+
+/* Sort ppvArray[iLeft...iRight] in ascending order, as determined
+   by *pfCompare, in O(n log n) time whatever the input. */
+
+{
+   const void **ppvHeap = ppvArray + iLeft;
+   int iSize = iRight - iLeft + 1;
+   int i;
+
+   for (i = iSize / 2 - 1; i >= 0; i--)
+      DynArray_siftDown(ppvHeap, i, iSize, pfCompare);
+   for (i = iSize - 1; i > 0; i--)
+   {
+      DynArray_swap(ppvHeap, 0, i);
+      DynArray_siftDown(ppvHeap, 0, i, pfCompare);
+   }
+}
+
+/*--------------------------------------------------------------------*/
+
+static int DynArray_partitionRight(const void *ppvArray[],
+   int iLeft, int iRight, int *piAlready,
+   int (*pfCompare)(const void *pvElement1, const void *pvElement2))
+
+/* Divide ppvArray[iLeft...iRight] around the pivot in ppvArray[iLeft]
+   so elements less than the pivot come before it and the others after
+   it. Return the index the pivot ends up at. Set *piAlready to 1
+   (TRUE) if no element had to move, or 0 (FALSE) otherwise. Some
+   element after the pivot must not be less than it. */
+
+{
+   const void *pvPivot = ppvArray[iLeft];
+   int iFirst = iLeft;
+   int iLast = iRight + 1;
+
+   while ((*pfCompare)(ppvArray[++iFirst], pvPivot) < 0)
+      ;
+   if (iFirst - 1 == iLeft)
+      while ((iFirst < iLast) &&
+             (! ((*pfCompare)(ppvArray[--iLast], pvPivot) < 0)))
          ;
-      while ((*pfCompare)(ppvArray[iRight], ppvArray[--iLast]) < 0)
-         if (iLast == iLeft)
-            break;
-      if (iFirst >= iLast)
-         break;
+   else
+      while (! ((*pfCompare)(ppvArray[--iLast], pvPivot) < 0))
+         ;
+
+   *piAlready = (iFirst >= iLast);
+   while (iFirst < iLast)
+   {
       DynArray_swap(ppvArray, iFirst, iLast);
+      while ((*pfCompare)(ppvArray[++iFirst], pvPivot) < 0)
+         ;
+      while (! ((*pfCompare)(ppvArray[--iLast], pvPivot) < 0))
+         ;
    }
-   DynArray_swap(ppvArray, iFirst, iRight);
-   return iFirst;
+
+   ppvArray[iLeft] = ppvArray[iFirst - 1];
+   ppvArray[iFirst - 1] = pvPivot;
+   return iFirst - 1;
 }
 
 /*--------------------------------------------------------------------*/
 
-static void DynArray_quicksort(const void *ppvArray[],
+static int DynArray_partitionLeft(const void *ppvArray[],
    int iLeft, int iRight,
    int (*pfCompare)(const void *pvElement1, const void *pvElement2))
 
-/* Sort ppvArray[iLeft...iRight] in ascending order, as determined
-   by *pfCompare. */
+/* Divide ppvArray[iLeft...iRight] around the pivot in ppvArray[iLeft]
+   so elements not greater than the pivot come before it and the
+   others after it. Return the index the pivot ends up at. */
+
+{
+   const void *pvPivot = ppvArray[iLeft];
+   int iFirst = iLeft;
+   int iLast = iRight + 1;
+
+   while ((*pfCompare)(pvPivot, ppvArray[--iLast]) < 0)
+      ;
+   if (iLast == iRight)
+      while ((iFirst < iLast) &&
+             (! ((*pfCompare)(pvPivot, ppvArray[++iFirst]) < 0)))
+         ;
+   else
+      while (! ((*pfCompare)(pvPivot, ppvArray[++iFirst]) < 0))
+         ;
+
+   while (iFirst < iLast)
+   {
+      DynArray_swap(ppvArray, iFirst, iLast);
+      while ((*pfCompare)(pvPivot, ppvArray[--iLast]) < 0)
+         ;
+      while (! ((*pfCompare)(pvPivot, ppvArray[++iFirst]) < 0))
+         ;
+   }
+
+   ppvArray[iLeft] = ppvArray[iLast];
+   ppvArray[iLast] = pvPivot;
+   return iLast;
+}
+
+/*--------------------------------------------------------------------*/
+
+static void DynArray_introsort(const void *ppvArray[],
+   int iLeft, int iRight, int iBadAllowed, int iLeftmost,
+   int (*pfCompare)(const void *pvElement1, const void *pvElement2))
 
-/* This function is a variation of the quicksort() function from the
-   book "Algorithms in C" by Robert Sedgewick. */
+/* Sort ppvArray[iLeft...iRight] in ascending order, as determined
+   by *pfCompare. Switch to heapsort after iBadAllowed lopsided
+   partitions. iLeftmost is 1 (TRUE) if the range starts the array,
+   or 0 (FALSE) if the element before it is not greater than any in
+   it. */
+
+/* This function is a variation of pattern-defeating quicksort
+   (pdqsort) by Orson Peters: quicksort with a median-of-three pivot,
+   insertion sort for short ranges, a separate partition for runs of
+   elements equal to the one before the range, a check for ranges that
+   are sorted already, and heapsort when partitions keep coming out
+   lopsided. The smaller side is sorted recursively and the larger one
+   in the loop, so the stack stays O(log n) deep. */
 
 {
+   int iSize;
    int iMid;
-   if (iRight > iLeft)
+   int iPivot;
+   int iAlready;
+   int iLeftSize;
+   int iRightSize;
+
+   while (1)
    {
-      iMid = DynArray_partition(ppvArray, iLeft, iRight, pfCompare);
-      DynArray_quicksort(ppvArray, iLeft, iMid - 1, pfCompare);
-      DynArray_quicksort(ppvArray, iMid + 1, iRight, pfCompare);
+      iSize = iRight - iLeft + 1;
+      if (iSize <= SORT_INSERTION_MAX)
+      {
+         DynArray_insertionSort(ppvArray, iLeft, iRight, -1, pfCompare);
+         return;
+      }
+
+      /* The pivot, moved to ppvArray[iLeft]: the median of three, or
+         for a long range the median of three such medians. */
+      iMid = iLeft + iSize / 2;
+      if (iSize >= SORT_NINTHER_MIN)
+      {
+         DynArray_sort3(ppvArray, iLeft, iMid, iRight, pfCompare);
+         DynArray_sort3(ppvArray, iLeft + 1, iMid - 1, iRight - 1,
+                        pfCompare);
+         DynArray_sort3(ppvArray, iLeft + 2, iMid + 1, iRight - 2,
+                        pfCompare);
+         DynArray_sort3(ppvArray, iMid - 1, iMid, iMid + 1, pfCompare);
+         DynArray_swap(ppvArray, iLeft, iMid);
+      }
+      else
+         DynArray_sort3(ppvArray, iMid, iLeft, iRight, pfCompare);
+
+      /* A pivot equal to the element before the range is the least
+         element of the range: everything equal to it is in place once
+         it is moved to the front. */
+      if ((! iLeftmost) &&
+          (! ((*pfCompare)(ppvArray[iLeft - 1], ppvArray[iLeft]) < 0)))
+      {
+         iLeft = DynArray_partitionLeft(ppvArray, iLeft, iRight,
+                                        pfCompare) + 1;
+         continue;
+      }
+
+      iPivot = DynArray_partitionRight(ppvArray, iLeft, iRight, &iAlready,
+                                       pfCompare);
+      iLeftSize = iPivot - iLeft;
+      iRightSize = iRight - iPivot;
+
+      if ((iLeftSize < iSize / 8) || (iRightSize < iSize / 8))
+      {
+         /* Lopsided: give up on quicksort, or break up the pattern
+            that caused it. */
+         if (--iBadAllowed == 0)
+         {
+            DynArray_heapsort(ppvArray, iLeft, iRight, pfCompare);
+            return;
+         }
+         if (iLeftSize >= SORT_INSERTION_MAX)
+         {
+            DynArray_swap(ppvArray, iLeft, iLeft + iLeftSize / 4);
+            DynArray_swap(ppvArray, iPivot - 1, iPivot - iLeftSize / 4);
+         }
+         if (iRightSize >= SORT_INSERTION_MAX)
+         {
+            DynArray_swap(ppvArray, iPivot + 1,
+                          iPivot + 1 + iRightSize / 4);
+            DynArray_swap(ppvArray, iRight, iRight - iRightSize / 4);
+         }
+      }
+      else if (iAlready &&
+               DynArray_insertionSort(ppvArray, iLeft, iPivot - 1,
+                                      SORT_PARTIAL_MAX, pfCompare) &&
+               DynArray_insertionSort(ppvArray, iPivot + 1, iRight,
+                                      SORT_PARTIAL_MAX, pfCompare))
+         return; /* It looked sorted, and was. */
+
+      if (iLeftSize < iRightSize)
+      {
+         DynArray_introsort(ppvArray, iLeft, iPivot - 1, iBadAllowed,
+                            iLeftmost, pfCompare);
+         iLeft = iPivot + 1;
+         iLeftmost = 0;
+      }
+      else
+      {
+         DynArray_introsort(ppvArray, iPivot + 1, iRight, iBadAllowed,
+                            0, pfCompare);
+         iRight = iPivot - 1;
+      }
    }
 }
 
@@ -373,12 +885,17 @@ void DynArray_sort(DynArray_T oDynArray,
    respectively. */
 
 {
+   int iLog;
+   int i;
+
    assert(oDynArray != NULL);
    assert(pfCompare != NULL);
    assert(DynArray_isValid(oDynArray));
 
-   DynArray_quicksort(oDynArray->ppvArray, 0, oDynArray->iLength-1,
-      pfCompare);
+   for (i = oDynArray->iLength, iLog = 0; i > 1; i /= 2)
+      iLog++;
+   DynArray_introsort(oDynArray->ppvArray, 0, oDynArray->iLength-1,
+      iLog, 1, pfCompare);
 
    assert(DynArray_isValid(oDynArray));
 }
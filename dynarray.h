@@ -9,10 +9,35 @@
 typedef struct DynArray *DynArray_T;
 /* A DynArray_T is an array whose length can expand dynamically. */
 
+#define DYNARRAY_HEADER_WORDS \
+   ((int)((3 * sizeof(int) + 2 * sizeof(short) + 2 * sizeof(void*) - 1) / \
+          sizeof(void*)))
+/* Number of pointer-sized words of bookkeeping in a DynArray: three
+   ints, two shorts and a pointer, rounded up to whole words.  Three
+   on LP64 systems, five on ILP32 ones. */
+
+#define DYNARRAY_WORDS(iInline) (DYNARRAY_HEADER_WORDS + (iInline))
+/* Number of pointer-sized words a DynArray with room for iInline
+   elements of its own takes: see DynArray_init(). */
+
 DynArray_T DynArray_new(int iLength);
 /* Return a new DynArray_T object whose length is iLength, or
    NULL if insufficient memory is available. */
 
+DynArray_T DynArray_newInline(int iLength, int iInline);
+/* Return a new DynArray_T object whose length is iLength, allocated
+   in one piece along with room for iInline elements, or NULL if
+   insufficient memory is available. */
+
+DynArray_T DynArray_init(void **ppvMem, int iWords, int iLength);
+/* Make the iWords pointer-sized words at ppvMem, such as an array on
+   the stack or from an arena, a new DynArray_T object whose length is
+   iLength, and return it, or NULL if insufficient memory is
+   available. Elements that do not fit in ppvMem go to the heap.
+   iWords should be DYNARRAY_WORDS() of the number of elements to
+   keep in ppvMem. The object must be freed with DynArray_free() before
+   ppvMem goes away, which leaves ppvMem itself alone. */
+
 void DynArray_free(DynArray_T oDynArray);
 /* Free oDynArray. */
 
@@ -32,6 +57,14 @@ int DynArray_add(DynArray_T oDynArray, const void *pvElement);
    Return 1 (TRUE) if successful, or 0 (FALSE) if insufficient memory
    is available. */
 
+int DynArray_addAll(DynArray_T oDynArray, const void **ppvElements,
+   int iCount);
+/* Add the iCount elements of ppvElements to the end of oDynArray, in
+   order, thus increasing its length by iCount.  ppvElements may be
+   elements of oDynArray itself.  Return 1 (TRUE) if successful, or 0
+   (FALSE) if insufficient memory is available, in which case oDynArray
+   is unchanged. */
+
 int DynArray_addAt(DynArray_T oDynArray, int iIndex,
    const void *pvElement);
 /* Add pvElement to oDynArray such that it is the iIndex'th element.
@@ -39,7 +72,22 @@ int DynArray_addAt(DynArray_T oDynArray, int iIndex,
    is available. */
 
 void *DynArray_removeAt(DynArray_T oDynArray, int iIndex);
-/* Remove and return the iIndex'th element of oDynArray. */
+/* Remove and return the iIndex'th element of oDynArray.  Removing the
+   first element takes constant time, so a DynArray can serve as a
+   queue. */
+
+void DynArray_shrink(DynArray_T oDynArray, int iLength);
+/* Remove the elements of oDynArray from the iLength'th on.  Its memory
+   is kept for elements added later. */
+
+void DynArray_clear(DynArray_T oDynArray);
+/* Remove all elements of oDynArray.  Its memory is kept for elements
+   added later, so it can be refilled without allocating. */
+
+int DynArray_reserve(DynArray_T oDynArray, int iLength);
+/* Make room in oDynArray for iLength elements, so that it can grow to
+   that length without allocating memory.  Return 1 (TRUE) if
+   successful, or 0 (FALSE) if insufficient memory is available. */
 
 void DynArray_toArray(DynArray_T oDynArray, void **ppvArray);
 /* Fill ppvArray with the elements of oDynArray.  ppvArray should point
@@ -653,7 +653,7 @@ static void Ish_executeCommand(char *acLine, DynArray_T oTokens,
    }
    
    /* Lexical analysis stage. */
-   iSuccessful = Lex_lexLine(acLine, oTokens, pcProgName);
+   iSuccessful = Lex_lexLine(acLine, oTokens, NULL, pcProgName);
    /* Check if successful lexical analysis, and if token
       array size is greater than zero. */
    if ((!iSuccessful) || (!DynArray_getLength(oTokens)))
@@ -663,7 +663,7 @@ static void Ish_executeCommand(char *acLine, DynArray_T oTokens,
    }
   
    /* Syntactical parsing stage. */
-   iSuccessful = Syn_synLine(oTokens, oCmds, pcProgName);
+   iSuccessful = Syn_synLine(oTokens, oCmds, NULL, pcProgName);
    /* Check if successful syntactical parsing. */
    if (!iSuccessful)
    {  
@@ -0,0 +1,384 @@
+/*--------------------------------------------------------------------*/
+/* jobtab.c                                                           */
+/* The background jobs of a session                                   */
+/*--------------------------------------------------------------------*/
+
+#include "jobtab.h"
+
+enum {JOBTAB_INLINE = 8};
+/* Number of jobs a table has room for before its array goes to the
+   heap. */
+
+/*--------------------------------------------------------------------*/
+
+struct Job
+
+/* A Job is a background command and its output. */
+
+{
+   pid_t iPid;
+   /* Leader of the process group of the job, 0 once it has finished,
+      or -1 before it has started. */
+
+   int iStatus;
+   /* Exit status of the job once it has finished. */
+
+   int iOutFD;
+   /* Anonymous file the job writes to. */
+
+   off_t iRead;
+   /* Number of bytes of iOutFD fetched so far. */
+
+   char *pcCommand;
+   /* The words of the command, as the job list shows them. */
+};
+
+/*--------------------------------------------------------------------*/
+
+struct JobTab
+
+/* A JobTab is the jobs of a session by number. */
+
+{
+   DynArray_T oJobs;
+   /* Job n at index n - 1, or NULL if there is no job n. */
+};
+
+/*--------------------------------------------------------------------*/
+
+static struct Job *JobTab_get(JobTab_T oTab, int iJob)
+
+/* Return job iJob of oTab. */
+
+{
+   struct Job *psJob;
+
+   assert(oTab != NULL);
+   assert((iJob >= 1) && (iJob <= DynArray_getLength(oTab->oJobs)));
+
+   psJob = (struct Job*)DynArray_get(oTab->oJobs, iJob - 1);
+   assert(psJob != NULL);
+   return psJob;
+}
+
+/*--------------------------------------------------------------------*/
+
+static char *JobTab_describe(SynCmd *psCmd)
+
+/* Return the words of the stages of command psCmd, joined by blanks
+   and pipes, or NULL if insufficient memory is available. */
+
+{
+   SynCmd *psStage;
+   size_t iLength = 1;
+   char *pcCommand;
+   int i;
+
+   for (psStage = psCmd; psStage != NULL; psStage = psStage->psNext)
+      for (i = 0; i < psStage->iArgc; i++)
+         iLength += strlen(psStage->ppcArgv[i]) + 3;
+
+   pcCommand = (char*)malloc(iLength);
+   if (pcCommand == NULL)
+      return NULL;
+   pcCommand[0] = '\0';
+   for (psStage = psCmd; psStage != NULL; psStage = psStage->psNext)
+   {
+      if (psStage != psCmd)
+         strcat(pcCommand, " | ");
+      for (i = 0; i < psStage->iArgc; i++)
+      {
+         if (i > 0)
+            strcat(pcCommand, " ");
+         strcat(pcCommand, psStage->ppcArgv[i]);
+      }
+   }
+   return pcCommand;
+}
+
+/*--------------------------------------------------------------------*/
+
+JobTab_T JobTab_new(void)
+
+/* Return a new, empty JobTab, or NULL if insufficient memory is
+   available. */
+
+{
+   JobTab_T oTab;
+
+   oTab = (JobTab_T)calloc(1, sizeof(struct JobTab));
+   if (oTab == NULL)
+      return NULL;
+   oTab->oJobs = DynArray_newInline(0, JOBTAB_INLINE);
+   if (oTab->oJobs == NULL)
+   {
+      free(oTab);
+      return NULL;
+   }
+   return oTab;
+}
+
+/*--------------------------------------------------------------------*/
+
+void JobTab_free(JobTab_T oTab)
+
+/* Hang up on the jobs of oTab that are still running, and free
+   oTab. */
+
+{
+   struct Job *psJob;
+   int i;
+
+   assert(oTab != NULL);
+
+   for (i = 0; i < DynArray_getLength(oTab->oJobs); i++)
+   {
+      psJob = (struct Job*)DynArray_get(oTab->oJobs, i);
+      if (psJob == NULL)
+         continue;
+      if (psJob->iPid > 0)
+         kill(-psJob->iPid, SIGHUP);
+      close(psJob->iOutFD);
+      free(psJob->pcCommand);
+      free(psJob);
+   }
+   DynArray_free(oTab->oJobs);
+   free(oTab);
+}
+
+/*--------------------------------------------------------------------*/
+
+int JobTab_add(JobTab_T oTab, SynCmd *psCmd, char *pcProgName)
+
+/* Add a job for command psCmd to oTab, with a new output file, and
+   return its number, or FAILURE if oTab is full or insufficient memory
+   is available. */
+
+{
+   struct Job *psJob;
+   int iLength;
+   int i;
+
+   assert(oTab != NULL);
+   assert(psCmd != NULL);
+   assert(pcProgName != NULL);
+
+   /* The lowest free number. */
+   iLength = DynArray_getLength(oTab->oJobs);
+   for (i = 0; i < iLength; i++)
+      if (DynArray_get(oTab->oJobs, i) == NULL)
+         break;
+   if (i == JOBTAB_MAX_JOBS)
+   {
+      fprintf(stderr, "%s: too many jobs\n", pcProgName);
+      return FAILURE;
+   }
+
+   psJob = (struct Job*)calloc(1, sizeof(struct Job));
+   if ((psJob == NULL) ||
+       ((psJob->pcCommand = JobTab_describe(psCmd)) == NULL) ||
+       ((i == iLength) && (! DynArray_add(oTab->oJobs, NULL))))
+   {
+      fprintf(stderr, "%s: cannot allocate memory\n", pcProgName);
+      if (psJob != NULL)
+         free(psJob->pcCommand);
+      free(psJob);
+      return FAILURE;
+   }
+   psJob->iOutFD = Common_createScratch(pcProgName);
+   if (psJob->iOutFD == FAILURE)
+   {
+      free(psJob->pcCommand);
+      free(psJob);
+      return FAILURE;
+   }
+   psJob->iPid = -1;
+   DynArray_set(oTab->oJobs, i, psJob);
+   return i + 1;
+}
+
+/*--------------------------------------------------------------------*/
+
+void JobTab_start(JobTab_T oTab, int iJob, pid_t iPid)
+
+/* Record that job iJob of oTab runs as process iPid. */
+
+{
+   assert(iPid > 0);
+   JobTab_get(oTab, iJob)->iPid = iPid;
+}
+
+/*--------------------------------------------------------------------*/
+
+void JobTab_remove(JobTab_T oTab, int iJob)
+
+/* Forget job iJob of oTab and its output. */
+
+{
+   struct Job *psJob;
+
+   psJob = JobTab_get(oTab, iJob);
+   close(psJob->iOutFD);
+   free(psJob->pcCommand);
+   free(psJob);
+   DynArray_set(oTab->oJobs, iJob - 1, NULL);
+}
+
+/*--------------------------------------------------------------------*/
+
+int JobTab_exited(JobTab_T oTab, pid_t iPid, int iStatus)
+
+/* If process iPid is a job of oTab, record that it ended with exit
+   status iStatus and return its number. Otherwise return 0. */
+
+{
+   struct Job *psJob;
+   int i;
+
+   assert(oTab != NULL);
+   assert(iPid > 0);
+
+   for (i = 0; i < DynArray_getLength(oTab->oJobs); i++)
+   {
+      psJob = (struct Job*)DynArray_get(oTab->oJobs, i);
+      if ((psJob != NULL) && (psJob->iPid == iPid))
+      {
+         psJob->iPid = 0;
+         psJob->iStatus = iStatus;
+         return i + 1;
+      }
+   }
+   return 0;
+}
+
+/*--------------------------------------------------------------------*/
+
+int JobTab_find(JobTab_T oTab, SynCmd *psCmd, char *pcProgName)
+
+/* Return the number of the job of oTab that the argument of command
+   psCmd names, as in "jobout 2" or "jobout %2", or FAILURE with a
+   message naming pcProgName if it names none. */
+
+{
+   const char *pcArg;
+   char *pcEnd;
+   long lJob;
+
+   assert(oTab != NULL);
+   assert(psCmd != NULL);
+   assert(pcProgName != NULL);
+
+   if (psCmd->iArgc < 2)
+   {
+      fprintf(stderr, "%s: %s: missing job number\n", pcProgName,
+              psCmd->ppcArgv[0]);
+      return FAILURE;
+   }
+   if (psCmd->iArgc > 2)
+   {
+      fprintf(stderr, "%s: %s: too many arguments\n", pcProgName,
+              psCmd->ppcArgv[0]);
+      return FAILURE;
+   }
+
+   pcArg = psCmd->ppcArgv[1];
+   if (pcArg[0] == '%')
+      pcArg++;
+   errno = 0;
+   lJob = strtol(pcArg, &pcEnd, 10);
+   if ((errno != 0) || (pcEnd == pcArg) || (*pcEnd != '\0') ||
+       (lJob < 1) || (lJob > DynArray_getLength(oTab->oJobs)) ||
+       (DynArray_get(oTab->oJobs, (int)lJob - 1) == NULL))
+   {
+      fprintf(stderr, "%s: %s: %s: no such job\n", pcProgName,
+              psCmd->ppcArgv[0], psCmd->ppcArgv[1]);
+      return FAILURE;
+   }
+   return (int)lJob;
+}
+
+/*--------------------------------------------------------------------*/
+
+int JobTab_getOutFD(JobTab_T oTab, int iJob)
+
+/* Return the output file of job iJob of oTab. */
+
+{
+   return JobTab_get(oTab, iJob)->iOutFD;
+}
+
+/*--------------------------------------------------------------------*/
+
+pid_t JobTab_getPid(JobTab_T oTab, int iJob)
+
+/* Return the pid of job iJob of oTab, or 0 if it has finished. */
+
+{
+   return JobTab_get(oTab, iJob)->iPid;
+}
+
+/*--------------------------------------------------------------------*/
+
+int JobTab_getStatus(JobTab_T oTab, int iJob)
+
+/* Return the exit status of finished job iJob of oTab. */
+
+{
+   return JobTab_get(oTab, iJob)->iStatus;
+}
+
+/*--------------------------------------------------------------------*/
+
+ssize_t JobTab_readOutput(JobTab_T oTab, int iJob, void *pvBuf,
+                          size_t iSize)
+
+/* Read up to iSize bytes that job iJob of oTab has written since the
+   last read into pvBuf. Return the number of bytes read, 0 if there
+   are none, or FAILURE. */
+
+{
+   struct Job *psJob;
+   ssize_t iGot;
+
+   assert(pvBuf != NULL);
+
+   psJob = JobTab_get(oTab, iJob);
+   while (((iGot = pread(psJob->iOutFD, pvBuf, iSize, psJob->iRead))
+           == -1) && (errno == EINTR))
+      ;
+   if (iGot > 0)
+      psJob->iRead += iGot;
+   return iGot;
+}
+
+/*--------------------------------------------------------------------*/
+
+void JobTab_list(JobTab_T oTab)
+
+/* Print the number, pid, state, unfetched output and command of each
+   job of oTab to stdout. */
+
+{
+   struct Job *psJob;
+   struct stat sStat;
+   char acState[32];
+   long long llUnread;
+   int i;
+
+   assert(oTab != NULL);
+
+   for (i = 0; i < DynArray_getLength(oTab->oJobs); i++)
+   {
+      psJob = (struct Job*)DynArray_get(oTab->oJobs, i);
+      if ((psJob == NULL) || (psJob->iPid == -1))
+         continue;
+      if (psJob->iPid > 0)
+         strcpy(acState, "running");
+      else
+         snprintf(acState, sizeof(acState), "exit %d", psJob->iStatus);
+      llUnread = (fstat(psJob->iOutFD, &sStat) == 0)
+         ? (long long)(sStat.st_size - psJob->iRead) : 0;
+      printf("[%d] %-9s %10lld bytes unread  %s\n", i + 1, acState,
+             llUnread, psJob->pcCommand);
+   }
+}
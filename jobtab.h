@@ -0,0 +1,75 @@
+/*--------------------------------------------------------------------*/
+/* jobtab.h                                                           */
+/* The background jobs of a session                                   */
+/*--------------------------------------------------------------------*/
+
+#ifndef JOBTAB_INCLUDED
+#define JOBTAB_INCLUDED
+
+#include "common.h"
+
+/*--------------------------------------------------------------------*/
+
+typedef struct JobTab *JobTab_T;
+/* A JobTab holds the background jobs of one session: commands, or
+   pipelines, started with a trailing "&", which run while the session
+   goes on with other commands. A job is known by a number, the lowest
+   one free from 1 up. It is a process group of its own, and writes
+   everything it prints into an anonymous file, from which the client
+   fetches it a piece at a time. A job that has finished stays in the
+   table until the last of its output has been fetched. */
+
+#define JOBTAB_MAX_JOBS 64 /* jobs a session may have at once */
+
+/*--------------------------------------------------------------------*/
+
+JobTab_T JobTab_new(void);
+/* Return a new, empty JobTab, or NULL if insufficient memory is
+   available. */
+
+void JobTab_free(JobTab_T oTab);
+/* Hang up on the jobs of oTab that are still running, and free
+   oTab. */
+
+int JobTab_add(JobTab_T oTab, SynCmd *psCmd, char *pcProgName);
+/* Add a job for command psCmd to oTab, with a new output file, and
+   return its number. It is not running until JobTab_start() says so.
+   Return FAILURE with a message naming pcProgName if oTab is full or
+   insufficient memory is available. */
+
+void JobTab_start(JobTab_T oTab, int iJob, pid_t iPid);
+/* Record that job iJob of oTab runs as process iPid, the leader of
+   its process group. */
+
+void JobTab_remove(JobTab_T oTab, int iJob);
+/* Forget job iJob of oTab and its output. */
+
+int JobTab_exited(JobTab_T oTab, pid_t iPid, int iStatus);
+/* If process iPid is a job of oTab, record that it ended with exit
+   status iStatus and return its number. Otherwise return 0. */
+
+int JobTab_find(JobTab_T oTab, SynCmd *psCmd, char *pcProgName);
+/* Return the number of the job of oTab that the argument of command
+   psCmd names, or FAILURE with a message naming pcProgName if it
+   names none. */
+
+int JobTab_getOutFD(JobTab_T oTab, int iJob);
+/* Return the output file of job iJob of oTab. It must only be read
+   with pread(2): its offset is the job's own. */
+
+pid_t JobTab_getPid(JobTab_T oTab, int iJob);
+/* Return the pid of job iJob of oTab, or 0 if it has finished. */
+
+int JobTab_getStatus(JobTab_T oTab, int iJob);
+/* Return the exit status of finished job iJob of oTab. */
+
+ssize_t JobTab_readOutput(JobTab_T oTab, int iJob, void *pvBuf,
+                          size_t iSize);
+/* Read up to iSize bytes that job iJob of oTab has written since the
+   last read into pvBuf. Return the number of bytes read, 0 if there
+   are none, or FAILURE with errno set. */
+
+void JobTab_list(JobTab_T oTab);
+/* Print a line about each job of oTab to stdout. */
+
+#endif
@@ -12,6 +12,11 @@
 #include <assert.h>
 #include <unistd.h>
 
+#define LEX_WORD_ENDS " \t\n\v\f\r\"|&"
+/* Characters that end the run of plain characters of a word: the
+   whitespace of isspace() in the "C" locale, the quote, and the pipe
+   and background operators. */
+
 /*--------------------------------------------------------------------*/
 
 struct Token
@@ -65,7 +70,8 @@ char *Lex_returnValue(void *pvItem)
 
 void Lex_freeToken(void *pvItem, void *pvExtra)
    
-/* Free token pvItem. pvExtra is unused. */
+/* Free token pvItem. pvExtra is unused. Not for tokens allocated
+   from an arena. */
    
 {
    Token_T psToken = NULL;
@@ -79,71 +85,118 @@ void Lex_freeToken(void *pvItem, void *pvExtra)
 
 /*--------------------------------------------------------------------*/
 
-static Token_T Lex_makeToken(TokenType eTokenType, char *pcValue)
+static Token_T Lex_makeToken(const char *pcLine, const LexSlice *psSlice,
+                             Arena_T oArena)
    
-/* Create and return a Token whose type is eTokenType and whose
-   value consists of string pcValue. Return NULL if insufficient
-   memory is available. The caller owns the Token. */
+/* Create and return a Token for slice psSlice of pcLine, allocated
+   from oArena if it is not NULL. Return NULL if insufficient memory
+   is available. The caller owns a Token that is not in an arena. */
 
 {
    Token_T psToken = NULL;
+   size_t iSize = (size_t)psSlice->iLength + 1;
 
-   assert(pcValue != NULL);
+   assert(pcLine != NULL);
+   assert(psSlice != NULL);
 
-   psToken = (Token_T)malloc(sizeof(struct Token));
-   /* Insufficient memory. */
-   if (psToken == NULL)
-      return NULL;
-   
-   psToken->eType = eTokenType;
-   
-   psToken->pcValue = (char*)malloc(strlen(pcValue) + 1);
+   /* One bump of a pointer each, and nothing to free. */
+   if (oArena != NULL)
+   {
+      psToken = (Token_T)Arena_alloc(oArena, sizeof(struct Token));
+      if (psToken == NULL)
+         return NULL;
+      psToken->pcValue = (char*)Arena_alloc(oArena, iSize);
+   }
+   else
+   {
+      psToken = (Token_T)malloc(sizeof(struct Token));
+      /* Insufficient memory. */
+      if (psToken == NULL)
+         return NULL;
+      psToken->pcValue = (char*)malloc(iSize);
+   }
    /* Insufficient memory. */
    if (psToken->pcValue == NULL)
    {
-      free(psToken);
+      if (oArena == NULL)
+         free(psToken);
       return NULL;
    }
    
-   strcpy(psToken->pcValue, pcValue);
+   psToken->eType = psSlice->eType;
+   Lex_copySlice(pcLine, psSlice, psToken->pcValue);
    
    return psToken;
 }
 
 /*--------------------------------------------------------------------*/
 
-int Lex_lexLine(const char *pcLine, DynArray_T oTokens, 
-                char *pcProgName)
-   
-/* Lexically analyze string pcLine. Populate oTokens with the
-   tokens that pcLine contains. Return 1 (TRUE) if successful, or
-   0 (FALSE) otherwise. In the latter case, oTokens may contain
-   tokens that were discovered before the error. The caller owns
-   the tokens placed in oTokens. Note that it returns TRUE if a line
-   is entirely a comment but does not add to oTokens. */
-   
-/* lexLine() uses DFA approach. It "reads" its characters from
-   psLine. */
-   
+void Lex_copySlice(const char *pcLine, const LexSlice *psSlice,
+                   char *pcValue)
+
+/* Write the value of slice psSlice of string pcLine into pcValue,
+   '\0'-terminated. */
+
+{
+   const char *pc;
+   const char *pcEnd;
+
+   assert(pcLine != NULL);
+   assert(psSlice != NULL);
+   assert(pcValue != NULL);
+
+   /* In place already: a single copy. */
+   if (psSlice->iLength == psSlice->iSpan)
+   {
+      memcpy(pcValue, pcLine + psSlice->iOffset, (size_t)psSlice->iLength);
+      pcValue[psSlice->iLength] = '\0';
+      return;
+   }
+
+   /* Quotes within a word are the only bytes the lexer drops. */
+   pcEnd = pcLine + psSlice->iOffset + psSlice->iSpan;
+   for (pc = pcLine + psSlice->iOffset; pc < pcEnd; pc++)
+      if (*pc != '"')
+         *pcValue++ = *pc;
+   *pcValue = '\0';
+}
+
+/*--------------------------------------------------------------------*/
+
+LexNext Lex_nextSlice(const char *pcLine, int *piIndex, LexSlice *psSlice,
+                      char *pcProgName)
+
+/* Find the next token of string pcLine from index *piIndex on, store
+   it in *psSlice and move *piIndex past it. Return LEX_TOKEN,
+   LEX_END or LEX_ERROR. */
+
+/* nextSlice() uses DFA approach. It "reads" its characters from
+   pcLine, and notes where the value of a token starts and ends
+   instead of copying it. The slice is kept in locals and stored once
+   the token ends. */
+
 {
    char c;
-   Token_T psToken = NULL;
 
    enum LexState {STATE_START, STATE_IN_WORD, STATE_IN_QUOTE};
    enum LexState eState = STATE_START;
    /* DFA states. */
    
-   int iLineIndex = 0;
+   int iLineIndex = *piIndex;
    /* Index for the line read from stdin. */
 
-   int iValueIndex = 0;
-   /* Index for each token created from the line. */
+   int iOffset = 0;
+   /* Index of the first byte of the token's value. */
 
-   char acValue[MAX_LINE_SIZE];
-   /* To store token's string value. */
+   int iEnd = 0;
+   /* Index just past the last byte of the token's value. */
+
+   int iQuotes = 0;
+   /* Number of quotes between iOffset and iEnd. */
 
    assert(pcLine != NULL);
-   assert(oTokens != NULL);
+   assert(piIndex != NULL);
+   assert(psSlice != NULL);
    assert(pcProgName != NULL);
    
    for (;;)
@@ -156,116 +209,81 @@ int Lex_lexLine(const char *pcLine, DynArray_T oTokens,
          case STATE_START:
             /* Start state (not in a token). */
             if ((c == '\n') || (c == '\0')) /* End of line. */
-               return TRUE;
+            {
+               *piIndex = iLineIndex - 1;
+               return LEX_END;
+            }
             else if (c == '"') /* Beginning of quoted token. */
+            {
+               iOffset = iEnd = iLineIndex;
                eState = STATE_IN_QUOTE;
+            }
             else if (isspace((int)c)) /* Ignore non-quoted spaces. */
                eState = STATE_START;
-            else if ((c == '>') || (c == '<')) 
+            else if ((c == '>') || (c == '<') || (c == '|') || (c == '&'))
             {
-               /* stdin/stdout redirection. */
-               /* Create a WORD token. */
-               acValue[0] = c;
-               acValue[1] = '\0';
-               psToken = Lex_makeToken(TOKEN_WORD, acValue);
-               if (psToken == NULL)
-               {
-                  fprintf(stderr, "%s: cannot allocate memory\n", 
-                          pcProgName);
-                  return FALSE;
-               }
-               if (! DynArray_add(oTokens, psToken))
-               {
-                  fprintf(stderr, "%s: Cannot allocate memory\n", 
-                          pcProgName);
-                  return FALSE;
-               }
-               iValueIndex = 0;
-               eState = STATE_START;
+               /* stdin/stdout redirection, pipe or background: a WORD
+                  token. */
+               psSlice->iOffset = iLineIndex - 1;
+               psSlice->iSpan = 1;
+               psSlice->iLength = 1;
+               psSlice->eType = TOKEN_WORD;
+               *piIndex = iLineIndex;
+               return LEX_TOKEN;
             }
             else /* Any other character. */
             {
-               acValue[iValueIndex++] = c;
+               iOffset = iLineIndex - 1;
+               iLineIndex += (int)strcspn(pcLine + iLineIndex, LEX_WORD_ENDS);
+               iEnd = iLineIndex;
                eState = STATE_IN_WORD;
             }
             break;
                         
          case STATE_IN_QUOTE:
             /* Quoted token. */
-            if (c == '"') /* Matching ending quote. */
+            if (c == '"') /* Matching ending quote: a QUOTE token. */
             {
-               /* Create a QUOTE token. */
-               acValue[iValueIndex] = '\0';
-               psToken = Lex_makeToken(TOKEN_QUOTE, acValue);
-               if (psToken == NULL)
-               {
-                  fprintf(stderr, "%s: cannot allocate memory\n", 
-                          pcProgName);
-                  return FALSE;
-               }
-               if (! DynArray_add(oTokens, psToken))
-               {
-                  fprintf(stderr, "%s: cannot allocate memory\n", 
-                          pcProgName);
-                  return FALSE;
-               }
-               iValueIndex = 0;
-               eState = STATE_START;
+               psSlice->iOffset = iOffset;
+               psSlice->iSpan = iEnd - iOffset;
+               psSlice->iLength = iEnd - iOffset - iQuotes;
+               psSlice->eType = TOKEN_QUOTE;
+               *piIndex = iLineIndex;
+               return LEX_TOKEN;
             }
             else if ((c == '\n') || (c == '\0')) 
             {
                /* Unterminated quotes. */
                fprintf(stderr, "%s: unmatched quote\n", pcProgName);
-               return FALSE;
+               return LEX_ERROR;
             }
             else /* Any other character. */
             {
-               acValue[iValueIndex++] = c;
+               /* Quotes passed over since the last byte of the value
+                  become part of the span. The rest of the quoted
+                  characters are taken in one step. */
+               iQuotes += iLineIndex - 1 - iEnd;
+               iLineIndex += (int)strcspn(pcLine + iLineIndex, "\"\n");
+               iEnd = iLineIndex;
                eState = STATE_IN_QUOTE;
             }
             break;
             
          case STATE_IN_WORD:
             /* Non-quoted token. */
-            if ((c == '\n') || (c == '\0')) /* End of line. */
+            if ((c == '\n') || (c == '\0') || (c == '|') || (c == '&') ||
+                isspace((int)c))
             {
-               /* Create a WORD token. */
-               acValue[iValueIndex] = '\0';
-               psToken = Lex_makeToken(TOKEN_WORD, acValue);
-               if (psToken == NULL)
-               {
-                  fprintf(stderr, "%s: cannot allocate memory\n", 
-                          pcProgName);
-                  return FALSE;
-               }
-               if (! DynArray_add(oTokens, psToken))
-               {
-                  fprintf(stderr, "%s: cannot allocate memory\n", 
-                          pcProgName);
-                  return FALSE;
-               }
-               iValueIndex = 0;
-               return TRUE;
-            }
-            else if (isspace((int)c)) /* Whitespace. */
-            {
-               /* Create a WORD token. */
-               acValue[iValueIndex] = '\0';
-               psToken = Lex_makeToken(TOKEN_WORD, acValue);
-               if (psToken == NULL)
-               {
-                  fprintf(stderr, "%s: cannot allocate memory\n", 
-                          pcProgName);
-                  return FALSE;
-               }
-               if (! DynArray_add(oTokens, psToken))
-               {
-                  fprintf(stderr, "%s: cannot allocate memory\n", 
-                          pcProgName);
-                  return FALSE;
-               }
-               iValueIndex = 0;
-               eState = STATE_START;
+               /* End of line, operator or whitespace: a WORD token.
+                  The end of the line or the operator is found again
+                  by the next call. */
+               psSlice->iOffset = iOffset;
+               psSlice->iSpan = iEnd - iOffset;
+               psSlice->iLength = iEnd - iOffset - iQuotes;
+               psSlice->eType = TOKEN_WORD;
+               *piIndex = ((c == '\n') || (c == '\0') || (c == '|') ||
+                           (c == '&')) ? iLineIndex - 1 : iLineIndex;
+               return LEX_TOKEN;
             }
             else if (c == '"') /* Quote within a word. */
             {
@@ -275,7 +293,8 @@ int Lex_lexLine(const char *pcLine, DynArray_T oTokens,
             }
             else /* Any other character. */
             {
-               acValue[iValueIndex++] = c;
+               iLineIndex += (int)strcspn(pcLine + iLineIndex, LEX_WORD_ENDS);
+               iEnd = iLineIndex;
                eState = STATE_IN_WORD;
             }
             break;
@@ -285,3 +304,45 @@ int Lex_lexLine(const char *pcLine, DynArray_T oTokens,
       }
    }
 }
+
+/*--------------------------------------------------------------------*/
+
+int Lex_lexLine(const char *pcLine, DynArray_T oTokens, 
+                Arena_T oArena, char *pcProgName)
+   
+/* Lexically analyze string pcLine. Populate oTokens with the
+   tokens that pcLine contains. Return 1 (TRUE) if successful, or
+   0 (FALSE) otherwise. In the latter case, oTokens may contain
+   tokens that were discovered before the error. The tokens are
+   allocated from oArena, or owned by the caller if it is NULL. Note
+   that it returns TRUE if a line is entirely a comment but does not
+   add to oTokens. */
+   
+{
+   Token_T psToken = NULL;
+   LexSlice sSlice;
+   LexNext eNext;
+   int iIndex = 0;
+
+   assert(pcLine != NULL);
+   assert(oTokens != NULL);
+   assert(pcProgName != NULL);
+
+   /* Each token is copied once, straight out of the line. */
+   while ((eNext = Lex_nextSlice(pcLine, &iIndex, &sSlice, pcProgName))
+          == LEX_TOKEN)
+   {
+      psToken = Lex_makeToken(pcLine, &sSlice, oArena);
+      if (psToken == NULL)
+      {
+         fprintf(stderr, "%s: cannot allocate memory\n", pcProgName);
+         return FALSE;
+      }
+      if (! DynArray_add(oTokens, psToken))
+      {
+         fprintf(stderr, "%s: cannot allocate memory\n", pcProgName);
+         return FALSE;
+      }
+   }
+   return (eNext == LEX_END);
+}
@@ -8,6 +8,7 @@
 #define LEX_INCLUDED
 
 #include "dynarray.h"
+#include "arena.h"
 
 #ifndef TRUE
 #define TRUE 1
@@ -25,11 +26,35 @@
 
 typedef struct Token *Token_T;
 /* A token is a string which is either a special character (like 
-   < or >), or a normal word (like a command or an argument. */
+   <, >, | or &), or a normal word (like a command or an argument. */
 
 enum TokenType {TOKEN_QUOTE, TOKEN_WORD};
 typedef enum TokenType TokenType;
 
+typedef struct LexSlice
+{
+   int iOffset;
+   /* Index in the line of the first byte of the token's value. */
+
+   int iSpan;
+   /* Number of bytes of the line from there to the last byte of its
+      value, including quotes within it. */
+
+   int iLength;
+   /* Number of bytes of its value: iSpan less those quotes. */
+
+   TokenType eType;
+   /* Type of the token. */
+} LexSlice;
+/* A slice is a token seen in place in its line rather than copied
+   out. Its value is the iSpan bytes at iOffset, without the '"'
+   characters among them; if iLength is iSpan there are none, and the
+   value can be used where it is. */
+
+enum LexNext {LEX_TOKEN, LEX_END, LEX_ERROR};
+typedef enum LexNext LexNext;
+/* Result of looking for the next token of a line. */
+
 /*--------------------------------------------------------------------*/
 
 TokenType Lex_returnType(void *pvItem);
@@ -39,16 +64,33 @@ char *Lex_returnValue(void *pvItem);
 /* Returns value of token pvItem. */
 
 void Lex_freeToken(void *pvItem, void *pvExtra);   
-/* Free token pvItem. pvExtra is unused. */
-
-int Lex_lexLine(const char *pcLine, DynArray_T oTokens, char *pcProgName);   
+/* Free token pvItem. pvExtra is unused. Not for tokens allocated
+   from an arena. */
+
+LexNext Lex_nextSlice(const char *pcLine, int *piIndex, LexSlice *psSlice,
+                      char *pcProgName);
+/* Find the next token of string pcLine from index *piIndex on, store
+   it in *psSlice and move *piIndex past it. Return LEX_TOKEN if there
+   was one, LEX_END at the end of the line, or LEX_ERROR (with a
+   message naming pcProgName) on an unmatched quote. Nothing is copied
+   or allocated. */
+
+void Lex_copySlice(const char *pcLine, const LexSlice *psSlice,
+                   char *pcValue);
+/* Write the value of slice psSlice of string pcLine into pcValue, of
+   at least psSlice->iLength + 1 bytes, '\0'-terminated. */
+
+int Lex_lexLine(const char *pcLine, DynArray_T oTokens, Arena_T oArena,
+                char *pcProgName);   
 /* Lexically analyze string pcLine. Populate oTokens with the
    tokens that pcLine contains. Return 1 (TRUE) if successful, or
    0 (FALSE) otherwise. In the latter case, oTokens may contain
-   tokens that were discovered before the error. The caller owns
-   the tokens placed in oTokens. Note that it returns TRUE if a line
-   is entirely a comment but does not add to oTokens. Also note that
-   function requires calling program's name for error-checking. */
+   tokens that were discovered before the error. The tokens are
+   allocated from oArena, which owns them, or with malloc if oArena
+   is NULL, in which case the caller owns them. Note that it returns
+   TRUE if a line is entirely a comment but does not add to oTokens.
+   Also note that function requires calling program's name for
+   error-checking. */
 
 #endif
 
@@ -0,0 +1,237 @@
+/*--------------------------------------------------------------------*/
+/* lz.c                                                               */
+/* Fast LZ77 block compression for the wire protocol                  */
+/*--------------------------------------------------------------------*/
+
+#include "lz.h"
+#include <stdint.h>
+#include <string.h>
+
+/*--------------------------------------------------------------------*/
+
+#define LZ_MIN_MATCH 4 /* shortest match worth a sequence */
+#define LZ_HASH_BITS 12 /* log2 of the number of hash table entries */
+#define LZ_MAX_OFFSET 65535 /* farthest a match can look back */
+#define LZ_LAST_LITERALS 5 /* bytes at the end always sent as literals */
+#define LZ_MATCH_LIMIT 12 /* no match starts this close to the end */
+#define LZ_SKIP_SHIFT 6 /* misses before the search takes bigger steps */
+
+/*--------------------------------------------------------------------*/
+
+static uint32_t Lz_read32(const unsigned char *puc)
+
+/* Return the four bytes at puc as a number. */
+
+{
+   uint32_t u;
+
+   memcpy(&u, puc, sizeof(u));
+   return u;
+}
+
+/*--------------------------------------------------------------------*/
+
+static uint32_t Lz_hash(uint32_t u)
+
+/* Return the hash table entry for the four bytes u. */
+
+{
+   return (u * 2654435761U) >> (32 - LZ_HASH_BITS);
+}
+
+/*--------------------------------------------------------------------*/
+
+static unsigned char *Lz_putLength(unsigned char *pucOut, size_t iLength)
+
+/* Write the part of iLength beyond the 15 of a token at pucOut and
+   return the end of what was written. */
+
+{
+   iLength -= 15;
+   while (iLength >= 255)
+   {
+      *pucOut++ = 255;
+      iLength -= 255;
+   }
+   *pucOut++ = (unsigned char)iLength;
+   return pucOut;
+}
+
+/*--------------------------------------------------------------------*/
+
+static unsigned char *Lz_emit(unsigned char *pucOut, unsigned char *pucEnd,
+                              const unsigned char *pucLiterals,
+                              size_t iLiterals, size_t iOffset,
+                              size_t iMatch)
+
+/* Write a sequence of the iLiterals bytes at pucLiterals and a match of
+   iMatch bytes at iOffset back, or no match if iMatch is 0, at pucOut,
+   which must not go past pucEnd. Return the end of what was written, or
+   NULL if it does not fit. */
+
+{
+   unsigned char *pucToken;
+   size_t iMost;
+
+   /* The most a sequence can take. */
+   iMost = 1 + iLiterals / 255 + 1 + iLiterals + 2 + iMatch / 255 + 1;
+   if ((size_t)(pucEnd - pucOut) < iMost)
+      return NULL;
+
+   pucToken = pucOut++;
+   *pucToken = (unsigned char)(((iLiterals < 15) ? iLiterals : 15) << 4);
+   if (iLiterals >= 15)
+      pucOut = Lz_putLength(pucOut, iLiterals);
+   memcpy(pucOut, pucLiterals, iLiterals);
+   pucOut += iLiterals;
+   if (iMatch == 0)
+      return pucOut;
+
+   *pucOut++ = (unsigned char)(iOffset & 0xff);
+   *pucOut++ = (unsigned char)(iOffset >> 8);
+   iMatch -= LZ_MIN_MATCH;
+   *pucToken |= (unsigned char)((iMatch < 15) ? iMatch : 15);
+   if (iMatch >= 15)
+      pucOut = Lz_putLength(pucOut, iMatch);
+   return pucOut;
+}
+
+/*--------------------------------------------------------------------*/
+
+size_t Lz_compress(const void *pvSrc, size_t iSize, void *pvDst,
+                   size_t iCapacity)
+
+/* Compress the iSize bytes at pvSrc into pvDst, which has room for
+   iCapacity bytes. Return the size of the compressed block, or 0 if it
+   does not fit. */
+
+{
+   const unsigned char *pucSrc = (const unsigned char*)pvSrc;
+   unsigned char *pucOut = (unsigned char*)pvDst;
+   unsigned char *pucEnd = pucOut + iCapacity;
+   uint32_t auTable[1 << LZ_HASH_BITS];
+   size_t iPos = 0, iAnchor = 0, iCandidate, iMatch, iLimit;
+   uint32_t uSeq, uHash;
+   unsigned int uMisses = 0;
+
+   memset(auTable, 0, sizeof(auTable));
+   if (iSize >= LZ_MATCH_LIMIT)
+   {
+      iLimit = iSize - LZ_MATCH_LIMIT;
+      while (iPos < iLimit)
+      {
+         uSeq = Lz_read32(pucSrc + iPos);
+         uHash = Lz_hash(uSeq);
+         iCandidate = auTable[uHash];
+         auTable[uHash] = (uint32_t)iPos;
+
+         if ((iCandidate >= iPos) || (iPos - iCandidate > LZ_MAX_OFFSET) ||
+             (Lz_read32(pucSrc + iCandidate) != uSeq))
+         {
+            /* Data that does not compress is skipped over ever
+               faster. */
+            iPos += 1 + (uMisses++ >> LZ_SKIP_SHIFT);
+            continue;
+         }
+
+         for (iMatch = LZ_MIN_MATCH;
+              (iPos + iMatch < iSize - LZ_LAST_LITERALS) &&
+              (pucSrc[iCandidate + iMatch] == pucSrc[iPos + iMatch]);
+              iMatch++)
+            ;
+         pucOut = Lz_emit(pucOut, pucEnd, pucSrc + iAnchor, iPos - iAnchor,
+                          iPos - iCandidate, iMatch);
+         if (pucOut == NULL)
+            return 0;
+         iPos += iMatch;
+         iAnchor = iPos;
+         uMisses = 0;
+      }
+   }
+
+   pucOut = Lz_emit(pucOut, pucEnd, pucSrc + iAnchor, iSize - iAnchor, 0, 0);
+   if (pucOut == NULL)
+      return 0;
+   return (size_t)(pucOut - (unsigned char*)pvDst);
+}
+
+/*--------------------------------------------------------------------*/
+
+static int Lz_getLength(const unsigned char **ppucIn,
+                        const unsigned char *pucEnd, size_t *piLength)
+
+/* Add the length bytes at *ppucIn, which must not go past pucEnd, to
+   *piLength and move *ppucIn past them. Return 1 (TRUE), or 0 (FALSE)
+   if they run past pucEnd. */
+
+{
+   unsigned char ucByte;
+
+   do
+   {
+      if (*ppucIn >= pucEnd)
+         return 0;
+      ucByte = *(*ppucIn)++;
+      *piLength += ucByte;
+   } while (ucByte == 255);
+   return 1;
+}
+
+/*--------------------------------------------------------------------*/
+
+ssize_t Lz_decompress(const void *pvSrc, size_t iSize, void *pvDst,
+                      size_t iCapacity)
+
+/* Decompress the block of iSize bytes at pvSrc into pvDst, which has
+   room for iCapacity bytes. Return the size of the output, or -1 if
+   the block is malformed or its output does not fit. */
+
+{
+   const unsigned char *pucIn = (const unsigned char*)pvSrc;
+   const unsigned char *pucInEnd = pucIn + iSize;
+   unsigned char *pucOut = (unsigned char*)pvDst;
+   unsigned char *pucOutEnd = pucOut + iCapacity;
+   const unsigned char *pucMatch;
+   size_t iLiterals, iMatch, iOffset;
+   unsigned char ucToken;
+
+   while (pucIn < pucInEnd)
+   {
+      ucToken = *pucIn++;
+
+      iLiterals = ucToken >> 4;
+      if ((iLiterals == 15) && ! Lz_getLength(&pucIn, pucInEnd, &iLiterals))
+         return -1;
+      if ((iLiterals > (size_t)(pucInEnd - pucIn)) ||
+          (iLiterals > (size_t)(pucOutEnd - pucOut)))
+         return -1;
+      memcpy(pucOut, pucIn, iLiterals);
+      pucIn += iLiterals;
+      pucOut += iLiterals;
+      if (pucIn == pucInEnd)
+         break; /* the last sequence */
+
+      if (pucInEnd - pucIn < 2)
+         return -1;
+      iOffset = (size_t)pucIn[0] | ((size_t)pucIn[1] << 8);
+      pucIn += 2;
+      if ((iOffset == 0) ||
+          (iOffset > (size_t)(pucOut - (unsigned char*)pvDst)))
+         return -1;
+
+      iMatch = ucToken & 15;
+      if ((iMatch == 15) && ! Lz_getLength(&pucIn, pucInEnd, &iMatch))
+         return -1;
+      iMatch += LZ_MIN_MATCH;
+      if (iMatch > (size_t)(pucOutEnd - pucOut))
+         return -1;
+
+      /* Byte by byte: the match may overlap what it produces. */
+      pucMatch = pucOut - iOffset;
+      while (iMatch-- > 0)
+         *pucOut++ = *pucMatch++;
+   }
+   return (ssize_t)(pucOut - (unsigned char*)pvDst);
+}
+
+/*--------------------------------------------------------------------*/
@@ -0,0 +1,47 @@
+/*--------------------------------------------------------------------*/
+/* lz.h                                                               */
+/* Fast LZ77 block compression for the wire protocol                  */
+/*--------------------------------------------------------------------*/
+
+#ifndef LZ_INCLUDED
+#define LZ_INCLUDED
+
+#include <stddef.h>
+#include <sys/types.h>
+
+/*--------------------------------------------------------------------*/
+
+/* A compressed block is a series of sequences, each of them
+
+      byte 0        token: literal count (high 4 bits) and match
+                    length less 4 (low 4 bits), 15 meaning "more
+                    follows"
+      0 or more     255s and a last byte under 255, added to a count
+                    of 15
+      n bytes       literals
+      2 bytes       match offset back from the current end of output,
+                    little-endian
+      0 or more     255s and a last byte under 255, added to a match
+                    length of 15
+
+   The last sequence ends after its literals. Matches may overlap their
+   own output, so runs of a repeated byte cost a few bytes. Blocks are
+   independent of each other, which keeps both sides' memory bounded by
+   the size of one block. */
+
+/*--------------------------------------------------------------------*/
+
+size_t Lz_compress(const void *pvSrc, size_t iSize, void *pvDst,
+                   size_t iCapacity);
+/* Compress the iSize bytes at pvSrc into pvDst, which has room for
+   iCapacity bytes. Return the size of the compressed block, or 0 if it
+   does not fit; a capacity below iSize thus rejects blocks that do not
+   save enough. */
+
+ssize_t Lz_decompress(const void *pvSrc, size_t iSize, void *pvDst,
+                      size_t iCapacity);
+/* Decompress the block of iSize bytes at pvSrc into pvDst, which has
+   room for iCapacity bytes. Return the size of the output, or -1 if
+   the block is malformed or its output does not fit. */
+
+#endif
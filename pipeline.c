@@ -0,0 +1,207 @@
+/*--------------------------------------------------------------------*/
+/* pipeline.c                                                         */
+/* Commands joined by pipes, all running at once                      */
+/*--------------------------------------------------------------------*/
+
+#include "pipeline.h"
+#include <sys/resource.h>
+#include <time.h>
+
+/*--------------------------------------------------------------------*/
+
+struct PipelineStage
+
+/* A command of a pipeline as it runs. */
+
+{
+   SynCmd *psCmd;
+   /* The command. */
+
+   pid_t iPid;
+   /* Process running the command, or 0 if it was not started. */
+
+   int iStatus;
+   /* Exit status of the command. */
+
+   struct timespec sStart;
+   /* When the command was started. */
+
+   double dWall;
+   /* Seconds the command ran. */
+
+   double dCpu;
+   /* Seconds of CPU time the command and its children used. */
+};
+
+/*--------------------------------------------------------------------*/
+
+static double Pipeline_since(const struct timespec *psStart)
+
+/* Return the seconds elapsed since *psStart. */
+
+{
+   struct timespec sNow;
+
+   clock_gettime(CLOCK_MONOTONIC, &sNow);
+   return (double)(sNow.tv_sec - psStart->tv_sec) +
+          (double)(sNow.tv_nsec - psStart->tv_nsec) / 1e9;
+}
+
+/*--------------------------------------------------------------------*/
+
+static pid_t Pipeline_start(struct PipelineStage *psStage, int iInFD,
+                            int iOutFD, char *pcProgName)
+
+/* Start the command of psStage reading from iInFD and writing to
+   iOutFD, either of which may be -1 to leave stdin or stdout as they
+   are. Return its pid, or FAILURE. */
+
+{
+   pid_t iPid;
+
+   clock_gettime(CLOCK_MONOTONIC, &psStage->sStart);
+   fflush(NULL);
+   if ((iPid = fork()) != 0)
+      return (iPid == -1) ? FAILURE : iPid;
+
+   /* The pipes, then the stage's own redirections. */
+   if (((iInFD != -1) && (dup2(iInFD, 0) == -1)) ||
+       ((iOutFD != -1) && (dup2(iOutFD, 1) == -1)))
+   {
+      perror(pcProgName);
+      exit(EXIT_FAILURE);
+   }
+   Common_execCmd(psStage->psCmd, pcProgName);
+   return FAILURE; /* not reached */
+}
+
+/*--------------------------------------------------------------------*/
+
+static void Pipeline_report(struct PipelineStage *psStages, int iStages,
+                            double dWall)
+
+/* Print the exit status and time of each of the iStages stages of
+   psStages, and the wall clock time dWall of the whole pipeline. */
+
+{
+   double dCpu = 0.0;
+   int i;
+
+   for (i = 0; i < iStages; i++)
+   {
+      if (psStages[i].iPid == 0)
+      {
+         fprintf(stderr, "%s: %d %-22s not started\n", PIPELINE_NAME,
+                 i + 1, psStages[i].psCmd->ppcArgv[0]);
+         continue;
+      }
+      fprintf(stderr, "%s: %d %-22s %7.2fs wall %7.2fs cpu", PIPELINE_NAME,
+              i + 1, psStages[i].psCmd->ppcArgv[0], psStages[i].dWall,
+              psStages[i].dCpu);
+      if (psStages[i].iStatus != 0)
+         fprintf(stderr, "  (exit %d)", psStages[i].iStatus);
+      fprintf(stderr, "\n");
+      dCpu += psStages[i].dCpu;
+   }
+   fprintf(stderr, "%s: %d stages, %.2fs wall, %.2fs cpu\n", PIPELINE_NAME,
+           iStages, dWall, dCpu);
+}
+
+/*--------------------------------------------------------------------*/
+
+int Pipeline_run(SynCmd *psCmd, char *pcProgName)
+
+/* Run the stages of pipeline psCmd, wait for all of them, and report
+   on each. Return the exit status of the last stage. */
+
+{
+   struct PipelineStage *psStages;
+   struct timespec sStart;
+   struct rusage sUsage;
+   SynCmd *psCmdStage;
+   int aiPipe[2];
+   int iInFD = -1;
+   int iStages = 0;
+   int iRunning = 0;
+   int iWaitStatus;
+   int iStatus;
+   pid_t iPid;
+   int i;
+
+   assert(psCmd != NULL);
+   assert(pcProgName != NULL);
+
+   for (psCmdStage = psCmd; psCmdStage != NULL;
+        psCmdStage = psCmdStage->psNext)
+      iStages++;
+   psStages = (struct PipelineStage*)calloc((size_t)iStages,
+                                            sizeof(struct PipelineStage));
+   if (psStages == NULL)
+   {
+      fprintf(stderr, "%s: cannot allocate memory\n", pcProgName);
+      return EXIT_FAILURE;
+   }
+
+   /* The stages are our children, and we wait for them. */
+   signal(SIGCHLD, SIG_DFL);
+
+   /* Start them all, each reading what the one before writes. A stage
+      that cannot be started closes the pipe of the one before, which
+      then gets SIGPIPE. */
+   clock_gettime(CLOCK_MONOTONIC, &sStart);
+   for (i = 0, psCmdStage = psCmd; i < iStages;
+        i++, psCmdStage = psCmdStage->psNext)
+   {
+      psStages[i].psCmd = psCmdStage;
+      aiPipe[0] = aiPipe[1] = -1;
+      if ((i + 1 < iStages) && (pipe2(aiPipe, O_CLOEXEC) == -1))
+      {
+         perror(pcProgName);
+         break;
+      }
+      iPid = Pipeline_start(&psStages[i], iInFD, aiPipe[1], pcProgName);
+      if (iInFD != -1)
+         close(iInFD);
+      if (aiPipe[1] != -1)
+         close(aiPipe[1]);
+      iInFD = aiPipe[0];
+      if (iPid == FAILURE)
+      {
+         perror(pcProgName);
+         break;
+      }
+      psStages[i].iPid = iPid;
+      iRunning++;
+   }
+   if (iInFD != -1)
+      close(iInFD);
+
+   /* Wait for the whole group. */
+   while (iRunning > 0)
+   {
+      iPid = wait4(-1, &iWaitStatus, 0, &sUsage);
+      if ((iPid == -1) && (errno == EINTR))
+         continue;
+      if (iPid == -1)
+         break;
+      for (i = 0; i < iStages; i++)
+         if (psStages[i].iPid == iPid)
+            break;
+      if (i == iStages)
+         continue;
+
+      psStages[i].dWall = Pipeline_since(&psStages[i].sStart);
+      psStages[i].dCpu =
+         (double)(sUsage.ru_utime.tv_sec + sUsage.ru_stime.tv_sec) +
+         (double)(sUsage.ru_utime.tv_usec + sUsage.ru_stime.tv_usec) / 1e6;
+      psStages[i].iStatus = WIFEXITED(iWaitStatus) ?
+         WEXITSTATUS(iWaitStatus) : 128 + WTERMSIG(iWaitStatus);
+      iRunning--;
+   }
+
+   Pipeline_report(psStages, iStages, Pipeline_since(&sStart));
+   iStatus = (psStages[iStages - 1].iPid != 0) ?
+      psStages[iStages - 1].iStatus : EXIT_FAILURE;
+   free(psStages);
+   return iStatus;
+}
@@ -0,0 +1,34 @@
+/*--------------------------------------------------------------------*/
+/* pipeline.h                                                         */
+/* Commands joined by pipes, all running at once                      */
+/*--------------------------------------------------------------------*/
+
+#ifndef PIPELINE_INCLUDED
+#define PIPELINE_INCLUDED
+
+#include "common.h"
+
+/*--------------------------------------------------------------------*/
+
+/* A pipeline
+
+      command | command ...
+
+   starts every command at once, each one's stdout connected to the
+   next one's stdin by a pipe, so that what flows between them never
+   touches the disk. A redirection of a stage takes the place of its
+   pipe. The pipeline is waited for as a whole, and then the exit
+   status and the time each stage took are printed to stderr. Its exit
+   status is that of the last stage. */
+
+#define PIPELINE_NAME "pipeline"
+
+/*--------------------------------------------------------------------*/
+
+int Pipeline_run(SynCmd *psCmd, char *pcProgName);
+/* Run the stages of pipeline psCmd, wait for all of them, and report
+   on each. Return the exit status of the last stage. The stages are
+   children of the calling process, which must not wait for other
+   children meanwhile. */
+
+#endif
@@ -0,0 +1,854 @@
+/*--------------------------------------------------------------------*/
+/* proto.c                                                            */
+/* Binary framed wire protocol between client and server              */
+/*--------------------------------------------------------------------*/
+
+#include "proto.h"
+#include "common.h"
+#include "lz.h"
+#include <endian.h>
+#include <time.h>
+
+/*--------------------------------------------------------------------*/
+
+struct ProtoConn
+
+/* What a connection agreed on. */
+
+{
+   int iLz;
+   /* Compression is on. */
+
+   ProtoStats sStats;
+   /* Its counters. */
+};
+
+static struct ProtoConn *psConns = NULL;
+/* Connections that agreed on something, by socket. */
+
+static int iConns = 0;
+/* Number of entries in psConns. */
+
+static int iCompression = TRUE;
+/* Offer or accept compression. */
+
+/*--------------------------------------------------------------------*/
+
+static void Proto_encodeHeader(unsigned char *pucHeader, ProtoType eType,
+                               unsigned int uFlags, uint32_t uId,
+                               uint64_t uLength)
+
+/* Encode a frame header into the PROTO_HEADER_SIZE bytes at
+   pucHeader. */
+
+{
+   uint16_t uFlags16 = htobe16((uint16_t)uFlags);
+   uint32_t uId32 = htobe32(uId);
+   uint64_t uLength64 = htobe64(uLength);
+
+   pucHeader[0] = PROTO_MAGIC;
+   pucHeader[1] = (unsigned char)eType;
+   memcpy(pucHeader + 2, &uFlags16, 2);
+   memcpy(pucHeader + 4, &uId32, 4);
+   memcpy(pucHeader + 8, &uLength64, 8);
+}
+
+/*--------------------------------------------------------------------*/
+
+static int Proto_decodeHeader(const unsigned char *pucHeader,
+                              ProtoHeader *psHeader)
+
+/* Decode the PROTO_HEADER_SIZE bytes at pucHeader into *psHeader.
+   Return 1 (TRUE) if they are a valid header, 0 (FALSE) otherwise. */
+
+{
+   uint16_t uFlags16;
+   uint32_t uId32;
+   uint64_t uLength64;
+
+   if ((pucHeader[0] != PROTO_MAGIC) ||
+       (pucHeader[1] < PROTO_HELLO) || (pucHeader[1] > PROTO_ARCHIVE))
+      return FALSE;
+
+   memcpy(&uFlags16, pucHeader + 2, 2);
+   memcpy(&uId32, pucHeader + 4, 4);
+   memcpy(&uLength64, pucHeader + 8, 8);
+   psHeader->eType = (ProtoType)pucHeader[1];
+   psHeader->uFlags = be16toh(uFlags16);
+   psHeader->uId = be32toh(uId32);
+   psHeader->uLength = be64toh(uLength64);
+   return TRUE;
+}
+
+/*--------------------------------------------------------------------*/
+
+static struct ProtoConn *Proto_getConn(int iSockFD)
+
+/* Return what the connection on iSockFD agreed on, or NULL if it did
+   not agree on compression. */
+
+{
+   if ((iSockFD < 0) || (iSockFD >= iConns) || (! psConns[iSockFD].iLz))
+      return NULL;
+   return &psConns[iSockFD];
+}
+
+/*--------------------------------------------------------------------*/
+
+static int Proto_setConn(int iSockFD, int iLz)
+
+/* Record whether the connection on iSockFD agreed on compression, and
+   start its counters afresh. Return 1 (TRUE) if compression is on, 0
+   (FALSE) if it is not or there is no memory to keep track of it. */
+
+{
+   struct ProtoConn *psNew;
+   int iNew;
+
+   if ((! iLz) || (iSockFD < 0))
+   {
+      Proto_forget(iSockFD);
+      return FALSE;
+   }
+   if (iSockFD >= iConns)
+   {
+      iNew = (iSockFD < 64) ? 64 : 2 * iSockFD;
+      psNew = (struct ProtoConn*)realloc(psConns,
+                                         iNew * sizeof(struct ProtoConn));
+      if (psNew == NULL)
+         return FALSE;
+      memset(psNew + iConns, 0, (iNew - iConns) * sizeof(struct ProtoConn));
+      psConns = psNew;
+      iConns = iNew;
+   }
+   memset(&psConns[iSockFD], 0, sizeof(struct ProtoConn));
+   psConns[iSockFD].iLz = TRUE;
+   return TRUE;
+}
+
+/*--------------------------------------------------------------------*/
+
+static long long Proto_cpuNanos(void)
+
+/* Return the CPU time of this process in nanoseconds. */
+
+{
+   struct timespec sTime;
+
+   clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &sTime);
+   return (long long)sTime.tv_sec * 1000000000LL + sTime.tv_nsec;
+}
+
+/*--------------------------------------------------------------------*/
+
+int Proto_writeFrame(int iSockFD, ProtoType eType, unsigned int uFlags,
+                     uint32_t uId, const void *pvPayload,
+                     uint64_t uLength)
+
+/* Write a frame header and, if pvPayload is not NULL, its payload to
+   iSockFD. Return SUCCESS or FAILURE. */
+
+{
+   unsigned char aucFrame[PROTO_HEADER_SIZE + MAX_LINE_SIZE];
+
+   Proto_encodeHeader(aucFrame, eType, uFlags, uId, uLength);
+
+   /* Small payloads go out in the same write as their header. */
+   if ((pvPayload != NULL) && (uLength <= MAX_LINE_SIZE))
+   {
+      memcpy(aucFrame + PROTO_HEADER_SIZE, pvPayload, (size_t)uLength);
+      if (Common_writen(iSockFD, aucFrame,
+                        PROTO_HEADER_SIZE + (size_t)uLength) == FAILURE)
+         return FAILURE;
+      return SUCCESS;
+   }
+
+   if (Common_writen(iSockFD, aucFrame, PROTO_HEADER_SIZE) == FAILURE)
+      return FAILURE;
+   if ((pvPayload != NULL) &&
+       (Common_writen(iSockFD, pvPayload, (size_t)uLength) == FAILURE))
+      return FAILURE;
+   return SUCCESS;
+}
+
+/*--------------------------------------------------------------------*/
+
+RecvBufRead Proto_peekHeader(RecvBuf_T oBuf, ProtoHeader *psHeader)
+
+/* Decode the next frame header from oBuf without consuming it. */
+
+{
+   unsigned char aucHeader[PROTO_HEADER_SIZE];
+   RecvBufRead eRead;
+
+   assert(oBuf != NULL);
+   assert(psHeader != NULL);
+
+   eRead = RecvBuf_peek(oBuf, aucHeader, PROTO_HEADER_SIZE);
+   if (eRead != RECVBUF_OK)
+      return eRead;
+   if (! Proto_decodeHeader(aucHeader, psHeader))
+      return RECVBUF_ERROR;
+   return RECVBUF_OK;
+}
+
+/*--------------------------------------------------------------------*/
+
+RecvBufRead Proto_readHeader(RecvBuf_T oBuf, ProtoHeader *psHeader)
+
+/* Read and decode the next frame header from oBuf. */
+
+{
+   unsigned char aucHeader[PROTO_HEADER_SIZE];
+   RecvBufRead eRead;
+
+   eRead = Proto_peekHeader(oBuf, psHeader);
+   if (eRead != RECVBUF_OK)
+      return eRead;
+   RecvBuf_readn(oBuf, aucHeader, PROTO_HEADER_SIZE);
+   return RECVBUF_OK;
+}
+
+/*--------------------------------------------------------------------*/
+
+RecvBufRead Proto_readFrame(RecvBuf_T oBuf, ProtoHeader *psHeader,
+                            void *pvPayload, size_t iSize)
+
+/* Read the next frame from oBuf, header and payload, only once all of
+   it has arrived. */
+
+{
+   unsigned char aucFrame[PROTO_HEADER_SIZE + MAX_LINE_SIZE];
+   RecvBufRead eRead;
+
+   assert(oBuf != NULL);
+   assert(psHeader != NULL);
+   assert(iSize <= MAX_LINE_SIZE);
+
+   eRead = RecvBuf_peek(oBuf, aucFrame, PROTO_HEADER_SIZE);
+   if (eRead != RECVBUF_OK)
+      return eRead;
+   if ((! Proto_decodeHeader(aucFrame, psHeader)) ||
+       (psHeader->uLength > iSize))
+      return RECVBUF_ERROR;
+
+   eRead = RecvBuf_peek(oBuf, aucFrame,
+                        PROTO_HEADER_SIZE + (size_t)psHeader->uLength);
+   if (eRead != RECVBUF_OK)
+      return eRead;
+   RecvBuf_readn(oBuf, aucFrame,
+                 PROTO_HEADER_SIZE + (size_t)psHeader->uLength);
+   memcpy(pvPayload, aucFrame + PROTO_HEADER_SIZE,
+          (size_t)psHeader->uLength);
+   return RECVBUF_OK;
+}
+
+/*--------------------------------------------------------------------*/
+
+int Proto_clientHello(int iSockFD, RecvBuf_T oBuf)
+
+/* Offer this client's protocol versions on iSockFD and wait for the
+   server's choice. Return the chosen version, or FAILURE. */
+
+{
+   uint16_t auVersions[2];
+   char acReply[MAX_LINE_SIZE];
+   ProtoHeader sHeader;
+   uint16_t uChosen;
+
+   auVersions[0] = htobe16(PROTO_VERSION_MIN);
+   auVersions[1] = htobe16(PROTO_VERSION_MAX);
+   if (Proto_writeFrame(iSockFD, PROTO_HELLO,
+                        iCompression ? PROTO_FLAG_LZ : 0, 0, auVersions,
+                        sizeof(auVersions)) == FAILURE)
+      return FAILURE;
+
+   if (Proto_readFrame(oBuf, &sHeader, acReply, MAX_LINE_SIZE - 1)
+       != RECVBUF_OK)
+      return FAILURE;
+   if (sHeader.eType == PROTO_ERROR)
+   {
+      acReply[sHeader.uLength] = '\0';
+      fprintf(stderr, "server refused connection: %s\n", acReply);
+      return FAILURE;
+   }
+   if ((sHeader.eType != PROTO_HELLO) ||
+       (sHeader.uLength != sizeof(uChosen)))
+      return FAILURE;
+
+   memcpy(&uChosen, acReply, sizeof(uChosen));
+   uChosen = be16toh(uChosen);
+   if ((uChosen < PROTO_VERSION_MIN) || (uChosen > PROTO_VERSION_MAX))
+      return FAILURE;
+
+   /* Compressed frames are understood either way; this only decides
+      what we send. */
+   Proto_setConn(iSockFD, iCompression && (sHeader.uFlags & PROTO_FLAG_LZ));
+   return uChosen;
+}
+
+/*--------------------------------------------------------------------*/
+
+int Proto_serverHello(int iSockFD, unsigned int uFlags,
+                      const void *pvPayload, uint64_t uLength)
+
+/* Answer the PROTO_HELLO frame with flags uFlags and payload pvPayload
+   from a client on iSockFD. Return the chosen version, or FAILURE if
+   there is none. */
+
+{
+   static const char acRefusal[] = "no common protocol version";
+   uint16_t auVersions[2];
+   uint16_t uMin, uMax, uChosen;
+   int iLz;
+
+   if (uLength != sizeof(auVersions))
+   {
+      Proto_writeFrame(iSockFD, PROTO_ERROR, 0, 0, acRefusal,
+                       sizeof(acRefusal) - 1);
+      return FAILURE;
+   }
+
+   /* Pick the newest version both ends speak. */
+   memcpy(auVersions, pvPayload, sizeof(auVersions));
+   uMin = be16toh(auVersions[0]);
+   uMax = be16toh(auVersions[1]);
+   uChosen = (uMax < PROTO_VERSION_MAX) ? uMax : PROTO_VERSION_MAX;
+   if ((uChosen < uMin) || (uChosen < PROTO_VERSION_MIN))
+   {
+      Proto_writeFrame(iSockFD, PROTO_ERROR, 0, 0, acRefusal,
+                       sizeof(acRefusal) - 1);
+      return FAILURE;
+   }
+
+   iLz = Proto_setConn(iSockFD, iCompression && (uFlags & PROTO_FLAG_LZ));
+   uChosen = htobe16(uChosen);
+   if (Proto_writeFrame(iSockFD, PROTO_HELLO, iLz ? PROTO_FLAG_LZ : 0, 0,
+                        &uChosen, sizeof(uChosen)) == FAILURE)
+      return FAILURE;
+   return be16toh(uChosen);
+}
+
+/*--------------------------------------------------------------------*/
+
+void Proto_setCompression(int iOn)
+
+/* Offer or accept compression on connections set up from now on. */
+
+{
+   iCompression = iOn;
+}
+
+/*--------------------------------------------------------------------*/
+
+int Proto_getStats(int iSockFD, ProtoStats *psStats)
+
+/* Store the compression counters of the connection on iSockFD in
+   *psStats. Return 1 (TRUE) if it agreed on compression, 0 (FALSE)
+   otherwise. */
+
+{
+   struct ProtoConn *psConn = Proto_getConn(iSockFD);
+
+   assert(psStats != NULL);
+
+   if (psConn == NULL)
+   {
+      memset(psStats, 0, sizeof(ProtoStats));
+      return FALSE;
+   }
+   *psStats = psConn->sStats;
+   return TRUE;
+}
+
+/*--------------------------------------------------------------------*/
+
+void Proto_forget(int iSockFD)
+
+/* Forget what was agreed on for the connection on iSockFD. */
+
+{
+   if ((iSockFD >= 0) && (iSockFD < iConns))
+      memset(&psConns[iSockFD], 0, sizeof(struct ProtoConn));
+}
+
+/*--------------------------------------------------------------------*/
+
+static int Proto_sendChunk(int iSockFD, uint32_t uId,
+                           const unsigned char *pucData, size_t iLength,
+                           int *piPacked)
+
+/* Send the iLength bytes at pucData, at most PROTO_LZ_CHUNK, as one
+   PROTO_DATA frame of request uId, compressed if the connection agreed
+   on it and they get smaller, and store whether they did in *piPacked.
+   Return SUCCESS or FAILURE. */
+
+{
+   unsigned char aucFrame[sizeof(uint32_t) + PROTO_LZ_CHUNK];
+   struct ProtoConn *psConn = Proto_getConn(iSockFD);
+   uint32_t uRaw = htobe32((uint32_t)iLength);
+   size_t iPacked = 0;
+   long long llStart;
+
+   assert(iLength <= PROTO_LZ_CHUNK);
+
+   /* Compressed only if it saves a sixteenth at least. */
+   if ((psConn != NULL) && (iLength >= PROTO_LZ_MIN))
+   {
+      llStart = Proto_cpuNanos();
+      iPacked = Lz_compress(pucData, iLength, aucFrame + sizeof(uRaw),
+                            iLength - iLength / 16);
+      psConn->sStats.llNanosOut += Proto_cpuNanos() - llStart;
+   }
+   if (piPacked != NULL)
+      *piPacked = (iPacked > 0);
+   if (psConn != NULL)
+   {
+      psConn->sStats.llRawOut += (long long)iLength;
+      psConn->sStats.llWireOut += (long long)(iPacked ? sizeof(uRaw) + iPacked
+                                                      : iLength);
+      psConn->sStats.llFramesOut++;
+      psConn->sStats.llPackedOut += (iPacked > 0);
+   }
+
+   if (iPacked == 0)
+      return Proto_writeFrame(iSockFD, PROTO_DATA, 0, uId, pucData, iLength);
+   memcpy(aucFrame, &uRaw, sizeof(uRaw));
+   return Proto_writeFrame(iSockFD, PROTO_DATA, PROTO_FLAG_LZ, uId, aucFrame,
+                           sizeof(uRaw) + iPacked);
+}
+
+/*--------------------------------------------------------------------*/
+
+int Proto_sendBytes(int iSockFD, uint32_t uId, const void *pvData,
+                    size_t iLength)
+
+/* Send the iLength bytes at pvData as PROTO_DATA frames of request
+   uId, compressed if the connection agreed on it. Return SUCCESS or
+   FAILURE. */
+
+{
+   const unsigned char *pucData = (const unsigned char*)pvData;
+   size_t iChunk;
+
+   /* Uncompressed, one frame does. */
+   if (Proto_getConn(iSockFD) == NULL)
+   {
+      if (iLength == 0)
+         return SUCCESS;
+      return Proto_writeFrame(iSockFD, PROTO_DATA, 0, uId, pvData, iLength);
+   }
+
+   while (iLength > 0)
+   {
+      iChunk = (iLength < PROTO_LZ_CHUNK) ? iLength : PROTO_LZ_CHUNK;
+      if (Proto_sendChunk(iSockFD, uId, pucData, iChunk, NULL) == FAILURE)
+         return FAILURE;
+      pucData += iChunk;
+      iLength -= iChunk;
+   }
+   return SUCCESS;
+}
+
+/*--------------------------------------------------------------------*/
+
+static int Proto_sendPacked(int iSockFD, uint32_t uId, int iFD,
+                            uint64_t uSize)
+
+/* Send the uSize bytes of the file open at iFD as compressed
+   PROTO_DATA frames of request uId, and the rest in one frame straight
+   from the file once PROTO_LZ_GIVEUP chunks in a row did not get
+   smaller. Return SUCCESS or FAILURE. */
+
+{
+   unsigned char aucChunk[PROTO_LZ_CHUNK];
+   struct ProtoConn *psConn = Proto_getConn(iSockFD);
+   uint64_t uLeft = uSize;
+   size_t iWant;
+   int iMisses = 0;
+   int iPacked;
+
+   while ((uLeft > 0) && (iMisses < PROTO_LZ_GIVEUP))
+   {
+      iWant = (uLeft < PROTO_LZ_CHUNK) ? (size_t)uLeft : PROTO_LZ_CHUNK;
+      if (Common_readn(iFD, aucChunk, iWant) != (ssize_t)iWant)
+         return FAILURE; /* the file shrank */
+      if (Proto_sendChunk(iSockFD, uId, aucChunk, iWant, &iPacked)
+          == FAILURE)
+         return FAILURE;
+      iMisses = iPacked ? 0 : iMisses + 1;
+      uLeft -= iWant;
+   }
+   if (uLeft == 0)
+      return SUCCESS;
+
+   /* Incompressible, like an archive or a binary: stop trying. */
+   psConn->sStats.llRawOut += (long long)uLeft;
+   psConn->sStats.llWireOut += (long long)uLeft;
+   psConn->sStats.llFramesOut++;
+   if ((Proto_writeFrame(iSockFD, PROTO_DATA, 0, uId, NULL, uLeft)
+        == FAILURE) ||
+       (Common_transfer(iSockFD, iFD, (size_t)uLeft) != (ssize_t)uLeft))
+      return FAILURE;
+   return SUCCESS;
+}
+
+/*--------------------------------------------------------------------*/
+
+ssize_t Proto_readData(RecvBuf_T oBuf, const ProtoHeader *psHeader,
+                       uint64_t *puLeft, void *pvBuf, size_t iSize)
+
+/* Read the next piece of the PROTO_DATA frame with header *psHeader,
+   of which *puLeft payload bytes are left, from oBuf into pvBuf of
+   size iSize. Return the number of bytes stored, or -1. */
+
+{
+   unsigned char aucPacked[sizeof(uint32_t) + PROTO_LZ_CHUNK];
+   struct ProtoConn *psConn = Proto_getConn(RecvBuf_getFD(oBuf));
+   uint32_t uRaw;
+   ssize_t iGot;
+   long long llStart;
+
+   assert(oBuf != NULL);
+   assert(psHeader != NULL);
+   assert(puLeft != NULL);
+
+   if (! (psHeader->uFlags & PROTO_FLAG_LZ))
+   {
+      iGot = RecvBuf_readn(oBuf, pvBuf,
+                           (*puLeft >= iSize) ? iSize : (size_t)*puLeft);
+      if (iGot <= 0)
+         return -1;
+      *puLeft -= (uint64_t)iGot;
+      if (psConn != NULL)
+      {
+         psConn->sStats.llRawIn += iGot;
+         psConn->sStats.llWireIn += iGot;
+      }
+      return iGot;
+   }
+
+   /* A compressed frame comes whole. */
+   assert(iSize >= PROTO_LZ_CHUNK);
+   if ((*puLeft != psHeader->uLength) || (*puLeft <= sizeof(uRaw)) ||
+       (*puLeft > sizeof(aucPacked)) ||
+       (RecvBuf_readn(oBuf, aucPacked, (size_t)*puLeft)
+        != (ssize_t)*puLeft))
+      return -1;
+   memcpy(&uRaw, aucPacked, sizeof(uRaw));
+   uRaw = be32toh(uRaw);
+   if ((uRaw == 0) || (uRaw > PROTO_LZ_CHUNK))
+      return -1;
+
+   llStart = Proto_cpuNanos();
+   iGot = Lz_decompress(aucPacked + sizeof(uRaw),
+                        (size_t)*puLeft - sizeof(uRaw), pvBuf, uRaw);
+   if (psConn != NULL)
+   {
+      psConn->sStats.llNanosIn += Proto_cpuNanos() - llStart;
+      psConn->sStats.llRawIn += (iGot > 0) ? iGot : 0;
+      psConn->sStats.llWireIn += (long long)*puLeft;
+   }
+   if (iGot != (ssize_t)uRaw)
+      return -1;
+   *puLeft = 0;
+   return iGot;
+}
+
+/*--------------------------------------------------------------------*/
+
+int Proto_sendData(int iSockFD, uint32_t uId, const char *pcSource)
+
+/* Send file pcSource as PROTO_DATA frames of request uId. Return
+   SUCCESS, FAILURE if the connection failed, or a positive errno value
+   if the file could not be read. */
+
+{
+   return Proto_sendRange(iSockFD, uId, pcSource, 0);
+}
+
+/*--------------------------------------------------------------------*/
+
+int Proto_sendRange(int iSockFD, uint32_t uId, const char *pcSource,
+                    uint64_t uOffset)
+
+/* Send file pcSource from byte uOffset on as PROTO_DATA frames of
+   request uId. Return SUCCESS, FAILURE if the connection failed, or a
+   positive errno value if the file could not be read. */
+
+{
+   struct stat sStat;
+   uint64_t uLength;
+   ssize_t iSent;
+   int iFD;
+   int iErrSv;
+
+   assert(pcSource != NULL);
+
+   if ((iFD = open(pcSource, O_RDONLY)) == -1)
+      return errno;
+   if (fstat(iFD, &sStat) == -1)
+   {
+      iErrSv = errno;
+      close(iFD);
+      return iErrSv;
+   }
+   if (S_ISDIR(sStat.st_mode))
+   {
+      close(iFD);
+      return EISDIR;
+   }
+   if ((uOffset > (uint64_t)sStat.st_size) ||
+       (lseek(iFD, (off_t)uOffset, SEEK_SET) == -1))
+   {
+      close(iFD);
+      return EINVAL;
+   }
+   uLength = (uint64_t)sStat.st_size - uOffset;
+
+   /* Compressed when both ends agreed and it is worth it. */
+   if ((Proto_getConn(iSockFD) != NULL) && (uLength >= PROTO_LZ_MIN))
+   {
+      iErrSv = Proto_sendPacked(iSockFD, uId, iFD, uLength);
+      close(iFD);
+      return iErrSv;
+   }
+
+   if (Proto_writeFrame(iSockFD, PROTO_DATA, 0, uId, NULL, uLength)
+       == FAILURE)
+   {
+      close(iFD);
+      return FAILURE;
+   }
+   iSent = Common_transfer(iSockFD, iFD, (size_t)uLength);
+   close(iFD);
+
+   /* The header promised uLength bytes: anything else breaks the
+      stream. */
+   if (iSent != (ssize_t)uLength)
+      return FAILURE;
+   return SUCCESS;
+}
+
+/*--------------------------------------------------------------------*/
+
+int Proto_sendEnd(int iSockFD, uint32_t uId, int iStatus)
+
+/* End the body of request uId with status iStatus. Return SUCCESS or
+   FAILURE. */
+
+{
+   uint32_t uStatus = htobe32((uint32_t)iStatus);
+
+   return Proto_writeFrame(iSockFD, PROTO_END, 0, uId, &uStatus,
+                           sizeof(uStatus));
+}
+
+/*--------------------------------------------------------------------*/
+
+int Proto_sendHave(int iSockFD, uint32_t uId, unsigned int uFlags,
+                   const unsigned char *pucDigest, uint64_t uSize)
+
+/* Offer a file of uSize bytes with SHA-256 digest pucDigest for
+   request uId, in a frame with flags uFlags. Return SUCCESS or
+   FAILURE. */
+
+{
+   unsigned char aucPayload[PROTO_DIGEST_SIZE + sizeof(uint64_t)];
+   uint64_t uNetSize = htobe64(uSize);
+
+   assert(pucDigest != NULL);
+
+   memcpy(aucPayload, pucDigest, PROTO_DIGEST_SIZE);
+   memcpy(aucPayload + PROTO_DIGEST_SIZE, &uNetSize, sizeof(uNetSize));
+   return Proto_writeFrame(iSockFD, PROTO_HAVE, uFlags, uId, aucPayload,
+                           sizeof(aucPayload));
+}
+
+/*--------------------------------------------------------------------*/
+
+RecvBufRead Proto_readHave(RecvBuf_T oBuf, uint32_t uId,
+                           unsigned char *pucDigest, uint64_t *puSize)
+
+/* Read a PROTO_HAVE frame of request uId from oBuf into pucDigest and
+   *puSize. */
+
+{
+   unsigned char aucPayload[PROTO_DIGEST_SIZE + sizeof(uint64_t)];
+   ProtoHeader sHeader;
+   RecvBufRead eRead;
+   uint64_t uNetSize;
+
+   assert(pucDigest != NULL);
+   assert(puSize != NULL);
+
+   eRead = Proto_readFrame(oBuf, &sHeader, aucPayload, sizeof(aucPayload));
+   if (eRead != RECVBUF_OK)
+      return eRead;
+   if ((sHeader.eType != PROTO_HAVE) || (sHeader.uId != uId) ||
+       (sHeader.uLength != sizeof(aucPayload)))
+      return RECVBUF_ERROR;
+
+   memcpy(pucDigest, aucPayload, PROTO_DIGEST_SIZE);
+   memcpy(&uNetSize, aucPayload + PROTO_DIGEST_SIZE, sizeof(uNetSize));
+   *puSize = be64toh(uNetSize);
+   return RECVBUF_OK;
+}
+
+/*--------------------------------------------------------------------*/
+
+int Proto_sendResume(int iSockFD, uint32_t uId,
+                     const unsigned char *pucDigest, uint64_t uSize,
+                     uint64_t uOffset)
+
+/* Ask for the file of uSize bytes with SHA-256 digest pucDigest of
+   request uId from byte uOffset on. Return SUCCESS or FAILURE. */
+
+{
+   unsigned char aucPayload[PROTO_DIGEST_SIZE + 2 * sizeof(uint64_t)];
+   uint64_t uNetSize = htobe64(uSize);
+   uint64_t uNetOffset = htobe64(uOffset);
+
+   assert(pucDigest != NULL);
+
+   memcpy(aucPayload, pucDigest, PROTO_DIGEST_SIZE);
+   memcpy(aucPayload + PROTO_DIGEST_SIZE, &uNetSize, sizeof(uNetSize));
+   memcpy(aucPayload + PROTO_DIGEST_SIZE + sizeof(uNetSize), &uNetOffset,
+          sizeof(uNetOffset));
+   return Proto_writeFrame(iSockFD, PROTO_RESUME, 0, uId, aucPayload,
+                           sizeof(aucPayload));
+}
+
+/*--------------------------------------------------------------------*/
+
+RecvBufRead Proto_readResume(RecvBuf_T oBuf, uint32_t uId,
+                             unsigned char *pucDigest, uint64_t *puSize,
+                             uint64_t *puOffset)
+
+/* Read a PROTO_RESUME frame of request uId from oBuf into pucDigest,
+   *puSize and *puOffset. */
+
+{
+   unsigned char aucPayload[PROTO_DIGEST_SIZE + 2 * sizeof(uint64_t)];
+   ProtoHeader sHeader;
+   RecvBufRead eRead;
+   uint64_t uNetSize, uNetOffset;
+
+   assert(pucDigest != NULL);
+   assert(puSize != NULL);
+   assert(puOffset != NULL);
+
+   eRead = Proto_readFrame(oBuf, &sHeader, aucPayload, sizeof(aucPayload));
+   if (eRead != RECVBUF_OK)
+      return eRead;
+   if ((sHeader.eType != PROTO_RESUME) || (sHeader.uId != uId) ||
+       (sHeader.uLength != sizeof(aucPayload)))
+      return RECVBUF_ERROR;
+
+   memcpy(pucDigest, aucPayload, PROTO_DIGEST_SIZE);
+   memcpy(&uNetSize, aucPayload + PROTO_DIGEST_SIZE, sizeof(uNetSize));
+   memcpy(&uNetOffset, aucPayload + PROTO_DIGEST_SIZE + sizeof(uNetSize),
+          sizeof(uNetOffset));
+   *puSize = be64toh(uNetSize);
+   *puOffset = be64toh(uNetOffset);
+   return RECVBUF_OK;
+}
+
+/*--------------------------------------------------------------------*/
+
+static int Proto_openDest(const char *pcDest, int *piFD)
+
+/* Open file pcDest for writing into *piFD unless pcDest is NULL or
+   *piFD is open already. Return 0, or an errno value on failure. */
+
+{
+   if ((pcDest == NULL) || (*piFD != -1))
+      return 0;
+   if ((*piFD = open(pcDest, O_WRONLY | O_CREAT | O_TRUNC,
+                     PERMISSIONS)) == -1)
+      return errno;
+   return 0;
+}
+
+/*--------------------------------------------------------------------*/
+
+int Proto_recvBody(RecvBuf_T oBuf, uint32_t uId, const char *pcDest,
+                   int *piStatus)
+
+/* Receive a body of request uId from oBuf into file pcDest, or to
+   stdout if pcDest is NULL. Return SUCCESS, or FAILURE if the
+   connection failed or broke the protocol. */
+
+{
+   char acBuf[PROTO_LZ_CHUNK];
+   ProtoHeader sHeader;
+   uint32_t uStatus;
+   uint64_t uLeft;
+   ssize_t iGot;
+   int iFD = 1;
+   int iErr = 0;
+
+   assert(oBuf != NULL);
+   assert(piStatus != NULL);
+
+   /* pcDest is only opened once data or a successful end arrives, so
+      a failed request leaves an existing file alone. */
+   if (pcDest == NULL)
+      fflush(stdout);
+   else
+      iFD = -1;
+
+   for (;;)
+   {
+      if ((Proto_readHeader(oBuf, &sHeader) != RECVBUF_OK) ||
+          (sHeader.uId != uId))
+         break;
+
+      if (sHeader.eType == PROTO_END)
+      {
+         if ((sHeader.uLength != sizeof(uStatus)) ||
+             (RecvBuf_readn(oBuf, &uStatus, sizeof(uStatus))
+              != sizeof(uStatus)))
+            break;
+         *piStatus = (int)be32toh(uStatus);
+         if ((*piStatus == 0) && (iErr == 0))
+            iErr = Proto_openDest(pcDest, &iFD);
+         if ((*piStatus == 0) && (iErr != 0))
+            *piStatus = iErr;
+         if ((pcDest != NULL) && (iFD != -1))
+         {
+            close(iFD);
+            if (*piStatus != 0)
+               unlink(pcDest);
+         }
+         return SUCCESS;
+      }
+
+      if (sHeader.eType != PROTO_DATA)
+         break;
+
+      /* Copy the payload to the file, draining it on errors. */
+      if (iErr == 0)
+         iErr = Proto_openDest(pcDest, &iFD);
+      for (uLeft = sHeader.uLength; uLeft > 0;)
+      {
+         iGot = Proto_readData(oBuf, &sHeader, &uLeft, acBuf, sizeof(acBuf));
+         if (iGot <= 0)
+            break;
+         if ((iErr == 0) && (Common_writen(iFD, acBuf, iGot) == FAILURE))
+            iErr = errno ? errno : EIO;
+      }
+      if (uLeft > 0)
+         break;
+   }
+
+   /* Connection lost or protocol broken. */
+   if ((pcDest != NULL) && (iFD != -1))
+   {
+      close(iFD);
+      unlink(pcDest);
+   }
+   return FAILURE;
+}
+
+/*--------------------------------------------------------------------*/
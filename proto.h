@@ -0,0 +1,273 @@
+/*--------------------------------------------------------------------*/
+/* proto.h                                                            */
+/* Binary framed wire protocol between client and server              */
+/*--------------------------------------------------------------------*/
+
+#ifndef PROTO_INCLUDED
+#define PROTO_INCLUDED
+
+#include <stdint.h>
+#include <sys/types.h>
+#include "recvbuf.h"
+
+/*--------------------------------------------------------------------*/
+
+/* Every message is a frame: a fixed PROTO_HEADER_SIZE byte header
+   followed by iLength bytes of payload. All header fields are sent in
+   network byte order:
+
+      byte  0      PROTO_MAGIC
+      byte  1      frame type
+      bytes 2-3    flags
+      bytes 4-7    request id
+      bytes 8-15   payload length
+
+   A connection starts with the client sending a PROTO_HELLO frame
+   with the lowest and highest protocol version it speaks (two 16 bit
+   numbers), and the server answering with a PROTO_HELLO frame holding
+   the version it picked, or a PROTO_ERROR frame. Afterwards the client
+   sends requests as PROTO_COMMAND frames holding a command line, and
+   the server answers each with a body that carries the request's id.
+   A client need not wait for one answer before sending its next
+   request: the server serves requests in the order they arrive.
+   A body is any number of PROTO_DATA frames followed by one PROTO_END
+   frame holding a 32 bit status. A sendfile upload is a body sent by
+   the client right after its command.
+
+   From version 2 on, a sendfile command may be followed by a
+   PROTO_HAVE frame instead, holding the SHA-256 digest of the file
+   (PROTO_DIGEST_SIZE bytes) and its size (64 bits). A server that
+   already stores those contents answers with the PROTO_END of the
+   request right away; otherwise it sends an empty PROTO_WANT frame
+   and the client sends the body as in version 1.
+
+   From version 3 on, a server without those contents answers with a
+   PROTO_SIGS frame instead of PROTO_WANT, holding the block signatures
+   of its old copy of the file, and the client sends a delta body made
+   of PROTO_DATA and PROTO_COPY frames (see delta.h). Likewise a
+   recvfile command is followed by a PROTO_SIGS frame from the client,
+   and answered with a delta body against the client's old copy. An
+   empty PROTO_SIGS frame means there is no old copy to use.
+
+   From version 4 on, transfers of large files can resume where an
+   interrupted one stopped. A receiver that kept the first bytes of a
+   file (see stage.h) says so in a PROTO_RESUME frame: the digest of
+   the file, its size (64 bits) and the number of bytes it has (64
+   bits). A client sends it between a recvfile command and its
+   PROTO_SIGS frame; a server sends it instead of PROTO_SIGS in answer
+   to the PROTO_HAVE of an upload. A sender that still has that file
+   answers with a body whose PROTO_HAVE has PROTO_FLAG_RESUME set and
+   whose data starts at that offset; otherwise it ignores the frame.
+
+   From version 5 on, a very large file can be downloaded over several
+   connections at once. A client willing to do that sends an empty
+   PROTO_STRIPE frame right before the PROTO_SIGS frame of a recvfile.
+   If the client has no old copy and the file is large enough, the
+   server answers with a PROTO_STRIPE frame describing the file instead
+   of a body, then the PROTO_END of the request, and the client fetches
+   the file in ranges over connections of its own (see stripe.h).
+
+   From version 6 on, a sendfile of several files or of a directory,
+   and a recvfile of a directory, carry an archive body instead: an
+   empty PROTO_ARCHIVE frame, PROTO_DATA frames holding all of the
+   files (see archive.h), and PROTO_END.
+
+   Independent of the version, a client may set PROTO_FLAG_LZ on its
+   PROTO_HELLO frame to offer compression, and the server sets it on
+   its answer to accept. On such a connection either side may then
+   send a PROTO_DATA frame with PROTO_FLAG_LZ set, whose payload is
+   the number of bytes it stands for (32 bits, at most PROTO_LZ_CHUNK)
+   followed by a compressed block of them (see lz.h). Data is
+   compressed PROTO_LZ_CHUNK bytes at a time; payloads smaller than
+   PROTO_LZ_MIN, and chunks that do not get smaller, are sent as they
+   are.
+
+   A connection whose first byte is not PROTO_MAGIC comes from a client
+   that predates this protocol, and is served with the old newline
+   framing instead (see Common_sendFile). */
+
+#define PROTO_MAGIC 0xC1
+#define PROTO_HEADER_SIZE 16
+
+#define PROTO_VERSION_LEGACY 0 /* newline framed, no handshake */
+#define PROTO_VERSION_MIN 1    /* oldest framed version spoken */
+#define PROTO_VERSION_MAX 6    /* newest framed version spoken */
+#define PROTO_VERSION_HAVE 2   /* first version with PROTO_HAVE */
+#define PROTO_VERSION_DELTA 3  /* first version with delta bodies */
+#define PROTO_VERSION_RESUME 4 /* first version with PROTO_RESUME */
+#define PROTO_VERSION_STRIPE 5 /* first version with striped downloads */
+#define PROTO_VERSION_ARCHIVE 6 /* first version with archive bodies */
+
+#define PROTO_DIGEST_SIZE 32 /* bytes of a SHA-256 digest */
+
+#define PROTO_FLAG_LZ 0x0001 /* compression offered, accepted, or used */
+#define PROTO_FLAG_RESUME 0x0002 /* the data resumes a transfer */
+#define PROTO_LZ_CHUNK (64 * 1024) /* most bytes a compressed frame holds */
+#define PROTO_LZ_MIN 512 /* smaller payloads are not compressed */
+#define PROTO_LZ_GIVEUP 4 /* chunks in a row that did not compress */
+
+enum ProtoType {PROTO_HELLO = 1, PROTO_COMMAND, PROTO_DATA, PROTO_END,
+                PROTO_ERROR, PROTO_HAVE, PROTO_WANT, PROTO_SIGS,
+                PROTO_COPY, PROTO_RESUME, PROTO_STRIPE,
+                PROTO_ARCHIVE};
+typedef enum ProtoType ProtoType;
+
+typedef struct ProtoHeader
+{
+   ProtoType eType;
+   /* What the frame is. */
+
+   unsigned int uFlags;
+   /* Per-frame flags, 16 bits. */
+
+   uint32_t uId;
+   /* Request the frame belongs to. */
+
+   uint64_t uLength;
+   /* Number of payload bytes after the header. */
+} ProtoHeader;
+/* A decoded frame header. */
+
+typedef struct ProtoStats
+{
+   long long llRawOut;
+   /* Bytes of data sent, before compression. */
+
+   long long llWireOut;
+   /* Bytes of data payload sent. */
+
+   long long llFramesOut;
+   /* Data frames sent. */
+
+   long long llPackedOut;
+   /* Data frames sent compressed. */
+
+   long long llNanosOut;
+   /* CPU time spent compressing, in nanoseconds. */
+
+   long long llRawIn;
+   /* Bytes of data received, after decompression. */
+
+   long long llWireIn;
+   /* Bytes of data payload received. */
+
+   long long llNanosIn;
+   /* CPU time spent decompressing, in nanoseconds. */
+} ProtoStats;
+/* Compression counters of a connection. */
+
+/*--------------------------------------------------------------------*/
+
+int Proto_writeFrame(int iSockFD, ProtoType eType, unsigned int uFlags,
+                     uint32_t uId, const void *pvPayload,
+                     uint64_t uLength);
+/* Write a frame header and, if pvPayload is not NULL, its uLength
+   bytes of payload to iSockFD. If pvPayload is NULL the caller sends
+   the payload itself. Return SUCCESS or FAILURE. */
+
+RecvBufRead Proto_peekHeader(RecvBuf_T oBuf, ProtoHeader *psHeader);
+/* Decode the next frame header from oBuf like Proto_readHeader, but
+   leave it in oBuf. */
+
+RecvBufRead Proto_readHeader(RecvBuf_T oBuf, ProtoHeader *psHeader);
+/* Read and decode the next frame header from oBuf. Return RECVBUF_OK,
+   RECVBUF_AGAIN if a non-blocking descriptor has no full header yet
+   (nothing is consumed then), RECVBUF_EOF, or RECVBUF_ERROR if the
+   read failed or the bytes are not a frame header. */
+
+RecvBufRead Proto_readFrame(RecvBuf_T oBuf, ProtoHeader *psHeader,
+                            void *pvPayload, size_t iSize);
+/* Read the next frame from oBuf, header and payload, only once all of
+   it has arrived. The payload is copied into pvPayload, of size iSize,
+   and a payload larger than iSize is an error. Return values are as
+   for Proto_readHeader. */
+
+int Proto_clientHello(int iSockFD, RecvBuf_T oBuf);
+/* Offer this client's protocol versions on iSockFD and wait for the
+   server's choice. Return the chosen version, or FAILURE. */
+
+int Proto_serverHello(int iSockFD, unsigned int uFlags,
+                      const void *pvPayload, uint64_t uLength);
+/* Answer the PROTO_HELLO frame with flags uFlags and payload pvPayload
+   from a client on iSockFD. Return the chosen version, or FAILURE if
+   there is none (the client has been sent a PROTO_ERROR frame then). */
+
+void Proto_setCompression(int iOn);
+/* Offer or accept compression on connections set up from now on if
+   iOn is 1 (TRUE), the default, and not if it is 0 (FALSE). */
+
+int Proto_getStats(int iSockFD, ProtoStats *psStats);
+/* Store the compression counters of the connection on iSockFD in
+   *psStats. Return 1 (TRUE) if it agreed on compression, 0 (FALSE)
+   otherwise. */
+
+void Proto_forget(int iSockFD);
+/* Forget what was agreed on for the connection on iSockFD, which is
+   being closed. */
+
+int Proto_sendBytes(int iSockFD, uint32_t uId, const void *pvData,
+                    size_t iLength);
+/* Send the iLength bytes at pvData as PROTO_DATA frames of request
+   uId, compressed if the connection agreed on it. Nothing is sent if
+   iLength is 0. Return SUCCESS or FAILURE. */
+
+ssize_t Proto_readData(RecvBuf_T oBuf, const ProtoHeader *psHeader,
+                       uint64_t *puLeft, void *pvBuf, size_t iSize);
+/* Read the next piece of the PROTO_DATA frame with header *psHeader,
+   of which *puLeft payload bytes are left, from oBuf into pvBuf of
+   size iSize, and subtract what it took from *puLeft. A compressed
+   frame is read and decompressed whole, so iSize must be at least
+   PROTO_LZ_CHUNK. Return the number of bytes stored, or -1 if the
+   connection failed or the frame is malformed. */
+
+int Proto_sendData(int iSockFD, uint32_t uId, const char *pcSource);
+/* Send file pcSource as PROTO_DATA frames of request uId: one frame
+   straight from the file, or compressed chunks if the connection
+   agreed on compression and they keep getting smaller. Return
+   SUCCESS, FAILURE if the connection failed, or a positive errno value
+   if the file could not be read, in which case nothing was sent. */
+
+int Proto_sendRange(int iSockFD, uint32_t uId, const char *pcSource,
+                    uint64_t uOffset);
+/* Send file pcSource from byte uOffset on like Proto_sendData. An
+   offset past its end is EINVAL. */
+
+int Proto_sendEnd(int iSockFD, uint32_t uId, int iStatus);
+/* End the body of request uId with status iStatus. Return SUCCESS or
+   FAILURE. */
+
+int Proto_sendHave(int iSockFD, uint32_t uId, unsigned int uFlags,
+                   const unsigned char *pucDigest, uint64_t uSize);
+/* Offer a file of uSize bytes with SHA-256 digest pucDigest for
+   request uId, in a frame with flags uFlags. Return SUCCESS or
+   FAILURE. */
+
+RecvBufRead Proto_readHave(RecvBuf_T oBuf, uint32_t uId,
+                           unsigned char *pucDigest, uint64_t *puSize);
+/* Read a PROTO_HAVE frame of request uId from oBuf into pucDigest and
+   *puSize. Return values are as for Proto_readHeader, and a frame of
+   another type, request or size is RECVBUF_ERROR. */
+
+int Proto_sendResume(int iSockFD, uint32_t uId,
+                     const unsigned char *pucDigest, uint64_t uSize,
+                     uint64_t uOffset);
+/* Ask for the file of uSize bytes with SHA-256 digest pucDigest of
+   request uId from byte uOffset on. Return SUCCESS or FAILURE. */
+
+RecvBufRead Proto_readResume(RecvBuf_T oBuf, uint32_t uId,
+                             unsigned char *pucDigest, uint64_t *puSize,
+                             uint64_t *puOffset);
+/* Read a PROTO_RESUME frame of request uId from oBuf into pucDigest,
+   *puSize and *puOffset. Return values are as for Proto_readHave. */
+
+int Proto_recvBody(RecvBuf_T oBuf, uint32_t uId, const char *pcDest,
+                   int *piStatus);
+/* Receive a body of request uId from oBuf into file pcDest, or to
+   stdout if pcDest is NULL. Store the status of its PROTO_END frame in
+   *piStatus. pcDest is not touched unless the body has data or ends
+   with status 0; if the file cannot be written the rest of the body is
+   drained, pcDest is removed and *piStatus holds an errno value.
+   Return SUCCESS, or FAILURE if the connection failed or broke the
+   protocol. */
+
+#endif
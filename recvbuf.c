@@ -0,0 +1,450 @@
+/*--------------------------------------------------------------------*/
+/* recvbuf.c                                                          */
+/* Buffered reader for a connected socket                             */
+/*--------------------------------------------------------------------*/
+
+#include "recvbuf.h"
+#include <assert.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+enum {RECVBUF_SIZE = 65536};
+
+/*--------------------------------------------------------------------*/
+
+struct RecvBuf
+
+/* A RecvBuf is a ring buffer of received bytes along with the
+   descriptor they come from. */
+
+{
+   int iFD;
+   /* Descriptor to read from. */
+
+   char *pcRing;
+   /* The ring buffer, RECVBUF_SIZE bytes. */
+
+   size_t iHead;
+   /* Index of the first unconsumed byte in pcRing. */
+
+   size_t iCount;
+   /* Number of unconsumed bytes, starting at iHead and wrapping
+      around the end of pcRing. */
+
+   long lReads;
+   /* Number of read system calls made. */
+
+   long lLines;
+   /* Number of lines returned. */
+
+   int iSkipping;
+   /* 1 (TRUE) while the rest of a line too long to return is being
+      thrown away, 0 (FALSE) otherwise. */
+};
+
+/*--------------------------------------------------------------------*/
+
+RecvBuf_T RecvBuf_new(int iFD)
+
+/* Return a new, empty RecvBuf reading from iFD, or NULL if
+   insufficient memory is available. */
+
+{
+   RecvBuf_T oBuf;
+
+   oBuf = (RecvBuf_T)calloc(1, sizeof(struct RecvBuf));
+   if (oBuf == NULL)
+      return NULL;
+
+   oBuf->pcRing = (char*)malloc(RECVBUF_SIZE);
+   if (oBuf->pcRing == NULL)
+   {
+      free(oBuf);
+      return NULL;
+   }
+   oBuf->iFD = iFD;
+   return oBuf;
+}
+
+/*--------------------------------------------------------------------*/
+
+void RecvBuf_free(RecvBuf_T oBuf)
+
+/* Free oBuf. Does not close its descriptor. */
+
+{
+   assert(oBuf != NULL);
+
+   free(oBuf->pcRing);
+   free(oBuf);
+}
+
+/*--------------------------------------------------------------------*/
+
+int RecvBuf_getFD(RecvBuf_T oBuf)
+
+/* Return the descriptor oBuf reads from. */
+
+{
+   assert(oBuf != NULL);
+   return oBuf->iFD;
+}
+
+/*--------------------------------------------------------------------*/
+
+size_t RecvBuf_getBuffered(RecvBuf_T oBuf)
+
+/* Return the number of bytes oBuf holds that have not been consumed
+   yet. */
+
+{
+   assert(oBuf != NULL);
+   return oBuf->iCount;
+}
+
+/*--------------------------------------------------------------------*/
+
+long RecvBuf_getReads(RecvBuf_T oBuf)
+
+/* Return the number of read system calls oBuf has made. */
+
+{
+   assert(oBuf != NULL);
+   return oBuf->lReads;
+}
+
+/*--------------------------------------------------------------------*/
+
+long RecvBuf_getLines(RecvBuf_T oBuf)
+
+/* Return the number of lines oBuf has returned. */
+
+{
+   assert(oBuf != NULL);
+   return oBuf->lLines;
+}
+
+/*--------------------------------------------------------------------*/
+
+static ssize_t RecvBuf_fill(RecvBuf_T oBuf)
+
+/* Read as much as fits into the free part of the ring of oBuf, in one
+   system call. Return the number of bytes read, 0 at end of file, or
+   -1 on error (with errno set). */
+
+{
+   struct iovec asVec[2];
+   size_t iTail;
+   ssize_t iRead;
+   int iVecs;
+
+   assert(oBuf->iCount < RECVBUF_SIZE);
+
+   /* The free part is one or two pieces of the ring. */
+   iTail = (oBuf->iHead + oBuf->iCount) % RECVBUF_SIZE;
+   asVec[0].iov_base = oBuf->pcRing + iTail;
+   if (iTail >= oBuf->iHead)
+   {
+      asVec[0].iov_len = RECVBUF_SIZE - iTail;
+      asVec[1].iov_base = oBuf->pcRing;
+      asVec[1].iov_len = oBuf->iHead;
+      iVecs = (oBuf->iHead > 0) ? 2 : 1;
+   }
+   else
+   {
+      asVec[0].iov_len = oBuf->iHead - iTail;
+      iVecs = 1;
+   }
+
+   do
+   {
+      oBuf->lReads++;
+      iRead = readv(oBuf->iFD, asVec, iVecs);
+   } while ((iRead < 0) && (errno == EINTR));
+
+   if (iRead > 0)
+      oBuf->iCount += (size_t)iRead;
+   return iRead;
+}
+
+/*--------------------------------------------------------------------*/
+
+static size_t RecvBuf_take(RecvBuf_T oBuf, char *pcDest, size_t iSize)
+
+/* Move up to iSize buffered bytes of oBuf into pcDest. Return the
+   number of bytes moved. */
+
+{
+   size_t iFirst;
+
+   if (iSize > oBuf->iCount)
+      iSize = oBuf->iCount;
+
+   iFirst = RECVBUF_SIZE - oBuf->iHead;
+   if (iFirst > iSize)
+      iFirst = iSize;
+   memcpy(pcDest, oBuf->pcRing + oBuf->iHead, iFirst);
+   memcpy(pcDest + iFirst, oBuf->pcRing, iSize - iFirst);
+
+   oBuf->iHead = (oBuf->iHead + iSize) % RECVBUF_SIZE;
+   oBuf->iCount -= iSize;
+   if (oBuf->iCount == 0)
+      oBuf->iHead = 0;
+   return iSize;
+}
+
+/*--------------------------------------------------------------------*/
+
+static void RecvBuf_skip(RecvBuf_T oBuf, size_t iSize)
+
+/* Consume the first iSize buffered bytes of oBuf without copying
+   them. */
+
+{
+   assert(iSize <= oBuf->iCount);
+
+   oBuf->iHead = (oBuf->iHead + iSize) % RECVBUF_SIZE;
+   oBuf->iCount -= iSize;
+   if (oBuf->iCount == 0)
+      oBuf->iHead = 0;
+}
+
+/*--------------------------------------------------------------------*/
+
+static long RecvBuf_findNewline(RecvBuf_T oBuf, size_t iLimit)
+
+/* Return the offset from the head of oBuf of the first newline among
+   the first iLimit buffered bytes, or -1 if there is none. */
+
+{
+   size_t iFirst;
+   char *pcHit;
+
+   if (iLimit > oBuf->iCount)
+      iLimit = oBuf->iCount;
+
+   iFirst = RECVBUF_SIZE - oBuf->iHead;
+   if (iFirst > iLimit)
+      iFirst = iLimit;
+
+   pcHit = memchr(oBuf->pcRing + oBuf->iHead, '\n', iFirst);
+   if (pcHit != NULL)
+      return pcHit - (oBuf->pcRing + oBuf->iHead);
+
+   pcHit = memchr(oBuf->pcRing, '\n', iLimit - iFirst);
+   if (pcHit != NULL)
+      return (long)iFirst + (pcHit - oBuf->pcRing);
+
+   return -1;
+}
+
+/*--------------------------------------------------------------------*/
+
+RecvBufRead RecvBuf_readLine(RecvBuf_T oBuf, char *pcLine,
+                             size_t iSize)
+
+/* Read a line from oBuf into pcLine, of size iSize, without its
+   newline and '\0'-terminated. A line longer than iSize - 1 is thrown
+   away up to and including its newline. */
+
+{
+   long lNewline;
+   size_t iLength;
+   ssize_t iRead;
+
+   assert(oBuf != NULL);
+   assert(pcLine != NULL);
+   assert(iSize > 1);
+   assert(iSize <= RECVBUF_SIZE);
+
+   for (;;)
+   {
+      if (oBuf->iSkipping)
+      {
+         /* The rest of a line too long for pcLine. */
+         lNewline = RecvBuf_findNewline(oBuf, oBuf->iCount);
+         if (lNewline >= 0)
+         {
+            RecvBuf_skip(oBuf, (size_t)lNewline + 1);
+            oBuf->iSkipping = 0;
+            return RECVBUF_LONG;
+         }
+         RecvBuf_skip(oBuf, oBuf->iCount);
+      }
+      else
+      {
+         /* A whole line, newline included, that pcLine can take. */
+         lNewline = RecvBuf_findNewline(oBuf, iSize);
+         if (lNewline >= 0)
+            break;
+         if (oBuf->iCount >= iSize)
+         {
+            oBuf->iSkipping = 1;
+            continue;
+         }
+      }
+
+      iRead = RecvBuf_fill(oBuf);
+      if (iRead == 0)
+         return RECVBUF_EOF;
+      if (iRead < 0)
+      {
+         if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+            return RECVBUF_AGAIN;
+         return RECVBUF_ERROR;
+      }
+   }
+
+   iLength = (size_t)lNewline;
+   RecvBuf_take(oBuf, pcLine, iLength);
+   pcLine[iLength] = '\0';
+   RecvBuf_skip(oBuf, 1);
+   oBuf->lLines++;
+   return RECVBUF_OK;
+}
+
+/*--------------------------------------------------------------------*/
+
+RecvBufRead RecvBuf_peek(RecvBuf_T oBuf, void *pvBuf, size_t iSize)
+
+/* Copy the next iSize bytes of oBuf into pvBuf without consuming
+   them, reading from the descriptor until that many are buffered. */
+
+{
+   ssize_t iRead;
+   size_t iFirst;
+
+   assert(oBuf != NULL);
+   assert(pvBuf != NULL);
+   assert(iSize <= RECVBUF_SIZE);
+
+   while (oBuf->iCount < iSize)
+   {
+      iRead = RecvBuf_fill(oBuf);
+      if (iRead == 0)
+         return RECVBUF_EOF;
+      if (iRead < 0)
+      {
+         if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+            return RECVBUF_AGAIN;
+         return RECVBUF_ERROR;
+      }
+   }
+
+   iFirst = RECVBUF_SIZE - oBuf->iHead;
+   if (iFirst > iSize)
+      iFirst = iSize;
+   memcpy(pvBuf, oBuf->pcRing + oBuf->iHead, iFirst);
+   memcpy((char*)pvBuf + iFirst, oBuf->pcRing, iSize - iFirst);
+   return RECVBUF_OK;
+}
+
+/*--------------------------------------------------------------------*/
+
+ssize_t RecvBuf_readn(RecvBuf_T oBuf, void *pvBuf, size_t iSize)
+
+/* Read iSize bytes from oBuf into pvBuf, taking buffered bytes first.
+   Return the number of bytes read, which is less than iSize only at
+   end of file, or -1 on a read error. */
+
+{
+   char *pcSave;
+   size_t iNLeft;
+   ssize_t iNRead;
+
+   assert(oBuf != NULL);
+   assert(pvBuf != NULL);
+
+   pcSave = (char*)pvBuf;
+   iNLeft = iSize - RecvBuf_take(oBuf, pcSave, iSize);
+   pcSave += iSize - iNLeft;
+
+   /* Buffer is empty now: read the rest straight into pvBuf. */
+   while (iNLeft > 0)
+   {
+      oBuf->lReads++;
+      iNRead = read(oBuf->iFD, pcSave, iNLeft);
+      if (iNRead < 0)
+      {
+         if (errno == EINTR)
+            continue;
+         return -1;
+      }
+      if (iNRead == 0)
+         break;
+      iNLeft -= (size_t)iNRead;
+      pcSave += iNRead;
+   }
+   return (ssize_t)(iSize - iNLeft);
+}
+
+/*--------------------------------------------------------------------*/
+
+int RecvBuf_save(RecvBuf_T oBuf, int iFD)
+
+/* Write the bytes oBuf holds that have not been consumed yet to iFD
+   and consume them. Return 0, or -1 on a write error. */
+
+{
+   size_t iFirst;
+   ssize_t iWritten;
+
+   assert(oBuf != NULL);
+
+   while (oBuf->iCount > 0)
+   {
+      iFirst = RECVBUF_SIZE - oBuf->iHead;
+      if (iFirst > oBuf->iCount)
+         iFirst = oBuf->iCount;
+      iWritten = write(iFD, oBuf->pcRing + oBuf->iHead, iFirst);
+      if (iWritten < 0)
+      {
+         if (errno == EINTR)
+            continue;
+         return -1;
+      }
+      oBuf->iHead = (oBuf->iHead + (size_t)iWritten) % RECVBUF_SIZE;
+      oBuf->iCount -= (size_t)iWritten;
+   }
+   oBuf->iHead = 0;
+   return 0;
+}
+
+/*--------------------------------------------------------------------*/
+
+int RecvBuf_restore(RecvBuf_T oBuf, int iFD)
+
+/* Throw away the bytes oBuf holds and hold the bytes read from iFD up
+   to its end instead. Return 0, or -1 on a read error or if they do
+   not fit into the ring. */
+
+{
+   ssize_t iRead;
+   char cMore;
+
+   assert(oBuf != NULL);
+
+   oBuf->iHead = 0;
+   oBuf->iCount = 0;
+   oBuf->iSkipping = 0;
+   do
+   {
+      iRead = read(iFD, oBuf->pcRing + oBuf->iCount,
+                   RECVBUF_SIZE - oBuf->iCount);
+      if (iRead > 0)
+         oBuf->iCount += (size_t)iRead;
+   } while ((iRead > 0) || ((iRead < 0) && (errno == EINTR)));
+   if (iRead < 0)
+      return -1;
+
+   /* A full ring may have more behind it. */
+   if ((oBuf->iCount == RECVBUF_SIZE) &&
+       (read(iFD, &cMore, 1) > 0))
+      return -1;
+   return 0;
+}
+
+/*--------------------------------------------------------------------*/
@@ -0,0 +1,79 @@
+/*--------------------------------------------------------------------*/
+/* recvbuf.h                                                          */
+/* Buffered reader for a connected socket                             */
+/*--------------------------------------------------------------------*/
+
+#ifndef RECVBUF_INCLUDED
+#define RECVBUF_INCLUDED
+
+#include <sys/types.h>
+
+/*--------------------------------------------------------------------*/
+
+typedef struct RecvBuf *RecvBuf_T;
+/* A RecvBuf sits in front of a descriptor and reads from it in large
+   chunks into a ring buffer. Command lines are cut out of the buffer,
+   and whatever follows a line (the body of a file upload, the next
+   pipelined command) stays there for the next reader. */
+
+enum RecvBufRead {RECVBUF_OK, RECVBUF_AGAIN, RECVBUF_EOF,
+                  RECVBUF_ERROR, RECVBUF_LONG};
+typedef enum RecvBufRead RecvBufRead;
+/* Result of trying to read a line or a fixed amount of data. */
+
+/*--------------------------------------------------------------------*/
+
+RecvBuf_T RecvBuf_new(int iFD);
+/* Return a new, empty RecvBuf reading from iFD, or NULL if
+   insufficient memory is available. */
+
+void RecvBuf_free(RecvBuf_T oBuf);
+/* Free oBuf. Does not close its descriptor. */
+
+int RecvBuf_getFD(RecvBuf_T oBuf);
+/* Return the descriptor oBuf reads from. */
+
+size_t RecvBuf_getBuffered(RecvBuf_T oBuf);
+/* Return the number of bytes oBuf holds that have not been consumed
+   yet. */
+
+RecvBufRead RecvBuf_readLine(RecvBuf_T oBuf, char *pcLine,
+                             size_t iSize);
+/* Read a line from oBuf into pcLine, of size iSize, without its
+   newline and '\0'-terminated. A line longer than iSize - 1 is thrown
+   away up to and including its newline, which may take several calls
+   on a non-blocking descriptor. Return RECVBUF_OK if a line was read,
+   RECVBUF_LONG once a line that was too long has been thrown away,
+   RECVBUF_AGAIN if the descriptor is non-blocking and has no data for
+   now, RECVBUF_EOF if the peer closed the connection before a full
+   line arrived, or RECVBUF_ERROR on a read error. */
+
+RecvBufRead RecvBuf_peek(RecvBuf_T oBuf, void *pvBuf, size_t iSize);
+/* Copy the next iSize bytes of oBuf into pvBuf without consuming
+   them, reading from the descriptor until that many are buffered.
+   iSize may not exceed the size of the ring. Return RECVBUF_OK,
+   RECVBUF_AGAIN if the descriptor is non-blocking and has no data for
+   now, RECVBUF_EOF or RECVBUF_ERROR. */
+
+ssize_t RecvBuf_readn(RecvBuf_T oBuf, void *pvBuf, size_t iSize);
+/* Read iSize bytes from oBuf into pvBuf, taking buffered bytes first.
+   Return the number of bytes read, which is less than iSize only at
+   end of file, or -1 on a read error. */
+
+int RecvBuf_save(RecvBuf_T oBuf, int iFD);
+/* Write the bytes oBuf holds that have not been consumed yet to iFD
+   and consume them, so that another process can take over where oBuf
+   stops (see RecvBuf_restore). Return 0, or -1 on a write error. */
+
+int RecvBuf_restore(RecvBuf_T oBuf, int iFD);
+/* Throw away the bytes oBuf holds and hold the bytes read from iFD up
+   to its end instead, as RecvBuf_save wrote them. Return 0, or -1 on
+   a read error or if they do not fit into the ring. */
+
+long RecvBuf_getReads(RecvBuf_T oBuf);
+/* Return the number of read system calls oBuf has made. */
+
+long RecvBuf_getLines(RecvBuf_T oBuf);
+/* Return the number of lines oBuf has returned. */
+
+#endif
@@ -1,79 +1,190 @@
-/* TO DOS:
-   1. Delete srvX.out after every command
-   2. Change stdout redirection after cd
-*/
-
 #include "server.h"
 
 /*--------------------------------------------------------------------*/
 
-static void Server_executeCommand(char *acLine, DynArray_T oTokens, DynArray_T oCmds, int iSockFD); /* execute a command contained in acLine */
-static int Server_handleSend(DynArray_T oCmds, int iSockFD); /* receive a file from remote client */
-static int Server_handleRecv(DynArray_T oCmds, int iSockFD); /* send a file to remote client */
-static void Server_exec(DynArray_T oCmds, int iSockFD); /* execute command stored in oCmds, and send terminal result back to client */
-static int Server_recvCommand(int iSockFD, char *acLine); /* receive a command from remote client */
+static void Server_forkLoop(int iListenFD); /* serve each client in its own process */
+static void Server_eventLoop(int iListenFD); /* serve all clients from one epoll loop */
+static Session_T Server_newSession(int iConnFD); /* set up the state of a new connection */
+static void Server_pumpSession(Session_T oSession); /* run the commands a session has waiting */
+static void Server_reapChildren(void); /* reap finished commands and answer their sessions */
+static void Server_closeSession(Session_T oSession); /* hang up on a client */
+static RecvBufRead Server_readRequest(Session_T oSession, char *acLine); /* receive a command from remote client */
+static int Server_runCommand(Session_T oSession, char *acLine); /* execute a command contained in acLine */
+static int Server_rejectLine(Session_T oSession); /* answer a command line that was too long */
+static int Server_finishCommand(Session_T oSession, int iWaitStatus); /* answer a command that ran in a child */
+static int Server_exitStatus(int iWaitStatus); /* the exit status a wait status stands for */
+static int Server_startJob(Session_T oSession, SynCmd *psCmd, char **ppcEnv); /* start a background job */
+static void Server_reapJobs(Session_T oSession); /* note which background jobs have finished */
+static int Server_waitJob(Session_T oSession, int iJob); /* wait for a background job */
+static int Server_finishWait(Session_T oSession); /* answer a wait for a background job that has finished */
+static int Server_sendJobOutput(Session_T oSession, int iJob); /* send what a background job has printed since last time */
+static int Server_killJob(Session_T oSession, int iJob); /* terminate a background job */
+static int Server_handleSend(Session_T oSession, char *pcDest); /* receive a file from remote client */
+static int Server_handleRecv(Session_T oSession, char *pcSource); /* send a file to remote client */
+static int Server_handleStripe(Session_T oSession, const char *pcRequest, uint64_t uLength); /* send one range of a striped download */
+static int Server_startTransfer(Session_T oSession, SynCmd *psCmd); /* run a file transfer in a child of its own */
+static int Server_finishTransfer(Session_T oSession, int iWaitStatus); /* take a session back from its transfer child */
+static void Server_detach(Session_T oSession); /* keep only one client in a child of the event model */
+static void Server_serveClient(Session_T oSession); /* serve one client until it disconnects */
+static int Server_beginCapture(Session_T oSession); /* send stdout and stderr where a session's output is collected */
+static int Server_beginRelay(Session_T oSession); /* send stdout and stderr through a pipe for a command about to run in a child */
+static int Server_sendScratch(Session_T oSession); /* send what a framed client's command has printed so far */
+static int Server_relayOutput(Session_T oSession); /* pass command output on to a client as it comes */
+static void Server_dropOutput(Session_T oSession); /* forget the output pipe of a session */
+static void Server_endJob(Session_T oSession); /* store a finished compile in the cache */
+static int Server_sendOutput(Session_T oSession, int iStatus); /* send the rest of a session's output */
+static void Server_setSlot(int iFD, Session_T oSession); /* map a descriptor to its session */
+static int Server_beginTransfer(Session_T oSession); /* queue what is sent to a client in its outbox */
+static int Server_endTransfer(Session_T oSession); /* send what a client's outbox holds, as far as it goes */
+static int Server_flushOutput(Session_T oSession); /* send queued answers once a client's socket takes them */
+static void Server_restoreOutput(void); /* put stdout and stderr back after a command */
+static void Server_namedScratch(Session_T oSession, char *pcPath); /* the path of a session's named scratch file */
+static int Server_openNamedScratch(Session_T oSession); /* collect a legacy client's output in a named file, as before memfd */
+static void Server_removeNamedScratch(Session_T oSession); /* remove that file with rm -f */
+static void Server_logStats(Session_T oSession); /* report how many reads a connection's commands took, and what compression saved */
+
+static int iEventMode = TRUE; /* serve clients from one epoll loop */
+static int iSavedOut = 1; /* the server's own stdout */
+static int iSavedErr = 2; /* the server's own stderr */
+static int iEpollFD = -1; /* descriptors the event model waits on */
+static int iListenSock = -1; /* where new connections come in */
+static int iParkedSock = -1; /* a socket while its descriptor points at its outbox */
+static char *pcNamedDir = NULL; /* -O: where named scratch files live */
+static DynArray_T oSessions = NULL; /* sessions of the event model, by socket and pipe */
 
 /*--------------------------------------------------------------------*/
 
 int main(int argc, char **argv)
 {
   /* variable declarations and initializations */
-  int iListenFD = 0, iConnFD = 0;
-  char acLine[MAX_LINE_SIZE];
-  DynArray_T oTokens = NULL;
-  DynArray_T oCmds = NULL;
-  pid_t iChildPID = 0;
-  socklen_t iCliLen = 0;
-  struct sockaddr_in sCliAddr, sServAddr;
-  bzero(&sCliAddr, sizeof(sCliAddr));
+  int iListenFD = 0;
+  int iOn = 1;
+  int iOpt = 0;
+  char *pcCacheDir = CACHE_DEFAULT_DIR;
+  char *pcStoreDir = STORE_DEFAULT_DIR;
+  char *pcStageDir = STAGE_DEFAULT_DIR;
+  long long llBudget = CACHE_DEFAULT_BUDGET;
+  struct sockaddr_in sServAddr;
   bzero(&sServAddr, sizeof(sServAddr));
-  
+
   /* check usage */
-  if (argc != 1) {
-    printf("usage: server\n");
+  while ((iOpt = getopt(argc, argv, "m:cuC:B:S:P:ZO")) != -1) {
+    if ((iOpt == 'm') && (strcmp(optarg, SERVER_MODE_EVENT) == 0))
+      iEventMode = TRUE;
+    else if ((iOpt == 'm') && (strcmp(optarg, SERVER_MODE_FORK) == 0))
+      iEventMode = FALSE;
+    else if (iOpt == 'c') /* copy file data instead of sendfile/splice */
+      Common_setZeroCopy(FALSE);
+    else if (iOpt == 'u') /* copy file data in batches through io_uring */
+      Uring_setOn(TRUE);
+    else if (iOpt == 'C') /* compile cache directory, "" for none */
+      pcCacheDir = optarg;
+    else if ((iOpt == 'B') && ((llBudget = atoll(optarg)) > 0))
+      ; /* compile cache budget in megabytes */
+    else if (iOpt == 'S') /* upload store directory, "" for none */
+      pcStoreDir = optarg;
+    else if (iOpt == 'P') /* partial upload directory, "" for none */
+      pcStageDir = optarg;
+    else if (iOpt == 'Z') /* refuse compression on the wire */
+      Proto_setCompression(FALSE);
+    else if (iOpt == 'O') { /* old scratch files, to compare against */
+      if ((pcNamedDir = getcwd(NULL, 0)) == NULL) {
+	perror("server: getcwd");
+	exit(EXIT_FAILURE);
+      }
+    }
+    else
+      break;
+  }
+  if ((iOpt != -1) || (optind != argc)) {
+    printf("usage: server [-m %s|%s] [-c] [-u] [-C cachedir] [-B megabytes] "
+	   "[-S storedir] [-P partialdir] [-Z] [-O]\n",
+	   SERVER_MODE_EVENT, SERVER_MODE_FORK);
     exit(EXIT_FAILURE);
   }
-  
+
+  /* compiles with known inputs are answered from the cache */
+  if ((pcCacheDir[0] != '\0') &&
+      (Cache_open(pcCacheDir, llBudget * 1024 * 1024) == FAILURE))
+    fprintf(stderr, "server: %s: %s, compile cache off\n", pcCacheDir,
+	    strerror(errno));
+
+  /* uploads with the same contents are stored once */
+  if ((pcStoreDir[0] != '\0') && (Store_open(pcStoreDir) == FAILURE))
+    fprintf(stderr, "server: %s: %s, upload store off\n", pcStoreDir,
+	    strerror(errno));
+
+  /* interrupted uploads of large files resume where they stopped */
+  if ((pcStageDir[0] != '\0') && (Stage_open(pcStageDir) == FAILURE))
+    fprintf(stderr, "server: %s: %s, resuming uploads off\n", pcStageDir,
+	    strerror(errno));
+
+  /* a client going away must not kill the server */
+  signal(SIGPIPE, SIG_IGN);
+
   /* create socket */
   if ((iListenFD = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
     perror("server: socket");
     exit(EXIT_FAILURE);
   }
-  
+  setsockopt(iListenFD, SOL_SOCKET, SO_REUSEADDR, &iOn, sizeof(iOn));
+
   /* address structure */
   bzero(&sServAddr, sizeof(sServAddr));
   sServAddr.sin_family = AF_INET;
   sServAddr.sin_addr.s_addr = htonl(INADDR_ANY);
   sServAddr.sin_port = htons(SERV_PORT);
-  
+
   /* bind connection */
   if (bind(iListenFD, (struct sockaddr *) &sServAddr, sizeof(sServAddr)) < 0) {
     perror("server: bind");
     exit(EXIT_FAILURE);
   }
-  
+
   /* listen for incoming connections */
   listen(iListenFD, MAX_PENDING);
-  
-  /* get new connections and start new processes for them */
+
+  if (iEventMode)
+    Server_eventLoop(iListenFD);
+  else
+    Server_forkLoop(iListenFD);
+  exit(EXIT_SUCCESS);
+}
+
+/*--------------------------------------------------------------------*/
+
+/* legacy model: get new connections and start a new process for each
+   of them, which serves the client until it disconnects */
+static void Server_forkLoop(int iListenFD)
+{
+  int iConnFD = 0;
+  Session_T oSession = NULL;
+  pid_t iChildPID = 0;
+  socklen_t iCliLen = 0;
+  struct sockaddr_in sCliAddr;
+  bzero(&sCliAddr, sizeof(sCliAddr));
+
+  signal(SIGCHLD, SIG_IGN); /* no zombies from finished connections */
+
   while (TRUE) {
     iCliLen = sizeof(sCliAddr);
     iConnFD = accept(iListenFD, (struct sockaddr *) &sCliAddr, &iCliLen);
-    
+
     if ((iChildPID = fork()) == 0) { /* child process */
       close(iListenFD);              /* close listening socket */
-      
+      signal(SIGCHLD, SIG_DFL);      /* commands are waited for */
+      iSavedOut = fcntl(1, F_DUPFD_CLOEXEC, 3);
+      iSavedErr = fcntl(2, F_DUPFD_CLOEXEC, 3);
+      if ((oSession = Server_newSession(iConnFD)) == NULL) {
+	fprintf(stderr, "server: cannot allocate memory\n");
+	exit(EXIT_FAILURE);
+      }
+
       /*****************************************************************
        ********** At this point, client is connected to server *********
        *****************************************************************/
 
-      while (Server_recvCommand(iConnFD, acLine) == SUCCESS) {
-	if (strlen(acLine)) {
-	  Server_executeCommand(acLine, oTokens, oCmds, iConnFD);
-	}
-	bzero(acLine, MAX_LINE_SIZE);
-      }	
-      close(iConnFD);
+      Server_serveClient(oSession);
       exit(EXIT_SUCCESS);
     }
     close(iConnFD); /* parent closes connected socket */
@@ -82,241 +193,1378 @@ int main(int argc, char **argv)
 
 /*--------------------------------------------------------------------*/
 
-/* execute a command contained in acLine */
-static void Server_executeCommand(char *acLine, DynArray_T oTokens,
-				  DynArray_T oCmds, int iSockFD)
+/* serve the client of oSession, over a blocking socket, until it
+   disconnects, and close the session */
+static void Server_serveClient(Session_T oSession)
 {
-  int iSuccessful = 0;
-  Cmd_T psCmd;
-  char acOutName[MAX_NAME];
-  bzero(acOutName, MAX_NAME);
- 
-  
-  assert(acLine != NULL);
+  int iWaitStatus = 0;
+  char acLine[MAX_LINE_SIZE];
+  bzero(acLine, MAX_LINE_SIZE);
 
-  /* redirect stdout and stderr */
-  Common_makeOutName(iSockFD, acOutName);
-  Common_redirectStdoutForce(acOutName, "server");
-  Common_redirectStderrForce(acOutName, "server");
+  while (Server_readRequest(oSession, acLine) == RECVBUF_OK) {
+    if (!Server_runCommand(oSession, acLine))
+      break;
+    if (Session_getPid(oSession) != 0) { /* wait for the command */
+      if (!Server_relayOutput(oSession))
+	break;
+      waitpid(Session_getPid(oSession), &iWaitStatus, 0);
+      if (!Server_finishCommand(oSession, iWaitStatus))
+	break;
+    }
+    bzero(acLine, MAX_LINE_SIZE);
+  }
+  Server_closeSession(oSession);
+}
 
-  /* create empty DynArrays */
-  if ((oTokens = DynArray_new(0)) == NULL) {
-    fprintf(stderr, "server: Server_executeCommand: cannot allocate memory\n");
-    Common_deleteFile(acOutName, "server");
-    return;
+/*--------------------------------------------------------------------*/
+
+/* event model: serve every client from this one process with an
+   edge-triggered epoll loop over non-blocking sockets. Commands that
+   only touch session state (cd, setenv, ...) run in place, and a
+   child is forked only for a command that has to be exec'ed. Its
+   output is relayed to the client as the pipe it writes to becomes
+   readable, and the request is answered once SIGCHLD (read through a
+   signalfd) reports that the command has finished. The same SIGCHLD
+   marks background jobs finished, and answers a session waiting for
+   one. Pipes are kept in the session table next to sockets. A file
+   transfer runs in a child of its own. Everything else sent to a
+   client goes through its outbox, which is emptied as far as the
+   socket takes it and after that on EPOLLOUT, so that a client that
+   does not read holds up nobody but itself. */
+static void Server_eventLoop(int iListenFD)
+{
+  int iSigFD = 0, iConnFD = 0;
+  int iEvents = 0, iFD = 0, i = 0;
+  Session_T oSession = NULL;
+  sigset_t sMask;
+  struct signalfd_siginfo sSigInfo;
+  struct epoll_event sEvent, asEvents[MAX_EVENTS];
+  bzero(&sEvent, sizeof(sEvent));
+
+  /* take SIGCHLD through a descriptor instead of a handler */
+  sigemptyset(&sMask);
+  sigaddset(&sMask, SIGCHLD);
+  if ((sigprocmask(SIG_BLOCK, &sMask, NULL) == -1) ||
+      ((iSigFD = signalfd(-1, &sMask, SFD_NONBLOCK | SFD_CLOEXEC)) == -1)) {
+    perror("server: signalfd");
+    exit(EXIT_FAILURE);
   }
-  if ((oCmds = DynArray_new(0)) == NULL) {
-    fprintf(stderr, "server: Server_executeCommand: cannot allocate memory\n");
-    Common_deleteFile(acOutName, "server");
-    return;
+
+  /* keep the real stdout and stderr to come back to after a command */
+  if (((iSavedOut = fcntl(1, F_DUPFD_CLOEXEC, 3)) == -1) ||
+      ((iSavedErr = fcntl(2, F_DUPFD_CLOEXEC, 3)) == -1)) {
+    perror("server: dup");
+    exit(EXIT_FAILURE);
   }
-  
-  /* lexical analysis stage. */
-  iSuccessful = Lex_lexLine(acLine, oTokens, "server");
-  /* check if successful lexical analysis, and if token
-     array size is greater than zero. */
-  if ((!iSuccessful) || (!DynArray_getLength(oTokens))) {  
-    Common_cleanup(oTokens, oCmds);
-    Common_deleteFile(acOutName, "server");
-    return;
+
+  /* sessions are indexed by socket */
+  if ((oSessions = DynArray_new(0)) == NULL) {
+    fprintf(stderr, "server: cannot allocate memory\n");
+    exit(EXIT_FAILURE);
   }
-  
-  /* syntactical parsing stage. */
-  iSuccessful = Syn_synLine(oTokens, oCmds, "server");
-  /* check if successful syntactical parsing. */
-  if (!iSuccessful) {  
-    Common_cleanup(oTokens, oCmds);
-    Common_deleteFile(acOutName, "server");
-    return;
-  }  
-  
-  /* check for custom commands */
-  if (Server_handleSend(oCmds, iSockFD)) { /* receive a file from remote client */
-    Common_cleanup(oTokens, oCmds);
-    Common_deleteFile(acOutName, "server");
-    return;
+
+  /* watch the listening socket and the signalfd */
+  iListenSock = iListenFD;
+  fcntl(iListenFD, F_SETFL, fcntl(iListenFD, F_GETFL, 0) | O_NONBLOCK);
+  fcntl(iListenFD, F_SETFD, FD_CLOEXEC);
+  if ((iEpollFD = epoll_create1(EPOLL_CLOEXEC)) == -1) {
+    perror("server: epoll_create1");
+    exit(EXIT_FAILURE);
   }
-  else if (Server_handleRecv(oCmds, iSockFD)) { /* send a file to remote client */
-    Common_cleanup(oTokens, oCmds);
-    Common_deleteFile(acOutName, "server");
-    return;
+  sEvent.events = EPOLLIN;
+  sEvent.data.fd = iListenFD;
+  epoll_ctl(iEpollFD, EPOLL_CTL_ADD, iListenFD, &sEvent);
+  sEvent.data.fd = iSigFD;
+  epoll_ctl(iEpollFD, EPOLL_CTL_ADD, iSigFD, &sEvent);
+
+  while (TRUE) {
+    if ((iEvents = epoll_wait(iEpollFD, asEvents, MAX_EVENTS, -1)) == -1) {
+      if (errno == EINTR) continue;
+      perror("server: epoll_wait");
+      exit(EXIT_FAILURE);
+    }
+
+    for (i = 0; i < iEvents; i++) {
+      iFD = asEvents[i].data.fd;
+
+      /* new connections */
+      if (iFD == iListenFD) {
+	while ((iConnFD = accept4(iListenFD, NULL, NULL,
+				  SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+	  if ((oSession = Server_newSession(iConnFD)) == NULL) {
+	    fprintf(stderr, "server: cannot allocate memory\n");
+	    close(iConnFD);
+	    continue;
+	  }
+	  Server_setSlot(iConnFD, oSession);
+	  sEvent.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+	  sEvent.data.fd = iConnFD;
+	  epoll_ctl(iEpollFD, EPOLL_CTL_ADD, iConnFD, &sEvent);
+	}
+      }
+
+      /* finished commands */
+      else if (iFD == iSigFD) {
+	while (read(iSigFD, &sSigInfo, sizeof(sSigInfo)) > 0)
+	  ;
+	Server_reapChildren();
+      }
+
+      /* output of a command */
+      else if ((iFD < DynArray_getLength(oSessions)) &&
+	       ((oSession = DynArray_get(oSessions, iFD)) != NULL) &&
+	       (iFD == Session_getOutFD(oSession))) {
+	if (!Server_relayOutput(oSession))
+	  Server_closeSession(oSession);
+	else
+	  Server_pumpSession(oSession);
+      }
+
+      /* data from a client, or room for what it is sent */
+      else if ((iFD < DynArray_getLength(oSessions)) &&
+	       ((oSession = DynArray_get(oSessions, iFD)) != NULL)) {
+	if (!Server_flushOutput(oSession))
+	  Server_closeSession(oSession);
+	else
+	  Server_pumpSession(oSession);
+      }
+    }
   }
+}
 
-  /* remove remote keyword */
-  psCmd = (Cmd_T) DynArray_get(oCmds, 0);
-  assert(Syn_returnType(psCmd) == CMD_CMD);
-  assert(strcmp(Syn_returnValue(psCmd), CMDNAME_REMOTE) == 0);
-  DynArray_removeAt(oCmds, 0);
-  
-  /* execute all other commands */
-  Server_exec(oCmds, iSockFD);
+/*--------------------------------------------------------------------*/
+
+/* set up the state of connection iConnFD */
+static Session_T Server_newSession(int iConnFD)
+{
+  int iOn = 1;
 
-  /* cleanup */
-  Common_deleteFile(acOutName, "server");
-  Common_cleanup(oTokens, oCmds);
+  /* answers are written in pieces (size, then data); do not let the
+     kernel hold the last piece back waiting for an acknowledgement */
+  setsockopt(iConnFD, IPPROTO_TCP, TCP_NODELAY, &iOn, sizeof(iOn));
+  return Session_new(iConnFD);
 }
 
 /*--------------------------------------------------------------------*/
 
-/* receive a file from remote client */
-static int Server_handleSend(DynArray_T oCmds, int iSockFD)
+/* run every complete command that oSession has waiting, until it
+   starts a command that runs in a child, waits for a background job,
+   has answers its client has not taken yet or its socket runs dry */
+static void Server_pumpSession(Session_T oSession)
 {
-  int iLength = 0;
+  char acLine[MAX_LINE_SIZE];
+  RecvBufRead eRead;
+  struct epoll_event sEvent;
+  bzero(&sEvent, sizeof(sEvent));
+
+  while ((Session_getPid(oSession) == 0) && (Session_getOutFD(oSession) == -1) &&
+	 (Session_getWaitJob(oSession) == 0) && !Session_isPending(oSession)) {
+    eRead = Server_readRequest(oSession, acLine);
+    if (eRead == RECVBUF_AGAIN)
+      return;
+    if ((eRead != RECVBUF_OK) || !Server_runCommand(oSession, acLine)) {
+      Server_closeSession(oSession);
+      return;
+    }
+
+    /* a command started: watch the pipe its output comes through */
+    if (Session_getOutFD(oSession) != -1) {
+      fcntl(Session_getOutFD(oSession), F_SETFL, O_NONBLOCK);
+      Server_setSlot(Session_getOutFD(oSession), oSession);
+      sEvent.events = EPOLLIN | EPOLLET;
+      sEvent.data.fd = Session_getOutFD(oSession);
+      epoll_ctl(iEpollFD, EPOLL_CTL_ADD, Session_getOutFD(oSession), &sEvent);
+    }
+  }
+}
+
+/*--------------------------------------------------------------------*/
+
+/* make oSession the session of descriptor iFD, or forget the session
+   of iFD if oSession is NULL */
+static void Server_setSlot(int iFD, Session_T oSession)
+{
+  while (DynArray_getLength(oSessions) <= iFD)
+    DynArray_add(oSessions, NULL);
+  DynArray_set(oSessions, iFD, oSession);
+}
+
+/*--------------------------------------------------------------------*/
+
+/* reap finished commands and send their output to their sessions.
+   A finished background job is only noted in its session's job table,
+   unless the session waits for it */
+static void Server_reapChildren(void)
+{
+  pid_t iPid = 0;
+  int iWaitStatus = 0;
+  Session_T oSession = NULL;
+  int iJob = 0;
   int i = 0;
-  int iFlag = FALSE;
-  Cmd_T psCmd = NULL;
-  CmdType eType;
-  int iArgs = 0;
-
-  assert(oCmds != NULL);
-
-  iLength = DynArray_getLength(oCmds);
-
-  /* Go through entire command */
-  for (i = 0; i < iLength; i++) {
-    psCmd = (Cmd_T) DynArray_get(oCmds, i);
-    eType = Syn_returnType(psCmd);
-    if (eType == CMD_CMD) {
-      if (strcmp(Syn_returnValue(psCmd), CMDNAME_SEND) == 0) {
-	assert(i == 0); 
-	iFlag = TRUE;
-      }
-      else break;
+
+  while ((iPid = waitpid(-1, &iWaitStatus, WNOHANG)) > 0) {
+    iJob = 0;
+    for (i = 0; i < DynArray_getLength(oSessions); i++) {
+      oSession = DynArray_get(oSessions, i);
+      if ((oSession != NULL) &&
+	  ((Session_getPid(oSession) == iPid) ||
+	   ((iJob = JobTab_exited(Session_getJobTab(oSession), iPid,
+				  Server_exitStatus(iWaitStatus))) != 0)))
+	break;
+    }
+    if (i == DynArray_getLength(oSessions)) /* client already gone */
+      continue;
+
+    if ((iJob == 0) && (Session_getTransferFD(oSession) != -1)) {
+      if (!Server_finishTransfer(oSession, iWaitStatus))
+	Server_closeSession(oSession);
+      else
+	Server_pumpSession(oSession); /* commands that came with it */
+    }
+    else if (iJob == 0) {
+      if (!Server_finishCommand(oSession, iWaitStatus))
+	Server_closeSession(oSession);
+      else
+	Server_pumpSession(oSession); /* commands that queued up */
+    }
+    else if (Session_getWaitJob(oSession) == iJob) {
+      if (!Server_finishWait(oSession))
+	Server_closeSession(oSession);
+      else
+	Server_pumpSession(oSession);
     }
-    else if (eType == CMD_ARG) iArgs++;
   }
+}
 
-  /* if not send */
-  if (!iFlag) return FALSE;
+/*--------------------------------------------------------------------*/
 
-  /* receive file from client */
-  psCmd = (Cmd_T) DynArray_get(oCmds, 1);
+/* forget a session and hang up on its client */
+static void Server_closeSession(Session_T oSession)
+{
+  int iSockFD = Session_getSockFD(oSession);
 
-  assert(Common_recvFile(iSockFD, Syn_returnValue(psCmd)) == SUCCESS);
-  
-  return TRUE;
+  Server_logStats(oSession);
+  if (iEventMode)
+    DynArray_set(oSessions, iSockFD, NULL);
+  Server_dropOutput(oSession); /* a command still running gets SIGPIPE */
+  Cache_end(Session_getJob(oSession), -1); /* its output is not stored */
+  Proto_forget(iSockFD); /* the descriptor goes to the next client */
+  close(iSockFD); /* also removes it from the epoll set */
+  Session_free(oSession);
 }
 
 /*--------------------------------------------------------------------*/
 
-/* send a file to remote client */
-static int Server_handleRecv(DynArray_T oCmds, int iSockFD)
+/* receive a command from remote client. The first bytes of a
+   connection decide whether it speaks the framed protocol (and
+   starts with a handshake) or sends plain lines */
+static RecvBufRead Server_readRequest(Session_T oSession, char *acLine)
 {
-  int iLength = 0;
-  int i = 0;
-  int iFlag = FALSE;
-  Cmd_T psCmd = NULL;
-  CmdType eType;
-  int iArgs = 0;
-
-  assert(oCmds != NULL);
-
-  iLength = DynArray_getLength(oCmds);
-
-  /* Go through entire command */
-  for (i = 0; i < iLength; i++) {
-    psCmd = (Cmd_T) DynArray_get(oCmds, i);
-    eType = Syn_returnType(psCmd);
-    if (eType == CMD_CMD) {
-      if (strcmp(Syn_returnValue(psCmd), CMDNAME_RECV) == 0) {
-	assert(i == 0); 
-	iFlag = TRUE;
+  RecvBuf_T oBuf = Session_getRecvBuf(oSession);
+  ProtoHeader sHeader;
+  RecvBufRead eRead;
+  int iVersion = 0;
+  unsigned char ucFirst = 0;
+
+  while (TRUE) {
+    /* not known yet: look at the first byte */
+    if (Session_getProtocol(oSession) == SESSION_PROTOCOL_UNKNOWN) {
+      if ((eRead = RecvBuf_peek(oBuf, &ucFirst, 1)) != RECVBUF_OK)
+	return eRead;
+      if (ucFirst != PROTO_MAGIC) {
+	Session_setProtocol(oSession, PROTO_VERSION_LEGACY);
+	continue;
       }
-      else break;
+      eRead = Proto_readFrame(oBuf, &sHeader, acLine, MAX_LINE_SIZE - 1);
+      if (eRead != RECVBUF_OK)
+	return eRead;
+      if (sHeader.eType != PROTO_HELLO)
+	return RECVBUF_ERROR;
+      if (!Server_beginTransfer(oSession))
+	return RECVBUF_ERROR;
+      iVersion = Proto_serverHello(Session_getSockFD(oSession),
+				   sHeader.uFlags, acLine, sHeader.uLength);
+      if (!Server_endTransfer(oSession) || (iVersion == FAILURE))
+	return RECVBUF_ERROR;
+      Session_setProtocol(oSession, iVersion);
+      continue;
     }
-    else if (eType == CMD_ARG) iArgs++;
+
+    /* old clients: one command per line, blank lines ignored */
+    if (Session_getProtocol(oSession) == PROTO_VERSION_LEGACY) {
+      eRead = RecvBuf_readLine(oBuf, acLine, MAX_LINE_SIZE);
+      if ((eRead == RECVBUF_OK) && (strlen(acLine) == 0))
+	continue;
+      if (eRead == RECVBUF_LONG) {
+	Session_countCommand(oSession);
+	if (!Server_rejectLine(oSession))
+	  return RECVBUF_ERROR;
+	if (Session_isPending(oSession)) /* go on once the client reads */
+	  return RECVBUF_AGAIN;
+	continue;
+      }
+      if (eRead == RECVBUF_OK)
+	Session_countCommand(oSession);
+      return eRead;
+    }
+
+    /* framed clients: one command per PROTO_COMMAND frame */
+    eRead = Proto_readFrame(oBuf, &sHeader, acLine, MAX_LINE_SIZE - 1);
+    if (eRead != RECVBUF_OK)
+      return eRead;
+
+    /* a range of a striped download, on a connection of its own */
+    if ((sHeader.eType == PROTO_STRIPE) &&
+	(Session_getProtocol(oSession) >= PROTO_VERSION_STRIPE)) {
+      Session_setRequestId(oSession, sHeader.uId);
+      if (!Server_handleStripe(oSession, acLine, sHeader.uLength))
+	return RECVBUF_ERROR;
+      continue;
+    }
+    if (sHeader.eType != PROTO_COMMAND)
+      return RECVBUF_ERROR;
+    acLine[sHeader.uLength] = '\0';
+    Session_setRequestId(oSession, sHeader.uId);
+    Session_countCommand(oSession);
+    return RECVBUF_OK;
+  }
+}
+
+/*--------------------------------------------------------------------*/
+
+/* answer a command line of a legacy client that was too long to run,
+   and has been thrown away, with an error. Return 0 (FALSE) if the
+   session should be closed, 1 (TRUE) otherwise */
+static int Server_rejectLine(Session_T oSession)
+{
+  if (!Server_beginCapture(oSession))
+    return FALSE;
+  fprintf(stderr, "server: command line longer than %d characters\n",
+	  MAX_LINE_SIZE - 1);
+  Server_restoreOutput();
+  return Server_sendOutput(oSession, EXIT_FAILURE) == SUCCESS;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* execute a command contained in acLine. Return 0 (FALSE) if the
+   session should be closed, 1 (TRUE) otherwise. A command that has to
+   be exec'ed is only started; Server_finishCommand answers it */
+static int Server_runCommand(Session_T oSession, char *acLine)
+{
+  Arena_T oArena = Session_getArena(oSession);
+  SynCmd sCmd;
+  char **apcEnvp = NULL;
+  JobTab_T oJobs = Session_getJobTab(oSession);
+  CacheJob_T oJob = NULL;
+  pid_t iPid = 0;
+  int iJob = 0;
+  int iRet = TRUE;
+
+  /* collect everything the command prints */
+  if (!Server_beginCapture(oSession))
+    return FALSE;
+  if (!iEventMode)
+    Server_reapJobs(oSession);
+
+  /* lexical and syntactical analysis, in one pass */
+  if (!Syn_parseLine(acLine, &sCmd, oArena, "server") ||
+      (sCmd.iArgc == 0) ||
+      !Session_enter(oSession, "server")) {
+    Arena_reset(oArena);
+    Server_restoreOutput();
+    return Server_sendOutput(oSession, EXIT_FAILURE) == SUCCESS;
   }
 
-  /* if not recv */
-  if (!iFlag) return FALSE;
+  switch (sCmd.eVerb) {
+  case VERB_SEND: /* receive a file from remote client */
+  case VERB_RECV: /* send a file to remote client */
+    Server_restoreOutput();
+    if ((sCmd.iArgc < 2) || (sCmd.psNext != NULL) || sCmd.iBackground) {
+      /* file transfers need a file name, and do not take pipes or & */
+      Arena_reset(oArena);
+      return FALSE;
+    }
+    Server_dropOutput(oSession); /* transfers answer for themselves */
+    if (iEventMode)
+      iRet = Server_startTransfer(oSession, &sCmd);
+    else if (sCmd.eVerb == VERB_SEND)
+      iRet = Server_handleSend(oSession, sCmd.ppcArgv[1]);
+    else
+      iRet = Server_handleRecv(oSession, sCmd.ppcArgv[1]);
+    Arena_reset(oArena);
+    return iRet;
+
+  case VERB_REMOTE:
+    break;
 
-  /* send file to client */
-  psCmd = (Cmd_T) DynArray_get(oCmds, 1);
-  if (Common_sendFile(iSockFD, Syn_returnValue(psCmd)) == FAILURE) {
-    assert(Common_sendFile(iSockFD, EMPTYFILE) == SUCCESS);
+  default:
+    fprintf(stderr, "server: %s: unknown command\n", sCmd.ppcArgv[0]);
+    Arena_reset(oArena);
+    Server_restoreOutput();
+    return Server_sendOutput(oSession, EXIT_FAILURE) == SUCCESS;
   }
 
-  return TRUE;
+  /* remove remote keyword */
+  Syn_shift(&sCmd);
+  iRet = EXIT_SUCCESS;
+
+  /* every stage of a pipeline runs as a program */
+  switch ((sCmd.psNext == NULL) ? sCmd.eVerb : VERB_OTHER) {
+  case VERB_EXIT: /* close session */
+    if (sCmd.iArgc == 1) {
+      Arena_reset(oArena);
+      Server_restoreOutput();
+      return FALSE;
+    }
+    fprintf(stderr, "server: exit: too many arguments\n");
+    iRet = EXIT_FAILURE;
+    break;
+
+  case VERB_CD: /* change current directory */
+    Common_handleCd(&sCmd, "server");
+    Session_saveCwd(oSession);
+    break;
+
+  case VERB_SETENV:
+    Session_handleSetenv(oSession, &sCmd, "server");
+    break;
+
+  case VERB_UNSETENV:
+    Session_handleUnsetenv(oSession, &sCmd, "server");
+    break;
+
+  case VERB_CACHESTATS:
+    Cache_handleStats(&sCmd, "server");
+    break;
+
+  case VERB_STORESTATS:
+    Store_handleStats(&sCmd, "server");
+    break;
+
+  case VERB_JOBS: /* list background jobs */
+    JobTab_list(oJobs);
+    break;
+
+  case VERB_JOBOUT: /* what a background job printed since last time */
+    if ((iJob = JobTab_find(oJobs, &sCmd, "server")) == FAILURE)
+      iRet = EXIT_FAILURE;
+    else if (!Server_sendJobOutput(oSession, iJob)) {
+      Arena_reset(oArena);
+      Server_restoreOutput();
+      return FALSE;
+    }
+    break;
+
+  case VERB_JOBWAIT: /* wait for a background job to finish */
+    if ((iJob = JobTab_find(oJobs, &sCmd, "server")) == FAILURE)
+      iRet = EXIT_FAILURE;
+    else if ((iRet = Server_waitJob(oSession, iJob)) == FAILURE) {
+      /* answered once the job has finished (see Server_reapChildren) */
+      Server_dropOutput(oSession);
+      Arena_reset(oArena);
+      Server_restoreOutput();
+      return TRUE;
+    }
+    break;
+
+  case VERB_JOBKILL: /* terminate a background job */
+    if ((iJob = JobTab_find(oJobs, &sCmd, "server")) == FAILURE)
+      iRet = EXIT_FAILURE;
+    else
+      iRet = Server_killJob(oSession, iJob);
+    break;
+
+  default:
+    if (sCmd.iArgc == 0) {
+      fprintf(stderr, "server: missing command name\n");
+      iRet = EXIT_FAILURE;
+    }
+    else if ((apcEnvp = Session_createEnvp(oSession)) == NULL) {
+      fprintf(stderr, "server: cannot allocate memory\n");
+      iRet = EXIT_FAILURE;
+    }
+    else if (sCmd.iBackground) { /* answered as soon as it started */
+      iRet = Server_startJob(oSession, &sCmd, apcEnvp);
+      free(apcEnvp);
+    }
+    else if (!Server_beginRelay(oSession)) {
+      free(apcEnvp);
+      Arena_reset(oArena);
+      Server_restoreOutput();
+      return FALSE;
+    }
+    else { /* run it in a child; its output is sent when it exits */
+      if ((oJob = Cache_begin(&sCmd)) != NULL) /* the child looks it up */
+	iPid = Cache_spawn(oJob, &sCmd, apcEnvp, "server");
+      else if (Build_isBuild(&sCmd)) /* several compilers at once */
+	iPid = Build_spawn(&sCmd, apcEnvp, "server");
+      else
+	iPid = Common_spawn(&sCmd, apcEnvp, "server");
+      free(apcEnvp);
+      if (iPid != FAILURE) {
+	Session_setPid(oSession, iPid);
+	Session_setJob(oSession, oJob);
+	Arena_reset(oArena);
+	Server_restoreOutput();
+	return TRUE;
+      }
+      Cache_end(oJob, EXIT_FAILURE);
+      iRet = EXIT_FAILURE;
+    }
+    break;
+  }
+
+  Arena_reset(oArena);
+  Server_restoreOutput();
+  return Server_sendOutput(oSession, iRet) == SUCCESS;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* answer a command of oSession that ran in a child and ended with
+   iWaitStatus. Return 0 (FALSE) if the session should be closed */
+static int Server_finishCommand(Session_T oSession, int iWaitStatus)
+{
+  int iStatus = Server_exitStatus(iWaitStatus);
+
+  Session_setPid(oSession, 0);
+
+  /* with output still in the pipe, the answer ends after the last of
+     it (see Server_relayOutput) */
+  Session_setStatus(oSession, iStatus);
+  if (Session_getOutFD(oSession) != -1)
+    return TRUE;
+  return Server_sendOutput(oSession, iStatus) == SUCCESS;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* return the exit status of a command that ended with iWaitStatus,
+   128 plus the signal for one that was killed */
+static int Server_exitStatus(int iWaitStatus)
+{
+  if (WIFEXITED(iWaitStatus))
+    return WEXITSTATUS(iWaitStatus);
+  if (WIFSIGNALED(iWaitStatus))
+    return 128 + WTERMSIG(iWaitStatus);
+  return 0;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* start psCmd as a background job of oSession, with environment
+   ppcEnv, and print its number and pid. Everything it prints goes
+   into the output file of the job. Return the exit status of the
+   command that started it */
+static int Server_startJob(Session_T oSession, SynCmd *psCmd, char **ppcEnv)
+{
+  JobTab_T oJobs = Session_getJobTab(oSession);
+  int iCapture = -1;
+  int iJob = 0;
+  pid_t iPid = 0;
+
+  if ((iJob = JobTab_add(oJobs, psCmd, "server")) == FAILURE)
+    return EXIT_FAILURE;
+
+  /* the job writes to its file instead of the session's output */
+  fflush(NULL);
+  if ((iCapture = fcntl(1, F_DUPFD_CLOEXEC, 3)) == -1) {
+    perror("server");
+    JobTab_remove(oJobs, iJob);
+    return EXIT_FAILURE;
+  }
+  dup2(JobTab_getOutFD(oJobs, iJob), 1);
+  dup2(JobTab_getOutFD(oJobs, iJob), 2);
+  if (Build_isBuild(psCmd))
+    iPid = Build_spawn(psCmd, ppcEnv, "server");
+  else
+    iPid = Common_spawn(psCmd, ppcEnv, "server");
+  fflush(NULL);
+  dup2(iCapture, 1);
+  dup2(iCapture, 2);
+  close(iCapture);
+
+  if (iPid == FAILURE) {
+    fprintf(stderr, "server: %s: cannot start job\n", psCmd->ppcArgv[0]);
+    JobTab_remove(oJobs, iJob);
+    return EXIT_FAILURE;
+  }
+  setpgid(iPid, iPid); /* as the child does, whichever comes first */
+  JobTab_start(oJobs, iJob, iPid);
+  printf("[%d] %d\n", iJob, (int) iPid);
+  return EXIT_SUCCESS;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* note which background jobs of oSession have finished. Only for the
+   fork model, whose process has no other children between commands;
+   the event model learns it from SIGCHLD */
+static void Server_reapJobs(Session_T oSession)
+{
+  pid_t iPid = 0;
+  int iWaitStatus = 0;
+
+  while ((iPid = waitpid(-1, &iWaitStatus, WNOHANG)) > 0)
+    JobTab_exited(Session_getJobTab(oSession), iPid,
+		  Server_exitStatus(iWaitStatus));
+}
+
+/*--------------------------------------------------------------------*/
+
+/* wait for background job iJob of oSession to finish. Return its exit
+   status, or FAILURE if the event model has to answer later, once the
+   job has finished; oSession takes no command until then */
+static int Server_waitJob(Session_T oSession, int iJob)
+{
+  JobTab_T oJobs = Session_getJobTab(oSession);
+  pid_t iPid = JobTab_getPid(oJobs, iJob);
+  int iWaitStatus = 0;
+
+  if (iPid == 0)
+    return JobTab_getStatus(oJobs, iJob);
+  if (iEventMode) {
+    Session_setWaitJob(oSession, iJob);
+    return FAILURE;
+  }
+  while ((waitpid(iPid, &iWaitStatus, 0) == -1) && (errno == EINTR))
+    ;
+  JobTab_exited(oJobs, iPid, Server_exitStatus(iWaitStatus));
+  return JobTab_getStatus(oJobs, iJob);
 }
-  
-/*--------------------------------------------------------------------*/
-
-/* execute command stored in oCmds, and send terminal result back to client */
-static void Server_exec(DynArray_T oCmds, int iSockFD)
-{
-  char *pcPathSave = NULL;
-  char *pcPath = NULL;
-  char acOutName[MAX_NAME];
-  bzero(acOutName, MAX_NAME);
-
-  assert(oCmds != NULL);
-  
-  if (strcmp((char*) Syn_returnValue((Cmd_T) DynArray_get(oCmds, 0)), "cd") == 0) {
-    Common_makeOutName(iSockFD, acOutName);
-    pcPathSave = getcwd(NULL, 0);
-    if (Common_handleCd(oCmds, "server")) /* change current directory */
-      { 
-	/* delete previous random text file */
-	pcPath = (char *) calloc(1, strlen(pcPathSave) + strlen(acOutName) + 2);
-	strcat(pcPath, pcPathSave);
-	strcat(pcPath, "/");
-	strcat(pcPath, acOutName);
-	//printf("\nPath to delete: %s\n", pcPath, ); // DEBUG
-	Common_deleteFile(pcPath, "server");
-
-	/* redirect stdout */
-	Common_redirectStdoutForce(acOutName, "server");
-	Common_redirectStderrForce(acOutName, "server");
-	assert(Common_sendFile(iSockFD, acOutName) == SUCCESS);
+
+/*--------------------------------------------------------------------*/
+
+/* answer the jobwait of oSession, whose job has finished, with the
+   job's exit status. Return 0 (FALSE) if the session should be
+   closed */
+static int Server_finishWait(Session_T oSession)
+{
+  JobTab_T oJobs = Session_getJobTab(oSession);
+  int iJob = Session_getWaitJob(oSession);
+
+  Session_setWaitJob(oSession, 0);
+  if (!Server_beginCapture(oSession))
+    return FALSE;
+  Server_restoreOutput();
+  return Server_sendOutput(oSession, JobTab_getStatus(oJobs, iJob)) == SUCCESS;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* send what background job iJob of oSession has printed since the last
+   time, straight from its output file, ahead of the rest of the
+   answer. A finished job whose output is all sent is forgotten.
+   Return 0 (FALSE) if the session should be closed */
+static int Server_sendJobOutput(Session_T oSession, int iJob)
+{
+  JobTab_T oJobs = Session_getJobTab(oSession);
+  pid_t iPid = JobTab_getPid(oJobs, iJob);
+  char acChunk[MAX_CHUNK];
+  ssize_t iGot = 0;
+  int iRet = SUCCESS;
+
+  /* a legacy client's answer is the scratch file stdout goes to */
+  if (!Server_beginTransfer(oSession))
+    return FALSE;
+  while ((iRet == SUCCESS) &&
+	 ((iGot = JobTab_readOutput(oJobs, iJob, acChunk, MAX_CHUNK)) > 0)) {
+    if (Session_getProtocol(oSession) == PROTO_VERSION_LEGACY)
+      iRet = (Common_writen(1, acChunk, (size_t) iGot) == FAILURE) ?
+	FAILURE : SUCCESS;
+    else
+      iRet = Proto_sendBytes(Session_getSockFD(oSession),
+			     Session_getRequestId(oSession), acChunk, iGot);
+  }
+  if (!Server_endTransfer(oSession))
+    iRet = FAILURE;
+
+  if ((iGot == 0) && (iPid == 0))
+    JobTab_remove(oJobs, iJob);
+  return iRet == SUCCESS;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* send SIGTERM to every process of background job iJob of oSession.
+   Return the exit status of jobkill */
+static int Server_killJob(Session_T oSession, int iJob)
+{
+  pid_t iPid = JobTab_getPid(Session_getJobTab(oSession), iJob);
+
+  if (iPid == 0) {
+    fprintf(stderr, "server: jobkill: %d: job has finished\n", iJob);
+    return EXIT_FAILURE;
+  }
+  if (kill(-iPid, SIGTERM) == -1) {
+    perror("server: jobkill");
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* receive a file from remote client into the upload store, which
+   links it into place, or straight into pcDest if the store is off. A
+   client that offers the digest of the file first is spared the upload
+   if the store has it, and otherwise only sends what pcDest lacks if
+   it speaks delta bodies, or what an interrupted upload of the same
+   contents did not get to. Several files or a directory arrive as
+   one archive, unpacked under the current directory. Return 0 (FALSE)
+   if the session should be closed */
+static int Server_handleSend(Session_T oSession, char *pcDest)
+{
+  int iSockFD = Session_getSockFD(oSession);
+  uint32_t uId = Session_getRequestId(oSession);
+  RecvBuf_T oBuf = Session_getRecvBuf(oSession);
+  unsigned char aucDigest[PROTO_DIGEST_SIZE];
+  unsigned char aucStaged[PROTO_DIGEST_SIZE];
+  char acTemp[PATH_MAX];
+  char acKey[STAGE_KEY_SIZE];
+  char *pcInto = pcDest;
+  char *pcKey = NULL;
+  ProtoHeader sHeader;
+  uint64_t uSize = 0;
+  uint64_t uStaged = 0;
+  uint64_t uHave = 0;
+  int iBaseFD = -1;
+  int iDelta = FALSE;
+  int iStatus = 0;
+  int iRet = TRUE;
+
+  if (Store_makeTemp(acTemp, sizeof(acTemp)) == SUCCESS)
+    pcInto = acTemp;
+
+  if (Session_getProtocol(oSession) == PROTO_VERSION_LEGACY) {
+    iRet = (Common_recvFile(oBuf, pcInto) == SUCCESS);
+    if (iRet && (pcInto != pcDest))
+      Store_put(pcInto, pcDest); /* the old protocol has no answer */
+  }
+  else if ((Session_getProtocol(oSession) >= PROTO_VERSION_ARCHIVE) &&
+	   (Proto_peekHeader(oBuf, &sHeader) == RECVBUF_OK) &&
+	   (sHeader.eType == PROTO_ARCHIVE)) {
+    /* several files, or a directory: unpacked where they were named */
+    iRet = (Archive_recv(oBuf, uId, &iStatus) == SUCCESS) &&
+      (Proto_sendEnd(iSockFD, uId, iStatus) == SUCCESS);
+  }
+  else {
+    if ((Session_getProtocol(oSession) >= PROTO_VERSION_HAVE) &&
+	(Proto_peekHeader(oBuf, &sHeader) == RECVBUF_OK) &&
+	(sHeader.eType == PROTO_HAVE)) {
+      if (Proto_readHave(oBuf, uId, aucDigest, &uSize) != RECVBUF_OK)
+	iRet = FALSE;
+      else if ((pcInto != pcDest) &&
+	       (Store_fetch(aucDigest, uSize, pcDest) == SUCCESS)) {
+	return Proto_sendEnd(iSockFD, uId, 0) == SUCCESS;
+      }
+      else if (Session_getProtocol(oSession) >= PROTO_VERSION_DELTA) {
+	iBaseFD = open(pcDest, O_RDONLY | O_CLOEXEC);
+	if (Session_getProtocol(oSession) >= PROTO_VERSION_RESUME) {
+	  Stage_keyForContents(aucDigest, uSize, acKey);
+	  pcKey = acKey;
+	}
+	/* an interrupted upload of the same contents only needs the rest */
+	if ((pcKey != NULL) &&
+	    (Stage_lookup(pcKey, aucStaged, &uStaged, &uHave) == SUCCESS) &&
+	    (uStaged == uSize))
+	  iRet = (Proto_sendResume(iSockFD, uId, aucDigest, uSize, uHave) == SUCCESS);
+	else
+	  iRet = (Delta_sendSigs(iSockFD, uId, iBaseFD) == SUCCESS);
+	iDelta = TRUE;
       }
+      else
+	iRet = (Proto_writeFrame(iSockFD, PROTO_WANT, 0, uId, NULL, 0) == SUCCESS);
+    }
+    if (iDelta) {
+      iRet = iRet &&
+	(Delta_recvBody(oBuf, uId, iBaseFD, pcInto, pcKey, &iStatus) == SUCCESS);
+      if (iBaseFD != -1)
+	close(iBaseFD);
+    }
+    else
+      iRet = iRet && (Proto_recvBody(oBuf, uId, pcInto, &iStatus) == SUCCESS);
+    if (iRet && (pcInto != pcDest) && (iStatus == 0))
+      iStatus = Store_put(pcInto, pcDest);
+    iRet = iRet && (Proto_sendEnd(iSockFD, uId, iStatus) == SUCCESS);
   }
-  else if (Common_handleSetenv(oCmds, "server")) /* set environment variable value */
-    { 
-      Common_makeOutName(iSockFD, acOutName);
-      assert(Common_sendFile(iSockFD, acOutName) == SUCCESS);
+  if (pcInto != pcDest) /* anything the store did not take */
+    unlink(pcInto);
+  return iRet;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* send a file to remote client, as a delta against its old copy if it
+   speaks delta bodies, or the rest of it if an interrupted transfer
+   left the client part of it. A large file the client has no copy of
+   is offered for a striped download instead, if it asked for one, and
+   a directory is sent as an archive of everything in it. Return 0
+   (FALSE) if the session should be closed */
+static int Server_handleRecv(Session_T oSession, char *pcSource)
+{
+  int iSockFD = Session_getSockFD(oSession);
+  uint32_t uId = Session_getRequestId(oSession);
+  RecvBuf_T oBuf = Session_getRecvBuf(oSession);
+  unsigned char aucDigest[PROTO_DIGEST_SIZE];
+  unsigned char aucHave[PROTO_DIGEST_SIZE];
+  DeltaSigs_T oSigs = NULL;
+  ProtoHeader sHeader;
+  uint64_t uSize = 0;
+  uint64_t uHave = 0;
+  uint64_t uOffset = 0;
+  StripeFile sFile;
+  struct stat sStat;
+  char acEmpty[1];
+  int iResume = FALSE;
+  int iStripe = FALSE;
+  int iSent = 0;
+  int iRet = TRUE;
+
+  if (Session_getProtocol(oSession) == PROTO_VERSION_LEGACY) {
+    if (Common_sendFile(iSockFD, pcSource) == FAILURE)
+      iRet = (Common_sendFile(iSockFD, EMPTYFILE) == SUCCESS);
+  }
+  else if (Session_getProtocol(oSession) >= PROTO_VERSION_DELTA) {
+    /* a client that kept part of the file from an interrupted transfer
+       asks for the rest, which it gets if the file is still the same */
+    if ((Session_getProtocol(oSession) >= PROTO_VERSION_RESUME) &&
+	(Proto_peekHeader(oBuf, &sHeader) == RECVBUF_OK) &&
+	(sHeader.eType == PROTO_RESUME)) {
+      if (Proto_readResume(oBuf, uId, aucDigest, &uSize, &uOffset) != RECVBUF_OK)
+	iRet = FALSE;
+      else
+	iResume = (Common_hashFile(pcSource, aucHave, &uHave) == SUCCESS) &&
+	  (uHave == uSize) &&
+	  (memcmp(aucHave, aucDigest, PROTO_DIGEST_SIZE) == 0);
     }
-  else if (Common_handleUnsetenv(oCmds, "server")) /* unset environment variable value */
-    { 
-      Common_makeOutName(iSockFD, acOutName);
-      assert(Common_sendFile(iSockFD, acOutName) == SUCCESS);
+
+    /* a client that can fetch a large file over several connections
+       says so */
+    if (iRet && (Session_getProtocol(oSession) >= PROTO_VERSION_STRIPE) &&
+	(Proto_peekHeader(oBuf, &sHeader) == RECVBUF_OK) &&
+	(sHeader.eType == PROTO_STRIPE)) {
+      iStripe = TRUE;
+      if (Proto_readFrame(oBuf, &sHeader, acEmpty, 0) != RECVBUF_OK)
+	iRet = FALSE;
+    }
+
+    /* the client's old copy comes next, even if it has none */
+    if (!iRet || (Delta_recvSigs(oBuf, uId, &oSigs) != RECVBUF_OK))
+      iRet = FALSE;
+    else {
+      if (iResume)
+	iSent = Delta_sendRange(iSockFD, uId, pcSource, aucDigest, uSize,
+				uOffset);
+      else if (iStripe && (oSigs == NULL) && Stripe_describe(pcSource, &sFile))
+	iSent = Stripe_sendOffer(iSockFD, uId, &sFile);
+      else if ((Session_getProtocol(oSession) >= PROTO_VERSION_ARCHIVE) &&
+	       (stat(pcSource, &sStat) == 0) && S_ISDIR(sStat.st_mode))
+	iSent = Archive_send(iSockFD, uId, &pcSource, 1);
+      else
+	iSent = Delta_sendBody(iSockFD, uId, pcSource, oSigs, NULL);
+      iRet = (iSent != FAILURE) &&
+	(Proto_sendEnd(iSockFD, uId, iSent) == SUCCESS);
+      Delta_freeSigs(oSigs);
     }
-  else if (strcmp((char*) Syn_returnValue((Cmd_T) DynArray_get(oCmds, 0)), "exit") == 0) { /* exit program */
-    Common_makeOutName(iSockFD, acOutName);
-    Common_deleteFile(acOutName, "server");
-    assert(Common_handleExit(oCmds, "server")); /* exit program */
   }
-  else 
-    {
-      Common_exec(oCmds, "server"); 
-      Common_makeOutName(iSockFD, acOutName);
-      assert(Common_sendFile(iSockFD, acOutName) == SUCCESS);
+  else {
+    iSent = Proto_sendData(iSockFD, uId, pcSource);
+    iRet = (iSent != FAILURE) &&
+      (Proto_sendEnd(iSockFD, uId, iSent) == SUCCESS);
+  }
+  return iRet;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* send the range of a striped download that pcRequest, of uLength
+   bytes, asks for. The event model cannot send several ranges at
+   once, so it first hands the connection to a process of its own,
+   which serves it like the fork model does. Return 0 (FALSE) if the
+   session should be closed */
+static int Server_handleStripe(Session_T oSession, const char *pcRequest,
+			       uint64_t uLength)
+{
+  int iSockFD = Session_getSockFD(oSession);
+  pid_t iPid = 0;
+
+  if (iEventMode) {
+    fflush(NULL);
+    if ((iPid = fork()) == -1) {
+      dprintf(iSavedErr, "server: fork: %s\n", strerror(errno));
+      return FALSE;
+    }
+    if (iPid != 0) { /* the child has the connection now */
+      epoll_ctl(iEpollFD, EPOLL_CTL_DEL, iSockFD, NULL);
+      return FALSE;
     }
+
+    Server_detach(oSession);
+    if (Stripe_sendRange(iSockFD, Session_getRequestId(oSession),
+			 pcRequest, uLength) == SUCCESS)
+      Server_serveClient(oSession);
+    else
+      Server_closeSession(oSession);
+    exit(EXIT_SUCCESS);
+  }
+
+  return (Stripe_sendRange(iSockFD, Session_getRequestId(oSession),
+			   pcRequest, uLength) == SUCCESS);
+}
+
+/*--------------------------------------------------------------------*/
+
+/* run the file transfer psCmd of oSession, for the event model, in a
+   child of its own: a client that stalls in the middle of a file
+   holds up nobody but itself. The session takes no command until
+   Server_finishTransfer has taken back the bytes that the child
+   received after the transfer. Return 0 (FALSE) if the session should
+   be closed */
+static int Server_startTransfer(Session_T oSession, SynCmd *psCmd)
+{
+  int iTransferFD = -1;
+  pid_t iPid = 0;
+  int iRet = TRUE;
+
+  if ((iTransferFD = Common_createScratch("server")) == -1) {
+    dprintf(iSavedErr, "server: scratch file: %s\n", strerror(errno));
+    return FALSE;
+  }
+  fflush(NULL);
+  if ((iPid = fork()) == -1) {
+    dprintf(iSavedErr, "server: fork: %s\n", strerror(errno));
+    close(iTransferFD);
+    return FALSE;
+  }
+  if (iPid != 0) { /* see Server_reapChildren */
+    Session_setPid(oSession, iPid);
+    Session_setTransferFD(oSession, iTransferFD);
+    return TRUE;
+  }
+
+  Server_detach(oSession);
+  if (psCmd->eVerb == VERB_SEND)
+    iRet = Server_handleSend(oSession, psCmd->ppcArgv[1]);
+  else
+    iRet = Server_handleRecv(oSession, psCmd->ppcArgv[1]);
+
+  /* pipelined commands may have come in behind the file */
+  if (iRet &&
+      (RecvBuf_save(Session_getRecvBuf(oSession), iTransferFD) == -1))
+    iRet = FALSE;
+  exit(iRet ? EXIT_SUCCESS : EXIT_FAILURE);
+}
+
+/*--------------------------------------------------------------------*/
+
+/* take oSession back from the child that ran its file transfer and
+   ended with iWaitStatus, along with the bytes it received and did not
+   consume. Return 0 (FALSE) if the session should be closed */
+static int Server_finishTransfer(Session_T oSession, int iWaitStatus)
+{
+  int iTransferFD = Session_getTransferFD(oSession);
+  int iRet = (Server_exitStatus(iWaitStatus) == EXIT_SUCCESS);
+
+  Session_setPid(oSession, 0);
+  Session_setTransferFD(oSession, -1);
+  iRet = iRet && (lseek(iTransferFD, 0, SEEK_SET) == 0) &&
+    (RecvBuf_restore(Session_getRecvBuf(oSession), iTransferFD) == 0);
+  close(iTransferFD);
+
+  /* the child shares the socket, and left it blocking for good */
+  Session_setBlocking(oSession, FALSE);
+  return iRet;
 }
 
 /*--------------------------------------------------------------------*/
 
-/* receive a command from remote client */
-static int Server_recvCommand(int iSockFD, char *acLine)
+/* let go of everything of the event model but the client of oSession,
+   in a child that serves that client from now on, over a blocking
+   socket without a time limit, like the fork model does */
+static void Server_detach(Session_T oSession)
 {
+  int iSockFD = Session_getSockFD(oSession);
   int i = 0;
-  int iRead = 0;
 
-  while (i < MAX_LINE_SIZE - 1) {
-    iRead = recv(iSockFD, acLine + i, 1, 0);
-    
-    if (iRead < 0) {
-      perror("error reading command");
-      return FAILURE;
+  for (i = 0; i < DynArray_getLength(oSessions); i++)
+    if ((i != iSockFD) && (DynArray_get(oSessions, i) != NULL))
+      close(i);
+  close(iListenSock);
+  close(iEpollFD);
+  iEventMode = FALSE;
+  Session_setBlocking(oSession, TRUE);
+  Session_flush(oSession); /* what the event model had queued, if any */
+}
+
+/*--------------------------------------------------------------------*/
+
+/* collect what the next command of oSession prints in its anonymous
+   scratch file, to be sent once the command is done: a legacy client
+   has to be told the size up front, and a command that runs in this
+   process could not print more than a pipe holds into a pipe that
+   only this process empties. A command started in a child prints into
+   a pipe instead, for a framed client (see Server_beginRelay). Return
+   0 (FALSE) if the session should be closed */
+static int Server_beginCapture(Session_T oSession)
+{
+  int iScratchFD = -1;
+
+  fflush(NULL);
+  if (((iScratchFD = Session_getScratch(oSession)) == -1) ||
+      !Server_openNamedScratch(oSession) ||
+      (ftruncate(iScratchFD, 0) == -1)) {
+    dprintf(iSavedErr, "server: scratch file: %s\n", strerror(errno));
+    return FALSE;
+  }
+  lseek(iScratchFD, 0, SEEK_SET);
+  dup2(iScratchFD, 1); /* one offset: stdout and stderr interleave */
+  dup2(iScratchFD, 2);
+  return TRUE;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* send what the command of oSession about to be started in a child
+   prints to a framed client as the command writes it, through a pipe
+   that is relayed to the client, after what has been printed so far.
+   A legacy client's command prints into the scratch file all along.
+   Return 0 (FALSE) if the session should be closed */
+static int Server_beginRelay(Session_T oSession)
+{
+  int aiPipe[2];
+
+  if (Session_getProtocol(oSession) == PROTO_VERSION_LEGACY)
+    return TRUE;
+  if (!Server_sendScratch(oSession))
+    return FALSE;
+  if (pipe2(aiPipe, O_CLOEXEC) == -1) {
+    dprintf(iSavedErr, "server: pipe: %s\n", strerror(errno));
+    return FALSE;
+  }
+  dup2(aiPipe[1], 1);
+  dup2(aiPipe[1], 2);
+  close(aiPipe[1]); /* the command and our stdout/stderr are the writers */
+  Session_setOutFD(oSession, aiPipe[0]);
+  return TRUE;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* send what the command of oSession, whose client speaks the framed
+   protocol, has printed into the scratch file so far, and empty the
+   file. Return 0 (FALSE) if the session should be closed */
+static int Server_sendScratch(Session_T oSession)
+{
+  int iScratchFD = Session_getScratch(oSession);
+  char acChunk[MAX_CHUNK];
+  ssize_t iGot = 0;
+  off_t iOffset = 0;
+  int iRet = SUCCESS;
+
+  fflush(NULL);
+  if (!Server_beginTransfer(oSession))
+    return FALSE;
+  while ((iRet == SUCCESS) &&
+	 ((iGot = pread(iScratchFD, acChunk, MAX_CHUNK, iOffset)) > 0)) {
+    iRet = Proto_sendBytes(Session_getSockFD(oSession),
+			   Session_getRequestId(oSession), acChunk, iGot);
+    iOffset += iGot;
+  }
+  if (!Server_endTransfer(oSession))
+    iRet = FAILURE;
+  if ((iGot == -1) || (ftruncate(iScratchFD, 0) == -1))
+    iRet = FAILURE;
+  lseek(iScratchFD, 0, SEEK_SET);
+  return iRet == SUCCESS;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* send the output waiting in the pipe of oSession to its client, one
+   PROTO_DATA frame per read, until the pipe would block or the client
+   has not taken the last frame yet (Server_flushOutput comes back for
+   the rest then). At end of file, close the pipe and, if the command
+   has been reaped already, end the answer with its status. Return 0
+   (FALSE) if the session should be closed */
+static int Server_relayOutput(Session_T oSession)
+{
+  int iSockFD = Session_getSockFD(oSession);
+  uint32_t uId = Session_getRequestId(oSession);
+  int iOutFD = Session_getOutFD(oSession);
+  char acChunk[MAX_CHUNK];
+  ssize_t iGot = 0;
+  int iRet = SUCCESS;
+
+  if (Session_isPending(oSession))
+    return TRUE;
+  while ((iRet == SUCCESS) && !Session_isPending(oSession) &&
+	 (((iGot = read(iOutFD, acChunk, MAX_CHUNK)) > 0) ||
+	  ((iGot == -1) && (errno == EINTR)))) {
+    if (iGot == -1)
+      continue;
+    Cache_addOutput(Session_getJob(oSession), acChunk, (size_t) iGot);
+    if (!Server_beginTransfer(oSession))
+      return FALSE;
+    iRet = Proto_sendBytes(iSockFD, uId, acChunk, iGot);
+    if (!Server_endTransfer(oSession))
+      iRet = FAILURE;
+  }
+  if ((iRet == SUCCESS) && (iGot == 0)) { /* command done writing */
+    Server_dropOutput(oSession);
+    if (Session_getPid(oSession) == 0) {
+      Server_endJob(oSession);
+      if (!Server_beginTransfer(oSession))
+	return FALSE;
+      iRet = Proto_sendEnd(iSockFD, uId, Session_getStatus(oSession));
+      if (!Server_endTransfer(oSession))
+	iRet = FAILURE;
     }
-    
-    assert(iRead == 1);
-    //printf("%d: %c\n", i, acLine[i]); fflush(NULL); // DEBUG
+  }
+  return iRet == SUCCESS;
+}
 
-    if (acLine[i] == '\n') {
-      break;
+/*--------------------------------------------------------------------*/
+
+/* close the output pipe of oSession, if it has one */
+static void Server_dropOutput(Session_T oSession)
+{
+  if (Session_getOutFD(oSession) == -1)
+    return;
+  if (iEventMode) /* the slot may be taken by the next pipe or socket */
+    Server_setSlot(Session_getOutFD(oSession), NULL);
+  close(Session_getOutFD(oSession));
+  Session_setOutFD(oSession, -1);
+}
+
+/*--------------------------------------------------------------------*/
+
+/* end the cache job of oSession's command, which has exited and
+   printed everything: a successful compile is stored along with what
+   it printed, which a legacy client's scratch file still holds */
+static void Server_endJob(Session_T oSession)
+{
+  CacheJob_T oJob = Session_getJob(oSession);
+  char acChunk[MAX_CHUNK];
+  ssize_t iGot = 0;
+  off_t iOffset = 0;
+
+  if (oJob == NULL)
+    return;
+  if (Session_getProtocol(oSession) == PROTO_VERSION_LEGACY)
+    while ((iGot = pread(Session_getScratch(oSession), acChunk, MAX_CHUNK,
+			 iOffset)) > 0) {
+      Cache_addOutput(oJob, acChunk, (size_t) iGot);
+      iOffset += iGot;
     }
-    i++;
+  Cache_end(oJob, Session_getStatus(oSession));
+  Session_setJob(oSession, NULL);
+}
+
+/*--------------------------------------------------------------------*/
+
+/* send the rest of the output of oSession's command to its client,
+   along with the status iStatus of the command */
+static int Server_sendOutput(Session_T oSession, int iStatus)
+{
+  int iSockFD = Session_getSockFD(oSession);
+  int iRet = 0;
+
+  Session_setStatus(oSession, iStatus);
+  if (Session_getProtocol(oSession) != PROTO_VERSION_LEGACY) {
+    if (Session_getOutFD(oSession) != -1) /* the writers are gone */
+      return Server_relayOutput(oSession) ? SUCCESS : FAILURE;
+    Server_endJob(oSession);
+    if (!Server_sendScratch(oSession) || !Server_beginTransfer(oSession))
+      return FAILURE;
+    iRet = Proto_sendEnd(iSockFD, Session_getRequestId(oSession), iStatus);
+    if (!Server_endTransfer(oSession))
+      iRet = FAILURE;
+    return iRet;
+  }
+
+  Server_endJob(oSession);
+  if (!Server_beginTransfer(oSession))
+    return FAILURE;
+  iRet = Common_sendFD(iSockFD, Session_getScratch(oSession));
+  if (!Server_endTransfer(oSession))
+    iRet = FAILURE;
+  Server_removeNamedScratch(oSession);
+  return iRet;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* queue what is written to the socket of oSession from here to
+   Server_endTransfer in its outbox, in the event model: the socket is
+   not blocking, and a client that does not read must not hold up the
+   loop. The outbox takes the socket's descriptor meanwhile, as stdout
+   takes the scratch file for a command, so that the protocol finds the
+   connection's state under the same number. Return 0 (FALSE) if the
+   session should be closed */
+static int Server_beginTransfer(Session_T oSession)
+{
+  int iSockFD = Session_getSockFD(oSession);
+  int iOutboxFD = -1;
+
+  if (!iEventMode)
+    return TRUE;
+  if (((iOutboxFD = Session_getOutbox(oSession)) == -1) ||
+      (lseek(iOutboxFD, 0, SEEK_END) == -1) ||
+      ((iParkedSock = fcntl(iSockFD, F_DUPFD_CLOEXEC, 3)) == -1) ||
+      (dup3(iOutboxFD, iSockFD, O_CLOEXEC) == -1)) {
+    dprintf(iSavedErr, "server: outbox: %s\n", strerror(errno));
+    if (iParkedSock != -1)
+      close(iParkedSock);
+    iParkedSock = -1;
+    return FALSE;
+  }
+  return TRUE;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* put the socket of oSession back under its descriptor, and send what
+   its outbox holds as far as the socket takes it; the rest goes once
+   there is room (see Server_flushOutput). Return 0 (FALSE) if the
+   session should be closed */
+static int Server_endTransfer(Session_T oSession)
+{
+  int iSockFD = Session_getSockFD(oSession);
+  int iRet = TRUE;
+
+  if (!iEventMode)
+    return TRUE;
+  if (dup3(iParkedSock, iSockFD, O_CLOEXEC) == -1) {
+    dprintf(iSavedErr, "server: outbox: %s\n", strerror(errno));
+    iRet = FALSE;
+  }
+  close(iParkedSock);
+  iParkedSock = -1;
+  return iRet && (Session_flush(oSession) == SUCCESS);
+}
+
+/*--------------------------------------------------------------------*/
+
+/* send what the outbox of oSession holds as far as its socket takes
+   it and, once all of it is out, go on relaying the output of a
+   command that stopped for it (see Server_relayOutput). Return 0
+   (FALSE) if the session should be closed */
+static int Server_flushOutput(Session_T oSession)
+{
+  if (Session_flush(oSession) == FAILURE)
+    return FALSE;
+  if (!Session_isPending(oSession) && (Session_getOutFD(oSession) != -1))
+    return Server_relayOutput(oSession);
+  return TRUE;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* put the server's stdout and stderr back after a command */
+static void Server_restoreOutput(void)
+{
+  fflush(NULL);
+  dup2(iSavedOut, 1);
+  dup2(iSavedErr, 2);
+}
+
+/*--------------------------------------------------------------------*/
+
+/* store the path of the named scratch file of oSession, of PATH_MAX
+   bytes, in pcPath. The name is unique among the sessions of the
+   server, as the name of a file of the old server was */
+static void Server_namedScratch(Session_T oSession, char *pcPath)
+{
+  char acName[MAX_NAME];
+  bzero(acName, MAX_NAME);
+
+  Common_makeOutName(iEventMode ? Session_getSockFD(oSession) : getpid(),
+		     acName);
+  snprintf(pcPath, PATH_MAX, "%s/%s", pcNamedDir, acName);
+}
+
+/*--------------------------------------------------------------------*/
+
+/* with -O, make the scratch file of oSession, if its client is a
+   legacy one, a file srvN.out in the starting directory, created
+   afresh for each command, as it was before anonymous scratch files.
+   This is only there for command_bench to compare against. Return 0
+   (FALSE) if it cannot be created, with errno set */
+static int Server_openNamedScratch(Session_T oSession)
+{
+  char acPath[PATH_MAX];
+  int iFD = -1;
+
+  if ((pcNamedDir == NULL) ||
+      (Session_getProtocol(oSession) != PROTO_VERSION_LEGACY))
+    return TRUE;
+  Server_namedScratch(oSession, acPath);
+  if ((iFD = open(acPath, O_RDWR | O_CREAT | O_TRUNC, PERMISSIONS)) == -1)
+    return FALSE;
+  dup3(iFD, Session_getScratch(oSession), O_CLOEXEC);
+  close(iFD);
+  return TRUE;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* with -O, remove the named scratch file of oSession once its answer
+   has been sent, by running rm -f on it as the server used to */
+static void Server_removeNamedScratch(Session_T oSession)
+{
+  char acPath[PATH_MAX];
+  int iWaitStatus = 0;
+  pid_t iPid = 0;
+
+  if (pcNamedDir == NULL)
+    return;
+  Server_namedScratch(oSession, acPath);
+  fflush(NULL);
+  if ((iPid = fork()) == 0) {
+    execl("/bin/rm", "rm", "-f", acPath, (char *) NULL);
+    _exit(EXIT_FAILURE);
   }
-  acLine[i] = '\0';
-  return SUCCESS;
+  if (iPid > 0)
+    waitpid(iPid, &iWaitStatus, 0);
 }
+
+/*--------------------------------------------------------------------*/
+
+/* report how many reads a connection's commands took, what
+   compression saved, and what io_uring has done in this process */
+static void Server_logStats(Session_T oSession)
+{
+  long lCommands = Session_getCommands(oSession);
+  long lReads = RecvBuf_getReads(Session_getRecvBuf(oSession));
+
+  ProtoStats sStats;
+  UringStats sRing;
+
+  dprintf(iSavedErr, "server: fd %d: %ld commands, %ld reads (%.2f per command)\n",
+	  Session_getSockFD(oSession), lCommands, lReads,
+	  lCommands ? (double) lReads / lCommands : 0.0);
+
+  /* what compression saved on the wire, and what it cost */
+  if (Proto_getStats(Session_getSockFD(oSession), &sStats))
+    dprintf(iSavedErr, "server: fd %d: compression: sent %lld bytes as %lld "
+	    "(ratio %.2f, %lld of %lld frames packed, %.1f ms cpu), "
+	    "received %lld bytes as %lld (ratio %.2f, %.1f ms cpu)\n",
+	    Session_getSockFD(oSession), sStats.llRawOut, sStats.llWireOut,
+	    sStats.llWireOut ? (double) sStats.llRawOut / sStats.llWireOut : 1.0,
+	    sStats.llPackedOut, sStats.llFramesOut, sStats.llNanosOut / 1e6,
+	    sStats.llRawIn, sStats.llWireIn,
+	    sStats.llWireIn ? (double) sStats.llRawIn / sStats.llWireIn : 1.0,
+	    sStats.llNanosIn / 1e6);
+
+  /* how many system calls the ring saved */
+  Uring_getStats(&sRing);
+  if (sRing.llOps > 0)
+    dprintf(iSavedErr, "server: fd %d: io_uring: %lld bytes in %lld reads "
+	    "and writes, %lld io_uring_enter calls (%.2f per operation)\n",
+	    Session_getSockFD(oSession), sRing.llBytes, sRing.llOps,
+	    sRing.llEnters, (double) sRing.llEnters / sRing.llOps);
+}
+
+/*--------------------------------------------------------------------*/
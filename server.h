@@ -2,15 +2,39 @@
 #define SERVER_INCLUDED 1
 
 #include "common.h"
+#include "session.h"
+#include "build.h"
+#include "store.h"
+#include "delta.h"
+#include "stage.h"
+#include "stripe.h"
+#include "archive.h"
+#include "uring.h"
+#include <limits.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <netinet/tcp.h>
 
 #ifndef MAX_PENDING
 #define MAX_PENDING 128
 #endif 
 
+#ifndef MAX_EVENTS
+#define MAX_EVENTS 64
+#endif
+
 #ifndef MAX_NAME
 #define MAX_NAME 20
 #endif
 
+#define SERVER_MODE_EVENT "event"
+#define SERVER_MODE_FORK "fork"
+
+#ifndef MAX_CHUNK
+#define MAX_CHUNK 65536 /* largest piece of command output sent at once */
+#endif
+
 /* function declarations */
 int Server_compile(char *pcSrc, char *pcExec); /* compile file */
 
@@ -0,0 +1,741 @@
+/*--------------------------------------------------------------------*/
+/* session.c                                                          */
+/* Per-connection state for the event-driven server                   */
+/*--------------------------------------------------------------------*/
+
+#include "session.h"
+
+extern char **environ;
+
+/*--------------------------------------------------------------------*/
+
+struct Session
+
+/* A session is everything the server remembers about one connected
+   client between two commands. */
+
+{
+   int iSockFD;
+   /* Connected socket of the client. */
+
+   char *pcCwd;
+   /* Current directory of the session. */
+
+   DynArray_T oEnv;
+   /* Environment of the session, as "NAME=VALUE" strings. */
+
+   int iScratchFD;
+   /* Anonymous scratch file command output goes to for a legacy
+      client, and the output of the server's own commands for any
+      client, or -1 if not created yet. */
+
+   pid_t iPid;
+   /* Command being run for the session, or 0 if idle. */
+
+   int iOutFD;
+   /* Read end of the pipe the output of the current command comes
+      through, or -1. */
+
+   int iStatus;
+   /* Exit status of the last command. */
+
+   RecvBuf_T oRecvBuf;
+   /* Bytes received from the client and not consumed yet. */
+
+   Arena_T oArena;
+   /* Memory of the tokens and command words of the current line. */
+
+   int iProtocol;
+   /* Protocol version the client speaks, or SESSION_PROTOCOL_UNKNOWN
+      before its first bytes arrived. */
+
+   uint32_t uRequestId;
+   /* Id of the request being served. */
+
+   long lCommands;
+   /* Number of commands received. */
+
+   CacheJob_T oJob;
+   /* Cache job of the command being run, or NULL. */
+
+   JobTab_T oJobs;
+   /* Background jobs of the session. */
+
+   int iWaitJob;
+   /* Background job the session waits for, or 0. */
+
+   int iTransferFD;
+   /* Anonymous file the child running a file transfer hands back the
+      bytes it received but did not consume through, or -1 if no
+      transfer is running. */
+
+   int iOutboxFD;
+   /* Anonymous file the answers to the client are queued in until the
+      socket takes them, or -1 if not created yet. */
+
+   off_t lOutboxSent;
+   /* How much of the outbox has been sent. */
+};
+
+/*--------------------------------------------------------------------*/
+
+static void Session_freeString(void *pvItem, void *pvExtra)
+
+/* Free string pvItem. pvExtra is unused. */
+
+{
+   free(pvItem);
+}
+
+/*--------------------------------------------------------------------*/
+
+Session_T Session_new(int iSockFD)
+
+/* Return a new session for connected socket iSockFD, or NULL if
+   insufficient memory is available. */
+
+{
+   Session_T oSession = NULL;
+   char *pcVar = NULL;
+   int i;
+
+   oSession = (Session_T)calloc(1, sizeof(struct Session));
+   if (oSession == NULL)
+      return NULL;
+
+   oSession->iSockFD = iSockFD;
+   oSession->iProtocol = SESSION_PROTOCOL_UNKNOWN;
+   oSession->iOutFD = -1;
+   oSession->pcCwd = getcwd(NULL, 0);
+   oSession->iScratchFD = -1;
+   oSession->iTransferFD = -1;
+   oSession->iOutboxFD = -1;
+   oSession->oEnv = DynArray_new(0);
+   oSession->oRecvBuf = RecvBuf_new(iSockFD);
+   oSession->oArena = Arena_new();
+   oSession->oJobs = JobTab_new();
+   if ((oSession->pcCwd == NULL) || (oSession->oEnv == NULL) ||
+       (oSession->oRecvBuf == NULL) || (oSession->oArena == NULL) ||
+       (oSession->oJobs == NULL))
+   {
+      Session_free(oSession);
+      return NULL;
+   }
+
+   /* Start from a copy of the server's environment. */
+   for (i = 0; environ[i] != NULL; i++)
+   {
+      pcVar = strdup(environ[i]);
+      if ((pcVar == NULL) || (! DynArray_add(oSession->oEnv, pcVar)))
+      {
+         free(pcVar);
+         Session_free(oSession);
+         return NULL;
+      }
+   }
+
+   return oSession;
+}
+
+/*--------------------------------------------------------------------*/
+
+void Session_free(Session_T oSession)
+
+/* Free oSession. Does not close its socket. */
+
+{
+   assert(oSession != NULL);
+
+   if (oSession->oEnv != NULL)
+   {
+      DynArray_map(oSession->oEnv, Session_freeString, NULL);
+      DynArray_free(oSession->oEnv);
+   }
+   if (oSession->oRecvBuf != NULL)
+      RecvBuf_free(oSession->oRecvBuf);
+   if (oSession->oArena != NULL)
+      Arena_free(oSession->oArena);
+   if (oSession->oJobs != NULL)
+      JobTab_free(oSession->oJobs);
+   free(oSession->pcCwd);
+   if (oSession->iScratchFD != -1)
+      close(oSession->iScratchFD);
+   if (oSession->iTransferFD != -1)
+      close(oSession->iTransferFD);
+   if (oSession->iOutboxFD != -1)
+      close(oSession->iOutboxFD);
+   free(oSession);
+}
+
+/*--------------------------------------------------------------------*/
+
+int Session_getSockFD(Session_T oSession)
+
+/* Return the socket of oSession. */
+
+{
+   assert(oSession != NULL);
+   return oSession->iSockFD;
+}
+
+/*--------------------------------------------------------------------*/
+
+int Session_getScratch(Session_T oSession)
+
+/* Return the scratch file of oSession, creating it on first use, or
+   -1 if it cannot be created. */
+
+{
+   assert(oSession != NULL);
+
+   if (oSession->iScratchFD == -1)
+      oSession->iScratchFD = Common_createScratch("server");
+   return oSession->iScratchFD;
+}
+
+/*--------------------------------------------------------------------*/
+
+pid_t Session_getPid(Session_T oSession)
+
+/* Return the pid of the command oSession is running, or 0 if it is
+   idle. */
+
+{
+   assert(oSession != NULL);
+   return oSession->iPid;
+}
+
+/*--------------------------------------------------------------------*/
+
+void Session_setPid(Session_T oSession, pid_t iPid)
+
+/* Record that oSession is running command iPid, or is idle again if
+   iPid is 0. */
+
+{
+   assert(oSession != NULL);
+   assert(iPid >= 0);
+   oSession->iPid = iPid;
+}
+
+/*--------------------------------------------------------------------*/
+
+int Session_getOutFD(Session_T oSession)
+
+/* Return the descriptor the output of the current command of oSession
+   comes through, or -1. */
+
+{
+   assert(oSession != NULL);
+   return oSession->iOutFD;
+}
+
+/*--------------------------------------------------------------------*/
+
+void Session_setOutFD(Session_T oSession, int iOutFD)
+
+/* Record that the output of the current command of oSession comes
+   through iOutFD, or that it is all in if iOutFD is -1. */
+
+{
+   assert(oSession != NULL);
+   oSession->iOutFD = iOutFD;
+}
+
+/*--------------------------------------------------------------------*/
+
+int Session_getStatus(Session_T oSession)
+
+/* Return the exit status of the last command of oSession. */
+
+{
+   assert(oSession != NULL);
+   return oSession->iStatus;
+}
+
+/*--------------------------------------------------------------------*/
+
+void Session_setStatus(Session_T oSession, int iStatus)
+
+/* Record that the last command of oSession ended with iStatus. */
+
+{
+   assert(oSession != NULL);
+   oSession->iStatus = iStatus;
+}
+
+/*--------------------------------------------------------------------*/
+
+RecvBuf_T Session_getRecvBuf(Session_T oSession)
+
+/* Return the receive buffer in front of the socket of oSession. */
+
+{
+   assert(oSession != NULL);
+   return oSession->oRecvBuf;
+}
+
+/*--------------------------------------------------------------------*/
+
+Arena_T Session_getArena(Session_T oSession)
+
+/* Return the arena the tokens and command words of the lines of
+   oSession are allocated from. */
+
+{
+   assert(oSession != NULL);
+   return oSession->oArena;
+}
+
+/*--------------------------------------------------------------------*/
+
+int Session_getProtocol(Session_T oSession)
+
+/* Return the protocol version the client of oSession speaks. */
+
+{
+   assert(oSession != NULL);
+   return oSession->iProtocol;
+}
+
+/*--------------------------------------------------------------------*/
+
+void Session_setProtocol(Session_T oSession, int iProtocol)
+
+/* Record that the client of oSession speaks protocol version
+   iProtocol. */
+
+{
+   assert(oSession != NULL);
+   oSession->iProtocol = iProtocol;
+}
+
+/*--------------------------------------------------------------------*/
+
+uint32_t Session_getRequestId(Session_T oSession)
+
+/* Return the id of the request oSession is serving. */
+
+{
+   assert(oSession != NULL);
+   return oSession->uRequestId;
+}
+
+/*--------------------------------------------------------------------*/
+
+void Session_setRequestId(Session_T oSession, uint32_t uId)
+
+/* Record that oSession is serving request uId. */
+
+{
+   assert(oSession != NULL);
+   oSession->uRequestId = uId;
+}
+
+/*--------------------------------------------------------------------*/
+
+void Session_countCommand(Session_T oSession)
+
+/* Count one more command received by oSession. */
+
+{
+   assert(oSession != NULL);
+   oSession->lCommands++;
+}
+
+/*--------------------------------------------------------------------*/
+
+long Session_getCommands(Session_T oSession)
+
+/* Return the number of commands oSession has received. */
+
+{
+   assert(oSession != NULL);
+   return oSession->lCommands;
+}
+
+/*--------------------------------------------------------------------*/
+
+CacheJob_T Session_getJob(Session_T oSession)
+
+/* Return the cache job of the command oSession is running, or NULL. */
+
+{
+   assert(oSession != NULL);
+   return oSession->oJob;
+}
+
+/*--------------------------------------------------------------------*/
+
+void Session_setJob(Session_T oSession, CacheJob_T oJob)
+
+/* Set the cache job of the command oSession is running to oJob. */
+
+{
+   assert(oSession != NULL);
+   oSession->oJob = oJob;
+}
+
+/*--------------------------------------------------------------------*/
+
+JobTab_T Session_getJobTab(Session_T oSession)
+
+/* Return the table of background jobs of oSession. */
+
+{
+   assert(oSession != NULL);
+   return oSession->oJobs;
+}
+
+/*--------------------------------------------------------------------*/
+
+int Session_getWaitJob(Session_T oSession)
+
+/* Return the number of the background job oSession waits for, or 0 if
+   it waits for none. */
+
+{
+   assert(oSession != NULL);
+   return oSession->iWaitJob;
+}
+
+/*--------------------------------------------------------------------*/
+
+void Session_setWaitJob(Session_T oSession, int iJob)
+
+/* Record that oSession waits for background job iJob, or for none if
+   iJob is 0. */
+
+{
+   assert(oSession != NULL);
+   assert(iJob >= 0);
+   oSession->iWaitJob = iJob;
+}
+
+/*--------------------------------------------------------------------*/
+
+int Session_getTransferFD(Session_T oSession)
+
+/* Return the file the transfer child of oSession hands back unconsumed
+   bytes through, or -1 if no transfer is running. */
+
+{
+   assert(oSession != NULL);
+   return oSession->iTransferFD;
+}
+
+/*--------------------------------------------------------------------*/
+
+void Session_setTransferFD(Session_T oSession, int iTransferFD)
+
+/* Record that a transfer child of oSession hands back unconsumed bytes
+   through iTransferFD, or that none is running if iTransferFD is -1.
+   Does not close the previous descriptor. */
+
+{
+   assert(oSession != NULL);
+   oSession->iTransferFD = iTransferFD;
+}
+
+/*--------------------------------------------------------------------*/
+
+int Session_setBlocking(Session_T oSession, int iBlocking)
+
+/* Switch the socket of oSession between blocking and non-blocking
+   mode. Return SUCCESS or FAILURE. */
+
+{
+   int iFlags;
+
+   assert(oSession != NULL);
+
+   if ((iFlags = fcntl(oSession->iSockFD, F_GETFL, 0)) == -1)
+      return FAILURE;
+   if (iBlocking)
+      iFlags &= ~O_NONBLOCK;
+   else
+      iFlags |= O_NONBLOCK;
+   if (fcntl(oSession->iSockFD, F_SETFL, iFlags) == -1)
+      return FAILURE;
+   return SUCCESS;
+}
+
+/*--------------------------------------------------------------------*/
+
+int Session_getOutbox(Session_T oSession)
+
+/* Return the outbox of oSession, creating it on first use, or -1 if
+   it cannot be created. */
+
+{
+   assert(oSession != NULL);
+
+   if (oSession->iOutboxFD == -1)
+      oSession->iOutboxFD = Common_createScratch("server");
+   return oSession->iOutboxFD;
+}
+
+/*--------------------------------------------------------------------*/
+
+int Session_flush(Session_T oSession)
+
+/* Send what the outbox of oSession holds to its client until the
+   socket would block, and empty the outbox once all of it is sent.
+   Return SUCCESS or FAILURE. */
+
+{
+   struct stat sStat;
+   ssize_t iSent;
+
+   assert(oSession != NULL);
+
+   if (oSession->iOutboxFD == -1)
+      return SUCCESS;
+   if (fstat(oSession->iOutboxFD, &sStat) == -1)
+      return FAILURE;
+
+   while (oSession->lOutboxSent < sStat.st_size)
+   {
+      iSent = sendfile(oSession->iSockFD, oSession->iOutboxFD,
+                       &oSession->lOutboxSent,
+                       (size_t)(sStat.st_size - oSession->lOutboxSent));
+      if (iSent > 0)
+         continue;
+      if ((iSent == -1) && (errno == EINTR))
+         continue;
+      if ((iSent == -1) && ((errno == EAGAIN) || (errno == EWOULDBLOCK)))
+         return SUCCESS;
+      return FAILURE;
+   }
+
+   /* All of it is out: start afresh. */
+   if ((ftruncate(oSession->iOutboxFD, 0) == -1) ||
+       (lseek(oSession->iOutboxFD, 0, SEEK_SET) == -1))
+      return FAILURE;
+   oSession->lOutboxSent = 0;
+   return SUCCESS;
+}
+
+/*--------------------------------------------------------------------*/
+
+int Session_isPending(Session_T oSession)
+
+/* Return 1 (TRUE) if the outbox of oSession holds bytes that have not
+   been sent, 0 (FALSE) otherwise. */
+
+{
+   struct stat sStat;
+
+   assert(oSession != NULL);
+
+   if (oSession->iOutboxFD == -1)
+      return FALSE;
+   if (fstat(oSession->iOutboxFD, &sStat) == -1)
+      return TRUE; /* Session_flush finds out what is wrong */
+   return oSession->lOutboxSent < sStat.st_size;
+}
+
+/*--------------------------------------------------------------------*/
+
+int Session_enter(Session_T oSession, char *pcProgName)
+
+/* Change the server's current directory to that of oSession. Return
+   1 (TRUE) if successful, or 0 (FALSE) otherwise. */
+
+{
+   assert(oSession != NULL);
+   assert(pcProgName != NULL);
+
+   if (chdir(oSession->pcCwd) == -1)
+   {
+      fprintf(stderr, "%s: cd: %s: %s\n", pcProgName, oSession->pcCwd,
+              strerror(errno));
+      return FALSE;
+   }
+   return TRUE;
+}
+
+/*--------------------------------------------------------------------*/
+
+int Session_saveCwd(Session_T oSession)
+
+/* Make the server's current directory the current directory of
+   oSession. Return 1 (TRUE) if successful, or 0 (FALSE) otherwise. */
+
+{
+   char *pcCwd = NULL;
+
+   assert(oSession != NULL);
+
+   if ((pcCwd = getcwd(NULL, 0)) == NULL)
+      return FALSE;
+   free(oSession->pcCwd);
+   oSession->pcCwd = pcCwd;
+   return TRUE;
+}
+
+/*--------------------------------------------------------------------*/
+
+char **Session_createEnvp(Session_T oSession)
+
+/* Create a NULL-terminated environment array for oSession and return
+   it, or NULL if insufficient memory is available. */
+
+{
+   char **apcEnvp = NULL;
+   int iLength;
+
+   assert(oSession != NULL);
+
+   iLength = DynArray_getLength(oSession->oEnv);
+   apcEnvp = (char**)calloc((size_t)(iLength + 1), sizeof(char*));
+   if (apcEnvp == NULL)
+      return NULL;
+   DynArray_toArray(oSession->oEnv, (void**)apcEnvp);
+   apcEnvp[iLength] = NULL;
+   return apcEnvp;
+}
+
+/*--------------------------------------------------------------------*/
+
+static int Session_findVar(Session_T oSession, const char *pcName)
+
+/* Return the index of variable pcName in the environment of oSession,
+   or -1 if it is not set. */
+
+{
+   char *pcVar;
+   size_t iNameLen;
+   int i;
+
+   iNameLen = strlen(pcName);
+   for (i = 0; i < DynArray_getLength(oSession->oEnv); i++)
+   {
+      pcVar = (char*)DynArray_get(oSession->oEnv, i);
+      if ((strncmp(pcVar, pcName, iNameLen) == 0) &&
+          (pcVar[iNameLen] == '='))
+         return i;
+   }
+   return -1;
+}
+
+/*--------------------------------------------------------------------*/
+
+static int Session_setVar(Session_T oSession, const char *pcName,
+                          const char *pcValue)
+
+/* Set variable pcName to pcValue in the environment of oSession.
+   Return 0 if successful, or an errno value otherwise. */
+
+{
+   char *pcVar = NULL;
+   int iIndex;
+
+   if ((*pcName == '\0') || (strchr(pcName, '=') != NULL))
+      return EINVAL;
+
+   pcVar = (char*)malloc(strlen(pcName) + strlen(pcValue) + 2);
+   if (pcVar == NULL)
+      return ENOMEM;
+   sprintf(pcVar, "%s=%s", pcName, pcValue);
+
+   iIndex = Session_findVar(oSession, pcName);
+   if (iIndex >= 0)
+      free(DynArray_set(oSession->oEnv, iIndex, pcVar));
+   else if (! DynArray_add(oSession->oEnv, pcVar))
+   {
+      free(pcVar);
+      return ENOMEM;
+   }
+   return 0;
+}
+
+/*--------------------------------------------------------------------*/
+
+int Session_handleSetenv(Session_T oSession, SynCmd *psCmd,
+                         char *pcProgName)
+
+/* Checks if psCmd is a setenv command. If so, it sets the variable in
+   the environment of oSession. Returns 1 if command is setenv
+   (regardless of whether execution is successful or not), 0
+   otherwise. */
+
+{
+   int iArgs;
+   int iErr;
+   char **apcArgs;
+
+   assert(oSession != NULL);
+   assert(psCmd != NULL);
+   assert(pcProgName != NULL);
+
+   if (psCmd->eVerb != VERB_SETENV)
+      return FALSE;
+   iArgs = psCmd->iArgc - 1;
+   apcArgs = psCmd->ppcArgv + 1;
+
+   if (iArgs > 2)
+   {
+      fprintf(stderr, "%s: setenv: too many arguments\n", pcProgName);
+      return TRUE;
+   }
+   if (iArgs == 0)
+   {
+      fprintf(stderr, "%s: setenv: missing variable\n", pcProgName);
+      return TRUE;
+   }
+   iErr = Session_setVar(oSession, apcArgs[0],
+                         (iArgs == 2) ? apcArgs[1] : "");
+   if (iErr != 0)
+      fprintf(stderr, "%s: setenv: %s: %s\n", pcProgName, apcArgs[0],
+              strerror(iErr));
+   return TRUE;
+}
+
+/*--------------------------------------------------------------------*/
+
+int Session_handleUnsetenv(Session_T oSession, SynCmd *psCmd,
+                           char *pcProgName)
+
+/* Checks if psCmd is an unsetenv command. If so, it removes the
+   variable from the environment of oSession. Returns 1 if command is
+   unsetenv (regardless of whether execution is successful or not), 0
+   otherwise. */
+
+{
+   int iArgs;
+   int iIndex;
+   char *pcArg = NULL;
+
+   assert(oSession != NULL);
+   assert(psCmd != NULL);
+   assert(pcProgName != NULL);
+
+   if (psCmd->eVerb != VERB_UNSETENV)
+      return FALSE;
+   iArgs = psCmd->iArgc - 1;
+   pcArg = psCmd->ppcArgv[psCmd->iArgc - 1];
+
+   if (iArgs > 1)
+   {
+      fprintf(stderr, "%s: unsetenv: too many arguments\n", pcProgName);
+      return TRUE;
+   }
+   if (iArgs == 0)
+   {
+      fprintf(stderr, "%s: unsetenv: missing variable\n", pcProgName);
+      return TRUE;
+   }
+   if ((*pcArg == '\0') || (strchr(pcArg, '=') != NULL))
+   {
+      fprintf(stderr, "%s: unsetenv: %s: %s\n", pcProgName, pcArg,
+              strerror(EINVAL));
+      return TRUE;
+   }
+   iIndex = Session_findVar(oSession, pcArg);
+   if (iIndex >= 0)
+      free(DynArray_removeAt(oSession->oEnv, iIndex));
+   return TRUE;
+}
+
+/*--------------------------------------------------------------------*/
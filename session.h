@@ -0,0 +1,171 @@
+/*--------------------------------------------------------------------*/
+/* session.h                                                          */
+/* Per-connection state for the event-driven server                   */
+/*--------------------------------------------------------------------*/
+
+#ifndef SESSION_INCLUDED
+#define SESSION_INCLUDED
+
+#include "common.h"
+#include "cache.h"
+#include "jobtab.h"
+
+/*--------------------------------------------------------------------*/
+
+typedef struct Session *Session_T;
+/* A session is everything the server remembers about one connected
+   client between two commands: its socket, current directory,
+   environment, where its command output goes, the bytes it has received but not
+   consumed yet, the answers it has not been able to send yet, the memory its command lines are analyzed in, the
+   command it is currently running and its background jobs. */
+
+#define SESSION_PROTOCOL_UNKNOWN -1
+/* Protocol of a session whose client has not sent anything yet. */
+
+/*--------------------------------------------------------------------*/
+
+Session_T Session_new(int iSockFD);
+/* Return a new session for connected socket iSockFD, or NULL if
+   insufficient memory is available. The session starts in the
+   server's current directory with a copy of the server's environment. */
+
+void Session_free(Session_T oSession);
+/* Free oSession. Does not close its socket. */
+
+int Session_getSockFD(Session_T oSession);
+/* Return the socket of oSession. */
+
+int Session_getScratch(Session_T oSession);
+/* Return the anonymous scratch file the command output of oSession is
+   collected in for a client of the legacy protocol, which cannot be
+   streamed to, and the output of a command the server runs itself for
+   any client. It is created on first use; return -1 if that fails. */
+
+pid_t Session_getPid(Session_T oSession);
+/* Return the pid of the command oSession is running, or 0 if it is
+   idle. */
+
+void Session_setPid(Session_T oSession, pid_t iPid);
+/* Record that oSession is running command iPid, or is idle again if
+   iPid is 0. */
+
+int Session_getOutFD(Session_T oSession);
+/* Return the read end of the pipe the output of the current command of
+   oSession comes through, or -1 if there is none (any more). */
+
+void Session_setOutFD(Session_T oSession, int iOutFD);
+/* Record that the output of the current command of oSession comes
+   through iOutFD, or that it is all in if iOutFD is -1. Does not
+   close the previous descriptor. */
+
+int Session_getStatus(Session_T oSession);
+/* Return the exit status of the last command of oSession. */
+
+void Session_setStatus(Session_T oSession, int iStatus);
+/* Record that the last command of oSession ended with iStatus. */
+
+RecvBuf_T Session_getRecvBuf(Session_T oSession);
+/* Return the receive buffer in front of the socket of oSession. */
+
+Arena_T Session_getArena(Session_T oSession);
+/* Return the arena the tokens and command words of the lines of
+   oSession are allocated from. It is reset after every command. */
+
+int Session_getProtocol(Session_T oSession);
+/* Return the protocol version the client of oSession speaks (see
+   proto.h), or SESSION_PROTOCOL_UNKNOWN. */
+
+void Session_setProtocol(Session_T oSession, int iProtocol);
+/* Record that the client of oSession speaks protocol version
+   iProtocol. */
+
+uint32_t Session_getRequestId(Session_T oSession);
+/* Return the id of the request oSession is serving. Always 0 for the
+   legacy protocol. */
+
+void Session_setRequestId(Session_T oSession, uint32_t uId);
+/* Record that oSession is serving request uId. */
+
+void Session_countCommand(Session_T oSession);
+/* Count one more command received by oSession. */
+
+long Session_getCommands(Session_T oSession);
+/* Return the number of commands oSession has received. */
+
+CacheJob_T Session_getJob(Session_T oSession);
+/* Return the cache job of the command oSession is running, or NULL if
+   its output is not going into the compile cache. */
+
+void Session_setJob(Session_T oSession, CacheJob_T oJob);
+/* Set the cache job of the command oSession is running to oJob. The
+   session does not own it: whoever clears it must end it. */
+
+JobTab_T Session_getJobTab(Session_T oSession);
+/* Return the table of background jobs of oSession. Freeing the
+   session hangs up on those still running. */
+
+int Session_getWaitJob(Session_T oSession);
+/* Return the number of the background job oSession waits for before
+   it takes its next command, or 0 if it waits for none. */
+
+void Session_setWaitJob(Session_T oSession, int iJob);
+/* Record that oSession waits for background job iJob of its job
+   table, or for none if iJob is 0. */
+
+int Session_getTransferFD(Session_T oSession);
+/* Return the anonymous file the child running a file transfer for
+   oSession hands back the bytes it received but did not consume
+   through, or -1 if no transfer is running. */
+
+void Session_setTransferFD(Session_T oSession, int iTransferFD);
+/* Record that a transfer child of oSession hands back unconsumed bytes
+   through iTransferFD, or that none is running if iTransferFD is -1.
+   Does not close the previous descriptor. */
+
+int Session_setBlocking(Session_T oSession, int iBlocking);
+/* Switch the socket of oSession between blocking and non-blocking
+   mode. Return SUCCESS or FAILURE. */
+
+int Session_getOutbox(Session_T oSession);
+/* Return the anonymous file the answers to the client of oSession are
+   queued in, for the event model, until its non-blocking socket takes
+   them (see Session_flush). It is created on first use; return -1 if
+   that fails. */
+
+int Session_flush(Session_T oSession);
+/* Send what the outbox of oSession holds to its client until the
+   socket would block, and empty the outbox once all of it is sent.
+   Return SUCCESS, or FAILURE if the client cannot be sent to. */
+
+int Session_isPending(Session_T oSession);
+/* Return 1 (TRUE) if the outbox of oSession holds bytes that have not
+   been sent, 0 (FALSE) otherwise. */
+
+int Session_enter(Session_T oSession, char *pcProgName);
+/* Change the server's current directory to that of oSession. Return
+   1 (TRUE) if successful, or 0 (FALSE) otherwise. */
+
+int Session_saveCwd(Session_T oSession);
+/* Make the server's current directory the current directory of
+   oSession. Return 1 (TRUE) if successful, or 0 (FALSE) otherwise. */
+
+char **Session_createEnvp(Session_T oSession);
+/* Create a NULL-terminated environment array for oSession and return
+   it, or NULL if insufficient memory is available. The caller owns
+   the array but not the strings in it. */
+
+int Session_handleSetenv(Session_T oSession, SynCmd *psCmd,
+                         char *pcProgName);
+/* Checks if psCmd is a setenv command. If so, it sets the variable in
+   the environment of oSession. Returns 1 if command is setenv
+   (regardless of whether execution is successful or not), 0
+   otherwise. */
+
+int Session_handleUnsetenv(Session_T oSession, SynCmd *psCmd,
+                           char *pcProgName);
+/* Checks if psCmd is an unsetenv command. If so, it removes the
+   variable from the environment of oSession. Returns 1 if command is
+   unsetenv (regardless of whether execution is successful or not), 0
+   otherwise. */
+
+#endif
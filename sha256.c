@@ -0,0 +1,181 @@
+/*--------------------------------------------------------------------*/
+/* sha256.c                                                           */
+/* SHA-256 message digest (FIPS 180-4)                                */
+/*--------------------------------------------------------------------*/
+
+#include "sha256.h"
+#include <assert.h>
+#include <string.h>
+
+/*--------------------------------------------------------------------*/
+
+static const uint32_t auK[64] =
+{
+   0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+   0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+   0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+   0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+   0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+   0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+   0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+   0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+   0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+   0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+   0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+/* Round constants. */
+
+#define ROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+/*--------------------------------------------------------------------*/
+
+static void Sha256_compress(uint32_t *puState,
+                            const unsigned char *pucBlock)
+
+/* Hash the 64 byte block pucBlock into state puState. */
+
+{
+   uint32_t auW[64];
+   uint32_t a, b, c, d, e, f, g, h, t1, t2;
+   int i;
+
+   for (i = 0; i < 16; i++)
+      auW[i] = ((uint32_t)pucBlock[4 * i] << 24) |
+               ((uint32_t)pucBlock[4 * i + 1] << 16) |
+               ((uint32_t)pucBlock[4 * i + 2] << 8) |
+               (uint32_t)pucBlock[4 * i + 3];
+   for (i = 16; i < 64; i++)
+      auW[i] = auW[i - 16] +
+               (ROTR(auW[i - 15], 7) ^ ROTR(auW[i - 15], 18) ^
+                (auW[i - 15] >> 3)) +
+               auW[i - 7] +
+               (ROTR(auW[i - 2], 17) ^ ROTR(auW[i - 2], 19) ^
+                (auW[i - 2] >> 10));
+
+   a = puState[0]; b = puState[1]; c = puState[2]; d = puState[3];
+   e = puState[4]; f = puState[5]; g = puState[6]; h = puState[7];
+   for (i = 0; i < 64; i++)
+   {
+      t1 = h + (ROTR(e, 6) ^ ROTR(e, 11) ^ ROTR(e, 25)) +
+           ((e & f) ^ (~e & g)) + auK[i] + auW[i];
+      t2 = (ROTR(a, 2) ^ ROTR(a, 13) ^ ROTR(a, 22)) +
+           ((a & b) ^ (a & c) ^ (b & c));
+      h = g; g = f; f = e; e = d + t1;
+      d = c; c = b; b = a; a = t1 + t2;
+   }
+   puState[0] += a; puState[1] += b; puState[2] += c; puState[3] += d;
+   puState[4] += e; puState[5] += f; puState[6] += g; puState[7] += h;
+}
+
+/*--------------------------------------------------------------------*/
+
+void Sha256_init(Sha256 *psHash)
+
+/* Start a new digest in *psHash. */
+
+{
+   static const uint32_t auInit[8] =
+   {
+      0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+      0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+   };
+
+   assert(psHash != NULL);
+
+   memcpy(psHash->auState, auInit, sizeof(auInit));
+   psHash->uLength = 0;
+}
+
+/*--------------------------------------------------------------------*/
+
+void Sha256_update(Sha256 *psHash, const void *pvData, size_t iSize)
+
+/* Add the iSize bytes at pvData to the digest in *psHash. */
+
+{
+   const unsigned char *pucData = (const unsigned char*)pvData;
+   size_t iHave;
+   size_t iTake;
+
+   assert(psHash != NULL);
+   assert((pvData != NULL) || (iSize == 0));
+
+   iHave = (size_t)(psHash->uLength % 64);
+   psHash->uLength += iSize;
+
+   /* Complete a partial block first. */
+   if (iHave > 0)
+   {
+      iTake = (iSize < 64 - iHave) ? iSize : 64 - iHave;
+      memcpy(psHash->aucBlock + iHave, pucData, iTake);
+      pucData += iTake;
+      iSize -= iTake;
+      if (iHave + iTake < 64)
+         return;
+      Sha256_compress(psHash->auState, psHash->aucBlock);
+   }
+
+   /* Whole blocks straight from the input. */
+   for (; iSize >= 64; pucData += 64, iSize -= 64)
+      Sha256_compress(psHash->auState, pucData);
+
+   memcpy(psHash->aucBlock, pucData, iSize);
+}
+
+/*--------------------------------------------------------------------*/
+
+void Sha256_final(Sha256 *psHash, unsigned char *pucDigest)
+
+/* Finish the digest in *psHash and store its SHA256_SIZE bytes in
+   pucDigest. */
+
+{
+   unsigned char aucPad[72];
+   uint64_t uBits;
+   size_t iPad;
+   int i;
+
+   assert(psHash != NULL);
+   assert(pucDigest != NULL);
+
+   /* A one bit, zeros up to 56 mod 64, then the length in bits. */
+   uBits = psHash->uLength * 8;
+   iPad = 64 - (size_t)((psHash->uLength + 8) % 64);
+   memset(aucPad, 0, sizeof(aucPad));
+   aucPad[0] = 0x80;
+   for (i = 0; i < 8; i++)
+      aucPad[iPad + i] = (unsigned char)(uBits >> (56 - 8 * i));
+   Sha256_update(psHash, aucPad, iPad + 8);
+
+   for (i = 0; i < 8; i++)
+   {
+      pucDigest[4 * i] = (unsigned char)(psHash->auState[i] >> 24);
+      pucDigest[4 * i + 1] = (unsigned char)(psHash->auState[i] >> 16);
+      pucDigest[4 * i + 2] = (unsigned char)(psHash->auState[i] >> 8);
+      pucDigest[4 * i + 3] = (unsigned char)psHash->auState[i];
+   }
+}
+
+/*--------------------------------------------------------------------*/
+
+void Sha256_toHex(const unsigned char *pucDigest, char *pcHex)
+
+/* Write digest pucDigest as lowercase hex digits followed by '\0'
+   into pcHex. */
+
+{
+   static const char acDigits[] = "0123456789abcdef";
+   int i;
+
+   assert(pucDigest != NULL);
+   assert(pcHex != NULL);
+
+   for (i = 0; i < SHA256_SIZE; i++)
+   {
+      pcHex[2 * i] = acDigits[pucDigest[i] >> 4];
+      pcHex[2 * i + 1] = acDigits[pucDigest[i] & 0x0f];
+   }
+   pcHex[2 * SHA256_SIZE] = '\0';
+}
+
+/*--------------------------------------------------------------------*/
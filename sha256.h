@@ -0,0 +1,45 @@
+/*--------------------------------------------------------------------*/
+/* sha256.h                                                           */
+/* SHA-256 message digest (FIPS 180-4)                                */
+/*--------------------------------------------------------------------*/
+
+#ifndef SHA256_INCLUDED
+#define SHA256_INCLUDED
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SHA256_SIZE 32 /* bytes in a digest */
+#define SHA256_HEX_SIZE (2 * SHA256_SIZE + 1) /* chars in a hex digest */
+
+typedef struct Sha256
+{
+   uint32_t auState[8];
+   /* Intermediate hash value. */
+
+   uint64_t uLength;
+   /* Number of bytes hashed so far. */
+
+   unsigned char aucBlock[64];
+   /* Bytes not hashed yet, less than a block. */
+} Sha256;
+/* The state of a SHA-256 computation. It is a plain structure so that
+   it can live on the stack. */
+
+/*--------------------------------------------------------------------*/
+
+void Sha256_init(Sha256 *psHash);
+/* Start a new digest in *psHash. */
+
+void Sha256_update(Sha256 *psHash, const void *pvData, size_t iSize);
+/* Add the iSize bytes at pvData to the digest in *psHash. */
+
+void Sha256_final(Sha256 *psHash, unsigned char *pucDigest);
+/* Finish the digest in *psHash and store its SHA256_SIZE bytes in
+   pucDigest. *psHash must be initialized again before reuse. */
+
+void Sha256_toHex(const unsigned char *pucDigest, char *pcHex);
+/* Write digest pucDigest as SHA256_HEX_SIZE - 1 lowercase hex digits
+   followed by '\0' into pcHex. */
+
+#endif
@@ -0,0 +1,368 @@
+/*--------------------------------------------------------------------*/
+/* stage.c                                                            */
+/* Staging area that keeps partly received files for resuming         */
+/*--------------------------------------------------------------------*/
+
+#include "stage.h"
+#include <dirent.h>
+#include <limits.h>
+#include <time.h>
+
+/*--------------------------------------------------------------------*/
+
+static char *pcStageDir = NULL;
+/* Absolute path of the staging directory, or NULL if staging is
+   off. */
+
+/*--------------------------------------------------------------------*/
+
+static void Stage_path(const char *pcKey, const char *pcSuffix,
+                       char *pcPath, size_t iSize)
+
+/* Write the path of the file of transfer pcKey with suffix pcSuffix
+   into pcPath of size iSize. */
+
+{
+   snprintf(pcPath, iSize, "%s/%s%s", pcStageDir, pcKey, pcSuffix);
+}
+
+/*--------------------------------------------------------------------*/
+
+static void Stage_prune(void)
+
+/* Remove the partial files nobody came back for. */
+
+{
+   char acPath[PATH_MAX];
+   struct dirent *psDirent;
+   struct stat sStat;
+   time_t iNow = time(NULL);
+   DIR *psDir;
+
+   if ((psDir = opendir(pcStageDir)) == NULL)
+      return;
+   while ((psDirent = readdir(psDir)) != NULL)
+   {
+      if (psDirent->d_name[0] == '.')
+         continue;
+      snprintf(acPath, sizeof(acPath), "%s/%s", pcStageDir,
+               psDirent->d_name);
+      if ((lstat(acPath, &sStat) == 0) &&
+          (iNow - sStat.st_mtime > STAGE_MAX_AGE))
+         unlink(acPath);
+   }
+   closedir(psDir);
+}
+
+/*--------------------------------------------------------------------*/
+
+int Stage_open(const char *pcDir)
+
+/* Keep partial files in staging directory pcDir, created if needed.
+   Return SUCCESS or FAILURE. */
+
+{
+   struct stat sStat;
+
+   assert(pcDir != NULL);
+
+   /* Only a private directory: whoever can write there can put words
+      in the mouth of a sender. */
+   if (((mkdir(pcDir, 0700) == -1) && (errno != EEXIST)) ||
+       (stat(pcDir, &sStat) == -1))
+      return FAILURE;
+   if ((! S_ISDIR(sStat.st_mode)) || (sStat.st_uid != geteuid()) ||
+       ((sStat.st_mode & 077) != 0))
+   {
+      errno = EPERM;
+      return FAILURE;
+   }
+
+   /* Sessions change directory, so the path must be absolute. */
+   free(pcStageDir);
+   if ((pcStageDir = realpath(pcDir, NULL)) == NULL)
+      return FAILURE;
+   Stage_prune();
+   return SUCCESS;
+}
+
+/*--------------------------------------------------------------------*/
+
+int Stage_isOn(void)
+
+/* Return 1 (TRUE) if there is a staging directory, 0 (FALSE)
+   otherwise. */
+
+{
+   return pcStageDir != NULL;
+}
+
+/*--------------------------------------------------------------------*/
+
+void Stage_keyForContents(const unsigned char *pucDigest, uint64_t uSize,
+                          char *pcKey)
+
+/* Write the key of a transfer of uSize bytes with SHA-256 digest
+   pucDigest into pcKey. */
+
+{
+   char acHex[SHA256_HEX_SIZE];
+
+   assert(pucDigest != NULL);
+   assert(pcKey != NULL);
+
+   Sha256_toHex(pucDigest, acHex);
+   snprintf(pcKey, STAGE_KEY_SIZE, "%s-%llu", acHex,
+            (unsigned long long)uSize);
+}
+
+/*--------------------------------------------------------------------*/
+
+void Stage_keyForPath(const char *pcDest, char *pcKey)
+
+/* Write the key of a transfer into file pcDest into pcKey. */
+
+{
+   unsigned char aucDigest[SHA256_SIZE];
+   char acCwd[PATH_MAX];
+   Sha256 sHash;
+
+   assert(pcDest != NULL);
+   assert(pcKey != NULL);
+
+   /* The same file, however it was named. */
+   Sha256_init(&sHash);
+   if ((pcDest[0] != '/') && (getcwd(acCwd, sizeof(acCwd)) != NULL))
+   {
+      Sha256_update(&sHash, acCwd, strlen(acCwd));
+      Sha256_update(&sHash, "/", 1);
+   }
+   Sha256_update(&sHash, pcDest, strlen(pcDest));
+   Sha256_final(&sHash, aucDigest);
+   Sha256_toHex(aucDigest, pcKey);
+}
+
+/*--------------------------------------------------------------------*/
+
+static int Stage_readId(const char *pcKey, unsigned char *pucDigest,
+                        uint64_t *puSize)
+
+/* Read the digest and size of the file of transfer pcKey from its id
+   file into pucDigest and *puSize. Return SUCCESS or FAILURE. */
+
+{
+   char acPath[PATH_MAX];
+   char acHex[SHA256_HEX_SIZE];
+   unsigned long long ullSize;
+   unsigned int uByte;
+   FILE *psFile;
+   int iFields;
+   int i;
+
+   Stage_path(pcKey, ".id", acPath, sizeof(acPath));
+   if ((psFile = fopen(acPath, "r")) == NULL)
+      return FAILURE;
+   iFields = fscanf(psFile, "%64s %llu", acHex, &ullSize);
+   fclose(psFile);
+   if ((iFields != 2) || (strlen(acHex) != 2 * SHA256_SIZE))
+      return FAILURE;
+
+   for (i = 0; i < SHA256_SIZE; i++)
+   {
+      if (sscanf(acHex + 2 * i, "%2x", &uByte) != 1)
+         return FAILURE;
+      pucDigest[i] = (unsigned char)uByte;
+   }
+   *puSize = (uint64_t)ullSize;
+   return SUCCESS;
+}
+
+/*--------------------------------------------------------------------*/
+
+int Stage_lookup(const char *pcKey, unsigned char *pucDigest,
+                 uint64_t *puSize, uint64_t *puHave)
+
+/* If transfer pcKey left a partial file behind, store the digest and
+   size of the whole file in pucDigest and *puSize, and the number of
+   bytes there are in *puHave, and return SUCCESS. Return FAILURE
+   otherwise. */
+
+{
+   char acPath[PATH_MAX];
+   struct stat sStat;
+
+   assert(pcKey != NULL);
+   assert(pucDigest != NULL);
+   assert(puSize != NULL);
+   assert(puHave != NULL);
+
+   if (pcStageDir == NULL)
+      return FAILURE;
+   Stage_path(pcKey, "", acPath, sizeof(acPath));
+   if ((stat(acPath, &sStat) == -1) || (sStat.st_size == 0) ||
+       (Stage_readId(pcKey, pucDigest, puSize) == FAILURE) ||
+       ((uint64_t)sStat.st_size > *puSize))
+      return FAILURE;
+   *puHave = (uint64_t)sStat.st_size;
+   return SUCCESS;
+}
+
+/*--------------------------------------------------------------------*/
+
+static int Stage_hashPrefix(int iFD, Sha256 *psHash, uint64_t *puHave)
+
+/* Add the bytes of the file open at iFD to *psHash and store their
+   number in *puHave, leaving the offset at its end. Return SUCCESS or
+   FAILURE. */
+
+{
+   char acBuf[MAX_BUFF * 16];
+   ssize_t iGot;
+
+   *puHave = 0;
+   while ((iGot = read(iFD, acBuf, sizeof(acBuf))) != 0)
+   {
+      if ((iGot == -1) && (errno == EINTR))
+         continue;
+      if (iGot == -1)
+         return FAILURE;
+      Sha256_update(psHash, acBuf, (size_t)iGot);
+      *puHave += (uint64_t)iGot;
+   }
+   return SUCCESS;
+}
+
+/*--------------------------------------------------------------------*/
+
+int Stage_begin(const char *pcKey, const unsigned char *pucDigest,
+                uint64_t uSize, int iResume, Sha256 *psHash,
+                uint64_t *puHave)
+
+/* Start receiving a file of uSize bytes with digest pucDigest as
+   transfer pcKey, keeping what arrived before if iResume is 1 (TRUE).
+   Return a descriptor to append the rest to, or -1. */
+
+{
+   unsigned char aucStaged[SHA256_SIZE];
+   char acPath[PATH_MAX];
+   char acHex[SHA256_HEX_SIZE];
+   uint64_t uStaged = 0;
+   FILE *psFile;
+   int iFD;
+
+   assert(pcKey != NULL);
+   assert(pucDigest != NULL);
+   assert(psHash != NULL);
+   assert(puHave != NULL);
+
+   *puHave = 0;
+   if (pcStageDir == NULL)
+      return -1;
+   Stage_path(pcKey, "", acPath, sizeof(acPath));
+   if ((iFD = open(acPath, O_RDWR | O_CREAT | O_CLOEXEC, PERMISSIONS)) == -1)
+      return -1;
+
+   /* One receiver per transfer: a second one goes without staging. */
+   if (flock(iFD, LOCK_EX | LOCK_NB) == -1)
+   {
+      close(iFD);
+      return -1;
+   }
+
+   if (iResume &&
+       (Stage_readId(pcKey, aucStaged, &uStaged) == SUCCESS) &&
+       (memcmp(aucStaged, pucDigest, SHA256_SIZE) == 0) &&
+       (uStaged == uSize) &&
+       (Stage_hashPrefix(iFD, psHash, puHave) == SUCCESS) &&
+       (*puHave <= uSize))
+      return iFD;
+
+   /* Not the same contents: start over. */
+   Sha256_init(psHash);
+   *puHave = 0;
+   if ((ftruncate(iFD, 0) == -1) || (lseek(iFD, 0, SEEK_SET) == -1))
+   {
+      close(iFD);
+      return -1;
+   }
+   Stage_path(pcKey, ".id", acPath, sizeof(acPath));
+   Sha256_toHex(pucDigest, acHex);
+   if (((psFile = fopen(acPath, "w")) == NULL) ||
+       (fprintf(psFile, "%s %llu\n", acHex, (unsigned long long)uSize) < 0) ||
+       (fclose(psFile) == EOF))
+   {
+      close(iFD);
+      return -1;
+   }
+   return iFD;
+}
+
+/*--------------------------------------------------------------------*/
+
+int Stage_finish(const char *pcKey, const char *pcDest)
+
+/* Move the complete file of transfer pcKey into place as file pcDest.
+   Return 0, or an errno value. */
+
+{
+   char acPath[PATH_MAX];
+   char acTemp[PATH_MAX];
+   struct stat sStat;
+   int iSrcFD, iDestFD;
+   int iErr = 0;
+
+   assert(pcKey != NULL);
+   assert(pcDest != NULL);
+
+   Stage_path(pcKey, "", acPath, sizeof(acPath));
+   if (rename(acPath, pcDest) == 0)
+   {
+      Stage_path(pcKey, ".id", acPath, sizeof(acPath));
+      unlink(acPath);
+      return 0;
+   }
+   if (errno != EXDEV)
+      return errno;
+
+   /* Another file system: copy next to pcDest, then rename. */
+   snprintf(acTemp, sizeof(acTemp), "%s.%ld.stage", pcDest, (long)getpid());
+   if ((iSrcFD = open(acPath, O_RDONLY | O_CLOEXEC)) == -1)
+      return errno;
+   iDestFD = open(acTemp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                  PERMISSIONS);
+   if ((iDestFD == -1) || (fstat(iSrcFD, &sStat) == -1) ||
+       (fchmod(iDestFD, sStat.st_mode & 07777) == -1) ||
+       (Common_transfer(iDestFD, iSrcFD, (size_t)sStat.st_size)
+        != (ssize_t)sStat.st_size) ||
+       (rename(acTemp, pcDest) == -1))
+      iErr = errno ? errno : EIO;
+   close(iSrcFD);
+   if (iDestFD != -1)
+      close(iDestFD);
+   if (iErr != 0)
+      unlink(acTemp);
+   else
+      Stage_discard(pcKey);
+   return iErr;
+}
+
+/*--------------------------------------------------------------------*/
+
+void Stage_discard(const char *pcKey)
+
+/* Remove what transfer pcKey left behind. */
+
+{
+   char acPath[PATH_MAX];
+
+   assert(pcKey != NULL);
+
+   if (pcStageDir == NULL)
+      return;
+   Stage_path(pcKey, "", acPath, sizeof(acPath));
+   unlink(acPath);
+   Stage_path(pcKey, ".id", acPath, sizeof(acPath));
+   unlink(acPath);
+}
+
+/*--------------------------------------------------------------------*/
@@ -0,0 +1,78 @@
+/*--------------------------------------------------------------------*/
+/* stage.h                                                            */
+/* Staging area that keeps partly received files for resuming         */
+/*--------------------------------------------------------------------*/
+
+#ifndef STAGE_INCLUDED
+#define STAGE_INCLUDED
+
+#include "common.h"
+
+/*--------------------------------------------------------------------*/
+
+/* A large file is received into the staging directory rather than
+   next to its destination, and only renamed into place once all of it
+   has arrived and its digest checks out. Should the connection drop,
+   what did arrive stays behind as
+
+      <key>      the first bytes of the file
+      <key>.id   SHA-256 digest (hex) and size of the whole file
+
+   and the next transfer of the same contents asks the sender for the
+   rest only (see PROTO_RESUME in proto.h). A server keys uploads by
+   the digest and size the client announced; a client keys downloads
+   by the destination path, since it learns the digest only from the
+   answer. Partial files that nobody came back for are removed after
+   STAGE_MAX_AGE seconds. */
+
+#define STAGE_DEFAULT_DIR ".cloudide-partial"
+#define STAGE_MIN_SIZE (1024 * 1024) /* smaller files are not staged */
+#define STAGE_MAX_AGE (7 * 24 * 60 * 60) /* a week */
+#define STAGE_KEY_SIZE (SHA256_HEX_SIZE + 24) /* chars in a key */
+
+/*--------------------------------------------------------------------*/
+
+int Stage_open(const char *pcDir);
+/* Keep partial files in staging directory pcDir, created if needed.
+   Return SUCCESS, or FAILURE if pcDir cannot be used; staging stays
+   off then. */
+
+int Stage_isOn(void);
+/* Return 1 (TRUE) if there is a staging directory, 0 (FALSE)
+   otherwise. */
+
+void Stage_keyForContents(const unsigned char *pucDigest, uint64_t uSize,
+                          char *pcKey);
+/* Write the key of a transfer of uSize bytes with SHA-256 digest
+   pucDigest into pcKey, of STAGE_KEY_SIZE chars. */
+
+void Stage_keyForPath(const char *pcDest, char *pcKey);
+/* Write the key of a transfer into file pcDest into pcKey, of
+   STAGE_KEY_SIZE chars. */
+
+int Stage_lookup(const char *pcKey, unsigned char *pucDigest,
+                 uint64_t *puSize, uint64_t *puHave);
+/* If transfer pcKey left a partial file behind, store the digest and
+   size of the whole file in pucDigest and *puSize, and the number of
+   bytes there are in *puHave, and return SUCCESS. Return FAILURE
+   otherwise. */
+
+int Stage_begin(const char *pcKey, const unsigned char *pucDigest,
+                uint64_t uSize, int iResume, Sha256 *psHash,
+                uint64_t *puHave);
+/* Start receiving a file of uSize bytes with digest pucDigest as
+   transfer pcKey. If iResume is 1 (TRUE) and the partial file there is
+   of the same contents, keep its bytes, add them to *psHash and store
+   their number in *puHave; otherwise start it afresh with *puHave 0.
+   Return a descriptor to append the rest to, which holds a lock on the
+   transfer until it is closed, or -1 if staging is off or another
+   receiver has the transfer. */
+
+int Stage_finish(const char *pcKey, const char *pcDest);
+/* Move the complete file of transfer pcKey into place as file pcDest.
+   Return 0, or an errno value; the file stays staged then. */
+
+void Stage_discard(const char *pcKey);
+/* Remove what transfer pcKey left behind. */
+
+#endif
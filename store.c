@@ -0,0 +1,343 @@
+/*--------------------------------------------------------------------*/
+/* store.c                                                            */
+/* Deduplicating content-addressed store behind sendfile uploads      */
+/*--------------------------------------------------------------------*/
+
+#include "store.h"
+#include <dirent.h>
+#include <limits.h>
+
+/*--------------------------------------------------------------------*/
+
+enum {STORE_UPLOADS, STORE_SKIPPED, STORE_BYTES, STORE_RECEIVED,
+      STORE_STORED, STORE_STATS};
+/* Counters kept in the stats file: uploads, uploads answered without
+   a transfer, bytes uploaded, bytes received for them, and bytes that
+   went into new objects. */
+
+static char *pcStoreDir = NULL;
+/* Absolute path of the store directory, or NULL if the store is
+   off. */
+
+static long lTempCount = 0;
+/* Number of temporary names made, to keep them unique. */
+
+/*--------------------------------------------------------------------*/
+
+static void Store_objectPath(const unsigned char *pucDigest, char *pcPath,
+                             size_t iSize)
+
+/* Write the path of the object with digest pucDigest into pcPath of
+   size iSize. */
+
+{
+   char acHex[SHA256_HEX_SIZE];
+
+   Sha256_toHex(pucDigest, acHex);
+   snprintf(pcPath, iSize, "%s/objects/%s", pcStoreDir, acHex);
+}
+
+/*--------------------------------------------------------------------*/
+
+static void Store_count(long long llUploads, long long llSkipped,
+                        long long llBytes, long long llReceived,
+                        long long llStored)
+
+/* Add the given amounts to the counters. */
+
+{
+   char acPath[PATH_MAX];
+   long long allStats[STORE_STATS];
+   int iFD;
+
+   snprintf(acPath, sizeof(acPath), "%s/stats", pcStoreDir);
+   if ((iFD = Common_lockCounters(acPath, allStats, STORE_STATS)) == FAILURE)
+      return;
+   allStats[STORE_UPLOADS] += llUploads;
+   allStats[STORE_SKIPPED] += llSkipped;
+   allStats[STORE_BYTES] += llBytes;
+   allStats[STORE_RECEIVED] += llReceived;
+   allStats[STORE_STORED] += llStored;
+   Common_unlockCounters(iFD, allStats, STORE_STATS);
+}
+
+/*--------------------------------------------------------------------*/
+
+static int Store_place(const char *pcObject, const char *pcDest)
+
+/* Replace file pcDest by a hardlink to object pcObject, or by a copy of
+   it if it cannot be linked. Return 0, or an errno value. */
+
+{
+   char acTemp[PATH_MAX];
+   struct stat sStat;
+   int iSrcFD, iDestFD;
+   int iErr = 0;
+
+   /* Link under a temporary name, then rename over pcDest: the file is
+      never missing or half written. */
+   snprintf(acTemp, sizeof(acTemp), "%s.%ld.store", pcDest, (long)getpid());
+   unlink(acTemp);
+   if (link(pcObject, acTemp) == 0)
+   {
+      if (rename(acTemp, pcDest) == -1)
+         iErr = errno;
+      unlink(acTemp); /* left alone if pcDest was linked already */
+      return iErr;
+   }
+   if ((errno != EXDEV) && (errno != EPERM) && (errno != EMLINK))
+      return errno;
+
+   /* Another file system: a private copy. */
+   if ((iSrcFD = open(pcObject, O_RDONLY | O_CLOEXEC)) == -1)
+      return errno;
+   iDestFD = open(acTemp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                  PERMISSIONS);
+   if ((iDestFD == -1) || (fstat(iSrcFD, &sStat) == -1) ||
+       (Common_transfer(iDestFD, iSrcFD, (size_t)sStat.st_size)
+        != (ssize_t)sStat.st_size) ||
+       (rename(acTemp, pcDest) == -1))
+      iErr = errno ? errno : EIO;
+   close(iSrcFD);
+   if (iDestFD != -1)
+      close(iDestFD);
+   if (iErr != 0)
+      unlink(acTemp);
+   return iErr;
+}
+
+/*--------------------------------------------------------------------*/
+
+static void Store_prune(void)
+
+/* Remove the objects no workspace file links to. */
+
+{
+   char acPath[PATH_MAX];
+   struct dirent *psDirent;
+   struct stat sStat;
+   DIR *psDir;
+
+   snprintf(acPath, sizeof(acPath), "%s/objects", pcStoreDir);
+   if ((psDir = opendir(acPath)) == NULL)
+      return;
+   while ((psDirent = readdir(psDir)) != NULL)
+   {
+      if (psDirent->d_name[0] == '.')
+         continue;
+      snprintf(acPath, sizeof(acPath), "%s/objects/%s", pcStoreDir,
+               psDirent->d_name);
+      if ((lstat(acPath, &sStat) == 0) && (sStat.st_nlink == 1))
+         unlink(acPath);
+   }
+   closedir(psDir);
+}
+
+/*--------------------------------------------------------------------*/
+
+int Store_open(const char *pcDir)
+
+/* Keep uploads in store directory pcDir, created if needed. Return
+   SUCCESS or FAILURE. */
+
+{
+   char acPath[PATH_MAX];
+   struct stat sStat;
+
+   assert(pcDir != NULL);
+
+   /* Only a private directory: anyone able to write objects could
+      change what our users upload. */
+   if (((mkdir(pcDir, 0700) == -1) && (errno != EEXIST)) ||
+       (stat(pcDir, &sStat) == -1))
+      return FAILURE;
+   if ((! S_ISDIR(sStat.st_mode)) || (sStat.st_uid != geteuid()) ||
+       ((sStat.st_mode & 077) != 0))
+   {
+      errno = EPERM;
+      return FAILURE;
+   }
+
+   snprintf(acPath, sizeof(acPath), "%s/objects", pcDir);
+   if ((mkdir(acPath, 0700) == -1) && (errno != EEXIST))
+      return FAILURE;
+   snprintf(acPath, sizeof(acPath), "%s/tmp", pcDir);
+   if ((mkdir(acPath, 0700) == -1) && (errno != EEXIST))
+      return FAILURE;
+
+   /* Sessions change directory, so the path must be absolute. */
+   free(pcStoreDir);
+   if ((pcStoreDir = realpath(pcDir, NULL)) == NULL)
+      return FAILURE;
+   Store_prune();
+   return SUCCESS;
+}
+
+/*--------------------------------------------------------------------*/
+
+int Store_makeTemp(char *pcPath, size_t iSize)
+
+/* Write the name of a new file an upload can be received into into
+   pcPath of size iSize. Return SUCCESS or FAILURE. */
+
+{
+   assert(pcPath != NULL);
+
+   if (pcStoreDir == NULL)
+      return FAILURE;
+   snprintf(pcPath, iSize, "%s/tmp/%ld.%ld", pcStoreDir, (long)getpid(),
+            lTempCount++);
+   return SUCCESS;
+}
+
+/*--------------------------------------------------------------------*/
+
+int Store_fetch(const unsigned char *pucDigest, uint64_t uSize,
+                const char *pcDest)
+
+/* If the store has an object of uSize bytes with SHA-256 digest
+   pucDigest, link it into place as file pcDest and return SUCCESS.
+   Return FAILURE otherwise. */
+
+{
+   char acObject[PATH_MAX];
+   struct stat sStat;
+
+   assert(pucDigest != NULL);
+   assert(pcDest != NULL);
+
+   if (pcStoreDir == NULL)
+      return FAILURE;
+   Store_objectPath(pucDigest, acObject, sizeof(acObject));
+   if ((stat(acObject, &sStat) == -1) || ((uint64_t)sStat.st_size != uSize))
+      return FAILURE;
+   if (Store_place(acObject, pcDest) != 0)
+      return FAILURE; /* an upload may still work */
+
+   Store_count(1, 1, (long long)uSize, 0, 0);
+   return SUCCESS;
+}
+
+/*--------------------------------------------------------------------*/
+
+int Store_put(const char *pcTemp, const char *pcDest)
+
+/* Add the upload received into pcTemp to the store unless it has the
+   same contents already, and link it into place as file pcDest. Return
+   0, or an errno value. */
+
+{
+   unsigned char aucDigest[SHA256_SIZE];
+   char acObject[PATH_MAX];
+   uint64_t uSize = 0;
+   int iNew = FALSE;
+   int iErr = 0;
+
+   assert(pcTemp != NULL);
+   assert(pcDest != NULL);
+
+   /* Named by what arrived, not by what the client claimed. */
+   if (Common_hashFile(pcTemp, aucDigest, &uSize) == FAILURE)
+   {
+      iErr = errno;
+      unlink(pcTemp);
+      return iErr;
+   }
+   chmod(pcTemp, 0444);
+   Store_objectPath(aucDigest, acObject, sizeof(acObject));
+   if (link(pcTemp, acObject) == 0)
+      iNew = TRUE;
+   else if (errno != EEXIST)
+      acObject[0] = '\0';
+
+   /* Should the object go away in between, pcTemp has the same
+      contents. */
+   if ((acObject[0] == '\0') || (Store_place(acObject, pcDest) != 0))
+   {
+      chmod(pcTemp, PERMISSIONS);
+      if (rename(pcTemp, pcDest) == -1)
+         iErr = errno;
+   }
+   unlink(pcTemp);
+
+   Store_count(1, 0, (long long)uSize, (long long)uSize,
+               iNew ? (long long)uSize : 0);
+   return iErr;
+}
+
+/*--------------------------------------------------------------------*/
+
+int Store_handleStats(SynCmd *psCmd, char *pcProgName)
+
+/* Checks if psCmd is a storestats command. If so, it prints how many
+   uploads and bytes the store has deduplicated. */
+
+{
+   char acPath[PATH_MAX];
+   long long allStats[STORE_STATS];
+   long long llBytes = 0, llLinked = 0, llLinks = 0;
+   struct dirent *psDirent;
+   struct stat sStat;
+   DIR *psDir;
+   int iObjects = 0;
+   int iFD;
+
+   assert(psCmd != NULL);
+   assert(pcProgName != NULL);
+
+   if (psCmd->eVerb != VERB_STORESTATS)
+      return FALSE;
+   if (psCmd->iArgc > 1)
+   {
+      fprintf(stderr, "%s: storestats: too many arguments\n", pcProgName);
+      return TRUE;
+   }
+   if (pcStoreDir == NULL)
+   {
+      printf("store: off\n");
+      return TRUE;
+   }
+
+   snprintf(acPath, sizeof(acPath), "%s/stats", pcStoreDir);
+   if ((iFD = Common_lockCounters(acPath, allStats, STORE_STATS)) == FAILURE)
+   {
+      fprintf(stderr, "%s: storestats: %s\n", pcProgName, strerror(errno));
+      return TRUE;
+   }
+   Common_unlockCounters(iFD, NULL, STORE_STATS);
+
+   /* What the objects hold now, and how often the workspaces have it. */
+   snprintf(acPath, sizeof(acPath), "%s/objects", pcStoreDir);
+   if ((psDir = opendir(acPath)) != NULL)
+   {
+      while ((psDirent = readdir(psDir)) != NULL)
+      {
+         snprintf(acPath, sizeof(acPath), "%s/objects/%s", pcStoreDir,
+                  psDirent->d_name);
+         if ((psDirent->d_name[0] == '.') || (lstat(acPath, &sStat) == -1))
+            continue;
+         iObjects++;
+         llBytes += (long long)sStat.st_size;
+         llLinks += (long long)sStat.st_nlink - 1;
+         llLinked += (long long)sStat.st_size * (sStat.st_nlink - 1);
+      }
+      closedir(psDir);
+   }
+
+   printf("store: %s\n", pcStoreDir);
+   printf("store: %lld uploads, %lld without a transfer\n",
+          allStats[STORE_UPLOADS], allStats[STORE_SKIPPED]);
+   printf("store: %lld bytes uploaded, %lld received, %lld stored "
+          "(%lld not sent, %lld not stored)\n",
+          allStats[STORE_BYTES], allStats[STORE_RECEIVED],
+          allStats[STORE_STORED],
+          allStats[STORE_BYTES] - allStats[STORE_RECEIVED],
+          allStats[STORE_BYTES] - allStats[STORE_STORED]);
+   printf("store: %d objects, %lld bytes, %lld links to them, "
+          "%lld bytes linked (dedup ratio %.2f)\n",
+          iObjects, llBytes, llLinks, llLinked,
+          llBytes ? (double)llLinked / llBytes : 1.0);
+   return TRUE;
+}
+
+/*--------------------------------------------------------------------*/
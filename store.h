@@ -0,0 +1,61 @@
+/*--------------------------------------------------------------------*/
+/* store.h                                                            */
+/* Deduplicating content-addressed store behind sendfile uploads      */
+/*--------------------------------------------------------------------*/
+
+#ifndef STORE_INCLUDED
+#define STORE_INCLUDED
+
+#include "common.h"
+
+/*--------------------------------------------------------------------*/
+
+/* Every uploaded file is kept once, as a read-only object named by the
+   SHA-256 digest of its contents, and each workspace file with those
+   contents is a hardlink to it. The store directory holds
+
+      objects/<digest>   the contents, read-only
+      tmp/               uploads being received
+      stats              upload counts, also used as lock file
+
+   The link count of an object is its reference count: the object
+   itself plus one per workspace file. Objects that no workspace file
+   links to any more are removed when a server opens the store. Since
+   the links share one inode, a workspace file must be replaced (as
+   sendfile and most editors do), not written in place; objects are
+   read-only to make that hard to get wrong. When the store and a
+   workspace are on different file systems the workspace gets a copy
+   instead. */
+
+#define STORE_DEFAULT_DIR ".cloudide-store"
+
+/*--------------------------------------------------------------------*/
+
+int Store_open(const char *pcDir);
+/* Keep uploads in store directory pcDir, created if needed. Return
+   SUCCESS, or FAILURE if pcDir cannot be used; the store stays off
+   then. */
+
+int Store_makeTemp(char *pcPath, size_t iSize);
+/* Write the name of a new file an upload can be received into, in the
+   store, into pcPath of size iSize. Return SUCCESS, or FAILURE if the
+   store is off. */
+
+int Store_fetch(const unsigned char *pucDigest, uint64_t uSize,
+                const char *pcDest);
+/* If the store has an object of uSize bytes with SHA-256 digest
+   pucDigest, link it into place as file pcDest and return SUCCESS.
+   Return FAILURE otherwise; the file then has to be uploaded. */
+
+int Store_put(const char *pcTemp, const char *pcDest);
+/* Add the upload received into pcTemp, a name from Store_makeTemp, to
+   the store unless it has the same contents already, and link it into
+   place as file pcDest. pcTemp is gone afterwards. Return 0, or an
+   errno value if pcDest could not be written. */
+
+int Store_handleStats(SynCmd *psCmd, char *pcProgName);
+/* Checks if psCmd is a storestats command. If so, it prints how many
+   uploads and bytes the store has deduplicated. Returns 1 if command
+   is storestats, 0 otherwise. */
+
+#endif
@@ -0,0 +1,591 @@
+/*--------------------------------------------------------------------*/
+/* stripe.c                                                           */
+/* Downloads of very large files striped over several connections     */
+/*--------------------------------------------------------------------*/
+
+#include "stripe.h"
+#include <endian.h>
+#include <limits.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <time.h>
+
+/*--------------------------------------------------------------------*/
+
+#define STRIPE_OFFER_HEADER 32 /* file fields before the path */
+#define STRIPE_REQUEST_HEADER 40 /* range and file fields before the path */
+
+struct StripeShared
+
+/* What the workers of a download share with each other and with the
+   process that started them, in memory mapped into all of them. */
+
+{
+   uint64_t uNext;
+   /* Next range to take. */
+
+   uint64_t uDone;
+   /* Ranges that arrived intact. */
+
+   uint64_t uBytes;
+   /* Bytes written so far, for measuring throughput. */
+};
+
+/*--------------------------------------------------------------------*/
+
+static void Stripe_putBe32(unsigned char *puc, uint32_t u)
+
+/* Store u at puc in network byte order. */
+
+{
+   u = htobe32(u);
+   memcpy(puc, &u, sizeof(u));
+}
+
+/*--------------------------------------------------------------------*/
+
+static void Stripe_putBe64(unsigned char *puc, uint64_t u)
+
+/* Store u at puc in network byte order. */
+
+{
+   u = htobe64(u);
+   memcpy(puc, &u, sizeof(u));
+}
+
+/*--------------------------------------------------------------------*/
+
+static uint32_t Stripe_getBe32(const unsigned char *puc)
+
+/* Return the number stored at puc in network byte order. */
+
+{
+   uint32_t u;
+
+   memcpy(&u, puc, sizeof(u));
+   return be32toh(u);
+}
+
+/*--------------------------------------------------------------------*/
+
+static uint64_t Stripe_getBe64(const unsigned char *puc)
+
+/* Return the number stored at puc in network byte order. */
+
+{
+   uint64_t u;
+
+   memcpy(&u, puc, sizeof(u));
+   return be64toh(u);
+}
+
+/*--------------------------------------------------------------------*/
+
+static uint64_t Stripe_mtime(const struct stat *psStat)
+
+/* Return the modification time in *psStat in nanoseconds. */
+
+{
+   return (uint64_t)psStat->st_mtim.tv_sec * 1000000000 +
+          (uint64_t)psStat->st_mtim.tv_nsec;
+}
+
+/*--------------------------------------------------------------------*/
+
+int Stripe_describe(const char *pcSource, StripeFile *psFile)
+
+/* Store a description of file pcSource in *psFile. Return 1 (TRUE) if
+   it is worth striping, 0 (FALSE) otherwise. */
+
+{
+   char acPath[PATH_MAX];
+   struct stat sStat;
+
+   assert(pcSource != NULL);
+   assert(psFile != NULL);
+
+   /* Other connections start out in another directory. */
+   if ((realpath(pcSource, acPath) == NULL) ||
+       (strlen(acPath) > STRIPE_MAX_PATH) ||
+       (stat(acPath, &sStat) == -1) || (! S_ISREG(sStat.st_mode)) ||
+       (sStat.st_size < STRIPE_MIN_SIZE))
+      return FALSE;
+
+   memset(psFile, 0, sizeof(*psFile));
+   psFile->uSize = (uint64_t)sStat.st_size;
+   psFile->uMtime = Stripe_mtime(&sStat);
+   psFile->uInode = (uint64_t)sStat.st_ino;
+   psFile->uMode = (uint32_t)(sStat.st_mode & 07777);
+   psFile->uRangeSize = STRIPE_RANGE_SIZE;
+   strcpy(psFile->acPath, acPath);
+   return TRUE;
+}
+
+/*--------------------------------------------------------------------*/
+
+int Stripe_sendOffer(int iSockFD, uint32_t uId, const StripeFile *psFile)
+
+/* Offer the file *psFile for request uId. Return SUCCESS or FAILURE. */
+
+{
+   unsigned char aucPayload[STRIPE_OFFER_HEADER + STRIPE_MAX_PATH];
+   size_t iPath;
+
+   assert(psFile != NULL);
+
+   iPath = strlen(psFile->acPath);
+   Stripe_putBe64(aucPayload, psFile->uSize);
+   Stripe_putBe64(aucPayload + 8, psFile->uMtime);
+   Stripe_putBe64(aucPayload + 16, psFile->uInode);
+   Stripe_putBe32(aucPayload + 24, psFile->uMode);
+   Stripe_putBe32(aucPayload + 28, psFile->uRangeSize);
+   memcpy(aucPayload + STRIPE_OFFER_HEADER, psFile->acPath, iPath);
+   return Proto_writeFrame(iSockFD, PROTO_STRIPE, 0, uId, aucPayload,
+                           STRIPE_OFFER_HEADER + iPath);
+}
+
+/*--------------------------------------------------------------------*/
+
+RecvBufRead Stripe_readOffer(RecvBuf_T oBuf, uint32_t uId,
+                             StripeFile *psFile)
+
+/* Read the PROTO_STRIPE frame of request uId from oBuf into
+   *psFile. */
+
+{
+   unsigned char aucPayload[STRIPE_OFFER_HEADER + STRIPE_MAX_PATH];
+   ProtoHeader sHeader;
+   RecvBufRead eRead;
+   size_t iPath;
+
+   assert(oBuf != NULL);
+   assert(psFile != NULL);
+
+   eRead = Proto_readFrame(oBuf, &sHeader, aucPayload, sizeof(aucPayload));
+   if (eRead != RECVBUF_OK)
+      return eRead;
+   if ((sHeader.eType != PROTO_STRIPE) || (sHeader.uId != uId) ||
+       (sHeader.uLength <= STRIPE_OFFER_HEADER))
+      return RECVBUF_ERROR;
+
+   memset(psFile, 0, sizeof(*psFile));
+   psFile->uSize = Stripe_getBe64(aucPayload);
+   psFile->uMtime = Stripe_getBe64(aucPayload + 8);
+   psFile->uInode = Stripe_getBe64(aucPayload + 16);
+   psFile->uMode = Stripe_getBe32(aucPayload + 24) & 07777;
+   psFile->uRangeSize = Stripe_getBe32(aucPayload + 28);
+   iPath = (size_t)sHeader.uLength - STRIPE_OFFER_HEADER;
+   memcpy(psFile->acPath, aucPayload + STRIPE_OFFER_HEADER, iPath);
+   psFile->acPath[iPath] = '\0';
+   if ((psFile->uRangeSize == 0) || (psFile->acPath[0] != '/') ||
+       (strlen(psFile->acPath) != iPath))
+      return RECVBUF_ERROR;
+   return RECVBUF_OK;
+}
+
+/*--------------------------------------------------------------------*/
+
+static int Stripe_sendData(int iSockFD, uint32_t uId, int iFD,
+                           uint64_t uOffset, uint64_t uLength,
+                           unsigned char *pucDigest)
+
+/* Send the uLength bytes at uOffset in the file open at iFD as
+   PROTO_DATA frames of request uId, and store their digest in
+   pucDigest. Return SUCCESS, FAILURE, or a positive errno value if the
+   file could not be read. */
+
+{
+   char acBuf[PROTO_LZ_CHUNK];
+   Sha256 sHash;
+   ssize_t iGot;
+   size_t iWant;
+
+   Sha256_init(&sHash);
+   while (uLength > 0)
+   {
+      iWant = (uLength < sizeof(acBuf)) ? (size_t)uLength : sizeof(acBuf);
+      iGot = pread(iFD, acBuf, iWant, (off_t)uOffset);
+      if ((iGot == -1) && (errno == EINTR))
+         continue;
+      if (iGot <= 0)
+         return (iGot == 0) ? ESTALE : errno; /* the file shrank */
+      if (Proto_sendBytes(iSockFD, uId, acBuf, (size_t)iGot) == FAILURE)
+         return FAILURE;
+      Sha256_update(&sHash, acBuf, (size_t)iGot);
+      uOffset += (uint64_t)iGot;
+      uLength -= (uint64_t)iGot;
+   }
+   Sha256_final(&sHash, pucDigest);
+   return SUCCESS;
+}
+
+/*--------------------------------------------------------------------*/
+
+int Stripe_sendRange(int iSockFD, uint32_t uId, const void *pvRequest,
+                     uint64_t uLength)
+
+/* Answer the range request of uLength bytes at pvRequest, request uId,
+   with the data of the range, its digest and a PROTO_END. Return
+   SUCCESS, or FAILURE if the connection failed. */
+
+{
+   const unsigned char *pucRequest = (const unsigned char*)pvRequest;
+   unsigned char aucDigest[SHA256_SIZE];
+   char acPath[STRIPE_MAX_PATH + 1];
+   uint64_t uOffset = 0, uRange = 0;
+   struct stat sStat;
+   size_t iPath;
+   int iFD = -1;
+   int iRet = EINVAL;
+
+   assert(pvRequest != NULL);
+
+   if ((uLength > STRIPE_REQUEST_HEADER) &&
+       ((iPath = (size_t)uLength - STRIPE_REQUEST_HEADER) <= STRIPE_MAX_PATH))
+   {
+      memcpy(acPath, pucRequest + STRIPE_REQUEST_HEADER, iPath);
+      acPath[iPath] = '\0';
+      uOffset = Stripe_getBe64(pucRequest);
+      uRange = Stripe_getBe64(pucRequest + 8);
+
+      /* Only ranges of the very file that was offered. */
+      if ((iFD = open(acPath, O_RDONLY | O_CLOEXEC)) == -1)
+         iRet = errno;
+      else if (fstat(iFD, &sStat) == -1)
+         iRet = errno;
+      else if (((uint64_t)sStat.st_size != Stripe_getBe64(pucRequest + 16)) ||
+               (Stripe_mtime(&sStat) != Stripe_getBe64(pucRequest + 24)) ||
+               ((uint64_t)sStat.st_ino != Stripe_getBe64(pucRequest + 32)))
+         iRet = ESTALE;
+      else if ((uOffset > (uint64_t)sStat.st_size) ||
+               (uRange > (uint64_t)sStat.st_size - uOffset))
+         iRet = EINVAL;
+      else
+         iRet = Stripe_sendData(iSockFD, uId, iFD, uOffset, uRange,
+                                aucDigest);
+      if (iFD != -1)
+         close(iFD);
+   }
+
+   if (iRet == SUCCESS)
+      iRet = Proto_sendHave(iSockFD, uId, 0, aucDigest, uRange);
+   if (iRet == FAILURE)
+      return FAILURE;
+   return Proto_sendEnd(iSockFD, uId, iRet);
+}
+
+/*--------------------------------------------------------------------*/
+
+static int Stripe_request(int iSockFD, const StripeFile *psFile,
+                          uint64_t uRange)
+
+/* Ask for range uRange of the file *psFile, as request uRange + 1.
+   Return SUCCESS or FAILURE. */
+
+{
+   unsigned char aucPayload[STRIPE_REQUEST_HEADER + STRIPE_MAX_PATH];
+   uint64_t uOffset = uRange * psFile->uRangeSize;
+   uint64_t uLength = psFile->uSize - uOffset;
+   size_t iPath = strlen(psFile->acPath);
+
+   if (uLength > psFile->uRangeSize)
+      uLength = psFile->uRangeSize;
+   Stripe_putBe64(aucPayload, uOffset);
+   Stripe_putBe64(aucPayload + 8, uLength);
+   Stripe_putBe64(aucPayload + 16, psFile->uSize);
+   Stripe_putBe64(aucPayload + 24, psFile->uMtime);
+   Stripe_putBe64(aucPayload + 32, psFile->uInode);
+   memcpy(aucPayload + STRIPE_REQUEST_HEADER, psFile->acPath, iPath);
+   return Proto_writeFrame(iSockFD, PROTO_STRIPE, 0, (uint32_t)(uRange + 1),
+                           aucPayload, STRIPE_REQUEST_HEADER + iPath);
+}
+
+/*--------------------------------------------------------------------*/
+
+static int Stripe_recvRange(RecvBuf_T oBuf, const StripeFile *psFile,
+                            uint64_t uRange, int iOutFD,
+                            struct StripeShared *psShared)
+
+/* Receive range uRange of the file *psFile from oBuf into the file
+   open at iOutFD, at its offset there, and check its digest. Return 0,
+   or an errno value. */
+
+{
+   unsigned char aucExpected[SHA256_SIZE];
+   unsigned char aucDigest[SHA256_SIZE];
+   char acBuf[PROTO_LZ_CHUNK];
+   uint32_t uId = (uint32_t)(uRange + 1);
+   uint64_t uOffset = uRange * psFile->uRangeSize;
+   uint64_t uLength = psFile->uSize - uOffset;
+   uint64_t uExpected = 0;
+   uint64_t uGot = 0;
+   uint64_t uLeft;
+   uint32_t uStatus;
+   ProtoHeader sHeader;
+   Sha256 sHash;
+   ssize_t iGot;
+   int iHaveDigest = FALSE;
+
+   if (uLength > psFile->uRangeSize)
+      uLength = psFile->uRangeSize;
+   Sha256_init(&sHash);
+
+   for (;;)
+   {
+      if ((Proto_peekHeader(oBuf, &sHeader) != RECVBUF_OK) ||
+          (sHeader.uId != uId))
+         return EIO;
+
+      if (sHeader.eType == PROTO_HAVE)
+      {
+         if (Proto_readHave(oBuf, uId, aucExpected, &uExpected)
+             != RECVBUF_OK)
+            return EIO;
+         iHaveDigest = TRUE;
+         continue;
+      }
+
+      Proto_readHeader(oBuf, &sHeader);
+      if (sHeader.eType == PROTO_END)
+      {
+         if ((sHeader.uLength != sizeof(uStatus)) ||
+             (RecvBuf_readn(oBuf, &uStatus, sizeof(uStatus))
+              != sizeof(uStatus)))
+            return EIO;
+         if (be32toh(uStatus) != 0)
+            return (int)be32toh(uStatus);
+         Sha256_final(&sHash, aucDigest);
+         if ((! iHaveDigest) || (uExpected != uLength) ||
+             (uGot != uLength) ||
+             (memcmp(aucDigest, aucExpected, SHA256_SIZE) != 0))
+            return EIO;
+         return 0;
+      }
+
+      if (sHeader.eType != PROTO_DATA)
+         return EIO;
+      for (uLeft = sHeader.uLength; uLeft > 0;)
+      {
+         iGot = Proto_readData(oBuf, &sHeader, &uLeft, acBuf, sizeof(acBuf));
+         if ((iGot <= 0) || ((uint64_t)iGot > uLength - uGot))
+            return EIO;
+         if (Common_pwriten(iOutFD, acBuf, (size_t)iGot,
+                            (off_t)(uOffset + uGot)) == FAILURE)
+            return errno ? errno : EIO;
+         Sha256_update(&sHash, acBuf, (size_t)iGot);
+         uGot += (uint64_t)iGot;
+         __atomic_fetch_add(&psShared->uBytes, (uint64_t)iGot,
+                            __ATOMIC_RELAXED);
+      }
+   }
+}
+
+/*--------------------------------------------------------------------*/
+
+static int Stripe_work(const struct sockaddr_in *psServer,
+                       const StripeFile *psFile, int iOutFD,
+                       struct StripeShared *psShared)
+
+/* Take ranges of the file *psFile and fetch them from the server at
+   *psServer into the file open at iOutFD, over a connection of this
+   worker's own, until none are left. Return 0, or an errno value. */
+
+{
+   uint64_t uRanges = (psFile->uSize + psFile->uRangeSize - 1) /
+                      psFile->uRangeSize;
+   uint64_t uRange, uNext;
+   RecvBuf_T oBuf;
+   int iSockFD;
+   int iOn = 1;
+   int iErr = 0;
+
+   if ((iSockFD = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0)) == -1)
+      return errno;
+   setsockopt(iSockFD, IPPROTO_TCP, TCP_NODELAY, &iOn, sizeof(iOn));
+   if (connect(iSockFD, (const struct sockaddr*)psServer,
+               sizeof(*psServer)) == -1)
+   {
+      iErr = errno;
+      close(iSockFD);
+      return iErr;
+   }
+   if ((oBuf = RecvBuf_new(iSockFD)) == NULL)
+   {
+      close(iSockFD);
+      return ENOMEM;
+   }
+   if (Proto_clientHello(iSockFD, oBuf) < PROTO_VERSION_STRIPE)
+      iErr = EPROTO;
+
+   /* One request ahead, so that the server never waits for the next
+      one. */
+   uRange = __atomic_fetch_add(&psShared->uNext, 1, __ATOMIC_RELAXED);
+   if ((iErr == 0) && (uRange < uRanges) &&
+       (Stripe_request(iSockFD, psFile, uRange) == FAILURE))
+      iErr = EIO;
+   while ((iErr == 0) && (uRange < uRanges))
+   {
+      uNext = __atomic_fetch_add(&psShared->uNext, 1, __ATOMIC_RELAXED);
+      if ((uNext < uRanges) &&
+          (Stripe_request(iSockFD, psFile, uNext) == FAILURE))
+         iErr = EIO;
+      if ((iErr == 0) &&
+          ((iErr = Stripe_recvRange(oBuf, psFile, uRange, iOutFD,
+                                    psShared)) == 0))
+         __atomic_fetch_add(&psShared->uDone, 1, __ATOMIC_RELAXED);
+      uRange = uNext;
+   }
+
+   RecvBuf_free(oBuf);
+   close(iSockFD);
+   return iErr;
+}
+
+/*--------------------------------------------------------------------*/
+
+static pid_t Stripe_startWorker(const struct sockaddr_in *psServer,
+                                const StripeFile *psFile, int iOutFD,
+                                struct StripeShared *psShared)
+
+/* Start a worker process fetching ranges of the file *psFile. Return
+   its pid, or FAILURE. */
+
+{
+   pid_t iPid;
+
+   fflush(NULL);
+   if ((iPid = fork()) == -1)
+      return FAILURE;
+   if (iPid == 0)
+      _exit(Stripe_work(psServer, psFile, iOutFD, psShared));
+   return iPid;
+}
+
+/*--------------------------------------------------------------------*/
+
+static double Stripe_now(void)
+
+/* Return the time on the monotonic clock in seconds. */
+
+{
+   struct timespec sNow;
+
+   clock_gettime(CLOCK_MONOTONIC, &sNow);
+   return (double)sNow.tv_sec + sNow.tv_nsec / 1e9;
+}
+
+/*--------------------------------------------------------------------*/
+
+int Stripe_fetch(const struct sockaddr_in *psServer,
+                 const StripeFile *psFile, const char *pcDest,
+                 int iMaxStreams)
+
+/* Download file *psFile from the server at *psServer into file pcDest
+   over at most iMaxStreams connections. Return 0, or an errno
+   value. */
+
+{
+   pid_t aiPids[STRIPE_MAX_STREAMS];
+   char acTemp[PATH_MAX];
+   struct StripeShared *psShared;
+   uint64_t uRanges, uBytes, uLastBytes = 0;
+   double dNow, dLast, dRate, dBest = -1.0;
+   int iStreams = 0, iRunning = 0, iWarm = 0;
+   int iGrow = TRUE;
+   int iStatus = 0;
+   int iOutFD;
+   int iErr = 0;
+   int i;
+
+   assert(psServer != NULL);
+   assert(psFile != NULL);
+   assert(pcDest != NULL);
+
+   uRanges = (psFile->uSize + psFile->uRangeSize - 1) / psFile->uRangeSize;
+   if (iMaxStreams > STRIPE_MAX_STREAMS)
+      iMaxStreams = STRIPE_MAX_STREAMS;
+   if ((uint64_t)iMaxStreams > uRanges)
+      iMaxStreams = (int)uRanges;
+
+   /* Every worker writes its ranges in place. */
+   snprintf(acTemp, sizeof(acTemp), "%s.%ld.stripe", pcDest, (long)getpid());
+   iOutFD = open(acTemp, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, PERMISSIONS);
+   if (iOutFD == -1)
+      return errno;
+   if ((fchmod(iOutFD, psFile->uMode) == -1) ||
+       (ftruncate(iOutFD, (off_t)psFile->uSize) == -1))
+   {
+      iErr = errno;
+      close(iOutFD);
+      unlink(acTemp);
+      return iErr;
+   }
+   psShared = mmap(NULL, sizeof(*psShared), PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+   if (psShared == MAP_FAILED)
+   {
+      iErr = errno;
+      close(iOutFD);
+      unlink(acTemp);
+      return iErr;
+   }
+   memset(psShared, 0, sizeof(*psShared));
+
+   dLast = Stripe_now();
+   while ((iRunning > 0) || (iStreams == 0))
+   {
+      /* A stream more while the last one paid off. */
+      while ((iStreams < iMaxStreams) && iGrow &&
+             ((iStreams < STRIPE_FIRST_STREAMS) || (iWarm < 0)) &&
+             (__atomic_load_n(&psShared->uNext, __ATOMIC_RELAXED) < uRanges))
+      {
+         if ((aiPids[iStreams] = Stripe_startWorker(psServer, psFile, iOutFD,
+                                                    psShared)) == FAILURE)
+         {
+            iGrow = FALSE;
+            break;
+         }
+         iStreams++;
+         iRunning++;
+         iWarm = 1; /* the first sample includes its start */
+      }
+      if (iRunning == 0)
+         break;
+
+      poll(NULL, 0, STRIPE_SAMPLE_MS);
+      for (i = 0; i < iStreams; i++)
+         if ((aiPids[i] != 0) && (waitpid(aiPids[i], &iStatus, WNOHANG) > 0))
+         {
+            aiPids[i] = 0;
+            iRunning--;
+            if ((iErr == 0) && WIFEXITED(iStatus) && WEXITSTATUS(iStatus))
+               iErr = WEXITSTATUS(iStatus);
+         }
+
+      dNow = Stripe_now();
+      uBytes = __atomic_load_n(&psShared->uBytes, __ATOMIC_RELAXED);
+      dRate = (double)(uBytes - uLastBytes) / (dNow - dLast);
+      uLastBytes = uBytes;
+      dLast = dNow;
+      if (iWarm-- > 0)
+         continue;
+      if (dRate * 100 < dBest * (100 + STRIPE_GAIN))
+         iGrow = FALSE;
+      else
+         dBest = dRate;
+   }
+
+   if ((iErr == 0) && (psShared->uDone != uRanges))
+      iErr = EIO;
+   munmap(psShared, sizeof(*psShared));
+   if ((close(iOutFD) == -1) && (iErr == 0))
+      iErr = errno;
+   if ((iErr == 0) && (rename(acTemp, pcDest) == -1))
+      iErr = errno;
+   if (iErr != 0)
+      unlink(acTemp);
+   return iErr;
+}
+
+/*--------------------------------------------------------------------*/
@@ -0,0 +1,104 @@
+/*--------------------------------------------------------------------*/
+/* stripe.h                                                           */
+/* Downloads of very large files striped over several connections     */
+/*--------------------------------------------------------------------*/
+
+#ifndef STRIPE_INCLUDED
+#define STRIPE_INCLUDED
+
+#include "common.h"
+
+/*--------------------------------------------------------------------*/
+
+/* One TCP stream cannot fill a link with a large bandwidth-delay
+   product, so a large download may go over several. The server offers
+   it in a PROTO_STRIPE frame:
+
+      bytes 0-7     size of the file
+      bytes 8-15    modification time, in nanoseconds
+      bytes 16-23   inode number
+      bytes 24-27   mode
+      bytes 28-31   range size
+      then          absolute path of the file
+
+   The client creates the file at its full size under a temporary name
+   and starts worker processes, each with a connection of its own,
+   that take the ranges of the file in turn. A worker asks for a range
+   with a PROTO_STRIPE frame:
+
+      bytes 0-7     offset of the range
+      bytes 8-15    length of the range
+      bytes 16-23   size of the file
+      bytes 24-31   modification time of the file
+      bytes 32-39   inode number of the file
+      then          absolute path of the file
+
+   and the server answers with PROTO_DATA frames of the range, a
+   PROTO_HAVE frame with the SHA-256 digest and length of the range,
+   and PROTO_END, with status ESTALE if the file is not the one offered
+   any more. The worker writes the data at its offset and checks the
+   digest. The client starts with STRIPE_FIRST_STREAMS workers and adds
+   one more while each addition raises the throughput by STRIPE_GAIN
+   percent, up to the number of streams the user allowed. The file is
+   renamed into place once all ranges have arrived intact. */
+
+#define STRIPE_MIN_SIZE (64 * 1024 * 1024) /* smaller files use one stream */
+#define STRIPE_RANGE_SIZE (8 * 1024 * 1024) /* bytes per range */
+#define STRIPE_MAX_STREAMS 16 /* most connections of one download */
+#define STRIPE_FIRST_STREAMS 2 /* connections a download starts with */
+#define STRIPE_SAMPLE_MS 250 /* how often throughput is measured */
+#define STRIPE_GAIN 10 /* percent a new stream must add to get another */
+#define STRIPE_MAX_PATH (MAX_LINE_SIZE - 41) /* longest path striped */
+
+typedef struct StripeFile
+{
+   uint64_t uSize;
+   /* Bytes in the file. */
+
+   uint64_t uMtime;
+   /* Modification time, in nanoseconds. */
+
+   uint64_t uInode;
+   /* Inode number. */
+
+   uint32_t uMode;
+   /* Permission bits. */
+
+   uint32_t uRangeSize;
+   /* Bytes per range. */
+
+   char acPath[STRIPE_MAX_PATH + 1];
+   /* Absolute path on the server. */
+} StripeFile;
+/* A file offered for a striped download. */
+
+/*--------------------------------------------------------------------*/
+
+int Stripe_describe(const char *pcSource, StripeFile *psFile);
+/* Store a description of file pcSource in *psFile. Return 1 (TRUE) if
+   it is worth striping, 0 (FALSE) otherwise. */
+
+int Stripe_sendOffer(int iSockFD, uint32_t uId, const StripeFile *psFile);
+/* Offer the file *psFile for request uId. Return SUCCESS or FAILURE. */
+
+RecvBufRead Stripe_readOffer(RecvBuf_T oBuf, uint32_t uId,
+                             StripeFile *psFile);
+/* Read the PROTO_STRIPE frame of request uId from oBuf into *psFile.
+   Return values are as for Proto_readHeader, and a frame of another
+   type or request, or one that does not describe a file, is
+   RECVBUF_ERROR. */
+
+int Stripe_sendRange(int iSockFD, uint32_t uId, const void *pvRequest,
+                     uint64_t uLength);
+/* Answer the range request of uLength bytes at pvRequest, request uId,
+   with the data of the range, its digest and a PROTO_END. Return
+   SUCCESS, or FAILURE if the connection failed. */
+
+int Stripe_fetch(const struct sockaddr_in *psServer,
+                 const StripeFile *psFile, const char *pcDest,
+                 int iMaxStreams);
+/* Download file *psFile from the server at *psServer into file pcDest
+   over at most iMaxStreams connections. Return 0, or an errno value;
+   pcDest is not touched then. */
+
+#endif
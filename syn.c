@@ -68,7 +68,8 @@ char *Syn_returnValue(void *pvItem)
 
 void Syn_freeCmd(void *pvItem, void *pvExtra)
 
-/* Free command word pvItem. pvExtra is unused. */
+/* Free command word pvItem. pvExtra is unused. Not for command words
+   allocated from an arena. */
 
 {
    Cmd_T psCmd = NULL;
@@ -82,15 +83,30 @@ void Syn_freeCmd(void *pvItem, void *pvExtra)
 
 /*--------------------------------------------------------------------*/
 
-static Cmd_T Syn_makeCmd(CmdType eCmdType, char *pcValue)
+static Cmd_T Syn_makeCmd(CmdType eCmdType, char *pcValue,
+                         Arena_T oArena)
 
 /* Create and return a Command word whose type is eCmdType and whose
-   value consists of string pcValue. Return NULL if insufficient
-   memory is available. The caller owns the command. */
+   value consists of string pcValue, allocated from oArena if it is
+   not NULL. Return NULL if insufficient memory is available. The
+   caller owns a command that is not in an arena. */
 
 {
    Cmd_T psCmd = NULL;
 
+   if (oArena != NULL)
+   {
+      psCmd = (Cmd_T)Arena_alloc(oArena, sizeof(struct Cmd));
+      if (psCmd == NULL)
+         return NULL;
+      psCmd->eType = eCmdType;
+      psCmd->pcValue = NULL;
+      if ((pcValue != NULL) &&
+          ((psCmd->pcValue = Arena_strdup(oArena, pcValue)) == NULL))
+         return NULL;
+      return psCmd;
+   }
+
    psCmd = (Cmd_T)malloc(sizeof(struct Cmd));
    /* Insufficient memory. */
    if (psCmd == NULL)
@@ -119,13 +135,15 @@ static Cmd_T Syn_makeCmd(CmdType eCmdType, char *pcValue)
 
 /*--------------------------------------------------------------------*/
 
-int Syn_synLine(DynArray_T oTokens, DynArray_T oCmds, char *pcProgName)
+int Syn_synLine(DynArray_T oTokens, DynArray_T oCmds, Arena_T oArena,
+                char *pcProgName)
 
 /* Syntactically analyze the token array oTokens. Populate oCmds
    with tokens that oTokens contains along with their type. 
    Return 1 (TRUE) if successful, or 0 (FALSE) otherwise. In the 
    latter case, oCmds may contain tokens that were discovered before 
-   the error. The caller owns the tokens placed in oCmds. */ 
+   the error. The command words are allocated from oArena, or owned
+   by the caller if it is NULL. */ 
 
 {
    int iLength;
@@ -159,7 +177,7 @@ int Syn_synLine(DynArray_T oTokens, DynArray_T oCmds, char *pcProgName)
    /* Quoted command name added without check. */
    if (Lex_returnType(psToken) == TOKEN_QUOTE)
    {
-      psCmd = Syn_makeCmd(CMD_CMD, Lex_returnValue(psToken));
+      psCmd = Syn_makeCmd(CMD_CMD, Lex_returnValue(psToken), oArena);
       if (psCmd == NULL)
       {
          fprintf(stderr, "%s: cannot allocate memory\n", pcProgName);
@@ -181,7 +199,7 @@ int Syn_synLine(DynArray_T oTokens, DynArray_T oCmds, char *pcProgName)
    /* Add command name. */
    else
    {
-      psCmd = Syn_makeCmd(CMD_CMD, Lex_returnValue(psToken));
+      psCmd = Syn_makeCmd(CMD_CMD, Lex_returnValue(psToken), oArena);
       if (psCmd == NULL)
       {
          fprintf(stderr, "%s: cannot allocate memory\n", pcProgName);
@@ -201,7 +219,7 @@ int Syn_synLine(DynArray_T oTokens, DynArray_T oCmds, char *pcProgName)
       /* Quoted arguments added without check. */
       if (Lex_returnType(psToken) == TOKEN_QUOTE)
       {
-         psCmd = Syn_makeCmd(CMD_ARG, Lex_returnValue(psToken));
+         psCmd = Syn_makeCmd(CMD_ARG, Lex_returnValue(psToken), oArena);
          if (psCmd == NULL)
          {
             fprintf(stderr, "%s: cannot allocate memory\n", pcProgName);
@@ -266,7 +284,7 @@ int Syn_synLine(DynArray_T oTokens, DynArray_T oCmds, char *pcProgName)
       /* Add argument. */
       else
       {
-         psCmd = Syn_makeCmd(CMD_ARG, Lex_returnValue(psToken));
+         psCmd = Syn_makeCmd(CMD_ARG, Lex_returnValue(psToken), oArena);
          if (psCmd == NULL)
          {
             fprintf(stderr, "%s: cannot allocate memory\n", pcProgName);
@@ -284,7 +302,7 @@ int Syn_synLine(DynArray_T oTokens, DynArray_T oCmds, char *pcProgName)
    /* No stdin redirection. */
    if (!iStdinFlag)
    {
-      psCmd = Syn_makeCmd(CMD_STDIN, NULL);
+      psCmd = Syn_makeCmd(CMD_STDIN, NULL, oArena);
       if (psCmd == NULL)
       {
          fprintf(stderr, "%s: cannot allocate memory\n", pcProgName);
@@ -311,7 +329,7 @@ int Syn_synLine(DynArray_T oTokens, DynArray_T oCmds, char *pcProgName)
       /* Quoted file name added without check. */
       if (Lex_returnType(psToken) == TOKEN_QUOTE)
       {
-         psCmd = Syn_makeCmd(CMD_STDIN, Lex_returnValue(psToken));
+         psCmd = Syn_makeCmd(CMD_STDIN, Lex_returnValue(psToken), oArena);
          if (psCmd == NULL)
          {
             fprintf(stderr, "%s: cannot allocate memory\n", pcProgName);
@@ -335,7 +353,7 @@ int Syn_synLine(DynArray_T oTokens, DynArray_T oCmds, char *pcProgName)
       /* Add stdin redirection. */
       else
       {
-         psCmd = Syn_makeCmd(CMD_STDIN, Lex_returnValue(psToken));
+         psCmd = Syn_makeCmd(CMD_STDIN, Lex_returnValue(psToken), oArena);
          if (psCmd == NULL)
          {
             fprintf(stderr, "%s: cannot allocate memory\n", pcProgName);
@@ -354,7 +372,7 @@ int Syn_synLine(DynArray_T oTokens, DynArray_T oCmds, char *pcProgName)
    /* No stdout redirection. */
    if (!iStdoutFlag)
    {
-      psCmd = Syn_makeCmd(CMD_STDOUT, NULL);
+      psCmd = Syn_makeCmd(CMD_STDOUT, NULL, oArena);
       if (psCmd == NULL)
       {
          fprintf(stderr, "%s: cannot allocate memory\n", pcProgName);
@@ -381,7 +399,7 @@ int Syn_synLine(DynArray_T oTokens, DynArray_T oCmds, char *pcProgName)
       /* Quoted file name added without check. */
       if (Lex_returnType(psToken) == TOKEN_QUOTE)
       {
-         psCmd = Syn_makeCmd(CMD_STDOUT, Lex_returnValue(psToken));
+         psCmd = Syn_makeCmd(CMD_STDOUT, Lex_returnValue(psToken), oArena);
          if (psCmd == NULL)
          {
             fprintf(stderr, "%s: cannot allocate memory\n", pcProgName);
@@ -405,7 +423,7 @@ int Syn_synLine(DynArray_T oTokens, DynArray_T oCmds, char *pcProgName)
       /* Add stdout redirection. */
       else
       {
-         psCmd = Syn_makeCmd(CMD_STDOUT, Lex_returnValue(psToken));
+         psCmd = Syn_makeCmd(CMD_STDOUT, Lex_returnValue(psToken), oArena);
          if (psCmd == NULL)
          {
             fprintf(stderr, "%s: cannot allocate memory\n", pcProgName);
@@ -423,7 +441,7 @@ int Syn_synLine(DynArray_T oTokens, DynArray_T oCmds, char *pcProgName)
    /* No stderr redirection. */
    if (!iStderrFlag)
    {
-      psCmd = Syn_makeCmd(CMD_STDERR, NULL);
+      psCmd = Syn_makeCmd(CMD_STDERR, NULL, oArena);
       if (psCmd == NULL)
       {
          fprintf(stderr, "%s: cannot allocate memory\n", pcProgName);
@@ -450,7 +468,7 @@ int Syn_synLine(DynArray_T oTokens, DynArray_T oCmds, char *pcProgName)
       /* Quoted file name added without check. */
       if (Lex_returnType(psToken) == TOKEN_QUOTE)
       {
-         psCmd = Syn_makeCmd(CMD_STDERR, Lex_returnValue(psToken));
+         psCmd = Syn_makeCmd(CMD_STDERR, Lex_returnValue(psToken), oArena);
          if (psCmd == NULL)
          {
             fprintf(stderr, "%s: cannot allocate memory\n", pcProgName);
@@ -474,7 +492,7 @@ int Syn_synLine(DynArray_T oTokens, DynArray_T oCmds, char *pcProgName)
       /* Add stdout redirection. */
       else
       {
-         psCmd = Syn_makeCmd(CMD_STDERR, Lex_returnValue(psToken));
+         psCmd = Syn_makeCmd(CMD_STDERR, Lex_returnValue(psToken), oArena);
          if (psCmd == NULL)
          {
             fprintf(stderr, "%s: cannot allocate memory\n", pcProgName);
@@ -491,3 +509,296 @@ int Syn_synLine(DynArray_T oTokens, DynArray_T oCmds, char *pcProgName)
 }
 
 /*--------------------------------------------------------------------*/
+
+static const struct SynVerbName
+{
+   const char *pcName;
+   SynVerb eVerb;
+} asVerbNames[] = {
+   {CMDNAME_REMOTE, VERB_REMOTE},
+   {CMDNAME_SEND, VERB_SEND},
+   {CMDNAME_RECV, VERB_RECV},
+   {"cd", VERB_CD},
+   {"setenv", VERB_SETENV},
+   {"unsetenv", VERB_UNSETENV},
+   {"exit", VERB_EXIT},
+   {"cachestats", VERB_CACHESTATS},
+   {"storestats", VERB_STORESTATS},
+   {CMDNAME_BUILD, VERB_BUILD},
+   {"jobs", VERB_JOBS},
+   {"jobout", VERB_JOBOUT},
+   {"jobwait", VERB_JOBWAIT},
+   {"jobkill", VERB_JOBKILL}
+};
+/* The name of each verb but VERB_OTHER. */
+
+/*--------------------------------------------------------------------*/
+
+SynVerb Syn_verb(const char *pcName)
+
+/* Return the verb of a command named pcName. */
+
+{
+   size_t i;
+
+   assert(pcName != NULL);
+
+   for (i = 0; i < sizeof(asVerbNames) / sizeof(asVerbNames[0]); i++)
+      if ((pcName[0] == asVerbNames[i].pcName[0]) &&
+          (strcmp(pcName, asVerbNames[i].pcName) == 0))
+         return asVerbNames[i].eVerb;
+   return VERB_OTHER;
+}
+
+/*--------------------------------------------------------------------*/
+
+void Syn_shift(SynCmd *psCmd)
+
+/* Drop the first word of command *psCmd and make the next one its
+   name. */
+
+{
+   assert(psCmd != NULL);
+   assert(psCmd->iArgc > 0);
+
+   psCmd->ppcArgv++;
+   psCmd->iArgc--;
+   psCmd->eVerb = (psCmd->iArgc > 0) ? Syn_verb(psCmd->ppcArgv[0])
+      : VERB_OTHER;
+}
+
+/*--------------------------------------------------------------------*/
+
+static CmdType Syn_redirection(const char *pcLine, const LexSlice *psSlice)
+
+/* Return CMD_STDIN, CMD_STDOUT or CMD_STDERR if slice psSlice of
+   pcLine is a redirection operator ("<" or "0<", ">" or "1>", "2>"),
+   or CMD_ARG if it is not. */
+
+{
+   const char *pc = pcLine + psSlice->iOffset;
+
+   if ((psSlice->eType != TOKEN_WORD) || (psSlice->iSpan > 2) ||
+       (psSlice->iLength != psSlice->iSpan))
+      return CMD_ARG;
+   if (psSlice->iLength == 1)
+      return (pc[0] == '<') ? CMD_STDIN : (pc[0] == '>') ? CMD_STDOUT
+         : CMD_ARG;
+   if ((pc[0] == '0') && (pc[1] == '<'))
+      return CMD_STDIN;
+   if ((pc[0] == '1') && (pc[1] == '>'))
+      return CMD_STDOUT;
+   if ((pc[0] == '2') && (pc[1] == '>'))
+      return CMD_STDERR;
+   return CMD_ARG;
+}
+
+/*--------------------------------------------------------------------*/
+
+static int Syn_beginStage(SynCmd *psCmd, Arena_T oArena, char *pcProgName)
+
+/* Make *psCmd an empty command with an argv array of SYN_ARGV_SIZE
+   words allocated from oArena. Return 1 (TRUE) if successful, or 0
+   (FALSE) otherwise. */
+
+{
+   memset(psCmd, 0, sizeof(*psCmd));
+   psCmd->ppcArgv = (char**)Arena_alloc(oArena, (SYN_ARGV_SIZE + 1)
+                                        * sizeof(char*));
+   if (psCmd->ppcArgv == NULL)
+   {
+      fprintf(stderr, "%s: cannot allocate memory\n", pcProgName);
+      return FALSE;
+   }
+   return TRUE;
+}
+
+/*--------------------------------------------------------------------*/
+
+static void Syn_endStage(SynCmd *psCmd)
+
+/* Terminate the argv array of command *psCmd and find its verb. */
+
+{
+   psCmd->ppcArgv[psCmd->iArgc] = NULL;
+   if (psCmd->iArgc > 0)
+      psCmd->eVerb = Syn_verb(psCmd->ppcArgv[0]);
+}
+
+/*--------------------------------------------------------------------*/
+
+int Syn_parseLine(const char *pcLine, SynCmd *psCmd, Arena_T oArena,
+                  char *pcProgName)
+
+/* Lexically and syntactically analyze string pcLine in one pass, and
+   store the command it contains in *psCmd, or the first stage of the
+   pipeline it contains. Return 1 (TRUE) if successful, or 0 (FALSE)
+   otherwise. The words, argv arrays and later stages are allocated
+   from oArena. */
+
+/* The rules are those of Lex_lexLine() followed by Syn_synLine(), but
+   each token is looked at once, as it is found, and goes straight to
+   its place in *psCmd. An unquoted "|" ends a stage of a pipeline and
+   starts the next, with redirections of its own. An unquoted "&" may
+   only end the line. */
+
+{
+   static const char *apcStreams[] = {NULL, NULL, "input", "output",
+                                      "error"};
+   /* Name of the stream of each redirection CmdType. */
+
+   int aiSeen[] = {FALSE, FALSE, FALSE, FALSE, FALSE};
+   /* Flag if redirection of each CmdType in this stage. */
+
+   CmdType eTarget = CMD_ARG;
+   /* Redirection whose file name is the next token, if any. */
+
+   SynCmd *psStage = psCmd;
+   /* The stage being analyzed. */
+
+   LexSlice sSlice;
+   LexNext eNext;
+   CmdType eType;
+   char **ppcArgv;
+   char *pcWord;
+   int iPipe;
+   int iAmp;
+   int iSize = SYN_ARGV_SIZE;
+   int iIndex = 0;
+
+   assert(pcLine != NULL);
+   assert(psCmd != NULL);
+   assert(oArena != NULL);
+   assert(pcProgName != NULL);
+
+   if (! Syn_beginStage(psStage, oArena, pcProgName))
+      return FALSE;
+
+   while ((eNext = Lex_nextSlice(pcLine, &iIndex, &sSlice, pcProgName))
+          == LEX_TOKEN)
+   {
+      eType = Syn_redirection(pcLine, &sSlice);
+      iPipe = (sSlice.eType == TOKEN_WORD) && (sSlice.iLength == 1) &&
+         (pcLine[sSlice.iOffset] == '|');
+      iAmp = (sSlice.eType == TOKEN_WORD) && (sSlice.iLength == 1) &&
+         (pcLine[sSlice.iOffset] == '&');
+
+      /* Anything after a background operator. */
+      if (psCmd->iBackground)
+      {
+         fprintf(stderr, "%s: & must end the command line\n",
+                 pcProgName);
+         return FALSE;
+      }
+      /* Missing command name. */
+      if ((psStage->iArgc == 0) && (eTarget == CMD_ARG) &&
+          (((eType != CMD_ARG) && (sSlice.iLength == 1)) || iPipe ||
+           iAmp))
+      {
+         fprintf(stderr, "%s: missing command name\n", pcProgName);
+         return FALSE;
+      }
+      /* Unquoted invalid file names. */
+      if ((eTarget != CMD_ARG) &&
+          (((eType != CMD_ARG) && (sSlice.iLength == 1)) || iPipe ||
+           iAmp))
+         break;
+      /* The whole line runs in the background. */
+      if (iAmp)
+      {
+         psCmd->iBackground = TRUE;
+         continue;
+      }
+      /* The end of a stage: the next one is analyzed afresh. */
+      if (iPipe)
+      {
+         Syn_endStage(psStage);
+         psStage->psNext = (SynCmd*)Arena_alloc(oArena, sizeof(SynCmd));
+         if (psStage->psNext == NULL)
+         {
+            fprintf(stderr, "%s: cannot allocate memory\n", pcProgName);
+            return FALSE;
+         }
+         psStage = psStage->psNext;
+         if (! Syn_beginStage(psStage, oArena, pcProgName))
+            return FALSE;
+         memset(aiSeen, 0, sizeof(aiSeen));
+         iSize = SYN_ARGV_SIZE;
+         continue;
+      }
+      /* A redirection operator, after the command name. */
+      if ((psStage->iArgc > 0) && (eTarget == CMD_ARG) &&
+          (eType != CMD_ARG))
+      {
+         /* Multiple redirection. */
+         if (aiSeen[eType])
+         {
+            fprintf(stderr, "%s: multiple redirection of standard %s\n",
+                    pcProgName, apcStreams[eType]);
+            return FALSE;
+         }
+         aiSeen[eType] = TRUE;
+         eTarget = eType;
+         continue;
+      }
+
+      pcWord = (char*)Arena_alloc(oArena, (size_t)sSlice.iLength + 1);
+      if (pcWord == NULL)
+      {
+         fprintf(stderr, "%s: cannot allocate memory\n", pcProgName);
+         return FALSE;
+      }
+      Lex_copySlice(pcLine, &sSlice, pcWord);
+
+      /* The file name of a redirection. */
+      if (eTarget != CMD_ARG)
+      {
+         if (eTarget == CMD_STDIN)
+            psStage->pcStdin = pcWord;
+         else if (eTarget == CMD_STDOUT)
+            psStage->pcStdout = pcWord;
+         else
+            psStage->pcStderr = pcWord;
+         eTarget = CMD_ARG;
+         continue;
+      }
+
+      /* The command name or an argument; the argv array doubles in
+         the arena when it is full. */
+      if (psStage->iArgc == iSize)
+      {
+         ppcArgv = (char**)Arena_alloc(oArena, (size_t)(2 * iSize + 1)
+                                       * sizeof(char*));
+         if (ppcArgv == NULL)
+         {
+            fprintf(stderr, "%s: cannot allocate memory\n", pcProgName);
+            return FALSE;
+         }
+         memcpy(ppcArgv, psStage->ppcArgv, (size_t)iSize * sizeof(char*));
+         psStage->ppcArgv = ppcArgv;
+         iSize *= 2;
+      }
+      psStage->ppcArgv[psStage->iArgc++] = pcWord;
+   }
+   if (eNext == LEX_ERROR)
+      return FALSE;
+
+   /* Redirection without file name. */
+   if (eTarget != CMD_ARG)
+   {
+      fprintf(stderr, "%s: standard %s redirection without file name\n",
+              pcProgName, apcStreams[eTarget]);
+      return FALSE;
+   }
+   /* A pipe into nothing. */
+   if ((psStage != psCmd) && (psStage->iArgc == 0))
+   {
+      fprintf(stderr, "%s: missing command name\n", pcProgName);
+      return FALSE;
+   }
+
+   Syn_endStage(psStage);
+   return TRUE;
+}
+
+/*--------------------------------------------------------------------*/
@@ -8,6 +8,7 @@
 #define SYN_INCLUDED
 
 #include "dynarray.h"
+#include "arena.h"
 
 #ifndef TRUE
 #define TRUE 1
@@ -21,6 +22,10 @@
 #define MAX_LINE_SIZE 1024
 #endif
 
+#ifndef SYN_ARGV_SIZE
+#define SYN_ARGV_SIZE 16 /* words an argv array has room for at first */
+#endif
+
 
 /*--------------------------------------------------------------------*/
 
@@ -31,6 +36,53 @@ typedef struct Cmd *Cmd_T;
 enum CmdType {CMD_CMD, CMD_ARG, CMD_STDIN, CMD_STDOUT, CMD_STDERR};
 typedef enum CmdType CmdType;
 
+#define CMDNAME_REMOTE "remote"
+#define CMDNAME_SEND "sendfile"
+#define CMDNAME_RECV "recvfile"
+#define CMDNAME_BUILD "build"
+
+enum SynVerb {VERB_OTHER, VERB_REMOTE, VERB_SEND, VERB_RECV, VERB_CD,
+              VERB_SETENV, VERB_UNSETENV, VERB_EXIT, VERB_CACHESTATS,
+              VERB_STORESTATS, VERB_BUILD, VERB_JOBS, VERB_JOBOUT,
+              VERB_JOBWAIT, VERB_JOBKILL};
+typedef enum SynVerb SynVerb;
+/* The commands that are carried out by the client or server itself,
+   rather than exec'ed, by the name they are given in a line. */
+
+typedef struct SynCmd
+{
+   SynVerb eVerb;
+   /* What the command name is. */
+
+   int iArgc;
+   /* Number of words: the command name and its arguments. */
+
+   char **ppcArgv;
+   /* The words, followed by NULL: an argv array for execvp(). */
+
+   char *pcStdin;
+   /* File that stdin is redirected from, or NULL. */
+
+   char *pcStdout;
+   /* File that stdout is redirected to, or NULL. */
+
+   char *pcStderr;
+   /* File that stderr is redirected to, or NULL. */
+
+   struct SynCmd *psNext;
+   /* The next stage of a pipeline, which reads what this one writes,
+      or NULL. */
+
+   int iBackground;
+   /* 1 (TRUE) if the line ended in "&", so that the command or
+      pipeline runs as a background job, 0 (FALSE) otherwise. Only set
+      on the first stage. */
+} SynCmd;
+/* A command as it is carried out: everything the line said, sorted
+   once, so that no later step has to look at the words again to find
+   out what to do. A line of commands joined by "|" is a pipeline, and
+   gives a list of them, first stage first. */
+
 /*--------------------------------------------------------------------*/
 
 CmdType Syn_returnType(void *pvItem);
@@ -40,14 +92,34 @@ char *Syn_returnValue(void *pvItem);
 /* Return the command word's value. */
 
 void Syn_freeCmd(void *pvItem, void *pvExtra);
-/* Free command word pvItem. pvExtra is unused. */
+/* Free command word pvItem. pvExtra is unused. Not for command words
+   allocated from an arena. */
 
-int Syn_synLine(DynArray_T oTokens, DynArray_T oCmds, char* pcProgName);
+int Syn_synLine(DynArray_T oTokens, DynArray_T oCmds, Arena_T oArena,
+                char* pcProgName);
 /* Syntactically analyze the token array oTokens. Populate oCmds
    with tokens that oTokens contains along with their type. 
    Return 1 (TRUE) if successful, or 0 (FALSE) otherwise. In the 
    latter case, oCmds may contain tokens that were discovered before 
-   the error. The caller owns the tokens placed in oCmds. Note that
-   the function needs the calling program's name for error-checking. */ 
+   the error. The command words are allocated from oArena, which owns
+   them, or with malloc if oArena is NULL, in which case the caller
+   owns them. Note that the function needs the calling program's name
+   for error-checking. */ 
+
+int Syn_parseLine(const char *pcLine, SynCmd *psCmd, Arena_T oArena,
+                  char *pcProgName);
+/* Lexically and syntactically analyze string pcLine in one pass, and
+   store the command it contains in *psCmd, or the first stage of the
+   pipeline it contains. Return 1 (TRUE) if successful, or 0 (FALSE)
+   with a message naming pcProgName otherwise. A line with no words
+   gives a command with iArgc 0. The words, argv arrays and later
+   stages are allocated from oArena, which owns them. */
+
+SynVerb Syn_verb(const char *pcName);
+/* Return the verb of a command named pcName. */
+
+void Syn_shift(SynCmd *psCmd);
+/* Drop the first word of command *psCmd, such as a "remote" that
+   prefixes another command, and make the next one its name. */
 
 #endif
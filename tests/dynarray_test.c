@@ -0,0 +1,514 @@
+/*--------------------------------------------------------------------*/
+/* dynarray_test.c                                                    */
+/* Drive a DynArray through the changes of storage it makes on its   */
+/* own, checking its invariants after each operation                  */
+/*--------------------------------------------------------------------*/
+
+/* dynarray.c is included rather than linked, so that DynArray_isValid
+   and the fields that say where the elements live can be looked at.
+   Each element points to a slot of aiValues, so a lost or duplicated
+   element shows up as the wrong pointer. */
+
+#undef NDEBUG
+#include "dynarray.c"
+
+#include <stdio.h>
+
+#define TEST_VALUES 4096 /* slots elements can point to */
+#define TEST_INLINE 8 /* elements kept inline by the arrays made here */
+#define TEST_COMPARES 3 /* comparisons allowed per element per level */
+#define TEST_GUARD 65536 /* bytes more than any free block of the heap */
+
+enum TestPattern {PATTERN_SORTED, PATTERN_REVERSED, PATTERN_EQUAL,
+		  PATTERN_ORGAN, PATTERN_SAWTOOTH, PATTERN_RANDOM,
+		  PATTERN_COUNT};
+/* orders to sort an array from */
+
+static const char *apcPatterns[PATTERN_COUNT] =
+  {"sorted", "reversed", "all equal", "organ pipe", "sawtooth", "random"};
+
+static const int aiSortLengths[] =
+  {0, 1, 2, 3, 23, 24, 25, 127, 128, 129, 1000, TEST_VALUES};
+/* around the insertion sort and ninther thresholds */
+
+static int aiValues[TEST_VALUES]; /* what the elements point to */
+static int iFailures = 0; /* checks that did not hold */
+static long lCompares = 0; /* calls of Test_compare */
+
+/*--------------------------------------------------------------------*/
+
+/* report check pcWhat of array kind pcKind as failed if iOk is 0 */
+static void Test_check(int iOk, const char *pcKind, const char *pcWhat)
+{
+  if (!iOk) {
+    fprintf(stderr, "dynarray_test: %s: %s\n", pcKind, pcWhat);
+    iFailures++;
+  }
+}
+
+/*--------------------------------------------------------------------*/
+
+/* return the element of value slot i, wrapping around aiValues */
+static const void *Test_element(int i)
+{
+  return &aiValues[i % TEST_VALUES];
+}
+
+/*--------------------------------------------------------------------*/
+
+/* return 1 if the elements of oDynArray live in its own struct */
+static int Test_isInline(DynArray_T oDynArray)
+{
+  return oDynArray->ppvArray - oDynArray->iFirst == oDynArray->apvInline;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* check that oDynArray is valid and holds the iCount elements of value
+   slots iFrom on, after operation pcWhat */
+static void Test_holds(DynArray_T oDynArray, int iFrom, int iCount,
+		       const char *pcKind, const char *pcWhat)
+{
+  int i = 0;
+
+  if (!DynArray_isValid(oDynArray)) {
+    Test_check(0, pcKind, pcWhat);
+    return;
+  }
+  if (DynArray_getLength(oDynArray) != iCount) {
+    Test_check(0, pcKind, pcWhat);
+    return;
+  }
+  for (i = 0; i < iCount; i++)
+    if (DynArray_get(oDynArray, i) != Test_element(iFrom + i)) {
+      Test_check(0, pcKind, pcWhat);
+      return;
+    }
+}
+
+/*--------------------------------------------------------------------*/
+
+/* add elements to the empty oDynArray until it has moved off its
+   inline room, then shrink and refill it. An array with no inline room
+   starts on the heap */
+static void Test_inline(DynArray_T oDynArray, const char *pcKind)
+{
+  int iInline = oDynArray->iInline;
+  int iPhysLength = 0;
+  const void **ppvArray = NULL;
+  int i = 0;
+
+  Test_holds(oDynArray, 0, 0, pcKind, "new");
+  Test_check(Test_isInline(oDynArray) == (iInline >= MIN_PHYS_LENGTH),
+	     pcKind, "starts inline");
+
+  for (i = 0; i < iInline; i++) {
+    Test_check(DynArray_add(oDynArray, Test_element(i)), pcKind, "add");
+    Test_holds(oDynArray, 0, i + 1, pcKind, "add inline");
+    Test_check(Test_isInline(oDynArray), pcKind, "stays inline while it fits");
+  }
+
+  /* one more moves it to the heap */
+  Test_check(DynArray_add(oDynArray, Test_element(iInline)), pcKind, "add");
+  Test_holds(oDynArray, 0, iInline + 1, pcKind, "add past inline room");
+  Test_check(!Test_isInline(oDynArray), pcKind, "moves to the heap");
+  for (i = iInline + 1; i < 100; i++)
+    Test_check(DynArray_add(oDynArray, Test_element(i)), pcKind, "add");
+  Test_holds(oDynArray, 0, 100, pcKind, "grow on the heap");
+
+  /* shrinking back within the inline room keeps the heap array, so
+     refilling it does not allocate */
+  iPhysLength = oDynArray->iPhysLength;
+  ppvArray = oDynArray->ppvArray;
+  DynArray_shrink(oDynArray, iInline / 2);
+  Test_holds(oDynArray, 0, iInline / 2, pcKind, "shrink to inline size");
+  for (i = iInline / 2; i < 100; i++)
+    Test_check(DynArray_add(oDynArray, Test_element(i)), pcKind, "add");
+  Test_holds(oDynArray, 0, 100, pcKind, "refill after shrink");
+  Test_check((oDynArray->iPhysLength == iPhysLength) &&
+	     (oDynArray->ppvArray == ppvArray), pcKind, "refill in place");
+
+  DynArray_shrink(oDynArray, 0);
+  Test_holds(oDynArray, 0, 0, pcKind, "shrink to empty");
+  for (i = 0; i < 3; i++)
+    Test_check(DynArray_add(oDynArray, Test_element(i)), pcKind, "add");
+  Test_holds(oDynArray, 0, 3, pcKind, "add after shrink to empty");
+
+  DynArray_free(oDynArray);
+}
+
+/*--------------------------------------------------------------------*/
+
+/* insert at the front of the empty oDynArray until it has moved off
+   its inline room, which happens in the middle of an insertion */
+static void Test_inlineFront(DynArray_T oDynArray, const char *pcKind)
+{
+  int iCount = oDynArray->iInline + 20;
+  int i = 0;
+
+  for (i = iCount - 1; i >= 0; i--) {
+    Test_check(DynArray_addAt(oDynArray, 0, Test_element(i)), pcKind,
+	       "addAt");
+    Test_holds(oDynArray, i, iCount - i, pcKind, "addAt the front");
+  }
+  Test_check(!Test_isInline(oDynArray), pcKind, "addAt moves to the heap");
+  DynArray_free(oDynArray);
+}
+
+/*--------------------------------------------------------------------*/
+
+/* check each way of making a DynArray with inline room */
+static void Test_inlineAll(void)
+{
+  void *apvMem[DYNARRAY_WORDS(TEST_INLINE)];
+  DynArray_T oDynArray = NULL;
+
+  Test_inline(DynArray_new(0), "new");
+  Test_inline(DynArray_newInline(0, TEST_INLINE), "newInline");
+  oDynArray = DynArray_init(apvMem, DYNARRAY_WORDS(TEST_INLINE), 0);
+  Test_check(oDynArray->iInline == TEST_INLINE, "init",
+	     "DYNARRAY_WORDS gives room for exactly that many elements");
+  Test_inline(oDynArray, "init");
+  Test_inlineFront(DynArray_new(0), "new");
+  Test_inlineFront(DynArray_newInline(0, TEST_INLINE), "newInline");
+  Test_inlineFront(DynArray_init(apvMem, DYNARRAY_WORDS(TEST_INLINE), 0),
+		   "init");
+
+  /* too long for the inline room from the start */
+  oDynArray = DynArray_newInline(TEST_INLINE + 1, TEST_INLINE);
+  Test_check(DynArray_isValid(oDynArray) && !Test_isInline(oDynArray) &&
+	     (DynArray_get(oDynArray, TEST_INLINE) == NULL),
+	     "newInline", "new past inline room");
+  DynArray_free(oDynArray);
+
+  /* room for fewer elements than the least physical length */
+  oDynArray = DynArray_newInline(0, 1);
+  Test_check(DynArray_isValid(oDynArray) && !Test_isInline(oDynArray),
+	     "newInline", "new with less room than the minimum");
+  DynArray_free(oDynArray);
+}
+
+/*--------------------------------------------------------------------*/
+
+/* compare the values that pvElement1 and pvElement2 point to */
+static int Test_compare(const void *pvElement1, const void *pvElement2)
+{
+  int iValue1 = *(const int *) pvElement1;
+  int iValue2 = *(const int *) pvElement2;
+
+  lCompares++;
+  return (iValue1 > iValue2) - (iValue1 < iValue2);
+}
+
+/*--------------------------------------------------------------------*/
+
+/* set the first iLength value slots in order ePattern */
+static void Test_fill(enum TestPattern ePattern, int iLength)
+{
+  int i = 0;
+
+  for (i = 0; i < iLength; i++)
+    switch (ePattern) {
+    case PATTERN_SORTED:
+      aiValues[i] = i;
+      break;
+    case PATTERN_REVERSED:
+      aiValues[i] = iLength - i;
+      break;
+    case PATTERN_EQUAL:
+      aiValues[i] = 7;
+      break;
+    case PATTERN_ORGAN:
+      aiValues[i] = (i < iLength / 2) ? i : iLength - i;
+      break;
+    case PATTERN_SAWTOOTH:
+      aiValues[i] = i % 16;
+      break;
+    default:
+      aiValues[i] = rand() % (iLength + 1);
+      break;
+    }
+}
+
+/*--------------------------------------------------------------------*/
+
+/* sort the first iLength value slots from order ePattern, and check
+   that the result is ordered, holds each element once, and took
+   O(n log n) comparisons */
+static void Test_sortPattern(enum TestPattern ePattern, int iLength)
+{
+  static char acSeen[TEST_VALUES];
+  const char *pcPattern = apcPatterns[ePattern];
+  DynArray_T oDynArray = DynArray_new(0);
+  const int *piElement = NULL;
+  long lLimit = 0;
+  int iLog = 0;
+  int iOk = 1;
+  int i = 0;
+
+  Test_fill(ePattern, iLength);
+  for (i = 0; i < iLength; i++)
+    Test_check(DynArray_add(oDynArray, Test_element(i)), pcPattern, "add");
+
+  lCompares = 0;
+  DynArray_sort(oDynArray, Test_compare);
+  Test_check(DynArray_isValid(oDynArray) &&
+	     (DynArray_getLength(oDynArray) == iLength), pcPattern, "sort");
+
+  memset(acSeen, 0, sizeof(acSeen));
+  for (i = 0; iOk && (i < iLength); i++) {
+    piElement = DynArray_get(oDynArray, i);
+    if ((piElement < aiValues) || (piElement >= aiValues + iLength) ||
+	acSeen[piElement - aiValues])
+      iOk = 0;
+    else
+      acSeen[piElement - aiValues] = 1;
+    if ((i > 0) &&
+	(Test_compare(DynArray_get(oDynArray, i - 1), piElement) > 0))
+      iOk = 0;
+  }
+  Test_check(iOk, pcPattern, "sorted and the same elements");
+
+  for (i = iLength, iLog = 1; i > 1; i /= 2)
+    iLog++;
+  lLimit = (long) TEST_COMPARES * iLength * iLog + SORT_INSERTION_MAX *
+    SORT_INSERTION_MAX;
+  Test_check(lCompares <= lLimit, pcPattern, "comparisons in O(n log n)");
+
+  DynArray_free(oDynArray);
+}
+
+/*--------------------------------------------------------------------*/
+
+/* sort every pattern at every length, and a sort of an array whose
+   first elements were removed */
+static void Test_sortAll(void)
+{
+  DynArray_T oDynArray = NULL;
+  size_t iLength = 0;
+  int ePattern = 0;
+  int i = 0;
+
+  srand(1);
+  for (ePattern = 0; ePattern < PATTERN_COUNT; ePattern++)
+    for (iLength = 0; iLength < sizeof(aiSortLengths) / sizeof(int);
+	 iLength++)
+      Test_sortPattern((enum TestPattern) ePattern, aiSortLengths[iLength]);
+
+  Test_fill(PATTERN_REVERSED, 200);
+  oDynArray = DynArray_newInline(0, TEST_INLINE);
+  for (i = 0; i < 200; i++)
+    Test_check(DynArray_add(oDynArray, Test_element(i)), "offset", "add");
+  for (i = 0; i < 100; i++)
+    DynArray_removeAt(oDynArray, 0);
+  DynArray_sort(oDynArray, Test_compare);
+  Test_check(DynArray_isValid(oDynArray) &&
+	     (DynArray_getLength(oDynArray) == 100), "offset", "sort");
+  for (i = 0; i < 100; i++)
+    Test_check(DynArray_get(oDynArray, i) == Test_element(199 - i),
+	       "offset", "sort after removeAt the front");
+  DynArray_free(oDynArray);
+}
+
+/*--------------------------------------------------------------------*/
+
+/* use the empty oDynArray as a queue: pop elements off the front and
+   add them at the back, so that the room left at the front is used
+   again */
+static void Test_queue(DynArray_T oDynArray, const char *pcKind)
+{
+  int iHead = 0;
+  int iTail = 0;
+  int i = 0;
+
+  /* fill, then pop one and add one, which slides the elements back
+     once as much room is free at the front as they take */
+  for (iTail = 0; iTail < 16; iTail++)
+    Test_check(DynArray_add(oDynArray, Test_element(iTail)), pcKind, "add");
+  for (i = 0; i < 100; i++) {
+    Test_check(DynArray_removeAt(oDynArray, 0) == Test_element(iHead++),
+	       pcKind, "removeAt the front");
+    Test_holds(oDynArray, iHead, iTail - iHead, pcKind, "pop front");
+    Test_check(DynArray_add(oDynArray, Test_element(iTail++)), pcKind,
+	       "add");
+    Test_holds(oDynArray, iHead, iTail - iHead, pcKind, "add after pop");
+  }
+
+  /* grow and shrink the queue at both ends, and wrap past aiValues */
+  for (i = 0; i < 3 * TEST_VALUES; i++) {
+    if ((i / 64) % 3 != 2) {
+      Test_check(DynArray_add(oDynArray, Test_element(iTail++)), pcKind,
+		 "add");
+    }
+    if (((i / 64) % 3 != 0) && (iTail > iHead))
+      Test_check(DynArray_removeAt(oDynArray, 0) == Test_element(iHead++),
+		 pcKind, "removeAt the front");
+    Test_holds(oDynArray, iHead, iTail - iHead, pcKind, "queue");
+  }
+
+  /* remove near the back and in the middle of an offset array */
+  Test_check(DynArray_getLength(oDynArray) > 4, pcKind, "queue length");
+  Test_check(DynArray_removeAt(oDynArray, DynArray_getLength(oDynArray) - 1)
+	     == Test_element(--iTail), pcKind, "removeAt the back");
+  Test_holds(oDynArray, iHead, iTail - iHead, pcKind, "pop back");
+  DynArray_removeAt(oDynArray, 1);
+  DynArray_addAt(oDynArray, 1, Test_element(iHead + 1));
+  Test_holds(oDynArray, iHead, iTail - iHead, pcKind, "remove and addAt");
+
+  /* emptying it by pops, shrink or clear starts it at the front */
+  while (DynArray_getLength(oDynArray) > 0)
+    DynArray_removeAt(oDynArray, 0);
+  Test_check(DynArray_isValid(oDynArray) && (oDynArray->iFirst == 0),
+	     pcKind, "pop to empty");
+  for (i = 0; i < 10; i++)
+    DynArray_add(oDynArray, Test_element(i));
+  DynArray_removeAt(oDynArray, 0);
+  DynArray_shrink(oDynArray, 0);
+  Test_check(DynArray_isValid(oDynArray) && (oDynArray->iFirst == 0),
+	     pcKind, "shrink to empty");
+  for (i = 0; i < 10; i++)
+    DynArray_add(oDynArray, Test_element(i));
+  DynArray_removeAt(oDynArray, 0);
+  DynArray_clear(oDynArray);
+  Test_check(DynArray_isValid(oDynArray) && (oDynArray->iFirst == 0),
+	     pcKind, "clear");
+
+  DynArray_free(oDynArray);
+}
+
+/*--------------------------------------------------------------------*/
+
+/* check that a reserve makes the following adds allocate nothing,
+   including when elements have been popped off the front */
+static void Test_reserve(DynArray_T oDynArray, const char *pcKind)
+{
+  const void **ppvArray = NULL;
+  int i = 0;
+
+  Test_check(DynArray_reserve(oDynArray, 100), pcKind, "reserve");
+  Test_holds(oDynArray, 0, 0, pcKind, "reserve");
+  ppvArray = oDynArray->ppvArray;
+  for (i = 0; i < 100; i++)
+    Test_check(DynArray_add(oDynArray, Test_element(i)), pcKind, "add");
+  Test_holds(oDynArray, 0, 100, pcKind, "add after reserve");
+  Test_check(oDynArray->ppvArray == ppvArray, pcKind, "add in place");
+
+  for (i = 0; i < 60; i++)
+    DynArray_removeAt(oDynArray, 0);
+  Test_check(DynArray_reserve(oDynArray, 150), pcKind, "reserve");
+  Test_holds(oDynArray, 60, 40, pcKind, "reserve after pop");
+  ppvArray = oDynArray->ppvArray;
+  for (i = 100; i < 210; i++)
+    Test_check(DynArray_add(oDynArray, Test_element(i)), pcKind, "add");
+  Test_holds(oDynArray, 60, 150, pcKind, "add after reserve");
+  Test_check(oDynArray->ppvArray == ppvArray, pcKind, "add in place");
+
+  Test_check(DynArray_reserve(oDynArray, 10), pcKind, "reserve less");
+  Test_holds(oDynArray, 60, 150, pcKind, "reserve less");
+  DynArray_free(oDynArray);
+}
+
+/*--------------------------------------------------------------------*/
+
+/* append runs of elements to the empty oDynArray, some of them from
+   its own elements, at each of the ways an append can need room: in
+   place, inline to heap, by sliding back over popped elements, and by
+   growing the heap array */
+static void Test_addAll(DynArray_T oDynArray, const char *pcKind)
+{
+  const void *apvElements[64];
+  void *pvGuard = NULL;
+  int iLength = 0;
+  int iRound = 0;
+  int i = 0;
+
+  for (i = 0; i < 64; i++)
+    apvElements[i] = Test_element(i);
+
+  Test_check(DynArray_addAll(oDynArray, NULL, 0), pcKind, "addAll nothing");
+  Test_holds(oDynArray, 0, 0, pcKind, "addAll nothing");
+  Test_check(DynArray_addAll(oDynArray, apvElements, 3), pcKind, "addAll");
+  Test_holds(oDynArray, 0, 3, pcKind, "addAll");
+  Test_check(DynArray_addAll(oDynArray, apvElements + 3, 61), pcKind,
+	     "addAll");
+  Test_holds(oDynArray, 0, 64, pcKind, "addAll past inline room");
+
+  /* its own elements, from a full array that must grow. An allocation
+     after the array keeps it from growing in place, so that the old
+     array is freed, and clobbered, before the copy */
+  for (iRound = 0; iRound < 3; iRound++) {
+    DynArray_clear(oDynArray);
+    for (i = 0; oDynArray->iLength < oDynArray->iPhysLength; i++)
+      DynArray_add(oDynArray, Test_element(i));
+    iLength = oDynArray->iLength;
+    pvGuard = malloc(TEST_GUARD);
+    Test_check(DynArray_addAll(oDynArray, oDynArray->ppvArray, iLength),
+	       pcKind, "addAll of itself");
+    free(pvGuard);
+    Test_check(DynArray_isValid(oDynArray) &&
+	       (DynArray_getLength(oDynArray) == 2 * iLength), pcKind,
+	       "addAll of itself");
+    for (i = 0; i < DynArray_getLength(oDynArray); i++)
+      Test_check(DynArray_get(oDynArray, i) == Test_element(i % iLength),
+		 pcKind, "addAll of itself copies");
+  }
+
+  /* its own elements after popping half, so they slide back first */
+  DynArray_clear(oDynArray);
+  while (oDynArray->iLength < oDynArray->iPhysLength)
+    DynArray_add(oDynArray, Test_element(oDynArray->iLength));
+  iLength = oDynArray->iLength / 2;
+  for (i = 0; i < iLength; i++)
+    DynArray_removeAt(oDynArray, 0);
+  Test_check(oDynArray->iFirst >= oDynArray->iLength, pcKind, "pop half");
+  Test_check(DynArray_addAll(oDynArray, oDynArray->ppvArray + 1, iLength - 1),
+	     pcKind, "addAll of itself after pop");
+  Test_check(DynArray_isValid(oDynArray) &&
+	     (DynArray_getLength(oDynArray) == 2 * iLength - 1), pcKind,
+	     "addAll of itself after pop");
+  for (i = 0; i < iLength - 1; i++)
+    Test_check(DynArray_get(oDynArray, iLength + i) ==
+	       Test_element(iLength + 1 + i), pcKind,
+	       "addAll of itself after pop copies");
+
+  DynArray_free(oDynArray);
+}
+
+/*--------------------------------------------------------------------*/
+
+/* check the queue and bulk operations on each kind of DynArray */
+static void Test_reuseAll(void)
+{
+  void *apvMem[DYNARRAY_WORDS(TEST_INLINE)];
+
+  Test_queue(DynArray_new(0), "new");
+  Test_queue(DynArray_newInline(0, TEST_INLINE), "newInline");
+  Test_queue(DynArray_init(apvMem, DYNARRAY_WORDS(TEST_INLINE), 0), "init");
+  Test_reserve(DynArray_new(0), "new");
+  Test_reserve(DynArray_newInline(0, TEST_INLINE), "newInline");
+  Test_reserve(DynArray_init(apvMem, DYNARRAY_WORDS(TEST_INLINE), 0), "init");
+  Test_addAll(DynArray_new(0), "new");
+  Test_addAll(DynArray_newInline(0, TEST_INLINE), "newInline");
+  Test_addAll(DynArray_init(apvMem, DYNARRAY_WORDS(TEST_INLINE), 0), "init");
+}
+
+/*--------------------------------------------------------------------*/
+
+int main(void)
+{
+  int i = 0;
+
+  for (i = 0; i < TEST_VALUES; i++)
+    aiValues[i] = i;
+
+  Test_inlineAll();
+  Test_sortAll();
+  Test_reuseAll();
+
+  if (iFailures > 0) {
+    fprintf(stderr, "dynarray_test: %d checks failed\n", iFailures);
+    exit(EXIT_FAILURE);
+  }
+  printf("dynarray_test: ok\n");
+  exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,333 @@
+/*--------------------------------------------------------------------*/
+/* legacy_test.c                                                      */
+/* Talk to the server the way a client from before the framed        */
+/* protocol does                                                      */
+/*--------------------------------------------------------------------*/
+
+/* The wire format is written out here rather than taken from
+   common.h, so that a change to it shows up as a failure instead of
+   changing both ends at once. A legacy client sends a command as a
+   line. An answer, and a file in either direction, is its length in
+   decimal, padded with newlines to 11 bytes, and then its bytes. */
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define LEGACY_HEADER_SIZE 11 /* bytes of the length before a body */
+#define TEST_PORT 21002 /* SERV_PORT of the server */
+#define TEST_TIMEOUT 10 /* seconds to wait for an answer */
+#define TEST_FILE "legacy_test.txt"
+#define TEST_STALLED "sendfile " TEST_FILE "\n100\n\n\n\n\n\n\n\nworld"
+/* an upload of 100 bytes that stops after 5 */
+#define TEST_LONG 100000 /* characters in a line too long to run */
+#define TEST_LONG_ANSWER "server: command line longer than 1023 characters\n"
+/* MAX_LINE_SIZE of the server, less one */
+#define TEST_BIG 16000000 /* bytes of an answer more than a socket holds */
+#define TEST_BIG_COMMAND "remote head -c 16000000 /dev/zero\n"
+
+static int iFailures = 0; /* checks that did not hold */
+
+/*--------------------------------------------------------------------*/
+
+/* report check pcWhat as failed if iOk is 0 */
+static void Test_check(int iOk, const char *pcMode, const char *pcWhat)
+{
+  if (!iOk) {
+    fprintf(stderr, "legacy_test: %s: %s\n", pcMode, pcWhat);
+    iFailures++;
+  }
+}
+
+/*--------------------------------------------------------------------*/
+
+/* write the iSize bytes of pvBuf to iFD. Return 0 or -1 */
+static int Test_write(int iFD, const void *pvBuf, size_t iSize)
+{
+  const char *pcBuf = pvBuf;
+  ssize_t iDone = 0;
+
+  while (iSize > 0) {
+    if ((iDone = write(iFD, pcBuf, iSize)) <= 0) {
+      if ((iDone == -1) && (errno == EINTR))
+	continue;
+      return -1;
+    }
+    pcBuf += iDone;
+    iSize -= (size_t) iDone;
+  }
+  return 0;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* read exactly iSize bytes from iFD into pvBuf. Return 0 or -1 */
+static int Test_read(int iFD, void *pvBuf, size_t iSize)
+{
+  char *pcBuf = pvBuf;
+  ssize_t iDone = 0;
+
+  while (iSize > 0) {
+    if ((iDone = read(iFD, pcBuf, iSize)) <= 0) {
+      if ((iDone == -1) && (errno == EINTR))
+	continue;
+      return -1;
+    }
+    pcBuf += iDone;
+    iSize -= (size_t) iDone;
+  }
+  return 0;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* send pcBody as a legacy length header and body */
+static int Test_sendBody(int iSockFD, const char *pcBody)
+{
+  char acHeader[32];
+  size_t iLength = 0;
+
+  snprintf(acHeader, sizeof(acHeader), "%zu", strlen(pcBody));
+  for (iLength = strlen(acHeader); iLength < LEGACY_HEADER_SIZE; iLength++)
+    acHeader[iLength] = '\n';
+  if (Test_write(iSockFD, acHeader, LEGACY_HEADER_SIZE) == -1)
+    return -1;
+  return Test_write(iSockFD, pcBody, strlen(pcBody));
+}
+
+/*--------------------------------------------------------------------*/
+
+/* receive a legacy length header and body into pcBody, of size iSize,
+   '\0'-terminated. Return 0, or -1 if the header is malformed or the
+   connection ends early */
+static int Test_recvBody(int iSockFD, char *pcBody, size_t iSize)
+{
+  char acHeader[LEGACY_HEADER_SIZE + 1];
+  char *pcEnd = NULL;
+  long lLength = 0;
+  int i = 0;
+
+  if (Test_read(iSockFD, acHeader, LEGACY_HEADER_SIZE) == -1)
+    return -1;
+  acHeader[LEGACY_HEADER_SIZE] = '\0';
+  lLength = strtol(acHeader, &pcEnd, 10);
+  if ((pcEnd == acHeader) || (lLength < 0) || ((size_t) lLength >= iSize))
+    return -1;
+  for (i = (int) (pcEnd - acHeader); i < LEGACY_HEADER_SIZE; i++)
+    if (acHeader[i] != '\n')
+      return -1;
+  if (Test_read(iSockFD, pcBody, (size_t) lLength) == -1)
+    return -1;
+  pcBody[lLength] = '\0';
+  return 0;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* receive a legacy answer of lExpected bytes and throw it away. Return
+   0, or -1 if it has another length or the connection ends early */
+static int Test_skipBody(int iSockFD, long lExpected)
+{
+  char acHeader[LEGACY_HEADER_SIZE + 1];
+  char acChunk[65536];
+  long lLength = 0;
+  size_t iChunk = 0;
+
+  if (Test_read(iSockFD, acHeader, LEGACY_HEADER_SIZE) == -1)
+    return -1;
+  acHeader[LEGACY_HEADER_SIZE] = '\0';
+  if ((lLength = strtol(acHeader, NULL, 10)) != lExpected)
+    return -1;
+  while (lLength > 0) {
+    iChunk = (lLength < (long) sizeof(acChunk)) ? (size_t) lLength :
+      sizeof(acChunk);
+    if (Test_read(iSockFD, acChunk, iChunk) == -1)
+      return -1;
+    lLength -= (long) iChunk;
+  }
+  return 0;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* send command pcLine and check that the answer is pcExpected */
+static void Test_command(int iSockFD, const char *pcMode, const char *pcLine,
+			 const char *pcExpected)
+{
+  char acAnswer[4096];
+
+  if ((Test_write(iSockFD, pcLine, strlen(pcLine)) == -1) ||
+      (Test_recvBody(iSockFD, acAnswer, sizeof(acAnswer)) == -1)) {
+    Test_check(0, pcMode, pcLine);
+    return;
+  }
+  Test_check(strcmp(acAnswer, pcExpected) == 0, pcMode, pcLine);
+}
+
+/*--------------------------------------------------------------------*/
+
+/* send a command line longer than the server takes, which is to be
+   answered with an error as a whole rather than run in pieces */
+static void Test_longLine(int iSockFD, const char *pcMode)
+{
+  char acAnswer[4096];
+  char *pcLine = NULL;
+
+  if ((pcLine = malloc(TEST_LONG + 2)) == NULL) {
+    Test_check(0, pcMode, "cannot allocate memory");
+    return;
+  }
+  memset(pcLine, 'x', TEST_LONG);
+  memcpy(pcLine, "remote echo ", strlen("remote echo "));
+  strcpy(pcLine + TEST_LONG, "\n");
+
+  Test_check(Test_write(iSockFD, pcLine, TEST_LONG + 1) == 0, pcMode,
+	     "long line");
+  Test_check((Test_recvBody(iSockFD, acAnswer, sizeof(acAnswer)) == 0) &&
+	     (strcmp(acAnswer, TEST_LONG_ANSWER) == 0), pcMode,
+	     "long line answered with an error");
+  free(pcLine);
+}
+
+/*--------------------------------------------------------------------*/
+
+/* connect to the server, trying for a few seconds while it starts.
+   Return the socket, on which an answer that takes longer than
+   TEST_TIMEOUT fails, or -1 */
+static int Test_connect(void)
+{
+  struct sockaddr_in sAddr;
+  struct timeval sTimeout;
+  int iSockFD = -1;
+  int i = 0;
+
+  memset(&sAddr, 0, sizeof(sAddr));
+  sAddr.sin_family = AF_INET;
+  sAddr.sin_port = htons(TEST_PORT);
+  sAddr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  for (i = 0; i < 50; i++) {
+    if ((iSockFD = socket(AF_INET, SOCK_STREAM, 0)) == -1)
+      return -1;
+    if (connect(iSockFD, (struct sockaddr *) &sAddr, sizeof(sAddr)) == 0) {
+      sTimeout.tv_sec = TEST_TIMEOUT;
+      sTimeout.tv_usec = 0;
+      setsockopt(iSockFD, SOL_SOCKET, SO_RCVTIMEO, &sTimeout, sizeof(sTimeout));
+      return iSockFD;
+    }
+    close(iSockFD);
+    usleep(100000);
+  }
+  return -1;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* run server pcServer in mode pcMode and hold a legacy conversation
+   with it */
+static void Test_mode(const char *pcServer, const char *pcMode)
+{
+  char acAnswer[4096];
+  int iSockFD = -1;
+  int iStallFD = -1;
+  int iSlowFD = -1;
+  int iStatus = 0;
+  pid_t iPid = 0;
+
+  if ((iPid = fork()) == 0) {
+    execl(pcServer, pcServer, "-m", pcMode, "-C", "", "-S", "", "-P", "",
+	  (char *) NULL);
+    perror(pcServer);
+    _exit(127);
+  }
+  if ((iSockFD = Test_connect()) == -1) {
+    Test_check(0, pcMode, "cannot connect to server");
+    kill(iPid, SIGTERM);
+    waitpid(iPid, &iStatus, 0);
+    return;
+  }
+
+  Test_command(iSockFD, pcMode, "remote echo hello\n", "hello\n");
+
+  /* an upload has no answer; the next command reads it back */
+  Test_check((Test_write(iSockFD, "sendfile " TEST_FILE "\n",
+			 strlen("sendfile " TEST_FILE "\n")) == 0) &&
+	     (Test_sendBody(iSockFD, "world\n") == 0), pcMode, "sendfile");
+  Test_command(iSockFD, pcMode, "remote cat " TEST_FILE "\n", "world\n");
+  Test_command(iSockFD, pcMode, "recvfile " TEST_FILE "\n", "world\n");
+
+  /* two commands in one write get two answers, in order */
+  Test_check(Test_write(iSockFD, "remote echo one\nremote echo two\n",
+			strlen("remote echo one\nremote echo two\n")) == 0,
+	     pcMode, "pipelined commands");
+  Test_check((Test_recvBody(iSockFD, acAnswer, sizeof(acAnswer)) == 0) &&
+	     (strcmp(acAnswer, "one\n") == 0), pcMode, "first of two answers");
+  Test_check((Test_recvBody(iSockFD, acAnswer, sizeof(acAnswer)) == 0) &&
+	     (strcmp(acAnswer, "two\n") == 0), pcMode, "second of two answers");
+
+  /* a line too long is thrown away whole; the next one runs */
+  Test_longLine(iSockFD, pcMode);
+  Test_command(iSockFD, pcMode, "remote echo after\n", "after\n");
+
+  /* a client that stops in the middle of an upload holds up no other */
+  if ((iStallFD = Test_connect()) == -1)
+    Test_check(0, pcMode, "cannot connect a second client");
+  else
+    Test_check(Test_write(iStallFD, TEST_STALLED, strlen(TEST_STALLED)) == 0,
+	       pcMode, "stalled sendfile");
+  Test_command(iSockFD, pcMode, "remote echo still here\n", "still here\n");
+  if (iStallFD != -1)
+    close(iStallFD);
+
+  /* nor does one that does not read a large answer, which it gets
+     whole once it does */
+  if ((iSlowFD = Test_connect()) == -1)
+    Test_check(0, pcMode, "cannot connect a third client");
+  else {
+    Test_check(Test_write(iSlowFD, TEST_BIG_COMMAND,
+			  strlen(TEST_BIG_COMMAND)) == 0, pcMode,
+	       "large answer");
+    usleep(500000); /* for the answer to fill the socket */
+  }
+  Test_command(iSockFD, pcMode, "remote echo not held up\n",
+	       "not held up\n");
+  if (iSlowFD != -1) {
+    Test_check(Test_skipBody(iSlowFD, TEST_BIG) == 0, pcMode,
+	       "large answer read late");
+    close(iSlowFD);
+  }
+
+  Test_command(iSockFD, pcMode, "remote rm " TEST_FILE "\n", "");
+  close(iSockFD);
+  kill(iPid, SIGTERM);
+  waitpid(iPid, &iStatus, 0);
+  unlink(TEST_FILE); /* if the stalled upload started after the rm */
+}
+
+/*--------------------------------------------------------------------*/
+
+int main(int argc, char **argv)
+{
+  if (argc != 2) {
+    fprintf(stderr, "usage: legacy_test <server>\n");
+    exit(EXIT_FAILURE);
+  }
+  signal(SIGPIPE, SIG_IGN);
+
+  Test_mode(argv[1], "event");
+  Test_mode(argv[1], "fork");
+
+  if (iFailures > 0) {
+    fprintf(stderr, "legacy_test: %d checks failed\n", iFailures);
+    exit(EXIT_FAILURE);
+  }
+  printf("legacy_test: ok\n");
+  exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,287 @@
+/*--------------------------------------------------------------------*/
+/* lex_ref.c                                                          */
+/* The lexer as it was before slices, kept for lex_test to compare    */
+/* against                                                            */
+/*--------------------------------------------------------------------*/
+
+/* This is the DFA of Lex_lexLine from before Lex_nextSlice, which
+   copies a token character by character into a buffer, frozen here so
+   that the lexer in lex.c has something other than itself to be
+   checked against. Only two things differ from the original: a token
+   is a LexRefToken, made with malloc, and "|" and "&" are tokens of
+   their own, as they have been since pipelines and background jobs.
+   Do not speed this file up. */
+
+#include "lex_ref.h"
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+/*--------------------------------------------------------------------*/
+
+struct LexRefToken
+
+/* A token is a string which is either a special character (like
+   <, >, | or &), or a normal word (like a command or an argument. */
+
+{
+      TokenType eType;
+      /* Type of the token */
+
+      char *pcValue;
+      /* The string which is the token's value */
+};
+
+/*--------------------------------------------------------------------*/
+
+TokenType LexRef_returnType(LexRefToken_T psToken)
+
+/* Returns type of token psToken. */
+
+{
+   assert(psToken != NULL);
+   assert((psToken->eType == TOKEN_QUOTE) ||
+          (psToken->eType == TOKEN_WORD));
+
+   return psToken->eType;
+}
+
+/*--------------------------------------------------------------------*/
+
+char *LexRef_returnValue(LexRefToken_T psToken)
+
+/* Returns value of token psToken. */
+
+{
+   assert(psToken != NULL);
+   return psToken->pcValue;
+}
+
+/*--------------------------------------------------------------------*/
+
+void LexRef_freeToken(void *pvItem, void *pvExtra)
+
+/* Free token pvItem. pvExtra is unused. */
+
+{
+   LexRefToken_T psToken = NULL;
+
+   assert(pvItem != NULL);
+
+   psToken = (LexRefToken_T)pvItem;
+   free(psToken->pcValue);
+   free(psToken);
+}
+
+/*--------------------------------------------------------------------*/
+
+static LexRefToken_T LexRef_makeToken(TokenType eTokenType, char *pcValue)
+
+/* Create and return a token whose type is eTokenType and whose value
+   consists of string pcValue. Return NULL if insufficient memory is
+   available. The caller owns the token. */
+
+{
+   LexRefToken_T psToken = NULL;
+
+   assert(pcValue != NULL);
+
+   psToken = (LexRefToken_T)malloc(sizeof(struct LexRefToken));
+   /* Insufficient memory. */
+   if (psToken == NULL)
+      return NULL;
+
+   psToken->eType = eTokenType;
+
+   psToken->pcValue = (char*)malloc(strlen(pcValue) + 1);
+   /* Insufficient memory. */
+   if (psToken->pcValue == NULL)
+   {
+      free(psToken);
+      return NULL;
+   }
+
+   strcpy(psToken->pcValue, pcValue);
+
+   return psToken;
+}
+
+/*--------------------------------------------------------------------*/
+
+int LexRef_lexLine(const char *pcLine, DynArray_T oTokens,
+                   char *pcProgName)
+
+/* Lexically analyze string pcLine. Populate oTokens with the
+   tokens that pcLine contains. Return 1 (TRUE) if successful, or
+   0 (FALSE) otherwise. In the latter case, oTokens may contain
+   tokens that were discovered before the error. */
+
+/* lexLine() uses DFA approach. It "reads" its characters from
+   psLine. */
+
+{
+   char c;
+   LexRefToken_T psToken = NULL;
+
+   enum LexState {STATE_START, STATE_IN_WORD, STATE_IN_QUOTE};
+   enum LexState eState = STATE_START;
+   /* DFA states. */
+
+   int iLineIndex = 0;
+   /* Index for the line read from stdin. */
+
+   int iValueIndex = 0;
+   /* Index for each token created from the line. */
+
+   char acValue[MAX_LINE_SIZE];
+   /* To store token's string value. */
+
+   assert(pcLine != NULL);
+   assert(oTokens != NULL);
+   assert(pcProgName != NULL);
+
+   for (;;)
+   {
+      /* "Read" the next character from pcLine. */
+      c = pcLine[iLineIndex++];
+
+      switch (eState)
+      {
+         case STATE_START:
+            /* Start state (not in a token). */
+            if ((c == '\n') || (c == '\0')) /* End of line. */
+               return TRUE;
+            else if (c == '"') /* Beginning of quoted token. */
+               eState = STATE_IN_QUOTE;
+            else if (isspace((int)c)) /* Ignore non-quoted spaces. */
+               eState = STATE_START;
+            else if ((c == '>') || (c == '<') || (c == '|') || (c == '&'))
+            {
+               /* stdin/stdout redirection, pipe or background. */
+               /* Create a WORD token. */
+               acValue[0] = c;
+               acValue[1] = '\0';
+               psToken = LexRef_makeToken(TOKEN_WORD, acValue);
+               if (psToken == NULL)
+               {
+                  fprintf(stderr, "%s: cannot allocate memory\n",
+                          pcProgName);
+                  return FALSE;
+               }
+               if (! DynArray_add(oTokens, psToken))
+               {
+                  fprintf(stderr, "%s: Cannot allocate memory\n",
+                          pcProgName);
+                  return FALSE;
+               }
+               iValueIndex = 0;
+               eState = STATE_START;
+            }
+            else /* Any other character. */
+            {
+               acValue[iValueIndex++] = c;
+               eState = STATE_IN_WORD;
+            }
+            break;
+
+         case STATE_IN_QUOTE:
+            /* Quoted token. */
+            if (c == '"') /* Matching ending quote. */
+            {
+               /* Create a QUOTE token. */
+               acValue[iValueIndex] = '\0';
+               psToken = LexRef_makeToken(TOKEN_QUOTE, acValue);
+               if (psToken == NULL)
+               {
+                  fprintf(stderr, "%s: cannot allocate memory\n",
+                          pcProgName);
+                  return FALSE;
+               }
+               if (! DynArray_add(oTokens, psToken))
+               {
+                  fprintf(stderr, "%s: cannot allocate memory\n",
+                          pcProgName);
+                  return FALSE;
+               }
+               iValueIndex = 0;
+               eState = STATE_START;
+            }
+            else if ((c == '\n') || (c == '\0'))
+            {
+               /* Unterminated quotes. */
+               fprintf(stderr, "%s: unmatched quote\n", pcProgName);
+               return FALSE;
+            }
+            else /* Any other character. */
+            {
+               acValue[iValueIndex++] = c;
+               eState = STATE_IN_QUOTE;
+            }
+            break;
+
+         case STATE_IN_WORD:
+            /* Non-quoted token. */
+            if ((c == '\n') || (c == '\0')) /* End of line. */
+            {
+               /* Create a WORD token. */
+               acValue[iValueIndex] = '\0';
+               psToken = LexRef_makeToken(TOKEN_WORD, acValue);
+               if (psToken == NULL)
+               {
+                  fprintf(stderr, "%s: cannot allocate memory\n",
+                          pcProgName);
+                  return FALSE;
+               }
+               if (! DynArray_add(oTokens, psToken))
+               {
+                  fprintf(stderr, "%s: cannot allocate memory\n",
+                          pcProgName);
+                  return FALSE;
+               }
+               iValueIndex = 0;
+               return TRUE;
+            }
+            else if (isspace((int)c) || (c == '|') || (c == '&'))
+            {
+               /* Whitespace, or a pipe or background that is read
+                  again from the start state. */
+               /* Create a WORD token. */
+               acValue[iValueIndex] = '\0';
+               psToken = LexRef_makeToken(TOKEN_WORD, acValue);
+               if (psToken == NULL)
+               {
+                  fprintf(stderr, "%s: cannot allocate memory\n",
+                          pcProgName);
+                  return FALSE;
+               }
+               if (! DynArray_add(oTokens, psToken))
+               {
+                  fprintf(stderr, "%s: cannot allocate memory\n",
+                          pcProgName);
+                  return FALSE;
+               }
+               if (! isspace((int)c))
+                  iLineIndex--;
+               iValueIndex = 0;
+               eState = STATE_START;
+            }
+            else if (c == '"') /* Quote within a word. */
+            {
+               /* If there is a quote in a word, then the whole word
+                  switches to a quoted token. */
+               eState = STATE_IN_QUOTE;
+            }
+            else /* Any other character. */
+            {
+               acValue[iValueIndex++] = c;
+               eState = STATE_IN_WORD;
+            }
+            break;
+
+         default:
+            assert(FALSE);
+      }
+   }
+}
@@ -0,0 +1,37 @@
+/*--------------------------------------------------------------------*/
+/* lex_ref.h                                                          */
+/* The lexer as it was before slices, kept for lex_test to compare    */
+/* against                                                            */
+/*--------------------------------------------------------------------*/
+
+#ifndef LEX_REF_INCLUDED
+#define LEX_REF_INCLUDED
+
+#include "lex.h"
+
+/*--------------------------------------------------------------------*/
+
+typedef struct LexRefToken *LexRefToken_T;
+/* A token of the reference lexer: its type and its value. */
+
+/*--------------------------------------------------------------------*/
+
+TokenType LexRef_returnType(LexRefToken_T psToken);
+/* Returns type of token psToken. */
+
+char *LexRef_returnValue(LexRefToken_T psToken);
+/* Returns value of token psToken. */
+
+void LexRef_freeToken(void *pvItem, void *pvExtra);
+/* Free token pvItem. pvExtra is unused. */
+
+int LexRef_lexLine(const char *pcLine, DynArray_T oTokens,
+                   char *pcProgName);
+/* Lexically analyze string pcLine, one character at a time, the way
+   Lex_lexLine did before it was a loop over Lex_nextSlice. Populate
+   oTokens with the tokens that pcLine contains, owned by the caller.
+   Return 1 (TRUE) if successful, or 0 (FALSE) otherwise. In the
+   latter case, oTokens may contain tokens that were discovered before
+   the error. */
+
+#endif
@@ -0,0 +1,170 @@
+/*--------------------------------------------------------------------*/
+/* lex_test.c                                                         */
+/* Check the slice lexer against the lexer it replaced                */
+/*--------------------------------------------------------------------*/
+
+/* Every line is lexed three ways: by the character-at-a-time lexer
+   of before, kept in lex_ref.c; by Lex_nextSlice with each slice
+   copied out by Lex_copySlice; and by Lex_lexLine. All three have to
+   agree on whether the line is well-formed and on the type and value
+   of every token found, up to an error if there is one. A slice also
+   has to lie within its line and say how long its value is. The
+   lexers complain about malformed lines on stderr, so this program
+   reports on stdout. */
+
+#include "lex.h"
+#include "lex_ref.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TEST_RANDOM_LINES 1000000 /* random lines checked */
+#define TEST_RANDOM_LENGTH 40 /* longest random line */
+#define TEST_LONG_LENGTH (MAX_LINE_SIZE - 1) /* length of the long lines */
+
+/* lines worth checking by hand: whitespace, quoting, operators and
+   malformed input */
+static const char *apcLines[] = {
+  "", " ", "\t", "\n", " \t\v\f\r ", "ls", " ls", "ls ", "ls\n",
+  "ls -l a b", "  ls   -l  ", "ls\ta", "ls\va\fb\rc", "ls\nwc",
+  "\"ls\"", "\"l\"s", "l\"s\"", "l\"\"s", "\"\"", "\"\" \"\"", "\"\"\"\"",
+  "ls \"a b\" c", "ls \"a\"\"b\"", "ls a\"b c\"d", "a\"b\"c\"d\"e",
+  "\"a\tb\"", "\" \"", "\"a\"b c", "\"<\" \">\" \"|\" \"&\"",
+  "<", ">", "|", "&", "<<", ">>", "||", "&&", "<>|&", "a<b", "a>b",
+  "a|b", "a&b", "a|", "|a", "a&", "&a", "a |b", "a| b", "a\"|\"b",
+  "\"a\"|b", "a|\"b\"", "ls < in > out", "ls <in >out", "0< in",
+  "1> out", "2> err", "cat < a | wc > b &", "ls|wc|sort&",
+  "\"", "a\"", "\"a", "ls \"unterminated", "ls \"a\" \"b", "a\"b",
+  "ls \"a\nb\"", "ls | wc \"", "\"|", "& \"", "\"\n\"",
+};
+
+/*--------------------------------------------------------------------*/
+
+/* lex pcLine all three ways and report any difference. Return 1 if
+   there is one, 0 otherwise */
+static int Test_compare(const char *pcLine)
+{
+  DynArray_T oRef = DynArray_new(0);
+  DynArray_T oTokens = DynArray_new(0);
+  Arena_T oArena = Arena_new();
+  char acValue[MAX_LINE_SIZE];
+  LexRefToken_T psRef = NULL;
+  LexSlice sSlice;
+  LexNext eNext = LEX_END;
+  int iRef = 0, iSlices = 0, iLexed = 0;
+  int iIndex = 0;
+  int iBad = 0;
+  int i = 0;
+
+  if ((oRef == NULL) || (oTokens == NULL) || (oArena == NULL)) {
+    fprintf(stderr, "lex_test: cannot allocate memory\n");
+    exit(EXIT_FAILURE);
+  }
+  iRef = LexRef_lexLine(pcLine, oRef, "lex_test");
+  iLexed = Lex_lexLine(pcLine, oTokens, oArena, "lex_test");
+
+  /* the slices, one by one against the tokens of the old lexer */
+  while (!iBad &&
+	 ((eNext = Lex_nextSlice(pcLine, &iIndex, &sSlice, "lex_test")) ==
+	  LEX_TOKEN)) {
+    if ((sSlice.iOffset < 0) || (sSlice.iLength > sSlice.iSpan) ||
+	(sSlice.iOffset + sSlice.iSpan > (int) strlen(pcLine)) ||
+	(iIndex < sSlice.iOffset + sSlice.iSpan)) {
+      iBad = 1;
+      break;
+    }
+    Lex_copySlice(pcLine, &sSlice, acValue);
+    if ((i >= DynArray_getLength(oRef)) ||
+	((int) strlen(acValue) != sSlice.iLength))
+      iBad = 1;
+    else {
+      psRef = DynArray_get(oRef, i);
+      iBad = (sSlice.eType != LexRef_returnType(psRef)) ||
+	(strcmp(acValue, LexRef_returnValue(psRef)) != 0);
+    }
+    i++;
+  }
+  iSlices = (eNext == LEX_END);
+  if (!iBad && (i != DynArray_getLength(oRef)))
+    iBad = 1; /* fewer slices than tokens */
+
+  /* the tokens of Lex_lexLine, all at once */
+  if (!iBad && (DynArray_getLength(oTokens) != DynArray_getLength(oRef)))
+    iBad = 1;
+  for (i = 0; !iBad && (i < DynArray_getLength(oTokens)); i++) {
+    psRef = DynArray_get(oRef, i);
+    iBad = (Lex_returnType(DynArray_get(oTokens, i)) !=
+	    LexRef_returnType(psRef)) ||
+      (strcmp(Lex_returnValue(DynArray_get(oTokens, i)),
+	      LexRef_returnValue(psRef)) != 0);
+  }
+
+  if (iBad || (iRef != iSlices) || (iRef != iLexed)) {
+    iBad = 1;
+    printf("lex_test: [%s]: old lexer %s, Lex_nextSlice %s, "
+	   "Lex_lexLine %s%s\n", pcLine, iRef ? "accepts" : "rejects",
+	   iSlices ? "accepts" : "rejects", iLexed ? "accepts" : "rejects",
+	   ((iRef == iSlices) && (iRef == iLexed)) ? ", with other tokens" :
+	   "");
+  }
+  DynArray_map(oRef, LexRef_freeToken, NULL);
+  DynArray_free(oRef);
+  DynArray_free(oTokens);
+  Arena_free(oArena);
+  return iBad;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* check lines as long as the server takes, made of pcPattern over and
+   over. Return the number of failures */
+static int Test_long(const char *pcPattern)
+{
+  char acLine[TEST_LONG_LENGTH + 1];
+  size_t iPattern = strlen(pcPattern);
+  int i = 0;
+
+  for (i = 0; i < TEST_LONG_LENGTH; i++)
+    acLine[i] = pcPattern[(size_t) i % iPattern];
+  acLine[TEST_LONG_LENGTH] = '\0';
+  return Test_compare(acLine);
+}
+
+/*--------------------------------------------------------------------*/
+
+int main(void)
+{
+  static const char acChars[] = "ab <>\"|&\t\n";
+  char acLine[TEST_RANDOM_LENGTH + 1];
+  size_t i = 0;
+  int iLength = 0;
+  int iBad = 0;
+  int j = 0;
+
+  if (freopen("/dev/null", "w", stderr) == NULL)
+    return EXIT_FAILURE;
+
+  for (i = 0; i < sizeof(apcLines) / sizeof(apcLines[0]); i++)
+    iBad += Test_compare(apcLines[i]);
+  iBad += Test_long("word ");
+  iBad += Test_long("a\"b c\"d ");
+  iBad += Test_long("\"quoted text\" | ");
+  iBad += Test_long("x");
+
+  /* the same seed every run, so that a failure can be repeated */
+  srand(3);
+  for (i = 0; i < TEST_RANDOM_LINES; i++) {
+    iLength = rand() % (TEST_RANDOM_LENGTH + 1);
+    for (j = 0; j < iLength; j++)
+      acLine[j] = acChars[(size_t) rand() % (sizeof(acChars) - 1)];
+    acLine[iLength] = '\0';
+    iBad += Test_compare(acLine);
+  }
+
+  if (iBad > 0) {
+    printf("lex_test: %d lines lexed differently\n", iBad);
+    return EXIT_FAILURE;
+  }
+  printf("lex_test: ok\n");
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,332 @@
+/*--------------------------------------------------------------------*/
+/* parse_test.c                                                       */
+/* Check the one-pass parser against the old parser                   */
+/*--------------------------------------------------------------------*/
+
+/* Syn_parseLine has to accept the lines Lex_lexLine followed by
+   Syn_synLine accept, with the same words and redirections.
+   Lex_lexLine and Syn_parseLine share Lex_nextSlice, so this checks
+   the parsers only; lex_test checks the lexer against the one of
+   before. The old pair knows neither pipelines nor background jobs,
+   so the line it is given is cut at every unquoted "|" first, and a
+   final unquoted "&" is taken off; an "&" anywhere else, or an empty
+   stage, makes the line malformed. The old parser also took "2>" for
+   a redirection of stdout, which the new one fixed: "2>" is only
+   checked against the lines of asStderr. The parsers complain about
+   malformed lines on stderr, so this program reports on stdout. */
+
+#include "lex.h"
+#include "syn.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TEST_RANDOM_LINES 200000 /* random lines checked */
+#define TEST_RANDOM_WORDS 10 /* most words in a random line */
+#define TEST_MAX_STAGES 16 /* most stages in a line of the corpus */
+
+/* a stage of a pipeline as the old parser sees it */
+typedef struct TestStage {
+  char *apcArgv[MAX_LINE_SIZE];
+  int iArgc;
+  char *pcStdin;
+  char *pcStdout;
+} TestStage;
+
+/* lines whose "2>" the old parser got wrong, with what they give */
+static const struct {
+  const char *pcLine;
+  int iOk;
+  const char *pcStderr;
+} asStderr[] = {
+  {"ls 2> err", 1, "err"},
+  {"ls 2> err > out", 1, "err"},
+  {"ls 2>err", 1, NULL},
+  {"ls 2> \"e r\" a", 1, "e r"},
+  {"ls 2> a | wc 2> b", 1, "a"},
+  {"ls \"2>\" a", 1, NULL},
+  {"ls 2> a 2> b", 0, NULL},
+  {"ls 2>", 0, NULL},
+  {"ls 2> | wc", 0, NULL},
+  {"ls 2> &", 0, NULL},
+};
+
+/* lines worth checking by hand: quoting, redirections, pipes, & and
+   malformed input */
+static const char *apcLines[] = {
+  "", "   ", "\t", "ls", "ls -l a b", "  ls   -l  ", "remote ls",
+  "\"ls\"", "\"l\"s", "l\"s\"", "ls \"a b\" c", "ls \"\"", "ls \"a\"\"b\"",
+  "ls a\"b c\"d", "ls \"<\"", "ls \">\" \"|\" \"&\"", "\"<\" a", "\">\"",
+  "ls < in", "ls <in", "ls 0< in", "ls > out", "ls >out", "ls 1> out",
+  "ls < in > out", "ls > out < in", "ls < \"i n\"", "ls < in a > out b",
+  "cat < a < b", "cat > a > b", "cat < a 0< b", "cat > a 1> b",
+  "ls <", "ls >", "ls < >", "ls > <", "ls < > x", "< in ls", "> out",
+  "<", ">", "0< in ls", "1> out ls", "ls < \"\"",
+  "ls | wc", "ls|wc", "ls | wc | sort -r", "ls -l|grep a|wc -l",
+  "cat < in | wc > out", "cat < a | cat < b", "ls > a | wc > b",
+  "ls | wc < in", "ls |", "| ls", "ls | | wc", "|", "ls || wc",
+  "ls \"|\" wc", "ls a|b", "ls | > out", "ls | < in", "ls > | wc",
+  "sleep 1 &", "sleep 1&", "ls | wc &", "ls > out &", "&", "& ls",
+  "ls & wc", "ls & &", "ls &&", "ls \"&\"", "ls a&b", "ls | &",
+  "ls & | wc", "ls < &", "ls > &", "ls &  ", "ls & \"x\"",
+  "ls \"unterminated", "ls \"a\" \"b", "\"", "ls | wc \"", "ls \"|",
+  "sendfile a", "recvfile \"a b\"", "cd", "cd ..", "setenv A b",
+  "exit", "remote exit", "jobs", "jobout 1", "build", "cachestats",
+  "a b c d e f g h i j k l m n o p q r s t u v w x y z 1 2 3 4 5 6 7 8",
+};
+
+/* words random lines are made of */
+static const char *apcWords[] = {
+  "ls", "a", "\"q r\"", "<", ">", "0<", "1>", "x\"y\"", "\"\"", "cd",
+  "\"<\"", "|", "&", "\"|\"", "\"&\"", "a|b", "&&", "remote", "\"",
+  "sendfile",
+};
+
+/* what separates them */
+static const char *apcGaps[] = {" ", "  ", "\t", ""};
+
+/*--------------------------------------------------------------------*/
+
+/* return 1 if strings pc1 and pc2 are equal or both NULL */
+static int Test_same(const char *pc1, const char *pc2)
+{
+  if ((pc1 == NULL) || (pc2 == NULL))
+    return pc1 == pc2;
+  return strcmp(pc1, pc2) == 0;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* run the old parser over tokens iFirst up to iEnd of oTokens, one
+   stage, and store what it found in *psStage. Return 1 if it accepted
+   them, 0 otherwise */
+static int Test_oldStage(DynArray_T oTokens, int iFirst, int iEnd,
+			 TestStage *psStage, Arena_T oArena)
+{
+  DynArray_T oStage = DynArray_new(0);
+  DynArray_T oCmds = DynArray_new(0);
+  void *pvCmd = NULL;
+  int iOk = 0;
+  int i = 0;
+
+  if ((oStage == NULL) || (oCmds == NULL)) {
+    fprintf(stderr, "parse_test: cannot allocate memory\n");
+    exit(EXIT_FAILURE);
+  }
+  for (i = iFirst; i < iEnd; i++)
+    DynArray_add(oStage, DynArray_get(oTokens, i));
+
+  memset(psStage, 0, sizeof(*psStage));
+  if ((iFirst < iEnd) && Syn_synLine(oStage, oCmds, oArena, "parse_test")) {
+    iOk = 1;
+    for (i = 0; i < DynArray_getLength(oCmds); i++) {
+      pvCmd = DynArray_get(oCmds, i);
+      switch (Syn_returnType(pvCmd)) {
+      case CMD_CMD:
+      case CMD_ARG:
+	psStage->apcArgv[psStage->iArgc++] = Syn_returnValue(pvCmd);
+	break;
+      case CMD_STDIN:
+	psStage->pcStdin = Syn_returnValue(pvCmd);
+	break;
+      case CMD_STDOUT:
+	psStage->pcStdout = Syn_returnValue(pvCmd);
+	break;
+      default: /* stderr, which it never finds (see asStderr) */
+	break;
+      }
+    }
+  }
+  DynArray_free(oStage);
+  DynArray_free(oCmds);
+  return iOk;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* parse pcLine with the old lexer and parser, stage by stage, into
+   asStages, and set *piStages and *piBackground. Return 1 if the
+   line is well-formed, 0 otherwise */
+static int Test_oldLine(const char *pcLine, TestStage *asStages,
+			int *piStages, int *piBackground, Arena_T oArena)
+{
+  DynArray_T oTokens = DynArray_new(0);
+  void *pvToken = NULL;
+  int iLength = 0;
+  int iFirst = 0;
+  int iOk = 1;
+  int i = 0;
+
+  *piStages = 0;
+  *piBackground = 0;
+  if (oTokens == NULL) {
+    fprintf(stderr, "parse_test: cannot allocate memory\n");
+    exit(EXIT_FAILURE);
+  }
+  if (!Lex_lexLine(pcLine, oTokens, oArena, "parse_test")) {
+    DynArray_free(oTokens);
+    return 0;
+  }
+
+  /* a final "&" runs the line in the background */
+  iLength = DynArray_getLength(oTokens);
+  if (iLength == 0) { /* no words at all */
+    DynArray_free(oTokens);
+    memset(&asStages[0], 0, sizeof(asStages[0]));
+    *piStages = 1;
+    return 1;
+  }
+  pvToken = DynArray_get(oTokens, iLength - 1);
+  if ((Lex_returnType(pvToken) == TOKEN_WORD) &&
+      (strcmp(Lex_returnValue(pvToken), "&") == 0)) {
+    *piBackground = 1;
+    iLength--;
+  }
+
+  /* every unquoted "|" ends a stage */
+  for (i = 0; iOk && (i <= iLength); i++) {
+    if (i < iLength) {
+      pvToken = DynArray_get(oTokens, i);
+      if (Lex_returnType(pvToken) != TOKEN_WORD)
+	continue;
+      if (strcmp(Lex_returnValue(pvToken), "&") == 0) {
+	iOk = 0;
+	break;
+      }
+      if (strcmp(Lex_returnValue(pvToken), "|") != 0)
+	continue;
+    }
+    if (*piStages == TEST_MAX_STAGES)
+      iOk = 0;
+    else
+      iOk = Test_oldStage(oTokens, iFirst, i, &asStages[(*piStages)++],
+			  oArena);
+    iFirst = i + 1;
+  }
+  DynArray_free(oTokens);
+  return iOk;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* parse pcLine with both parsers and report any difference. Return 1
+   if there is one, 0 otherwise */
+static int Test_compare(const char *pcLine)
+{
+  TestStage asStages[TEST_MAX_STAGES];
+  Arena_T oOldArena = Arena_new();
+  Arena_T oNewArena = Arena_new();
+  SynCmd sCmd;
+  SynCmd *psStage = NULL;
+  int iStages = 0;
+  int iBackground = 0;
+  int iOld = 0, iNew = 0;
+  int iBad = 0;
+  int i = 0, j = 0;
+
+  if ((oOldArena == NULL) || (oNewArena == NULL)) {
+    fprintf(stderr, "parse_test: cannot allocate memory\n");
+    exit(EXIT_FAILURE);
+  }
+  iOld = Test_oldLine(pcLine, asStages, &iStages, &iBackground, oOldArena);
+  iNew = Syn_parseLine(pcLine, &sCmd, oNewArena, "parse_test");
+
+  if (iOld != iNew)
+    iBad = 1;
+  else if (iOld) {
+    iBad = (sCmd.iBackground != iBackground);
+    for (i = 0, psStage = &sCmd; !iBad && (i < iStages);
+	 i++, psStage = psStage->psNext) {
+      if ((psStage == NULL) || (psStage->iArgc != asStages[i].iArgc) ||
+	  (psStage->ppcArgv[psStage->iArgc] != NULL) ||
+	  !Test_same(psStage->pcStdin, asStages[i].pcStdin) ||
+	  !Test_same(psStage->pcStdout, asStages[i].pcStdout) ||
+	  (psStage->pcStderr != NULL) ||
+	  ((psStage->iArgc > 0) &&
+	   (psStage->eVerb != Syn_verb(psStage->ppcArgv[0])))) {
+	iBad = 1;
+	break;
+      }
+      for (j = 0; j < psStage->iArgc; j++)
+	if (strcmp(psStage->ppcArgv[j], asStages[i].apcArgv[j]) != 0)
+	  iBad = 1;
+    }
+    if (!iBad && (psStage != NULL))
+      iBad = 1; /* more stages than the old parser found */
+  }
+
+  if (iBad)
+    printf("parse_test: [%s]: old parser %s, new parser %s%s\n", pcLine,
+	   iOld ? "accepts" : "rejects", iNew ? "accepts" : "rejects",
+	   (iOld == iNew) ? ", with other words" : "");
+  Arena_free(oOldArena);
+  Arena_free(oNewArena);
+  return iBad;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* check the lines with "2>". Return the number of failures */
+static int Test_stderr(void)
+{
+  Arena_T oArena = NULL;
+  SynCmd sCmd;
+  size_t i = 0;
+  int iOk = 0;
+  int iBad = 0;
+
+  for (i = 0; i < sizeof(asStderr) / sizeof(asStderr[0]); i++) {
+    if ((oArena = Arena_new()) == NULL) {
+      fprintf(stderr, "parse_test: cannot allocate memory\n");
+      exit(EXIT_FAILURE);
+    }
+    iOk = Syn_parseLine(asStderr[i].pcLine, &sCmd, oArena, "parse_test");
+    if ((iOk != asStderr[i].iOk) ||
+	(iOk && !Test_same(sCmd.pcStderr, asStderr[i].pcStderr))) {
+      printf("parse_test: [%s]: wrong stderr redirection\n",
+	     asStderr[i].pcLine);
+      iBad++;
+    }
+    Arena_free(oArena);
+  }
+  return iBad;
+}
+
+/*--------------------------------------------------------------------*/
+
+int main(void)
+{
+  char acLine[MAX_LINE_SIZE];
+  size_t iWords = sizeof(apcWords) / sizeof(apcWords[0]);
+  size_t iGaps = sizeof(apcGaps) / sizeof(apcGaps[0]);
+  size_t i = 0;
+  int iCount = 0;
+  int iBad = 0;
+  int j = 0;
+
+  if (freopen("/dev/null", "w", stderr) == NULL)
+    return EXIT_FAILURE;
+
+  for (i = 0; i < sizeof(apcLines) / sizeof(apcLines[0]); i++)
+    iBad += Test_compare(apcLines[i]);
+  iBad += Test_stderr();
+
+  /* the same seed every run, so that a failure can be repeated */
+  srand(2);
+  for (i = 0; i < TEST_RANDOM_LINES; i++) {
+    acLine[0] = '\0';
+    iCount = rand() % (TEST_RANDOM_WORDS + 1);
+    for (j = 0; j < iCount; j++) {
+      strcat(acLine, apcWords[(size_t) rand() % iWords]);
+      strcat(acLine, apcGaps[(size_t) rand() % iGaps]);
+    }
+    iBad += Test_compare(acLine);
+  }
+
+  if (iBad > 0) {
+    printf("parse_test: %d lines parsed differently\n", iBad);
+    return EXIT_FAILURE;
+  }
+  printf("parse_test: ok\n");
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,454 @@
+/*--------------------------------------------------------------------*/
+/* uring.c                                                            */
+/* Bulk copies between descriptors through io_uring                   */
+/*--------------------------------------------------------------------*/
+
+#include "uring.h"
+#include <linux/io_uring.h>
+#include <poll.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+
+/*--------------------------------------------------------------------*/
+
+enum UringSlotState {URING_FREE, URING_READING, URING_FULL,
+                     URING_WRITING};
+
+struct UringSlot
+
+/* A UringSlot is one registered buffer and what is being done with
+   it. */
+
+{
+   enum UringSlotState eState;
+   /* Whether it is free, being read into, holding data or being
+      written from. */
+
+   char *pcBuf;
+   /* URING_SLOT_SIZE bytes. */
+
+   uint64_t uOffset;
+   /* Offset of its first byte from where the copy started. */
+
+   size_t iLength;
+   /* Number of bytes asked for while reading, held otherwise. */
+
+   size_t iDone;
+   /* Number of bytes held that are written already. */
+};
+
+/*--------------------------------------------------------------------*/
+
+struct Uring
+
+/* A Uring is the ring of one process: its descriptor, the mapped
+   submission and completion queues, and the buffers copies go
+   through. */
+
+{
+   int iFD;
+   /* The ring. */
+
+   pid_t iPid;
+   /* Process that set it up, or 0 if none did. */
+
+   unsigned *puSqHead, *puSqTail, *puSqMask, *puSqArray;
+   /* The submission queue. */
+
+   unsigned *puCqHead, *puCqTail, *puCqMask;
+   /* The completion queue. */
+
+   struct io_uring_sqe *psSqes;
+   /* Submission queue entries. */
+
+   struct io_uring_cqe *psCqes;
+   /* Completion queue entries. */
+
+   int iFixed;
+   /* 1 (TRUE) if the buffers are registered with the kernel. */
+
+   struct UringSlot asSlots[URING_SLOTS];
+   /* The buffers. */
+
+   UringStats sStats;
+   /* What has been done so far. */
+};
+
+/*--------------------------------------------------------------------*/
+
+static int iUringOn = FALSE;
+/* Whether copies go through io_uring. */
+
+static struct Uring sRing;
+/* The ring of this process. */
+
+/*--------------------------------------------------------------------*/
+
+void Uring_setOn(int iOn)
+
+/* Copy through io_uring from now on if iOn is TRUE, or not at all if
+   it is FALSE. */
+
+{
+   iUringOn = iOn;
+}
+
+/*--------------------------------------------------------------------*/
+
+int Uring_isOn(void)
+
+/* Return TRUE if copies go through io_uring, FALSE otherwise. */
+
+{
+   return iUringOn;
+}
+
+/*--------------------------------------------------------------------*/
+
+void Uring_getStats(UringStats *psStats)
+
+/* Store what the ring of this process has done so far in
+   *psStats. */
+
+{
+   assert(psStats != NULL);
+
+   if (sRing.iPid == getpid())
+      *psStats = sRing.sStats;
+   else
+      bzero(psStats, sizeof(*psStats));
+}
+
+/*--------------------------------------------------------------------*/
+
+static int Uring_setup(void)
+
+/* Set up the ring of this process, unless it is set up already. One
+   inherited from a parent is left alone: its queues are the parent's.
+   Return SUCCESS, or FAILURE with errno set. */
+
+{
+   struct io_uring_params sParams;
+   struct iovec asIov[URING_SLOTS];
+   size_t iSqSize, iCqSize;
+   char *pcSq, *pcCq, *pcBufs;
+   void *pvSqes;
+   int iFD;
+   int i;
+
+   if (sRing.iPid == getpid())
+      return SUCCESS;
+
+   bzero(&sParams, sizeof(sParams));
+   if ((iFD = (int)syscall(__NR_io_uring_setup, 2 * URING_SLOTS,
+                           &sParams)) == -1)
+      return FAILURE;
+   if (! (sParams.features & IORING_FEAT_SINGLE_MMAP))
+   {
+      close(iFD);
+      errno = ENOSYS; /* older than 5.4: not worth it */
+      return FAILURE;
+   }
+
+   /* Both queues come in one mapping, the entries in another. */
+   iSqSize = sParams.sq_off.array + sParams.sq_entries * sizeof(unsigned);
+   iCqSize = sParams.cq_off.cqes
+      + sParams.cq_entries * sizeof(struct io_uring_cqe);
+   if (iCqSize > iSqSize)
+      iSqSize = iCqSize;
+   pcSq = mmap(NULL, iSqSize, PROT_READ | PROT_WRITE,
+               MAP_SHARED | MAP_POPULATE, iFD, IORING_OFF_SQ_RING);
+   pvSqes = mmap(NULL, sParams.sq_entries * sizeof(struct io_uring_sqe),
+                 PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, iFD,
+                 IORING_OFF_SQES);
+   pcBufs = mmap(NULL, URING_SLOTS * URING_SLOT_SIZE,
+                 PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+   if ((pcSq == MAP_FAILED) || (pvSqes == MAP_FAILED) ||
+       (pcBufs == MAP_FAILED))
+   {
+      close(iFD); /* the mappings go with the process */
+      errno = ENOMEM;
+      return FAILURE;
+   }
+   pcCq = pcSq;
+
+   bzero(&sRing, sizeof(sRing));
+   sRing.iFD = iFD;
+   sRing.iPid = getpid();
+   sRing.puSqHead = (unsigned *)(pcSq + sParams.sq_off.head);
+   sRing.puSqTail = (unsigned *)(pcSq + sParams.sq_off.tail);
+   sRing.puSqMask = (unsigned *)(pcSq + sParams.sq_off.ring_mask);
+   sRing.puSqArray = (unsigned *)(pcSq + sParams.sq_off.array);
+   sRing.puCqHead = (unsigned *)(pcCq + sParams.cq_off.head);
+   sRing.puCqTail = (unsigned *)(pcCq + sParams.cq_off.tail);
+   sRing.puCqMask = (unsigned *)(pcCq + sParams.cq_off.ring_mask);
+   sRing.psCqes = (struct io_uring_cqe *)(pcCq + sParams.cq_off.cqes);
+   sRing.psSqes = pvSqes;
+   for (i = 0; i < URING_SLOTS; i++)
+   {
+      sRing.asSlots[i].pcBuf = pcBufs + (size_t)i * URING_SLOT_SIZE;
+      asIov[i].iov_base = sRing.asSlots[i].pcBuf;
+      asIov[i].iov_len = URING_SLOT_SIZE;
+   }
+
+   /* Registered buffers spare the kernel pinning pages per operation;
+      without them (RLIMIT_MEMLOCK), plain reads and writes still
+      work. */
+   sRing.iFixed = (syscall(__NR_io_uring_register, iFD,
+                           IORING_REGISTER_BUFFERS, asIov, URING_SLOTS)
+                   == 0);
+   return SUCCESS;
+}
+
+/*--------------------------------------------------------------------*/
+
+static void Uring_prep(int iSlot, int iWrite, int iFD, int iSeekable,
+                       off_t lBase)
+
+/* Queue a read into, or a write from, slot iSlot on descriptor iFD,
+   which starts the copy at offset lBase if iSeekable. */
+
+{
+   struct UringSlot *psSlot = &sRing.asSlots[iSlot];
+   unsigned uTail = *sRing.puSqTail;
+   unsigned uIndex = uTail & *sRing.puSqMask;
+   struct io_uring_sqe *psSqe = &sRing.psSqes[uIndex];
+   uint64_t uAt = psSlot->uOffset + (iWrite ? psSlot->iDone : 0);
+
+   bzero(psSqe, sizeof(*psSqe));
+   if (sRing.iFixed)
+   {
+      psSqe->opcode = iWrite ? IORING_OP_WRITE_FIXED : IORING_OP_READ_FIXED;
+      psSqe->buf_index = (unsigned short)iSlot;
+   }
+   else
+      psSqe->opcode = iWrite ? IORING_OP_WRITE : IORING_OP_READ;
+   psSqe->fd = iFD;
+   psSqe->addr = (uint64_t)(uintptr_t)
+      (psSlot->pcBuf + (iWrite ? psSlot->iDone : 0));
+   psSqe->len = (unsigned)(iWrite ? psSlot->iLength - psSlot->iDone
+                           : psSlot->iLength);
+   /* -1: the current position, which is all a socket or pipe has */
+   psSqe->off = iSeekable ? (uint64_t)lBase + uAt : (uint64_t)-1;
+   psSqe->user_data = (uint64_t)iSlot;
+
+   sRing.puSqArray[uIndex] = uIndex;
+   psSlot->eState = iWrite ? URING_WRITING : URING_READING;
+   __atomic_store_n(sRing.puSqTail, uTail + 1, __ATOMIC_RELEASE);
+}
+
+/*--------------------------------------------------------------------*/
+
+static void Uring_wait(int iFD, short iEvents)
+
+/* Wait until iFD, which is non-blocking and said EAGAIN, is ready for
+   iEvents. */
+
+{
+   struct pollfd sPoll;
+
+   sPoll.fd = iFD;
+   sPoll.events = iEvents;
+   sPoll.revents = 0;
+   poll(&sPoll, 1, -1);
+}
+
+/*--------------------------------------------------------------------*/
+
+static int Uring_isSeekable(int iFD, off_t *plOffset)
+
+/* Return TRUE, with the current offset of iFD in *plOffset, if iFD
+   is a file that can be read and written at offsets; FALSE if it is a
+   socket, a pipe, or a file open for appending, whose bytes have to
+   go in order. */
+
+{
+   struct stat sStat;
+   int iFlags;
+
+   if ((fstat(iFD, &sStat) == -1) || (! S_ISREG(sStat.st_mode)) ||
+       ((iFlags = fcntl(iFD, F_GETFL)) == -1) || (iFlags & O_APPEND))
+      return FALSE;
+   return ((*plOffset = lseek(iFD, 0, SEEK_CUR)) != -1);
+}
+
+/*--------------------------------------------------------------------*/
+
+ssize_t Uring_copy(int iOutFD, int iInFD, size_t iCount)
+
+/* Copy iCount bytes from the current offset of iInFD to iOutFD
+   through the ring. Return the number of bytes copied, or FAILURE
+   with errno set. */
+
+{
+   struct UringSlot *psSlot;
+   struct io_uring_cqe *psCqe;
+   off_t lInBase, lOutBase;
+   uint64_t uEnd = iCount; /* where the input ends */
+   uint64_t uNextRead = 0; /* offset of the next read */
+   uint64_t uNextWrite = 0; /* offset of the next write to a stream */
+   uint64_t uWritten = 0;
+   unsigned uHead, uSubmit;
+   int iInSeek, iOutSeek;
+   int iReading = 0, iWriting = 0;
+   int iErr = 0;
+   int i;
+
+   if (! iUringOn)
+   {
+      errno = ENOSYS;
+      return FAILURE;
+   }
+   if (Uring_setup() == FAILURE)
+   {
+      fprintf(stderr, "io_uring: %s, copying without it\n",
+              strerror(errno));
+      iUringOn = FALSE;
+      errno = ENOSYS;
+      return FAILURE;
+   }
+
+   /* Files are read and written at offsets, in any order. */
+   iInSeek = Uring_isSeekable(iInFD, &lInBase);
+   iOutSeek = Uring_isSeekable(iOutFD, &lOutBase);
+   for (i = 0; i < URING_SLOTS; i++)
+      sRing.asSlots[i].eState = URING_FREE;
+
+   for (;;)
+   {
+      /* Fill what is free, empty what is full. */
+      for (i = 0; i < URING_SLOTS; i++)
+      {
+         psSlot = &sRing.asSlots[i];
+         if ((psSlot->eState == URING_FREE) && (iErr == 0) &&
+             (uNextRead < uEnd) && (iInSeek || (iReading == 0)))
+         {
+            psSlot->uOffset = uNextRead;
+            psSlot->iLength = (uEnd - uNextRead < URING_SLOT_SIZE)
+               ? (size_t)(uEnd - uNextRead) : URING_SLOT_SIZE;
+            psSlot->iDone = 0;
+            uNextRead += psSlot->iLength;
+            Uring_prep(i, FALSE, iInFD, iInSeek, lInBase);
+            iReading++;
+         }
+         else if ((psSlot->eState == URING_FULL) && (iErr == 0) &&
+                  (iOutSeek || ((iWriting == 0) &&
+                                (psSlot->uOffset + psSlot->iDone
+                                 == uNextWrite))))
+         {
+            Uring_prep(i, TRUE, iOutFD, iOutSeek, lOutBase);
+            iWriting++;
+         }
+      }
+      if (iReading + iWriting == 0)
+         break;
+
+      /* Hand them over and wait for at least one to finish. */
+      uSubmit = *sRing.puSqTail
+         - __atomic_load_n(sRing.puSqHead, __ATOMIC_ACQUIRE);
+      if (syscall(__NR_io_uring_enter, sRing.iFD, uSubmit, 1,
+                  IORING_ENTER_GETEVENTS, NULL, 0) == -1)
+      {
+         if (errno == EINTR)
+            continue;
+         iErr = errno; /* the ring itself is broken */
+         break;
+      }
+      sRing.sStats.llEnters++;
+
+      uHead = *sRing.puCqHead;
+      while (uHead != __atomic_load_n(sRing.puCqTail, __ATOMIC_ACQUIRE))
+      {
+         psCqe = &sRing.psCqes[uHead & *sRing.puCqMask];
+         psSlot = &sRing.asSlots[psCqe->user_data];
+         uHead++;
+         sRing.sStats.llOps++;
+
+         /* A read: the buffer holds data now, or the input ended. */
+         if (psSlot->eState == URING_READING)
+         {
+            iReading--;
+            if ((psCqe->res == -EINTR) || (psCqe->res == -EAGAIN))
+            {
+               if (psCqe->res == -EAGAIN)
+                  Uring_wait(iInFD, POLLIN);
+               uNextRead = iInSeek ? uNextRead : psSlot->uOffset;
+               psSlot->eState = URING_FREE;
+               if (iInSeek) /* the same range again */
+               {
+                  Uring_prep((int)(psSlot - sRing.asSlots), FALSE, iInFD,
+                             iInSeek, lInBase);
+                  iReading++;
+               }
+               continue;
+            }
+            if (psCqe->res < 0)
+            {
+               iErr = -psCqe->res;
+               psSlot->eState = URING_FREE;
+               continue;
+            }
+            if ((size_t)psCqe->res < psSlot->iLength)
+            {
+               /* A stream reads on from what it got; a file ends. */
+               if (iInSeek || (psCqe->res == 0))
+                  uEnd = (psSlot->uOffset + psCqe->res < uEnd)
+                     ? psSlot->uOffset + psCqe->res : uEnd;
+               uNextRead = psSlot->uOffset + psCqe->res;
+            }
+            psSlot->iLength = (size_t)psCqe->res;
+            psSlot->eState = (psCqe->res > 0) ? URING_FULL : URING_FREE;
+            continue;
+         }
+
+         /* A write: the buffer is free again once all of it is out. */
+         iWriting--;
+         if ((psCqe->res == -EINTR) || (psCqe->res == -EAGAIN))
+         {
+            if (psCqe->res == -EAGAIN)
+               Uring_wait(iOutFD, POLLOUT);
+            psSlot->eState = URING_FULL;
+            continue;
+         }
+         if (psCqe->res <= 0)
+         {
+            iErr = (psCqe->res < 0) ? -psCqe->res : EIO;
+            psSlot->eState = URING_FREE;
+            continue;
+         }
+         psSlot->iDone += (size_t)psCqe->res;
+         uWritten += (uint64_t)psCqe->res;
+         uNextWrite += iOutSeek ? 0 : (uint64_t)psCqe->res;
+         sRing.sStats.llBytes += psCqe->res;
+         psSlot->eState = (psSlot->iDone == psSlot->iLength)
+            ? URING_FREE : URING_FULL;
+      }
+      __atomic_store_n(sRing.puCqHead, uHead, __ATOMIC_RELEASE);
+
+      /* Reads of a file that ended early bring nothing past its end. */
+      for (i = 0; i < URING_SLOTS; i++)
+      {
+         psSlot = &sRing.asSlots[i];
+         if ((psSlot->eState == URING_FULL) &&
+             (psSlot->uOffset + psSlot->iLength > uEnd))
+         {
+            psSlot->iLength = (psSlot->uOffset >= uEnd)
+               ? 0 : (size_t)(uEnd - psSlot->uOffset);
+            if (psSlot->iDone >= psSlot->iLength)
+               psSlot->eState = URING_FREE;
+         }
+      }
+   }
+
+   /* Leave both offsets past what was copied, as read and write do. */
+   if (iInSeek)
+      lseek(iInFD, lInBase + (off_t)uWritten, SEEK_SET);
+   if (iOutSeek)
+      lseek(iOutFD, lOutBase + (off_t)uWritten, SEEK_SET);
+   if (iErr != 0)
+   {
+      errno = iErr;
+      return FAILURE;
+   }
+   return (ssize_t)uWritten;
+}
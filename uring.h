@@ -0,0 +1,62 @@
+/*--------------------------------------------------------------------*/
+/* uring.h                                                            */
+/* Bulk copies between descriptors through io_uring                   */
+/*--------------------------------------------------------------------*/
+
+#ifndef URING_INCLUDED
+#define URING_INCLUDED
+
+#include "common.h"
+
+/*--------------------------------------------------------------------*/
+
+/* With io_uring on, a copy that would otherwise go through a
+   read(2)/write(2) loop keeps up to URING_SLOTS reads and writes in
+   flight at once, into and out of buffers registered with the kernel,
+   and submits and reaps them in batches with one io_uring_enter(2)
+   per round. A regular file is read and written at explicit offsets,
+   so several of its operations can be in flight; a socket or pipe has
+   one read and one write in flight at a time, which keeps its bytes in
+   order.
+
+   Each process sets up its own ring on first use, so forked servers
+   do not share one. Where the kernel has no io_uring, or refuses it,
+   io_uring turns itself off and copies go through the caller's own
+   loop again. */
+
+#define URING_SLOTS 8 /* buffers, and so operations in flight */
+#define URING_SLOT_SIZE (256 * 1024) /* bytes in a buffer */
+
+typedef struct UringStats
+{
+   long long llEnters;
+   /* Number of io_uring_enter(2) calls made. */
+
+   long long llOps;
+   /* Number of reads and writes completed. */
+
+   long long llBytes;
+   /* Number of bytes copied. */
+} UringStats;
+
+/*--------------------------------------------------------------------*/
+
+void Uring_setOn(int iOn);
+/* Copy through io_uring from now on if iOn is 1 (TRUE), or not at all
+   if it is 0 (FALSE). Off at first. */
+
+int Uring_isOn(void);
+/* Return 1 (TRUE) if copies go through io_uring, 0 (FALSE)
+   otherwise. */
+
+ssize_t Uring_copy(int iOutFD, int iInFD, size_t iCount);
+/* Copy iCount bytes from the current offset of iInFD to iOutFD and
+   move the offsets of both past them, as Common_copyFD does. Return
+   the number of bytes copied, which is less than iCount only if iInFD
+   ended early, or FAILURE with errno set. errno is ENOSYS only if
+   io_uring is off or cannot be set up, and nothing was copied. */
+
+void Uring_getStats(UringStats *psStats);
+/* Store what the ring of this process has done so far in *psStats. */
+
+#endif